@@ -8,10 +8,14 @@
 
 #pragma once
 
-#define POLL_TIMEOUT   1   /* number of sec to wait in select before
-                            * doing idle maintenance stuff. set to 0 to
-                            * have no wait time, and -1 to have select
-                            * block until there's activity.
+#define POLL_TIMEOUT   1   /* number of sec between passes of the idle
+                            * maintenance stuff: releasing SLOWMSGS
+                            * holds and dropping clients past the send
+                            * queue deadline. set to 0 to run it on
+                            * every pass through the loop; -1 gets the
+                            * default of a second, since it can't be
+                            * turned off. idle boots, mod timeouts and
+                            * shutdown are on their own timers.
                             */
 
 /* Our packets are in the following format:
@@ -63,6 +67,11 @@
 #define MAX_TOPICLEN    32      /* chars in a group topic */
 #define MAX_HUSHED      32      /* maximum number of hushed people */
 #define MAX_NOTIFIES    40      /* maximum notifies allowed */
+#define HUSH_INDEX_MAX  (1024*1024)
+                                /* bytes of bitsets kept for who hushes
+                                 * whom. anyone past that has their hush
+                                 * lists matched per message instead.
+                                 */
 
 #define MAX_WRITES	20	        /* maximum writes allowed to nickname */
 #define MAX_AWAY_LEN	(MAX_INPUTSTR - 17)
@@ -70,8 +79,52 @@
                                  * if you've already sent one within this 
                                  * number of seconds 
                                  */
-#define MAX_SENDPACKET_QUEUE 10  /* maximum number of writes to queue up */
-#define MAX_SENDPACKET_RETRIES 10  /* maximum number of retries per write */
+#define SENDQUEUE_HIWAT 16384   /* bytes waiting to go to a client before
+                                 * it's considered backed up
+                                 */
+#define SENDQUEUE_LOWAT 4096    /* bytes it has to drain down to before
+                                 * it's not backed up any more
+                                 */
+#define SENDQUEUE_LIMIT 65536   /* most bytes that can be waiting to go to
+                                 * a client. anything more is dropped.
+                                 */
+#define SENDQUEUE_DEADLINE 60   /* seconds a packet can sit waiting to go
+                                 * before the client is dropped. 0 = never.
+                                 */
+#define SENDQUEUE_OVERFLOW (PKTSERV_OVERFLOW_DROPLOW | PKTSERV_OVERFLOW_PAUSE)
+                                /* what to do to a backed up client:
+                                 * PKTSERV_OVERFLOW_DROPLOW drops open
+                                 * group messages and status chatter to
+                                 * them, PKTSERV_OVERFLOW_PAUSE stops
+                                 * reading their commands until they catch
+                                 * up. 0 for neither.
+                                 */
+#define RESOLVER_THREADS 4      /* threads doing reverse DNS lookups on
+                                 * new connections. with 0 the lookups
+                                 * are done inline, and a slow resolver
+                                 * holds up the whole server.
+                                 */
+#define DNSCACHE_SIZE 1024      /* addresses whose reverse DNS answer is
+                                 * remembered. 0 turns the cache off.
+                                 */
+#define DNSCACHE_TTL 3600       /* seconds a host name is remembered */
+#define DNSCACHE_NEGTTL 300     /* seconds an address that wouldn't
+                                 * resolve is remembered as such
+                                 */
+#define PKT_READ_BUDGET 8       /* maximum number of packets to handle from
+                                 * one client per pass through the loop
+                                 */
+#define PORT_POLICY PKTSERV_POLICY_LOWLATENCY
+                                /* how a listen port writes to its clients,
+                                 * unless its -p or -s spec says otherwise:
+                                 * PKTSERV_POLICY_DEFERRED queues packets
+                                 * and writes each client's queue once per
+                                 * pass through the loop,
+                                 * PKTSERV_POLICY_LOWLATENCY does that and
+                                 * also turns off Nagle, and
+                                 * PKTSERV_POLICY_IMMEDIATE writes every
+                                 * packet as soon as it's sent.
+                                 */
 
 
 /*
@@ -31,6 +31,9 @@
 
 #include "server/mdb.h"
 
+#include "pktresolve.h"
+#include "pktdnscache.h"
+
 #define RNAME_LEN 256
 
 /*
@@ -101,13 +104,44 @@ static int double_reverse_check_sa(const struct sockaddr *sa, socklen_t salen,
 #endif  /* !NO_DOUBLE_RES_LOOKUPS */
 
 
-char *getremotename(int socketfd)
+/*
+ * getsockaddrcached - answer from the reverse DNS cache only: the
+ * verified host name, or "[addr]" if it's known not to resolve.
+ * returns 0 if it was answered, -1 if it still needs looking up.
+ */
+int getsockaddrcached(const struct sockaddr *sa, socklen_t salen,
+                      char *buf, size_t buflen)
+{
+    char numerichost[RNAME_LEN - 3]; /* leave room for "[]\0" */
+
+    switch (pktdnscache_get(sa, salen, buf, buflen)) {
+    case PKTDNSCACHE_HIT:
+        return 0;
+
+    case PKTDNSCACHE_NEGATIVE:
+        if (addr_to_numeric(sa, salen, numerichost, sizeof(numerichost)) != 0)
+            snprintf(numerichost, sizeof(numerichost), "(unknown)");
+        snprintf(buf, buflen, "[%s]", numerichost);
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * getsockaddrname - the verified host name for an address, or "[addr]"
+ * if it can't be resolved. it only uses the caller's buffer, so the
+ * resolver threads can run it. answers come from, and go into, the
+ * reverse DNS cache.
+ */
+void getsockaddrname(const struct sockaddr *sa, socklen_t salen,
+                     char *buf, size_t buflen)
 {
-    static char rname[RNAME_LEN];
-    struct sockaddr_storage rs;
-    socklen_t rs_size = sizeof(rs);
     char numerichost[RNAME_LEN - 3]; /* leave room for "[]\0" */
 
+    if (getsockaddrcached(sa, salen, buf, buflen) == 0)
+        return;
+
     /* Don't want to waste all our time in resolving stuff... */
 #ifdef HAVE_LIBRESOLV
     _res.retrans = 3;
@@ -119,36 +153,75 @@ char *getremotename(int socketfd)
 #endif
 #endif
 
-    memset(rname, 0, sizeof(rname));
-
-    /* get address of remote user */
-    if (getpeername(socketfd, (struct sockaddr *)&rs, &rs_size) < 0) {
-        vmdb(MSG_ERR, "getpeername failed for socket %d", socketfd);
-        return(NULL);
-    }
+    memset(buf, 0, buflen);
 
     /* get a numeric representation for logging / fallback */
-    if (addr_to_numeric((struct sockaddr *)&rs, rs_size,
-                        numerichost, sizeof(numerichost)) != 0) {
+    if (addr_to_numeric(sa, salen, numerichost, sizeof(numerichost)) != 0) {
         snprintf(numerichost, sizeof(numerichost), "(unknown)");
     }
 
 #ifdef NO_DOUBLE_RES_LOOKUPS
     /* Simple reverse lookup without double-reverse verification */
-    if (getnameinfo((struct sockaddr *)&rs, rs_size,
-                    rname, sizeof(rname), NULL, 0, NI_NAMEREQD) != 0) {
-        snprintf(rname, sizeof(rname), "[%s]", numerichost);
+    if (getnameinfo(sa, salen, buf, buflen, NULL, 0, NI_NAMEREQD) != 0) {
+        pktdnscache_put(sa, salen, NULL);
+        snprintf(buf, buflen, "[%s]", numerichost);
         vmdb(MSG_INFO, "Can not resolve %s", numerichost);
+        return;
     }
 #else
     /* Double-reverse lookup: reverse → forward → verify */
-    if (double_reverse_check_sa((struct sockaddr *)&rs, rs_size,
-                                rname, sizeof(rname)) != 0) {
+    if (double_reverse_check_sa(sa, salen, buf, buflen) != 0) {
+        pktdnscache_put(sa, salen, NULL);
         vmdb(MSG_INFO, "%s fails double reverse", numerichost);
-        snprintf(rname, sizeof(rname), "[%s]", numerichost);
+        snprintf(buf, buflen, "[%s]", numerichost);
+        return;
     }
 #endif  /* NO_DOUBLE_RES_LOOKUPS */
 
+    pktdnscache_put(sa, salen, buf);
+}
+
+char *getremotename(int socketfd)
+{
+    static char rname[RNAME_LEN];
+    struct sockaddr_storage rs;
+    socklen_t rs_size = sizeof(rs);
+
+    memset(rname, 0, sizeof(rname));
+
+    /* get address of remote user */
+    if (getpeername(socketfd, (struct sockaddr *)&rs, &rs_size) < 0) {
+        vmdb(MSG_ERR, "getpeername failed for socket %d", socketfd);
+        return(NULL);
+    }
+
+    getsockaddrname((struct sockaddr *)&rs, rs_size, rname, sizeof(rname));
+    return(rname);
+}
+
+/* return a remote connection's address, as "[addr]", without looking
+ * anything up. NULL if there isn't one.
+ */
+char *getremoteaddr(int socketfd)
+{
+    static char rname[RNAME_LEN];
+    struct sockaddr_storage rs;
+    socklen_t rs_size = sizeof(rs);
+    char numerichost[RNAME_LEN - 3]; /* leave room for "[]\0" */
+
+    memset(rname, 0, sizeof(rname));
+
+    if (getpeername(socketfd, (struct sockaddr *)&rs, &rs_size) < 0) {
+        vmdb(MSG_ERR, "getpeername failed for socket %d", socketfd);
+        return(NULL);
+    }
+
+    if (addr_to_numeric((struct sockaddr *)&rs, rs_size,
+                        numerichost, sizeof(numerichost)) != 0) {
+        snprintf(numerichost, sizeof(numerichost), "(unknown)");
+    }
+
+    snprintf(rname, sizeof(rname), "[%s]", numerichost);
     return(rname);
 }
 
@@ -182,6 +255,13 @@ char *getlocalname(int socketfd)
         snprintf(numerichost, sizeof(numerichost), "(unknown)");
     }
 
+    /* a verified name from the cache will do. a negative entry only
+     * means the double reverse check failed, so that still gets a
+     * plain lookup. */
+    if (pktdnscache_get((struct sockaddr *)&rs, rs_size,
+                        rname, sizeof(rname)) == PKTDNSCACHE_HIT)
+        return(rname);
+
     /* get hostname from table */
     if (getnameinfo((struct sockaddr *)&rs, rs_size,
                     rname, sizeof(rname), NULL, 0, NI_NAMEREQD) != 0) {
@@ -21,18 +21,225 @@
 #include "pktserv_internal.h"
 #include "pktbuffers.h"
 
+cbuf_t **cbufs = NULL;      /* connection slots, indexed by slot id */
+int cbufs_size = 0;         /* number of slots in cbufs[] */
+
+static int cbufs_max = 0;   /* upper bound on cbufs_size. 0 = none */
+
+static int *freeslots = NULL; /* stack of unused slot ids */
+static int nfreeslots = 0;
+
+static int *fd2slot = NULL; /* fd -> slot id, -1 if the fd isn't ours */
+static int fd2slot_size = 0;
+
+
+/*
+ * packet buffer pool.
+ *
+ * almost every packet fits in MSGPOOL_BUFSZ bytes, so those come out
+ * of slabs of MSGPOOL_PER_SLAB buffers, each with its msgbuf_t header
+ * right in front of its data. freed buffers go on a free list. once
+ * more than MSGPOOL_HIWAT are sitting free, slabs with nothing in use
+ * get handed back until we're down to MSGPOOL_LOWAT.
+ */
+#define MSGPOOL_PER_SLAB    64
+#define MSGPOOL_HIWAT       (MSGPOOL_PER_SLAB * 16)
+#define MSGPOOL_LOWAT       (MSGPOOL_PER_SLAB * 4)
+
+typedef struct msgslab_st {
+    LIST_ENTRY(msgslab_st) entries; /* slab list entries */
+    int nused;                      /* buffers handed out */
+    struct {
+        msgbuf_t hdr;
+        char data[MSGPOOL_BUFSZ];
+    } bufs[MSGPOOL_PER_SLAB];
+} msgslab_t;
+
+static LIST_HEAD(, msgslab_st) g_slabs = LIST_HEAD_INITIALIZER(g_slabs);
+static LIST_HEAD(, msgslab_st) g_empty_slabs = LIST_HEAD_INITIALIZER(g_empty_slabs);
+static struct mblisthead g_pool_free = TAILQ_HEAD_INITIALIZER(g_pool_free);
+static int g_pool_inuse = 0;
+static int g_pool_nfree = 0;
+static int g_pool_peak = 0;
+
+/* spare msgbuf headers for queue entries pointing at shared payloads */
+static struct mblisthead g_shared_free = TAILQ_HEAD_INITIALIZER(g_shared_free);
+static int g_shared_nfree = 0;
+
+/* most spare headers to keep around */
+#define MSGSHARE_MAXFREE    MSGPOOL_HIWAT
+
+
+static int
+msgpool_grow(void)
+{
+    msgslab_t *slab;
+    int i;
+
+    slab = (msgslab_t*)malloc(sizeof(msgslab_t));
+    if (!slab) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    slab->nused = 0;
+    for (i = 0; i < MSGPOOL_PER_SLAB; i++) {
+        slab->bufs[i].hdr.sz = MSGPOOL_BUFSZ;
+        slab->bufs[i].hdr.data = slab->bufs[i].data;
+        slab->bufs[i].hdr.slab = slab;
+        slab->bufs[i].hdr.shared = NULL;
+        TAILQ_INSERT_TAIL(&g_pool_free, &slab->bufs[i].hdr, entries);
+    }
+    LIST_INSERT_HEAD(&g_empty_slabs, slab, entries);
+    g_pool_nfree += MSGPOOL_PER_SLAB;
+    return 0;
+}
+
+/* give back empty slabs until we're at the low-water mark */
+static void
+msgpool_trim(void)
+{
+    msgslab_t *slab;
+    int i;
+
+    while (g_pool_nfree > MSGPOOL_LOWAT &&
+           (slab = LIST_FIRST(&g_empty_slabs)) != NULL) {
+        LIST_REMOVE(slab, entries);
+        for (i = 0; i < MSGPOOL_PER_SLAB; i++)
+            TAILQ_REMOVE(&g_pool_free, &slab->bufs[i].hdr, entries);
+        g_pool_nfree -= MSGPOOL_PER_SLAB;
+        free(slab);
+    }
+}
+
+/* get a buffer that can hold sz bytes, out of the pool if it'll fit.
+ * returns it reset to empty, or NULL and sets errno (usually to ENOMEM)
+ * on failure.
+ */
+msgbuf_t *
+_msgbuf_get(size_t sz)
+{
+    msgbuf_t *msgbuf;
+
+    if (sz > MSGPOOL_BUFSZ)
+        return _msgbuf_alloc(NULL, sz);
+
+    if (TAILQ_EMPTY(&g_pool_free) && msgpool_grow() < 0)
+        return NULL;
+
+    msgbuf = TAILQ_FIRST(&g_pool_free);
+    TAILQ_REMOVE(&g_pool_free, msgbuf, entries);
+    g_pool_nfree--;
+
+    if (msgbuf->slab->nused++ == 0) {
+        LIST_REMOVE(msgbuf->slab, entries);
+        LIST_INSERT_HEAD(&g_slabs, msgbuf->slab, entries);
+    }
+
+    if (++g_pool_inuse > g_pool_peak)
+        g_pool_peak = g_pool_inuse;
+
+    msgbuf->len = 0;
+    msgbuf->pos = msgbuf->data;
+    return msgbuf;
+}
+
+/* make a shared payload holding a copy of data. the caller holds the
+ * one reference it starts with.
+ *
+ * returns NULL and sets errno on failure.
+ */
+msgpayload_t *
+msgpayload_new(const char *data, size_t len)
+{
+    msgpayload_t *payload;
+
+    payload = (msgpayload_t*)malloc(sizeof(msgpayload_t) + len);
+    if (!payload) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    payload->refs = 1;
+    payload->len = len;
+    memcpy(payload->data, data, len);
+    return payload;
+}
+
+/* drop a reference, freeing the payload along with the last one */
+void
+msgpayload_unref(msgpayload_t *payload)
+{
+    if (--payload->refs == 0)
+        free(payload);
+}
+
+/* get a queue entry for a shared payload. it takes its own reference,
+ * which _msgbuf_free() gives back. only pos may be changed.
+ *
+ * returns NULL and sets errno on failure.
+ */
+msgbuf_t *
+_msgbuf_share(msgpayload_t *payload)
+{
+    msgbuf_t *msgbuf;
+
+    if ((msgbuf = TAILQ_FIRST(&g_shared_free)) != NULL) {
+        TAILQ_REMOVE(&g_shared_free, msgbuf, entries);
+        g_shared_nfree--;
+    } else {
+        msgbuf = (msgbuf_t*)malloc(sizeof(msgbuf_t));
+        if (!msgbuf) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        msgbuf->slab = NULL;
+    }
+
+    payload->refs++;
+    msgbuf->shared = payload;
+    msgbuf->data = payload->data;
+    msgbuf->sz = payload->len;
+    msgbuf->len = payload->len;
+    msgbuf->pos = msgbuf->data;
+    return msgbuf;
+}
+
+/* current pool counters. any of the pointers may be NULL. */
+void
+msgpool_stats(int *inuse, int *nfree, int *peak)
+{
+    if (inuse)
+        *inuse = g_pool_inuse;
+    if (nfree)
+        *nfree = g_pool_nfree;
+    if (peak)
+        *peak = g_pool_peak;
+}
+
+/* start the peak count over from what's in use now */
+void
+msgpool_reset_peak(void)
+{
+    g_pool_peak = g_pool_inuse;
+}
 
 /* if the passed-in msgbuf exists and has sufficient buffer space, clear 
  * it out and reset it, otherwise allocate it.
  * returns the requested msgbuf on if successful, or NULL and sets
  * errno (usually to ENOMEM) on failure.
  * 
- * right now it just mallocs stuff on the fly. probably should pull
- * from a memory pool.
+ * this always mallocs. use _msgbuf_get() for packet-sized buffers.
  */
 msgbuf_t *
 _msgbuf_alloc(msgbuf_t *msgbuf, size_t sz)
 {
+    if (msgbuf && msgbuf->shared) {
+        /* shared data is read-only, so start over with a fresh one */
+        _msgbuf_free(msgbuf);
+        msgbuf = NULL;
+    }
+
     if (msgbuf && msgbuf->sz >= sz) {
         memset(msgbuf->data, 0, msgbuf->sz);
         msgbuf->len = 0;
@@ -40,6 +247,12 @@ _msgbuf_alloc(msgbuf_t *msgbuf, size_t sz)
         return msgbuf;
     }
 
+    if (msgbuf && msgbuf->slab) {
+        /* the data's part of the slab, so it can't be regrown in place */
+        _msgbuf_free(msgbuf);
+        msgbuf = NULL;
+    }
+
     if (msgbuf && msgbuf->sz)
         free(msgbuf->data);
 
@@ -49,6 +262,8 @@ _msgbuf_alloc(msgbuf_t *msgbuf, size_t sz)
             errno = ENOMEM;
             return NULL;
         }
+        msgbuf->slab = NULL;
+        msgbuf->shared = NULL;
     }
 
     msgbuf->data = (char*)malloc(sz);
@@ -68,21 +283,140 @@ _msgbuf_alloc(msgbuf_t *msgbuf, size_t sz)
 void
 _msgbuf_free(msgbuf_t *msgbuf)
 {
-    if (msgbuf->data) {
-        memset(msgbuf->data, 0, msgbuf->sz);
-        free(msgbuf->data);
+    msgslab_t *slab = msgbuf->slab;
+
+    if (msgbuf->shared) {
+        msgpayload_unref(msgbuf->shared);
+        msgbuf->shared = NULL;
+        if (g_shared_nfree < MSGSHARE_MAXFREE) {
+            TAILQ_INSERT_HEAD(&g_shared_free, msgbuf, entries);
+            g_shared_nfree++;
+        } else {
+            free(msgbuf);
+        }
+        return;
     }
+
+    if (slab) {
+        TAILQ_INSERT_HEAD(&g_pool_free, msgbuf, entries);
+        g_pool_nfree++;
+        g_pool_inuse--;
+        if (--slab->nused == 0) {
+            LIST_REMOVE(slab, entries);
+            LIST_INSERT_HEAD(&g_empty_slabs, slab, entries);
+        }
+        if (g_pool_nfree > MSGPOOL_HIWAT)
+            msgpool_trim();
+        return;
+    }
+
+    if (msgbuf->data)
+        free(msgbuf->data);
     free(msgbuf);
 }
 
+/* make room for at least want slots (we double it). new slots get
+ * pushed onto the free stack so that the lowest ids come off first.
+ *
+ * returns 0 on success
+ * returns -1 if we're at cbufs_max or out of memory
+ */
+static int
+cbufs_grow(int want)
+{
+    int newsize;
+    int i;
+    cbuf_t **newcbufs;
+    int *newfree;
+
+    newsize = cbufs_size ? cbufs_size : 16;
+    while (newsize < want)
+        newsize *= 2;
+    if (cbufs_size && newsize == cbufs_size)
+        newsize *= 2;
+    if (cbufs_max && newsize > cbufs_max)
+        newsize = cbufs_max;
+    if (newsize <= cbufs_size || newsize < want) {
+        errno = ENFILE;
+        return -1;
+    }
+
+    newcbufs = realloc(cbufs, sizeof(cbuf_t*) * newsize);
+    if (!newcbufs) {
+        errno = ENOMEM;
+        return -1;
+    }
+    cbufs = newcbufs;
+
+    newfree = realloc(freeslots, sizeof(int) * newsize);
+    if (!newfree) {
+        errno = ENOMEM;
+        return -1;
+    }
+    freeslots = newfree;
+
+    /* each cbuf gets its own allocation, so pointers to them (and the
+     * list heads inside them) stay put when the table grows. */
+    for (i = cbufs_size; i < newsize; i++) {
+        cbufs[i] = (cbuf_t*)calloc(1, sizeof(cbuf_t));
+        if (!cbufs[i]) {
+            newsize = i;
+            break;
+        }
+        cbufs[i]->slot = i;
+        cbufs[i]->fd = -1;
+        TAILQ_INIT(&(cbufs[i]->wlist));
+    }
+
+    /* slot 0 is never handed out */
+    for (i = newsize - 1; i >= cbufs_size; i--) {
+        if (i > 0)
+            freeslots[nfreeslots++] = i;
+    }
+
+    if (newsize == cbufs_size) {
+        errno = ENOMEM;
+        return -1;
+    }
+    cbufs_size = newsize;
+    return 0;
+}
+
+/* make sure fd2slot can hold fd */
+static int
+fd2slot_grow(int fd)
+{
+    int newsize;
+    int i;
+    int *newmap;
+
+    if (fd < fd2slot_size)
+        return 0;
+
+    newsize = fd2slot_size ? fd2slot_size : 64;
+    while (newsize <= fd)
+        newsize *= 2;
+
+    newmap = realloc(fd2slot, sizeof(int) * newsize);
+    if (!newmap) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = fd2slot_size; i < newsize; i++)
+        newmap[i] = -1;
+
+    fd2slot = newmap;
+    fd2slot_size = newsize;
+    return 0;
+}
+
 void
 cbufs_reset(void)
 {
     int i;
 
-    for (i = 0; i < MAX_USERS; i++) {
-        cbufs[i].newmsg = 1;
-        TAILQ_INIT(&(cbufs[i].wlist));
+    for (i = 0; i < cbufs_size; i++) {
+        TAILQ_INIT(&(cbufs[i]->wlist));
     }
 }
 
@@ -90,14 +424,129 @@ int
 cbufs_init(void)
 {
     if (cbufs == NULL) {
-        cbufs = (cbuf_t*)calloc(sizeof(cbuf_t), MAX_USERS);
+        if (cbufs_grow(0) < 0)
+            return -1;
     }
-    if (!cbufs)
-        return -1;
     cbufs_reset();
     return 0;
 }
 
+/* slot ids handed out will be < max. 0 means no limit. */
+void
+cbufs_set_max(int max)
+{
+    cbufs_max = (max > 0) ? max : 0;
+}
+
+/* reset a slot for a new connection on fd */
+static cbuf_t *
+cbuf_setup(int slot, int fd)
+{
+    cbuf_t *cbuf = cbufs[slot];
+    u_int gen = cbuf->gen + 1;
+
+    if (fd2slot_grow(fd) < 0)
+        return NULL;
+
+    memset(cbuf, 0, sizeof(cbuf_t));
+    cbuf->slot = slot;
+    cbuf->gen = gen;
+    cbuf->fd = fd;
+    TAILQ_INIT(&(cbuf->wlist));
+
+    fd2slot[fd] = slot;
+    return cbuf;
+}
+
+/* grab a free slot for fd.
+ *
+ * returns the slot's cbuf, cleared out, or NULL if the table is full
+ * (or we're out of memory).
+ */
+cbuf_t *
+cbuf_alloc(int fd)
+{
+    int slot;
+    cbuf_t *cbuf;
+
+    if (fd < 0)
+        return NULL;
+
+    if (nfreeslots == 0 && cbufs_grow(cbufs_size + 1) < 0)
+        return NULL;
+
+    slot = freeslots[nfreeslots - 1];
+    cbuf = cbuf_setup(slot, fd);
+    if (cbuf)
+        nfreeslots--;
+    return cbuf;
+}
+
+/* grab a specific slot for fd. this is used when reloading sockets
+ * after a restart, where the main server already knows the
+ * connection by its old slot id.
+ *
+ * returns NULL if the slot is already in use.
+ */
+cbuf_t *
+cbuf_claim(int slot, int fd)
+{
+    int i;
+    cbuf_t *cbuf;
+
+    if (slot <= 0 || fd < 0)
+        return NULL;
+
+    if (slot >= cbufs_size && cbufs_grow(slot + 1) < 0)
+        return NULL;
+
+    for (i = nfreeslots - 1; i >= 0; i--) {
+        if (freeslots[i] == slot)
+            break;
+    }
+    if (i < 0)
+        return NULL;
+
+    cbuf = cbuf_setup(slot, fd);
+    if (cbuf) {
+        memmove(&freeslots[i], &freeslots[i+1],
+                (size_t)(nfreeslots - (i + 1)) * sizeof(int));
+        nfreeslots--;
+    }
+    return cbuf;
+}
+
+/* give a slot back once its fd has been closed */
+void
+cbuf_release(cbuf_t *cbuf)
+{
+    if (cbuf->fd < 0)
+        return; /* already released */
+
+    if (cbuf->fd < fd2slot_size && fd2slot[cbuf->fd] == cbuf->slot)
+        fd2slot[cbuf->fd] = -1;
+
+    cbuf->fd = -1;
+    cbuf->state = DISCONNECTED;
+    freeslots[nfreeslots++] = cbuf->slot;
+}
+
+cbuf_t *
+cbuf_from_slot(int slot)
+{
+    if (slot < 0 || slot >= cbufs_size)
+        return NULL;
+    return cbufs[slot];
+}
+
+cbuf_t *
+cbuf_from_fd(int fd)
+{
+    if (fd < 0 || fd >= fd2slot_size || fd2slot[fd] < 0)
+        return NULL;
+    return cbufs[fd2slot[fd]];
+}
+
 #define socketStateStrCase(x) case x: return #x; break;
 const char* socketStateStr(SocketState state)
 {
@@ -116,6 +565,7 @@ const char* socketStateStr(SocketState state)
         socketStateStrCase(COMPLETE_PACKET);
         socketStateStrCase(LISTEN_SOCKET);
         socketStateStrCase(LISTEN_SOCKET_SSL);
+        socketStateStrCase(RESOLVER_PIPE);
     }
     return "UNKNOWN";
 };
@@ -14,6 +14,7 @@
 #include "config.h"
 
 #include <sys/types.h> /* for u_int on some platforms */
+#include <stdint.h>
 
 #include "bsdqueue.h"
 
@@ -21,6 +22,15 @@
 #include <openssl/ssl.h>
 #endif
 
+/* refcounted, read-only packet data shared by several msgbufs. this is
+ * how one packet gets queued to many connections without a copy each.
+ */
+typedef struct msgpayload_st {
+    int refs;            /* msgbufs (and callers) holding it */
+    size_t len;          /* length of the data */
+    char data[];         /* the packet itself */
+} msgpayload_t;
+
 /* msg buffer */
 typedef struct msgbuf_st {
     TAILQ_ENTRY(msgbuf_st)    entries;  /* message buffer list entries */
@@ -31,8 +41,24 @@ typedef struct msgbuf_st {
     char *pos;           /* ptr to the current read/write position */
 
     char *data;          /* data buffer */
+
+    struct msgslab_st *slab; /* pool slab this came out of, NULL if it
+                              * was malloc'd */
+    msgpayload_t *shared;    /* payload data points into, NULL if the
+                              * msgbuf has its own copy */
+    uint64_t queued;         /* when it went on a write list, in ms */
 } msgbuf_t;
 
+/* size of the buffers in the packet buffer pool. bigger requests fall
+ * back to malloc.
+ */
+#define MSGPOOL_BUFSZ       MAX_PKT_LEN
+
+/* size of each connection's input buffer. big enough to take in a
+ * good run of pipelined packets with one read.
+ */
+#define PKT_INBUF_SZ        (MAX_PKT_LEN * 16)
+
 
 typedef enum {
     DISCONNECTED,        /* disconnected */
@@ -48,7 +74,8 @@ typedef enum {
     WANT_RAW_DISCONNECT, /* pending disconnect - socket level */
     COMPLETE_PACKET,     /* complete packet received. */
     LISTEN_SOCKET,       /* this is a listen socket */
-    LISTEN_SOCKET_SSL    /* this is an ssl listen socket */
+    LISTEN_SOCKET_SSL,   /* this is an ssl listen socket */
+    RESOLVER_PIPE        /* wakeup pipe for finished DNS lookups */
 } SocketState;
 
 typedef enum {
@@ -61,22 +88,40 @@ typedef enum {
 
 /* client buffer */
 typedef struct cbuf_st {
-    u_int id;               /* this connection's unique identifier */
-    int fd;                 /* the client's file descriptor */
+    int slot;               /* this connection's index in cbufs[]. this is
+                             * the id the main server knows it by. */
+    u_int gen;              /* generation. bumped every time the slot is
+                             * handed out to a new connection. */
+    int fd;                 /* the client's file descriptor (-1 if none) */
     SocketState state;      /* state of the current connection (see above) */
     SocketDisposition disp; /* disposition (see above) */
 
-    /* read buffer */
-    msgbuf_t *rbuf;         /* read buffer. just one of these */
-    char newmsg;            /* set to TRUE if next read is start of new packet */
-    /*        FALSE if a packet is partially read */
+    /* input buffer. filled a read at a time, and packets are handed
+     * out of it in place. NULL until the first read. */
+    char *ibuf;
+    size_t ihead;           /* offset of the first unhandled byte */
+    size_t ilen;            /* number of unhandled bytes */
+    char isaved;            /* byte under the null ending the last packet */
+    int iheld;              /* set while isaved needs to be put back */
+    int backlogged;         /* has packets left over for the next pass */
 
     /* write buffers */
     TAILQ_HEAD(mblisthead, msgbuf_st) wlist; /* write list */
     int wlist_size;         /* number of pending packets in list */
+    size_t wbytes;          /* unsent bytes in the write list */
+    int backedup;           /* went over the high-water mark and hasn't
+                             * drained to the low-water mark yet */
+    int rpaused;            /* not reading from it while it's backed up */
     int retries;            /* number of send retries attempted */
 
     int is_ssl;             /* is this an ssl_connection? */
+    int policy;             /* pktserv_policy_t. accepted connections
+                             * inherit it from their listen socket. */
+    int dirty;              /* has packets queued since the last flush */
+
+    short events;           /* events the backend is watching for (POLLIN/
+                             * POLLOUT). can be 0 while it's on hold. */
+    int watched;            /* registered with the event backend */
 
 #ifdef HAVE_SSL
     SSL *ssl_con;           /* this will be NULL if it's a cleartext client */
@@ -86,8 +131,30 @@ typedef struct cbuf_st {
 
 
 msgbuf_t *_msgbuf_alloc(msgbuf_t *msgbuf, size_t sz);
+msgbuf_t *_msgbuf_get(size_t sz);
+msgbuf_t *_msgbuf_share(msgpayload_t *payload);
+msgpayload_t *msgpayload_new(const char *data, size_t len);
+void msgpayload_unref(msgpayload_t *payload);
 void _msgbuf_free(msgbuf_t *msgbuf);
+void msgpool_stats(int *inuse, int *nfree, int *peak);
+void msgpool_reset_peak(void);
 void cbufs_reset(void);
 int cbufs_init(void);
 
+/* connection slot table.
+ *
+ * cbufs[] is indexed by slot id, not by file descriptor, and grows as
+ * needed. slot 0 is reserved and never handed out. fds are mapped to
+ * slots through a separate index, so any fd number can be used.
+ */
+extern cbuf_t **cbufs;      /* connection slots */
+extern int cbufs_size;      /* number of slots in cbufs[] */
+
+void cbufs_set_max(int max);
+cbuf_t *cbuf_alloc(int fd);
+cbuf_t *cbuf_claim(int slot, int fd);
+void cbuf_release(cbuf_t *cbuf);
+cbuf_t *cbuf_from_slot(int slot);
+cbuf_t *cbuf_from_fd(int fd);
+
 const char* socketStateStr(SocketState state);
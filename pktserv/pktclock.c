@@ -0,0 +1,48 @@
+/*
+ * pktclock.c
+ *
+ * the loop clock, see pktclock.h.
+ *
+ * Author: Michel Hoche-Mong
+ * Copyright (c) 2001-2026 Michel Hoche-Mong
+ * All rights reserved.
+ *
+ */
+
+#include "config.h"
+
+#include <time.h>
+
+#include "pktclock.h"
+
+/* the coarse clocks are read from the vDSO without going down to the
+ * hardware, at a tick's resolution. */
+#ifdef CLOCK_MONOTONIC_COARSE
+#define LOOP_MONOTONIC  CLOCK_MONOTONIC_COARSE
+#else
+#define LOOP_MONOTONIC  CLOCK_MONOTONIC
+#endif
+
+#ifdef CLOCK_REALTIME_COARSE
+#define LOOP_REALTIME   CLOCK_REALTIME_COARSE
+#else
+#define LOOP_REALTIME   CLOCK_REALTIME
+#endif
+
+struct pktclock g_pktclock;
+
+void
+pktclock_update(void)
+{
+    clock_gettime(LOOP_MONOTONIC, &g_pktclock.mono);
+    clock_gettime(LOOP_REALTIME, &g_pktclock.wall);
+}
+
+uint64_t
+pktclock_read_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(LOOP_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
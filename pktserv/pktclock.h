@@ -0,0 +1,62 @@
+/*
+ * pktclock.h
+ *
+ * the loop clock: what time it was when the packet server last woke
+ * up.
+ *
+ * pktserv_run() reads the clocks once each time the event backend
+ * returns, before anything gets handled, so everything done in one
+ * pass through the loop sees the same time and nothing along the way
+ * has to ask the kernel. the coarse clocks are used where there are
+ * any; nothing that reads this cares about a few milliseconds.
+ *
+ * Author: Michel Hoche-Mong
+ * Copyright (c) 2001-2026 Michel Hoche-Mong
+ * All rights reserved.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+struct pktclock {
+    struct timespec mono;       /* CLOCK_MONOTONIC */
+    struct timespec wall;       /* CLOCK_REALTIME */
+};
+
+/* read it with the functions below; only pktclock_update() writes it */
+extern struct pktclock g_pktclock;
+
+/* read the clocks again. pktserv_run() does this after every wait. */
+void pktclock_update(void);
+
+/* monotonic milliseconds read fresh, on the same clock as
+ * pktclock_ms(). only for threads other than the loop's, which would
+ * otherwise see the time as of the loop's last wakeup. */
+uint64_t pktclock_read_ms(void);
+
+/* wall clock seconds, as time(NULL) */
+static inline time_t
+pktclock_time(void)
+{
+    return g_pktclock.wall.tv_sec;
+}
+
+/* the wall clock as gettimeofday() would give it */
+static inline void
+pktclock_timeval(struct timeval *tv)
+{
+    tv->tv_sec = g_pktclock.wall.tv_sec;
+    tv->tv_usec = g_pktclock.wall.tv_nsec / 1000;
+}
+
+/* monotonic milliseconds. the timer wheel runs on this */
+static inline uint64_t
+pktclock_ms(void)
+{
+    return (uint64_t)g_pktclock.mono.tv_sec * 1000 +
+           (uint64_t)g_pktclock.mono.tv_nsec / 1000000;
+}
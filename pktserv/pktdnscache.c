@@ -0,0 +1,335 @@
+/*
+ * pktdnscache.c
+ *
+ * reverse DNS answer cache.
+ *
+ * Entries are keyed by address family and the raw address bytes (an
+ * IPv4-mapped IPv6 address is filed as the IPv4 address it carries),
+ * and hold either the verified host name or a note that there isn't
+ * one. Answers go stale after a TTL, a shorter one for the negatives,
+ * since a broken resolver can come back. The entries live in one
+ * array sized by pktdnscache_config(); once it's full the least
+ * recently used entry makes way for the new one.
+ *
+ * The resolver threads fill the cache as well as read it, so it's
+ * all done under a mutex.
+ *
+ * Author: Michel Hoche-Mong
+ * Copyright (c) 2001-2026 Michel Hoche-Mong
+ * All rights reserved.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "bsdqueue.h"
+#include "server/mdb.h"
+
+#include "pkttimer.h"
+#include "pktclock.h"
+#include "pktresolve.h"
+#include "pktdnscache.h"
+
+#define DNSCACHE_DEFAULT_SIZE   1024
+#define DNSCACHE_DEFAULT_TTL    (60L * 60 * 1000)
+#define DNSCACHE_DEFAULT_NEGTTL (5L * 60 * 1000)
+
+typedef struct dnscache_entry_st {
+    LIST_ENTRY(dnscache_entry_st) chain;    /* hash bucket */
+    TAILQ_ENTRY(dnscache_entry_st) lru;     /* lru or free list */
+    int family;
+    unsigned char addr[16];
+    uint64_t expires;                       /* dnscache_now() time */
+    int found;                              /* 0 for a negative entry */
+    char name[PKTRESOLVE_NAMELEN];
+} dnscache_entry_t;
+
+LIST_HEAD(dnscache_chain, dnscache_entry_st);
+TAILQ_HEAD(dnscache_list, dnscache_entry_st);
+
+static dnscache_entry_t *g_entries = NULL;
+static struct dnscache_chain *g_buckets = NULL;
+static u_int g_bucketmask = 0;
+static struct dnscache_list g_lru = TAILQ_HEAD_INITIALIZER(g_lru);   /* newest first */
+static struct dnscache_list g_free = TAILQ_HEAD_INITIALIZER(g_free);
+static int g_nentries = 0;
+
+static int g_size = DNSCACHE_DEFAULT_SIZE;
+static long g_ttl = DNSCACHE_DEFAULT_TTL;
+static long g_negttl = DNSCACHE_DEFAULT_NEGTTL;
+static int g_allocated = 0;     /* g_entries matches g_size */
+
+static unsigned long g_hits = 0;
+static unsigned long g_misses = 0;
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+#define DNSCACHE_LOCK()     pthread_mutex_lock(&g_lock)
+#define DNSCACHE_UNLOCK()   pthread_mutex_unlock(&g_lock)
+#else
+#define DNSCACHE_LOCK()
+#define DNSCACHE_UNLOCK()
+#endif
+
+
+/* the loop thread goes by the loop clock, like the timer wheel. the
+ * resolver threads run while the loop is asleep, so the loop clock
+ * is as old as its last wakeup for them; they read the clock
+ * themselves. both count from the same point. */
+static uint64_t
+dnscache_now(void)
+{
+    return pktresolve_on_worker() ? pktclock_read_ms() : pkttimer_now();
+}
+
+/* pull the key out of a sockaddr. returns -1 if it's not something
+ * we cache. */
+static int
+dnscache_key(const struct sockaddr *sa, socklen_t salen,
+             int *family, unsigned char addr[16])
+{
+    memset(addr, 0, 16);
+
+    if (sa->sa_family == AF_INET && salen >= sizeof(struct sockaddr_in)) {
+        *family = AF_INET;
+        memcpy(addr, &((const struct sockaddr_in *)sa)->sin_addr, 4);
+        return 0;
+    }
+
+    if (sa->sa_family == AF_INET6 && salen >= sizeof(struct sockaddr_in6)) {
+        const struct in6_addr *a6 = &((const struct sockaddr_in6 *)sa)->sin6_addr;
+
+        if (IN6_IS_ADDR_V4MAPPED(a6)) {
+            *family = AF_INET;
+            memcpy(addr, &a6->s6_addr[12], 4);
+        } else {
+            *family = AF_INET6;
+            memcpy(addr, a6->s6_addr, 16);
+        }
+        return 0;
+    }
+
+    return -1;
+}
+
+/* FNV-1a over the key */
+static u_int
+dnscache_hash(int family, const unsigned char addr[16])
+{
+    uint32_t h = 2166136261u;
+    int i;
+
+    h = (h ^ (uint32_t)family) * 16777619u;
+    for (i = 0; i < 16; i++)
+        h = (h ^ addr[i]) * 16777619u;
+    return h & g_bucketmask;
+}
+
+/* (re)build the table for g_size entries, dropping whatever was in it.
+ * returns -1 if there's no cache to use. call with the lock held. */
+static int
+dnscache_alloc(void)
+{
+    u_int nbuckets;
+    int i;
+
+    if (g_allocated)
+        return g_entries ? 0 : -1;
+
+    free(g_entries);
+    free(g_buckets);
+    g_entries = NULL;
+    g_buckets = NULL;
+    TAILQ_INIT(&g_lru);
+    TAILQ_INIT(&g_free);
+    g_nentries = 0;
+    g_allocated = 1;
+
+    if (g_size <= 0)
+        return -1;
+
+    /* keep the chains short: at least two buckets per entry */
+    for (nbuckets = 16; nbuckets < (u_int)g_size * 2; nbuckets <<= 1)
+        ;
+
+    g_entries = (dnscache_entry_t *)calloc(g_size, sizeof(dnscache_entry_t));
+    g_buckets = (struct dnscache_chain *)calloc(nbuckets, sizeof(struct dnscache_chain));
+    if (g_entries == NULL || g_buckets == NULL) {
+        vmdb(MSG_ERR, "%s: no memory for %d entries, not caching", __FUNCTION__, g_size);
+        free(g_entries);
+        free(g_buckets);
+        g_entries = NULL;
+        g_buckets = NULL;
+        return -1;
+    }
+
+    g_bucketmask = nbuckets - 1;
+    for (i = 0; i < g_size; i++)
+        TAILQ_INSERT_TAIL(&g_free, &g_entries[i], lru);
+
+    return 0;
+}
+
+static dnscache_entry_t *
+dnscache_find(int family, const unsigned char addr[16])
+{
+    dnscache_entry_t *e;
+
+    LIST_FOREACH(e, &g_buckets[dnscache_hash(family, addr)], chain) {
+        if (e->family == family && memcmp(e->addr, addr, 16) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+static void
+dnscache_drop(dnscache_entry_t *e)
+{
+    LIST_REMOVE(e, chain);
+    TAILQ_REMOVE(&g_lru, e, lru);
+    TAILQ_INSERT_HEAD(&g_free, e, lru);
+    g_nentries--;
+}
+
+
+void
+pktdnscache_config(int size, long ttl_ms, long negttl_ms)
+{
+    DNSCACHE_LOCK();
+    if (size != g_size) {
+        g_size = size;
+        g_allocated = 0;
+    }
+    g_ttl = ttl_ms;
+    g_negttl = negttl_ms;
+    DNSCACHE_UNLOCK();
+}
+
+int
+pktdnscache_get(const struct sockaddr *sa, socklen_t salen,
+                char *buf, size_t buflen)
+{
+    unsigned char addr[16];
+    dnscache_entry_t *e;
+    int family;
+    int ret = PKTDNSCACHE_MISS;
+
+    if (dnscache_key(sa, salen, &family, addr) < 0)
+        return PKTDNSCACHE_MISS;
+
+    DNSCACHE_LOCK();
+    if (dnscache_alloc() < 0)
+        goto done;
+
+    if ((e = dnscache_find(family, addr)) == NULL)
+        goto done;
+
+    if (e->expires <= dnscache_now()) {
+        dnscache_drop(e);
+        goto done;
+    }
+
+    TAILQ_REMOVE(&g_lru, e, lru);
+    TAILQ_INSERT_HEAD(&g_lru, e, lru);
+    g_hits++;
+
+    if (e->found) {
+        snprintf(buf, buflen, "%s", e->name);
+        ret = PKTDNSCACHE_HIT;
+    } else {
+        ret = PKTDNSCACHE_NEGATIVE;
+    }
+
+done:
+    DNSCACHE_UNLOCK();
+    return ret;
+}
+
+void
+pktdnscache_put(const struct sockaddr *sa, socklen_t salen, const char *name)
+{
+    unsigned char addr[16];
+    dnscache_entry_t *e;
+    int family;
+    long ttl;
+
+    DNSCACHE_LOCK();
+    g_misses++;
+
+    if (dnscache_key(sa, salen, &family, addr) < 0 || dnscache_alloc() < 0)
+        goto done;
+
+    ttl = name ? g_ttl : g_negttl;
+    if (ttl <= 0)
+        goto done;
+
+    if ((e = dnscache_find(family, addr)) != NULL) {
+        TAILQ_REMOVE(&g_lru, e, lru);
+    } else {
+        if ((e = TAILQ_FIRST(&g_free)) != NULL) {
+            TAILQ_REMOVE(&g_free, e, lru);
+        } else {
+            /* full. the oldest goes. */
+            e = TAILQ_LAST(&g_lru, dnscache_list);
+            LIST_REMOVE(e, chain);
+            TAILQ_REMOVE(&g_lru, e, lru);
+            g_nentries--;
+        }
+        e->family = family;
+        memcpy(e->addr, addr, 16);
+        LIST_INSERT_HEAD(&g_buckets[dnscache_hash(family, addr)], e, chain);
+        g_nentries++;
+    }
+
+    e->expires = dnscache_now() + ttl;
+    e->found = (name != NULL);
+    snprintf(e->name, sizeof(e->name), "%s", name ? name : "");
+    TAILQ_INSERT_HEAD(&g_lru, e, lru);
+
+done:
+    DNSCACHE_UNLOCK();
+}
+
+void
+pktdnscache_stats(int *entries, unsigned long *hits, unsigned long *misses)
+{
+    DNSCACHE_LOCK();
+    if (entries)
+        *entries = g_nentries;
+    if (hits)
+        *hits = g_hits;
+    if (misses)
+        *misses = g_misses;
+    DNSCACHE_UNLOCK();
+}
+
+void
+pktdnscache_reset_stats(void)
+{
+    DNSCACHE_LOCK();
+    g_hits = 0;
+    g_misses = 0;
+    DNSCACHE_UNLOCK();
+}
+
+void
+pktdnscache_flush(void)
+{
+    dnscache_entry_t *e;
+
+    DNSCACHE_LOCK();
+    if (g_entries) {
+        while ((e = TAILQ_FIRST(&g_lru)) != NULL)
+            dnscache_drop(e);
+    }
+    DNSCACHE_UNLOCK();
+}
@@ -0,0 +1,53 @@
+/*
+ * pktdnscache.h
+ *
+ * cache of reverse DNS answers, keyed by the binary address, so a
+ * client reconnecting over and over doesn't cost a lookup every time.
+ *
+ * These shouldn't be called directly by the main server and instead
+ * should be called from pktserv.c or getrname.c.
+ *
+ * Author: Michel Hoche-Mong
+ * Copyright (c) 2001-2026 Michel Hoche-Mong
+ * All rights reserved.
+ *
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/* what pktdnscache_get() found */
+#define PKTDNSCACHE_MISS     -1     /* nothing, or it had expired */
+#define PKTDNSCACHE_NEGATIVE  0     /* the address is known not to resolve */
+#define PKTDNSCACHE_HIT       1     /* the verified name is in buf */
+
+/* size the cache and set how long answers are kept, in milliseconds.
+ * negttl_ms is for addresses that didn't resolve. a size of 0 turns
+ * the cache off. changing the size throws away what's cached.
+ */
+void pktdnscache_config(int size, long ttl_ms, long negttl_ms);
+
+/* look sa up in the cache. on a hit the name is copied into buf.
+ *
+ * returns one of PKTDNSCACHE_MISS, PKTDNSCACHE_NEGATIVE or PKTDNSCACHE_HIT.
+ */
+int pktdnscache_get(const struct sockaddr *sa, socklen_t salen,
+                    char *buf, size_t buflen);
+
+/* remember the answer of a lookup of sa. name is the verified host
+ * name, or NULL if there wasn't one. each call counts as a miss.
+ */
+void pktdnscache_put(const struct sockaddr *sa, socklen_t salen,
+                     const char *name);
+
+/* current counters. any of the pointers may be NULL. */
+void pktdnscache_stats(int *entries, unsigned long *hits,
+                       unsigned long *misses);
+
+/* zero the hit and miss counters */
+void pktdnscache_reset_stats(void);
+
+/* forget everything that's cached */
+void pktdnscache_flush(void);
@@ -0,0 +1,493 @@
+/*
+ * pktevent.c
+ *
+ * event notification backends for the packet server.
+ *
+ * Two backends are supported:
+ *
+ *   poll   - portable. The whole pollset gets its interest recomputed
+ *            and handed to the kernel on every pass through the loop,
+ *            so each wakeup costs O(total connections).
+ *
+ *   epoll  - Linux. Each fd is registered once. The interest set is
+ *            only touched (one epoll_ctl()) when a connection's wanted
+ *            events actually change, e.g. when its write list goes from
+ *            empty to non-empty and back, and only the fds that are
+ *            ready get dispatched. Each wakeup costs O(ready fds).
+ *
+ * Author: Michel Hoche-Mong
+ * Copyright (c) 2001-2026 Michel Hoche-Mong
+ * All rights reserved.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include "bsdqueue.h"
+#include "server/mdb.h"
+
+#include "pktserv_internal.h"
+#include "pktbuffers.h"
+#include "pktevent.h"
+#include "pktclock.h"
+
+static pktserv_backend_t g_backend = PKTSERV_BACKEND_POLL;
+static int g_initialized = 0;
+
+/* poll backend */
+static struct pollfd *g_pollset;
+static int g_pollsetsize = 0;
+static int g_pollsetmax = 0;
+
+#ifdef HAVE_EPOLL
+/* epoll backend */
+static int g_epfd = -1;
+static struct epoll_event *g_epevents;
+static int g_epeventsmax = 0;
+static int g_epnfds = 0;     /* number of registered fds */
+#endif
+
+
+/*
+ * Figure out which events a connection needs to be woken up for.
+ *
+ * We only ask for write-readiness when the connection actually needs to
+ * write (pending data or SSL handshake/write retry). Leaving it on for
+ * idle connections makes the backend return immediately on every pass
+ * and spins the CPU at 100 %.
+ */
+static short
+pktevent_interest(cbuf_t *cbuf)
+{
+    /* a client whose output is backed up doesn't get to send us any
+     * more until it's caught up, and one the server's holding off on
+     * waits for handle_idle() (or its DNS lookup) to let it go */
+    short events = (cbuf->rpaused || cbuf->disp == IGNORE) ? 0 : POLLIN;
+
+    switch (cbuf->state) {
+        case ACCEPTED:
+            /* Freshly accepted: the state machine must run
+             * immediately so the server can send the protocol
+             * banner before the client sends anything. */
+        case WANT_WRITE:
+        case WANT_SSL_WRITE:
+        case WANT_SSL_ACCEPT:
+            /* These states need write-readiness notification. */
+        case WANT_DISCONNECT:
+        case WANT_RAW_DISCONNECT:
+            /* Disconnects should be processed promptly even if
+             * the remote side has gone quiet. */
+            events |= POLLOUT;
+            break;
+        default:
+            break;
+    }
+
+    if (!TAILQ_EMPTY(&(cbuf->wlist)))
+        events |= POLLOUT;
+
+    return events;
+}
+
+
+/**************************************************************
+ * poll() backend
+ **************************************************************/
+
+/* resize the pollfd array if necessary (we double it) and append our fd
+ * to it.
+ *
+ * returns 0 on success
+ * returns -1 on error (malloc error)
+ */
+static int
+poll_add(int fd)
+{
+    int i;
+
+    /* check to see if we already have a pollfd for this fd */
+    for (i = 0; i < g_pollsetsize; i++) {
+        if ( g_pollset[i].fd == fd ) {
+            break;
+        }
+    }
+
+    /* if there's no pre-existing pollfd for it, add it */
+    if (i == g_pollsetsize) {
+        /* first time through? Allocate the pollset. */
+        if (g_pollsetmax == 0) {
+            struct pollfd *newset;
+            newset = malloc(sizeof(struct pollfd) * 16);
+            if (!newset)
+                return -1;
+
+            g_pollsetmax = 16;
+            g_pollset = newset;
+        } else if (g_pollsetsize == g_pollsetmax) {
+            struct pollfd *newset;
+            newset = realloc(g_pollset, sizeof(struct pollfd) * g_pollsetmax * 2);
+            if (!newset)
+                return -1;
+
+            g_pollsetmax *= 2;
+            g_pollset = newset;
+        }
+        g_pollset[g_pollsetsize++].fd = fd;
+    }
+
+    g_pollset[i].events = POLLIN;
+    g_pollset[i].revents = 0;
+    return 0;
+}
+
+/* find the fd in the array, and memmove everything back one
+ * element, being sure to resize the array size. Doesn't effect
+ * the actual memory allocated, and hence doesn't change g_pollsetmax.
+ */
+static void
+poll_delete(int fd)
+{
+    int i;
+    for (i = 0; i < g_pollsetsize; i++) {
+        if ( g_pollset[i].fd == fd ) {
+            int move_count = g_pollsetsize - (i + 1);
+            if (move_count > 0) {
+                memmove(&g_pollset[i],
+                        &g_pollset[i+1],
+                        (size_t)move_count * sizeof(struct pollfd));
+            }
+            g_pollsetsize--;
+            return;
+        }
+    }
+}
+
+/* Update pollfd events based on each connection's current state. */
+static void
+poll_update_events(void)
+{
+    int i;
+    for (i = 0; i < g_pollsetsize; i++) {
+        cbuf_t *cbuf = cbuf_from_fd(g_pollset[i].fd);
+        if (cbuf == NULL)
+            continue;
+
+        g_pollset[i].events = pktevent_interest(cbuf);
+    }
+}
+
+static int
+poll_wait(int timeout, pktevent_handler *handler)
+{
+    int ret;
+    int i;
+    int pollsetsize;
+
+    poll_update_events();
+    ret = poll(g_pollset, g_pollsetsize, timeout); // millisec
+    pktclock_update();
+    if (ret <= 0)
+        return ret;
+
+    /* the handler can remove the current fd from the set (on disconnect)
+     * and append new ones (on accept), so walk it carefully. */
+    pollsetsize = g_pollsetsize;
+    for (i = 0; i < pollsetsize && i < g_pollsetsize; ) {
+        int fd = g_pollset[i].fd;
+        short revents = g_pollset[i].revents;
+
+#ifdef DEBUG
+        vmdb(MSG_DEBUG, "%s: {fd=%d, events=%d, revents=%d}", __FUNCTION__,
+             fd, g_pollset[i].events, revents);
+#endif
+        if (revents) {
+            cbuf_t *cbuf = cbuf_from_fd(fd);
+            if (cbuf)
+                handler(cbuf->slot, revents);
+        }
+
+        if (i < g_pollsetsize && g_pollset[i].fd == fd) {
+            i++;
+        } else {
+            /* entry i went away and the next one slid into its place */
+            pollsetsize--;
+        }
+    }
+    return ret;
+}
+
+
+#ifdef HAVE_EPOLL
+/**************************************************************
+ * epoll() backend
+ **************************************************************/
+
+static uint32_t
+epoll_events_from_poll(short events)
+{
+    uint32_t ev = 0;
+
+    if (events & POLLIN)
+        ev |= EPOLLIN;
+    if (events & POLLOUT)
+        ev |= EPOLLOUT;
+    return ev;
+}
+
+static short
+poll_events_from_epoll(uint32_t ev)
+{
+    short events = 0;
+
+    if (ev & EPOLLIN)
+        events |= POLLIN;
+    if (ev & EPOLLOUT)
+        events |= POLLOUT;
+    if (ev & EPOLLERR)
+        events |= POLLERR;
+    if (ev & EPOLLHUP)
+        events |= POLLHUP;
+    return events;
+}
+
+/* the event data carries the slot and its generation, so events that
+ * were already queued for a connection that has since gone away (and
+ * whose slot got reused) can be told apart and dropped. */
+static uint64_t
+epoll_data(cbuf_t *cbuf)
+{
+    return ((uint64_t)cbuf->gen << 32) | (uint32_t)cbuf->slot;
+}
+
+static int
+epoll_add(cbuf_t *cbuf)
+{
+    struct epoll_event ev;
+    int fd = cbuf->fd;
+    short want = pktevent_interest(cbuf);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = epoll_events_from_poll(want);
+    ev.data.u64 = epoll_data(cbuf);
+
+    if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        if (errno != EEXIST) {
+            vmdb(MSG_ERR, "%s: epoll_ctl(ADD, fd%d): %s", __FUNCTION__,
+                 fd, strerror(errno));
+            return -1;
+        }
+        if (epoll_ctl(g_epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+            vmdb(MSG_ERR, "%s: epoll_ctl(MOD, fd%d): %s", __FUNCTION__,
+                 fd, strerror(errno));
+            return -1;
+        }
+    } else {
+        g_epnfds++;
+    }
+    cbuf->events = want;
+    cbuf->watched = 1;
+
+    /* keep the ready list big enough to hand back every fd at once */
+    if (g_epnfds > g_epeventsmax) {
+        struct epoll_event *newevents;
+        int newmax = g_epeventsmax ? g_epeventsmax * 2 : 16;
+
+        newevents = realloc(g_epevents, sizeof(struct epoll_event) * newmax);
+        if (newevents) {
+            g_epevents = newevents;
+            g_epeventsmax = newmax;
+        }
+    }
+    return 0;
+}
+
+static void
+epoll_delete(cbuf_t *cbuf)
+{
+    struct epoll_event ev; /* pre-2.6.9 kernels want a non-NULL event */
+
+    memset(&ev, 0, sizeof(ev));
+    if (epoll_ctl(g_epfd, EPOLL_CTL_DEL, cbuf->fd, &ev) == 0)
+        g_epnfds--;
+}
+
+static void
+epoll_update(cbuf_t *cbuf)
+{
+    struct epoll_event ev;
+    short want;
+
+    if (cbuf->state == DISCONNECTED || !cbuf->watched)
+        return;   /* not registered */
+
+    want = pktevent_interest(cbuf);
+    if (want == cbuf->events)
+        return;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = epoll_events_from_poll(want);
+    ev.data.u64 = epoll_data(cbuf);
+    if (epoll_ctl(g_epfd, EPOLL_CTL_MOD, cbuf->fd, &ev) < 0) {
+        vmdb(MSG_ERR, "%s: epoll_ctl(MOD, fd%d): %s", __FUNCTION__,
+             cbuf->fd, strerror(errno));
+        return;
+    }
+    cbuf->events = want;
+}
+
+static int
+epoll_wait_ready(int timeout, pktevent_handler *handler)
+{
+    int ret;
+    int i;
+
+    if (g_epeventsmax == 0) {
+        pktclock_update();
+        return 0;
+    }
+
+    ret = epoll_wait(g_epfd, g_epevents, g_epeventsmax, timeout);
+    pktclock_update();
+    if (ret <= 0) {
+        if (ret < 0 && errno == EINTR)
+            return 0;
+        return ret;
+    }
+
+    for (i = 0; i < ret; i++) {
+        int slot = (int)(uint32_t)g_epevents[i].data.u64;
+        u_int gen = (u_int)(g_epevents[i].data.u64 >> 32);
+        cbuf_t *cbuf = cbuf_from_slot(slot);
+
+#ifdef DEBUG
+        vmdb(MSG_DEBUG, "%s: {slot=%d, gen=%u, events=%d}", __FUNCTION__,
+             slot, gen, g_epevents[i].events);
+#endif
+        if (cbuf == NULL || cbuf->gen != gen || cbuf->fd < 0)
+            continue;   /* stale */
+
+        handler(slot, poll_events_from_epoll(g_epevents[i].events));
+    }
+    return ret;
+}
+#endif /* HAVE_EPOLL */
+
+
+/**************************************************************
+ * Entry points
+ **************************************************************/
+
+int
+pktevent_init(pktserv_backend_t backend)
+{
+    if (backend == PKTSERV_BACKEND_DEFAULT) {
+#ifdef HAVE_EPOLL
+        backend = PKTSERV_BACKEND_EPOLL;
+#else
+        backend = PKTSERV_BACKEND_POLL;
+#endif
+    }
+
+#ifdef HAVE_EPOLL
+    if (backend == PKTSERV_BACKEND_EPOLL) {
+        if (g_epfd < 0) {
+            g_epfd = epoll_create1(EPOLL_CLOEXEC);
+            if (g_epfd < 0) {
+                vmdb(MSG_ERR, "%s: epoll_create1: %s", __FUNCTION__,
+                     strerror(errno));
+                return -1;
+            }
+        }
+        g_backend = backend;
+        g_initialized = 1;
+        return 0;
+    }
+#else
+    if (backend == PKTSERV_BACKEND_EPOLL) {
+        vmdb(MSG_ERR, "%s: epoll backend not compiled in", __FUNCTION__);
+        return -1;
+    }
+#endif
+
+    g_backend = PKTSERV_BACKEND_POLL;
+    g_initialized = 1;
+    return 0;
+}
+
+const char *
+pktevent_name(void)
+{
+    return (g_backend == PKTSERV_BACKEND_EPOLL) ? "epoll" : "poll";
+}
+
+int
+pktevent_add(cbuf_t *cbuf)
+{
+    if (cbuf->fd < 0)
+        return -1;
+
+    /* nobody picked one. go with the default */
+    if (!g_initialized && pktevent_init(PKTSERV_BACKEND_DEFAULT) < 0)
+        return -1;
+
+#ifdef HAVE_EPOLL
+    if (g_backend == PKTSERV_BACKEND_EPOLL)
+        return epoll_add(cbuf);
+#endif
+    if (poll_add(cbuf->fd) < 0)
+        return -1;
+    cbuf->events = POLLIN;
+    cbuf->watched = 1;
+    return 0;
+}
+
+void
+pktevent_delete(cbuf_t *cbuf)
+{
+    if (cbuf->fd < 0)
+        return;
+
+#ifdef HAVE_EPOLL
+    if (g_backend == PKTSERV_BACKEND_EPOLL) {
+        epoll_delete(cbuf);
+        cbuf->events = 0;
+        cbuf->watched = 0;
+        return;
+    }
+#endif
+    poll_delete(cbuf->fd);
+    cbuf->events = 0;
+    cbuf->watched = 0;
+}
+
+void
+pktevent_update(cbuf_t *cbuf)
+{
+#ifdef HAVE_EPOLL
+    if (g_backend == PKTSERV_BACKEND_EPOLL) {
+        epoll_update(cbuf);
+        return;
+    }
+#endif
+    /* the poll backend recomputes everything in poll_wait() */
+}
+
+int
+pktevent_wait(int timeout, pktevent_handler *handler)
+{
+#ifdef HAVE_EPOLL
+    if (g_backend == PKTSERV_BACKEND_EPOLL)
+        return epoll_wait_ready(timeout, handler);
+#endif
+    return poll_wait(timeout, handler);
+}
@@ -0,0 +1,56 @@
+/*
+ * pktevent.h
+ *
+ * event notification backends (poll and epoll) for the packet server.
+ *
+ * These shouldn't be called directly by the main server and instead
+ * should be called from pktserv.c and pktsocket.c.
+ *
+ * Author: Michel Hoche-Mong
+ * Copyright (c) 2001-2026 Michel Hoche-Mong
+ * All rights reserved.
+ *
+ */
+
+#pragma once
+
+#include "pktbuffers.h"
+#include "pktserv.h"
+
+/* called for each connection that has activity. slot is the index
+ * into cbufs[]. revents uses the poll() POLLIN/POLLOUT/POLLERR/POLLHUP/
+ * POLLNVAL bits regardless of which backend is in use.
+ */
+typedef void (pktevent_handler)(int slot, short revents);
+
+/* pick the backend. must be called before any fds are added.
+ * returns 0 on success, -1 if the backend isn't available.
+ */
+int pktevent_init(pktserv_backend_t backend);
+
+/* name of the backend in use ("poll" or "epoll") */
+const char *pktevent_name(void);
+
+/* start watching a connection's fd. the initial interest set is taken
+ * from the state of the cbuf.
+ *
+ * returns 0 on success, -1 on error.
+ */
+int pktevent_add(cbuf_t *cbuf);
+
+/* stop watching a connection's fd. call this before closing it. */
+void pktevent_delete(cbuf_t *cbuf);
+
+/* recompute the interest set of a single connection after its state
+ * or write list changed. this is O(1) and only touches the kernel if
+ * the interest set actually changed.
+ */
+void pktevent_update(cbuf_t *cbuf);
+
+/* wait up to timeout milliseconds (-1 blocks) for activity and call
+ * the handler for each connection that is ready. the loop clock is
+ * brought up to date when the wait ends, before any handler runs.
+ *
+ * returns the number of ready fds, 0 on timeout or EINTR, -1 on error.
+ */
+int pktevent_wait(int timeout, pktevent_handler *handler);
@@ -0,0 +1,264 @@
+/*
+ * pktresolve.c
+ *
+ * reverse DNS lookups off the event loop.
+ *
+ * getnameinfo() and the double-reverse check behind it block for as
+ * long as the resolver takes, which can be seconds when it's broken.
+ * The lookups are handed to a few worker threads instead. Each one
+ * takes a request off the todo list, resolves it, and puts the answer
+ * on the done list. The event loop is woken up through a pipe, and
+ * picks the answers up from there.
+ *
+ * The worker threads only ever touch the two lists and their own
+ * request; the connection tables stay single threaded.
+ *
+ * Author: Michel Hoche-Mong
+ * Copyright (c) 2001-2026 Michel Hoche-Mong
+ * All rights reserved.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "bsdqueue.h"
+#include "server/mdb.h"
+
+#include "pktresolve.h"
+
+#ifdef HAVE_PTHREAD
+
+typedef struct resolve_req_st {
+    TAILQ_ENTRY(resolve_req_st) entries;
+    int slot;
+    u_int gen;
+    struct sockaddr_storage sa;
+    socklen_t salen;
+    char name[PKTRESOLVE_NAMELEN];
+} resolve_req_t;
+
+TAILQ_HEAD(resolve_list, resolve_req_st);
+
+static struct resolve_list g_todo = TAILQ_HEAD_INITIALIZER(g_todo);
+static struct resolve_list g_done = TAILQ_HEAD_INITIALIZER(g_done);
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_wake = PTHREAD_COND_INITIALIZER;
+static int g_pipe[2] = { -1, -1 };
+static int g_nthreads = 0;
+static pktresolve_cb *g_cb = NULL;
+static pthread_key_t g_worker_key;     /* set on the worker threads */
+
+
+static void *
+resolve_worker(void *arg)
+{
+    resolve_req_t *req;
+    int was_empty;
+
+    (void)arg;
+
+    pthread_setspecific(g_worker_key, &g_worker_key);
+
+    for (;;) {
+        pthread_mutex_lock(&g_lock);
+        while (TAILQ_EMPTY(&g_todo))
+            pthread_cond_wait(&g_wake, &g_lock);
+        req = TAILQ_FIRST(&g_todo);
+        TAILQ_REMOVE(&g_todo, req, entries);
+        pthread_mutex_unlock(&g_lock);
+
+        getsockaddrname((struct sockaddr *)&req->sa, req->salen,
+                        req->name, sizeof(req->name));
+
+        pthread_mutex_lock(&g_lock);
+        was_empty = TAILQ_EMPTY(&g_done);
+        TAILQ_INSERT_TAIL(&g_done, req, entries);
+        pthread_mutex_unlock(&g_lock);
+
+        /* one byte in the pipe is enough to get the whole done list
+         * looked at. if it's full, there's already one waiting. */
+        if (was_empty && write(g_pipe[1], "", 1) < 0 && errno != EAGAIN)
+            vmdb(MSG_ERR, "%s: couldn't wake up the server: %s",
+                 __FUNCTION__, strerror(errno));
+    }
+
+    return NULL;
+}
+
+/* set up one end of the wakeup pipe */
+static int
+pipe_setup(int fd)
+{
+    int flags;
+
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0)
+        return -1;
+
+    /* a restarted server shouldn't inherit it */
+    flags = fcntl(fd, F_GETFD, 0);
+    if (flags < 0 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) < 0)
+        return -1;
+
+    return 0;
+}
+
+int
+pktresolve_init(int nthreads, pktresolve_cb *cb)
+{
+    pthread_t tid;
+    sigset_t all, old;
+    int i;
+
+    if (g_nthreads > 0)
+        return g_pipe[0];   /* already running */
+
+    if (nthreads <= 0)
+        return -1;
+
+    if (pipe(g_pipe) < 0) {
+        vmdb(MSG_ERR, "%s: pipe: %s", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+    if (pipe_setup(g_pipe[0]) < 0 || pipe_setup(g_pipe[1]) < 0) {
+        vmdb(MSG_ERR, "%s: fcntl: %s", __FUNCTION__, strerror(errno));
+        goto fail;
+    }
+
+    g_cb = cb;
+
+    if (pthread_key_create(&g_worker_key, NULL) != 0) {
+        vmdb(MSG_ERR, "%s: pthread_key_create failed", __FUNCTION__);
+        goto fail;
+    }
+
+    /* signals are the main thread's business. the workers start out
+     * with everything blocked so none of them get delivered there. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&tid, NULL, resolve_worker, NULL) != 0) {
+            vmdb(MSG_ERR, "%s: couldn't start resolver thread %d", __FUNCTION__, i);
+            break;
+        }
+        pthread_detach(tid);
+        g_nthreads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (g_nthreads == 0) {
+        pthread_key_delete(g_worker_key);
+        goto fail;
+    }
+
+    vmdb(MSG_INFO, "%s: %d resolver threads", __FUNCTION__, g_nthreads);
+    return g_pipe[0];
+
+fail:
+    close(g_pipe[0]);
+    close(g_pipe[1]);
+    g_pipe[0] = g_pipe[1] = -1;
+    return -1;
+}
+
+int
+pktresolve_request(int slot, u_int gen, const struct sockaddr *sa,
+                   socklen_t salen)
+{
+    resolve_req_t *req;
+
+    if (g_nthreads == 0 || salen > sizeof(req->sa))
+        return -1;
+
+    req = (resolve_req_t *)malloc(sizeof(resolve_req_t));
+    if (req == NULL)
+        return -1;
+
+    req->slot = slot;
+    req->gen = gen;
+    memcpy(&req->sa, sa, salen);
+    req->salen = salen;
+    req->name[0] = '\0';
+
+    pthread_mutex_lock(&g_lock);
+    TAILQ_INSERT_TAIL(&g_todo, req, entries);
+    pthread_cond_signal(&g_wake);
+    pthread_mutex_unlock(&g_lock);
+
+    return 0;
+}
+
+int
+pktresolve_on_worker(void)
+{
+    return g_nthreads > 0 && pthread_getspecific(g_worker_key) != NULL;
+}
+
+void
+pktresolve_complete(void)
+{
+    struct resolve_list done;
+    resolve_req_t *req;
+    char buf[64];
+
+    /* drain the pipe before taking the list. anything finished after
+     * this point writes a fresh byte. */
+    while (read(g_pipe[0], buf, sizeof(buf)) > 0)
+        ;
+
+    TAILQ_INIT(&done);
+    pthread_mutex_lock(&g_lock);
+    TAILQ_CONCAT(&done, &g_done, entries);
+    pthread_mutex_unlock(&g_lock);
+
+    while ((req = TAILQ_FIRST(&done)) != NULL) {
+        TAILQ_REMOVE(&done, req, entries);
+        if (g_cb)
+            g_cb(req->slot, req->gen, req->name);
+        free(req);
+    }
+}
+
+#else /* !HAVE_PTHREAD */
+
+int
+pktresolve_init(int nthreads, pktresolve_cb *cb)
+{
+    (void)nthreads;
+    (void)cb;
+    return -1;
+}
+
+int
+pktresolve_request(int slot, u_int gen, const struct sockaddr *sa,
+                   socklen_t salen)
+{
+    (void)slot;
+    (void)gen;
+    (void)sa;
+    (void)salen;
+    return -1;
+}
+
+int
+pktresolve_on_worker(void)
+{
+    return 0;
+}
+
+void
+pktresolve_complete(void)
+{
+}
+
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,65 @@
+/*
+ * pktresolve.h
+ *
+ * reverse DNS lookups for the packet server, done on a small pool of
+ * worker threads so a slow resolver can't stall the event loop.
+ *
+ * These shouldn't be called directly by the main server and instead
+ * should be called from pktserv.c.
+ *
+ * Author: Michel Hoche-Mong
+ * Copyright (c) 2001-2026 Michel Hoche-Mong
+ * All rights reserved.
+ *
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/* longest name a lookup hands back, including the NUL */
+#define PKTRESOLVE_NAMELEN 256
+
+/* called from the event loop for each finished lookup. slot and gen
+ * are what was passed to pktresolve_request(); the connection may be
+ * long gone by now, so check gen before using it.
+ */
+typedef void (pktresolve_cb)(int slot, u_int gen, const char *name);
+
+/* start nthreads worker threads. finished lookups are announced on a
+ * pipe, whose read end is returned so the caller can watch it.
+ *
+ * returns the fd, or -1 if the threads couldn't be started (or there's
+ * no thread support), in which case lookups have to be done inline.
+ */
+int pktresolve_init(int nthreads, pktresolve_cb *cb);
+
+/* queue a lookup of sa for the connection in slot.
+ *
+ * returns 0 if it was queued, -1 if not.
+ */
+int pktresolve_request(int slot, u_int gen, const struct sockaddr *sa,
+                       socklen_t salen);
+
+/* empty the wakeup pipe and run the callback for every lookup that's
+ * finished. call this when the pipe is readable.
+ */
+void pktresolve_complete(void);
+
+/* 1 if this is one of the worker threads, 0 if not */
+int pktresolve_on_worker(void);
+
+/* look up the verified host name for an address, or "[addr]" if it
+ * can't be resolved. this blocks; it's what the worker threads run,
+ * and it's safe to call from any thread. (getrname.c)
+ */
+void getsockaddrname(const struct sockaddr *sa, socklen_t salen,
+                     char *buf, size_t buflen);
+
+/* the same, but only if the answer is already cached. never blocks.
+ *
+ * returns 0 if buf was filled in, -1 if it needs a real lookup.
+ */
+int getsockaddrcached(const struct sockaddr *sa, socklen_t salen,
+                      char *buf, size_t buflen);
@@ -1,7 +1,7 @@
 /*
  * pktserv.c
  *
- * main event loop for an SSL-enabled poll-based server.
+ * main event loop for an SSL-enabled poll/epoll-based server.
  *
  * Author: Michel Hoche-Mong
  * Copyright (c) 2001-2026 Michel Hoche-Mong
@@ -24,6 +24,7 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #ifdef HAVE_FCNTL_H
@@ -41,46 +42,378 @@
 #include "pktserv_internal.h"
 #include "pktbuffers.h"
 #include "pktserv.h"
+#include "pktevent.h"
 #include "pktsocket.h"
+#include "pktresolve.h"
+#include "pktdnscache.h"
+#include "pkttimer.h"
+#include "pktclock.h"
 #include "sslsocket.h"
 
-cbuf_t *cbufs;    /* array of user packet buffers */
 
-int port_fd;    /* plaintext listen port */
-int sslport_fd; /* ssl listen port's file descriptor  */
+/* private callbacks */
+pktserv_cb_t g_pktserv_cb = {0};
 
+/* fires every IDLE_PERIOD ms to run handle_idle(). it has to run:
+ * it's what lets held (IGNORE) connections read again and what drops
+ * anyone past the send queue deadline, so a negative POLL_TIMEOUT
+ * gets the default period rather than none. */
+#if POLL_TIMEOUT >= 0
+#define IDLE_PERIOD     (POLL_TIMEOUT * 1000L)
+#else
+#define IDLE_PERIOD     1000L
+#endif
+static pkttimer_t g_idle_timer;
+
+/* slots with packets queued since the last flush */
+static int *g_dirty = NULL;
+static int g_ndirty = 0;
+static int g_dirty_sz = 0;
+
+/* slots with input buffered that they didn't get to handle last pass */
+static int *g_backlog = NULL;
+static int g_nbacklog = 0;
+static int g_backlog_sz = 0;
+
+/* output queue limits. see pktserv_set_outlimits() */
+static size_t g_out_hiwat = 16384;
+static size_t g_out_lowat = 4096;
+static size_t g_out_limit = 65536;
+static long g_out_deadline = 60000;
+static int g_out_overflow = PKTSERV_OVERFLOW_DROPLOW | PKTSERV_OVERFLOW_PAUSE;
+static unsigned long g_out_drops = 0;   /* packets refused for space */
+
+static int input_ready(cbuf_t *cbuf);
+static void handle_input(cbuf_t *cbuf);
+static void mark_backlogged(cbuf_t *cbuf);
+static void handle_disconnect(cbuf_t *cbuf);
+static void handle_raw_disconnect(cbuf_t *cbuf);
+
+/* how long the packet at the head of a connection's write list has
+ * been waiting, in ms. 0 if there isn't one.
+ */
+static long
+outqueue_age(cbuf_t *cbuf, uint64_t now)
+{
+    msgbuf_t *head = TAILQ_FIRST(&(cbuf->wlist));
 
-struct pollfd* g_pollset;
-int g_pollsetsize = 0;
-int g_pollsetmax = 0;
+    if (head == NULL || now < head->queued)
+        return 0;
+    return (long)(now - head->queued);
+}
 
-/* private callbacks */
-pktserv_cb_t g_pktserv_cb = {0};
+/* drop a connection that hasn't taken anything off its write list
+ * within the deadline. it's not reading, so it's not going to tell us
+ * it's writeable either; get rid of it now.
+ *
+ * returns 1 if it was dropped.
+ */
+static int
+check_deadline(cbuf_t *cbuf, uint64_t now)
+{
+    long age;
+
+    if (g_out_deadline <= 0 || TAILQ_EMPTY(&(cbuf->wlist)))
+        return 0;
+
+    switch (cbuf->state) {
+        case DISCONNECTED:
+        case WANT_RAW_DISCONNECT:
+        case LISTEN_SOCKET:
+        case LISTEN_SOCKET_SSL:
+        case RESOLVER_PIPE:
+            return 0;
+        default:
+            break;
+    }
+
+    age = outqueue_age(cbuf, now);
+    if (age <= g_out_deadline)
+        return 0;
+
+    vmdb(MSG_WARN, "fd%d: output stuck for %ldms (%d packets, %lu bytes), dropping it",
+         cbuf->fd, age, cbuf->wlist_size, (unsigned long)cbuf->wbytes);
+
+    if (g_pktserv_cb.lost_client && cbuf->state != WANT_DISCONNECT)
+        g_pktserv_cb.lost_client(cbuf->slot);
+
+    cbuf->dirty = 0;    /* no point in trying to write to it again */
+    handle_disconnect(cbuf);
+    handle_raw_disconnect(cbuf);
+    return 1;
+}
+
+/* let a backed up connection go again once it's drained to the
+ * low-water mark, and pick up any input that was left waiting.
+ */
+static void
+check_drained(cbuf_t *cbuf)
+{
+    if (!cbuf->backedup || cbuf->wbytes > g_out_lowat)
+        return;
+
+    vmdb(MSG_DEBUG, "fd%d: output drained to %lu bytes", cbuf->fd,
+         (unsigned long)cbuf->wbytes);
+    cbuf->backedup = 0;
+    if (cbuf->rpaused) {
+        cbuf->rpaused = 0;
+        if (cbuf->ilen > 0)
+            mark_backlogged(cbuf);
+    }
+}
 
 /*
- * handle any idle-time chores
- *
- * (this should go away when we have an event queue).
+ * handle any idle-time chores. timed events belong on the timer wheel;
+ * this is only for things that still have to be looked at periodically.
  */
 static void
-handle_idle(void)
+handle_idle(pkttimer_t *t, void *arg)
 {
+    uint64_t now = pktclock_ms();
     int i;
 
     if (g_pktserv_cb.idle) {
         g_pktserv_cb.idle(0);
     }
 
-    /* for all users, check ignore/held state */
-    for (i = 0; i < MAX_USERS; i++) {
-        if (cbufs[i].disp == IGNORE) {
-            if ( g_pktserv_cb.ok2read(cbufs[i].fd) == 1 ) {
-                if (add_pollfd(cbufs[i].fd) == 0) {
-                    cbufs[i].disp = OK;
-                }
+    /* for all users, check ignore/held state. held connections may
+     * be sitting on buffered input the socket won't tell us about.
+     * this is also where anyone who's stopped taking their output
+     * gets dropped. */
+    for (i = 1; i < cbufs_size; i++) {
+        if (check_deadline(cbufs[i], now))
+            continue;
+        if (cbufs[i]->disp == IGNORE && input_ready(cbufs[i])) {
+            if (!g_pktserv_cb.ok2read || g_pktserv_cb.ok2read(i) == 1) {
+                cbufs[i]->disp = OK;
+                handle_input(cbufs[i]);
+                pktevent_update(cbufs[i]);
             }
         }
     }
+
+    pkttimer_schedule(t, IDLE_PERIOD);
+}
+
+/* remember that a connection needs flushing at the end of this pass
+ * through the loop.
+ *
+ * returns -1 if we couldn't keep track of it, in which case the caller
+ * should just write it now.
+ */
+static int
+mark_dirty(cbuf_t *cbuf)
+{
+    int *tmp;
+    int sz;
+
+    if (cbuf->dirty)
+        return 0;
+
+    if (g_ndirty == g_dirty_sz) {
+        sz = g_dirty_sz ? g_dirty_sz * 2 : 64;
+        tmp = (int*)realloc(g_dirty, (size_t)sz * sizeof(int));
+        if (tmp == NULL)
+            return -1;
+        g_dirty = tmp;
+        g_dirty_sz = sz;
+    }
+
+    g_dirty[g_ndirty++] = cbuf->slot;
+    cbuf->dirty = 1;
+    return 0;
+}
+
+/* write out everything a connection has queued up */
+static void
+flush_cbuf(cbuf_t *cbuf)
+{
+    SocketState was = cbuf->state;
+
+    cbuf->dirty = 0;
+    if (cbuf->fd < 0 || TAILQ_EMPTY(&(cbuf->wlist)))
+        return;
+
+    switch (was) {
+        case DISCONNECTED:
+        case WANT_RAW_DISCONNECT:
+        case LISTEN_SOCKET:
+        case LISTEN_SOCKET_SSL:
+            return;
+
+        case WANT_SSL_ACCEPT:
+        case WANT_SSL_READ:
+        case WANT_SSL_WRITE:
+            /* SSL is in the middle of something and has to be retried
+             * with the same arguments. the state machine will get to
+             * the queue once that's done. */
+            pktevent_update(cbuf);
+            return;
+
+        case WANT_WRITE:
+            /* the last write didn't all go out. leave it until the
+             * socket says it's writeable rather than trying again. */
+            if (cbuf->retries > 0) {
+                pktevent_update(cbuf);
+                return;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    cbuf->state = WANT_WRITE;
+    if (pktsocket_write(cbuf) < 0) {
+        vmdb(MSG_WARN, "%s: fd%d, error sending packet.", __FUNCTION__, cbuf->fd);
+        cbuf->state = WANT_DISCONNECT;
+    } else if (was == WANT_DISCONNECT) {
+        /* the last words got out (or as much as would); carry on
+         * with the disconnect */
+        cbuf->state = WANT_DISCONNECT;
+    } else if (was == WANT_READ && cbuf->state == WANT_HEADER) {
+        /* don't lose track of a half-read packet */
+        cbuf->state = WANT_READ;
+    }
+    check_drained(cbuf);
+
+    /* if it didn't all go out, start watching for writeability */
+    pktevent_update(cbuf);
+}
+
+/* flush every connection that had packets queued during this pass */
+static void
+flush_dirty(void)
+{
+    cbuf_t *cbuf;
+    int i;
+
+    for (i = 0; i < g_ndirty; i++) {
+        cbuf = cbuf_from_slot(g_dirty[i]);
+        if (cbuf != NULL && cbuf->dirty)
+            flush_cbuf(cbuf);
+    }
+    g_ndirty = 0;
+}
+
+/* remember that a connection has packets left to handle next pass.
+ * it's only going to be starved of its turn if this fails, so there's
+ * not much to do about it but complain.
+ */
+static void
+mark_backlogged(cbuf_t *cbuf)
+{
+    int *tmp;
+    int sz;
+
+    if (cbuf->backlogged)
+        return;
+
+    if (g_nbacklog == g_backlog_sz) {
+        sz = g_backlog_sz ? g_backlog_sz * 2 : 64;
+        tmp = (int*)realloc(g_backlog, (size_t)sz * sizeof(int));
+        if (tmp == NULL) {
+            vmdb(MSG_ERR, "%s: out of memory, fd%d may stall", __FUNCTION__, cbuf->fd);
+            return;
+        }
+        g_backlog = tmp;
+        g_backlog_sz = sz;
+    }
+
+    g_backlog[g_nbacklog++] = cbuf->slot;
+    cbuf->backlogged = 1;
+}
+
+/* is the connection in a state where it can take another packet? */
+static int
+input_ready(cbuf_t *cbuf)
+{
+    switch (cbuf->state) {
+        case IDLE:
+        case WANT_HEADER:
+        case WANT_READ:
+        case WANT_WRITE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * hand the packets sitting in a connection's input buffer to the
+ * dispatcher. each connection only gets PKT_READ_BUDGET packets a
+ * pass, so one that's pipelined a pile of commands can't starve
+ * everyone else. whatever's left goes on the backlog for next time.
+ */
+static void
+handle_input(cbuf_t *cbuf)
+{
+    char *pkt;
+    int budget;
+
+    for (budget = PKT_READ_BUDGET; budget > 0; budget--) {
+        /* their output is backed up. the rest waits until it drains. */
+        if (cbuf->rpaused)
+            break;
+
+        if (g_pktserv_cb.ok2read && !g_pktserv_cb.ok2read(cbuf->slot)) {
+            /* hold off. handle_idle() will come back for it. */
+            if (cbuf->ilen > 0)
+                cbuf->disp = IGNORE;
+            break;
+        }
+
+        pkt = pktsocket_packet(cbuf);
+        if (pkt == NULL)
+            break;
+
+        if (g_pktserv_cb.dispatch)
+            g_pktserv_cb.dispatch(cbuf->slot, pkt);
+
+        /* the dispatcher may have decided to drop them */
+        if (cbuf->state == WANT_DISCONNECT || cbuf->state == WANT_RAW_DISCONNECT ||
+            cbuf->state == DISCONNECTED)
+            return;
+
+        /* ready for the next packet */
+        cbuf->state = WANT_HEADER;
+    }
+
+    if (budget == 0 && cbuf->ilen > 0 && !cbuf->rpaused)
+        mark_backlogged(cbuf);
+
+    if (cbuf->state == COMPLETE_PACKET)
+        cbuf->state = WANT_HEADER;
+
+    if (!TAILQ_EMPTY(&(cbuf->wlist)) &&
+        (cbuf->state == WANT_HEADER || cbuf->state == WANT_READ)) {
+        /* cycle back to want write if there's stuff left */
+        cbuf->state = WANT_WRITE;
+    }
+}
+
+/* give the connections that ran out of budget last pass another go */
+static void
+run_backlog(void)
+{
+    cbuf_t *cbuf;
+    int i, n = g_nbacklog;
+
+    for (i = 0; i < n; i++) {
+        cbuf = cbuf_from_slot(g_backlog[i]);
+        if (cbuf == NULL || !cbuf->backlogged)
+            continue;
+        cbuf->backlogged = 0;
+
+        if (cbuf->disp != IGNORE && input_ready(cbuf)) {
+            handle_input(cbuf);
+            pktevent_update(cbuf);
+        }
+    }
+
+    /* anything that got backlogged again is at the end */
+    g_nbacklog -= n;
+    memmove(g_backlog, g_backlog + n, (size_t)g_nbacklog * sizeof(int));
 }
 
 #if 0
@@ -120,12 +453,19 @@ handle_disconnect(cbuf_t *cbuf)
 {
     msgbuf_t *msgbuf;
 
-    /* clear out the read buffer */
-    if (cbuf->rbuf) {
-        if (cbuf->rbuf->data)
-            free(cbuf->rbuf->data);
-        free(cbuf->rbuf);
-        cbuf->rbuf = NULL;
+    /* last chance for anything that was queued but never flushed */
+    if (cbuf->dirty) {
+        cbuf->dirty = 0;
+        pktsocket_write(cbuf);
+    }
+
+    /* clear out the input buffer */
+    if (cbuf->ibuf) {
+        free(cbuf->ibuf);
+        cbuf->ibuf = NULL;
+        cbuf->ihead = 0;
+        cbuf->ilen = 0;
+        cbuf->iheld = 0;
     }
 
 
@@ -133,10 +473,12 @@ handle_disconnect(cbuf_t *cbuf)
     while (!TAILQ_EMPTY(&(cbuf->wlist))) {
         msgbuf = (msgbuf_t*)(TAILQ_FIRST(&(cbuf->wlist)));
         TAILQ_REMOVE(&(cbuf->wlist), msgbuf, entries);
-        if (msgbuf->data)
-            free(msgbuf->data);
-        free(msgbuf);
+        _msgbuf_free(msgbuf);
     }
+    cbuf->wlist_size = 0;
+    cbuf->wbytes = 0;
+    cbuf->backedup = 0;
+    cbuf->rpaused = 0;
 
     cbuf->state = WANT_RAW_DISCONNECT;
 
@@ -145,6 +487,10 @@ handle_disconnect(cbuf_t *cbuf)
 static void
 handle_raw_disconnect(cbuf_t *cbuf)
 {
+    /* stop watching it before it goes away, so a reused fd number
+     * doesn't inherit the old registration */
+    pktevent_delete(cbuf);
+
     /* close the fd */
     close(cbuf->fd);
 
@@ -156,125 +502,50 @@ handle_raw_disconnect(cbuf_t *cbuf)
     }
 #endif
 
-    delete_pollfd(cbuf->fd);
-
-    cbuf->state = DISCONNECTED;
-}
-
-
-/* resize the pollfd array if necessary (we double it) and append our fd to it.
- * we automatically set it to look for both read and write activity.
- *
- * returns 0 on success
- * returns -1 on error (malloc error)
- */
-int
-add_pollfd(int fd)
-{
-    int i;
-
-    /* check to see if we already have a pollfd for this fd */
-    for (i = 0; i < g_pollsetsize; i++) {
-        if ( g_pollset[i].fd == fd ) {
-            break;
-        }
-    }
-
-    /* if there's no pre-existing pollfd for it, add it */
-    if (i == g_pollsetsize) {
-        /* first time through? Allocate the pollset. */
-        if (g_pollsetmax == 0) {
-            struct pollfd *newset;
-            newset = malloc(sizeof(struct pollfd) * 16);
-            if (!newset)
-                return -1; 
-
-            g_pollsetmax = 16;
-            g_pollset = newset;
-        } else if (g_pollsetsize == g_pollsetmax) {
-            struct pollfd *newset;
-            newset = realloc(g_pollset, sizeof(struct pollfd) * g_pollsetmax * 2);
-            if (!newset)
-                return -1; 
-
-            g_pollsetmax *= 2;
-            g_pollset = newset;
-        }
-        g_pollset[g_pollsetsize++].fd = fd;
-    }
-
-    /* Only watch for readability by default.  POLLOUT is added
-     * dynamically by update_pollfd_events() when there is actually
-     * data to write; leaving it on all the time causes poll() to
-     * return immediately on idle connections → 100 % CPU. */
-    g_pollset[i].events = POLLIN;
-    return 0;
-}
-
-
-/* find the fd in the array, and memcpy everything back one
- * element, being sure to resize the array size. Doesn't effect
- * the actual memory allocated, and hence doesn't change g_pollsetmax.
- *
- */
-void 
-delete_pollfd(int fd)
-{
-    int i;
-    for (i = 0; i < g_pollsetsize; i++) {
-        if ( g_pollset[i].fd == fd ) {
-            int move_count = g_pollsetsize - (i + 1);
-            if (move_count > 0) {
-                memmove(&g_pollset[i],
-                        &g_pollset[i+1],
-                        (size_t)move_count * sizeof(struct pollfd));
-            }
-            g_pollsetsize--;
-            return;
-        }
-    }
+    /* hand the slot back. this sets the state to DISCONNECTED */
+    cbuf_release(cbuf);
 }
 
 
 /*
- * State machine to process pollfd's.
+ * State machine to process a connection with activity. revents holds
+ * the poll() style event bits regardless of the backend in use.
  */
 static void
-pollfd_state_machine(struct pollfd* pollfd)
+pollfd_state_machine(cbuf_t *cbuf, short revents)
 {
     int writeable;
     int readable;
-    cbuf_t *cbuf;
-
-    /* Check bounds: file descriptor must be < MAX_USERS to use as array index */
-    if (pollfd->fd >= MAX_USERS) {
-        vmdb(MSG_ERR, "pollfd_state_machine: file descriptor %d >= MAX_USERS (%d), ignoring", pollfd->fd, MAX_USERS);
-        return;
-    }
-
-    cbuf = &cbufs[pollfd->fd];
 
     /* if we have an exception, disconnect 'em */
-    if ( (pollfd->revents & POLLERR) ||
-         (pollfd->revents & POLLHUP) ||
-         (pollfd->revents & POLLNVAL)) {
+    if ( (revents & POLLERR) ||
+         (revents & POLLHUP) ||
+         (revents & POLLNVAL)) {
         /*
          * A remote close often surfaces as POLLHUP without a prior read that
          * transitions to WANT_DISCONNECT. Notify upper layers here so login/
          * group bookkeeping (e.g. sign-off messages) still runs.
          */
+        if (cbuf->state == DISCONNECTED)
+            return;
+
         if (g_pktserv_cb.lost_client &&
             cbuf->state != LISTEN_SOCKET &&
-            cbuf->state != LISTEN_SOCKET_SSL) {
-            g_pktserv_cb.lost_client(cbuf->fd);
+            cbuf->state != LISTEN_SOCKET_SSL &&
+            cbuf->state != WANT_RAW_DISCONNECT) {
+            g_pktserv_cb.lost_client(cbuf->slot);
         }
+
+        /* the error condition is sticky, so finish the job now rather
+         * than coming back around and reporting the loss again. */
         handle_disconnect(cbuf);
+        handle_raw_disconnect(cbuf);
         return;
     }
 
 
-    readable = pollfd->revents & POLLIN;
-    writeable = pollfd->revents & POLLOUT;
+    readable = revents & POLLIN;
+    writeable = revents & POLLOUT;
     if (readable || writeable) {
         cbuf->disp = OK;
     }
@@ -290,10 +561,14 @@ pollfd_state_machine(struct pollfd* pollfd)
                 pktsocket_accept(cbuf);
                 return;
 
+            case RESOLVER_PIPE:     /* some DNS lookups have finished */
+                pktresolve_complete();
+                return;
+
             case ACCEPTED:          /* freshly accepted client. inform the upper level */
                 cbuf->state = WANT_HEADER;
                 if (g_pktserv_cb.new_client)
-                    g_pktserv_cb.new_client(cbuf->fd, cbuf->is_ssl);
+                    g_pktserv_cb.new_client(cbuf->slot, cbuf->is_ssl);
                 break;
 
             case WANT_SSL_ACCEPT:   /* need to retry the accept */
@@ -302,8 +577,11 @@ pollfd_state_machine(struct pollfd* pollfd)
                 return;
 
             case WANT_SSL_READ:     /* need to retry the SSL read */
-                if (readable || writeable)
+                if (readable || writeable) {
                     pktsocket_read(cbuf);
+                    if (cbuf->state == WANT_HEADER || cbuf->state == WANT_READ)
+                        handle_input(cbuf);
+                }
                 return;
 
             case WANT_SSL_WRITE:    /* need to retry the SSL write */
@@ -315,6 +593,11 @@ pollfd_state_machine(struct pollfd* pollfd)
                 if (writeable) {
                     pktsocket_write(cbuf);
                 }
+                if (cbuf->state == WANT_WRITE) {
+                    /* still blocked on output. wait for the socket
+                     * to become writeable again instead of spinning. */
+                    return;
+                }
                 if (readable && (cbuf->state == WANT_READ || cbuf->state == WANT_HEADER)) {
                     /* pktsocket_write() may have set this to BLOCKED */
                     cbuf->disp = OK;
@@ -332,20 +615,21 @@ pollfd_state_machine(struct pollfd* pollfd)
                 if (readable) {
                     int ok2read = 1;
                     if (g_pktserv_cb.ok2read) {
-                        ok2read = g_pktserv_cb.ok2read(cbuf->fd);
+                        ok2read = g_pktserv_cb.ok2read(cbuf->slot);
                     }
-                    if (ok2read) {
-                        pktsocket_read(cbuf);
-                        if (cbuf->state == COMPLETE_PACKET && g_pktserv_cb.dispatch) {
-                            g_pktserv_cb.dispatch(cbuf->fd, cbuf->rbuf->data);
-                            _msgbuf_free(cbuf->rbuf);
-                            cbuf->rbuf = NULL;
-                            /* ready for the next packet */
-                            cbuf->state = WANT_HEADER;
-                        }
+                    if (!ok2read) {
+                        /* stop listening to them until handle_idle()
+                         * decides it's time, rather than spinning on
+                         * input we're not going to take */
+                        cbuf->disp = IGNORE;
+                    } else if (pktsocket_read(cbuf) == 0 &&
+                        (cbuf->state == WANT_HEADER || cbuf->state == WANT_READ)) {
+                        /* take care of as many packets as that got us */
+                        handle_input(cbuf);
                     }
                 }
-                if (!TAILQ_EMPTY(&(cbuf->wlist))) {
+                if (!TAILQ_EMPTY(&(cbuf->wlist)) &&
+                    (cbuf->state == WANT_HEADER || cbuf->state == WANT_READ)) {
                     /* cycle back to want write if there's stuff left */
                     cbuf->state = WANT_WRITE;
                 }
@@ -355,7 +639,7 @@ pollfd_state_machine(struct pollfd* pollfd)
                 vmdb(MSG_WARN, "%s: fd%d, disconnecting user\n", __FUNCTION__, cbuf->fd);
                 /* let main program know client went bye-bye */
                 if (g_pktserv_cb.lost_client)
-                    g_pktserv_cb.lost_client(cbuf->fd);
+                    g_pktserv_cb.lost_client(cbuf->slot);
 
                 handle_disconnect(cbuf);
                 break;
@@ -378,21 +662,23 @@ pollfd_state_machine(struct pollfd* pollfd)
 }
 
 /* 
- * run all the elements in the pollfd set through the statemachine
+ * run an fd with activity through the statemachine, then let the
+ * event backend know if it needs to watch for something different.
  */
-void
-handle_pollfds(void)
+static void
+handle_pollfd(int slot, short revents)
 {
-    int i;
-    int pollsetsize = g_pollsetsize; /* save this because we can resize it in the state machine */
-#ifdef DEBUG
-    for (i = 0; i < pollsetsize; i++) {
-        vmdb(MSG_DEBUG, "%s: {fd=%d, events=%d, revents=%d}", __FUNCTION__,
-            g_pollset[i].fd, g_pollset[i].events, g_pollset[i].revents);
+    cbuf_t *cbuf = cbuf_from_slot(slot);
+
+    if (cbuf == NULL) {
+        vmdb(MSG_ERR, "%s: no such slot %d, ignoring", __FUNCTION__, slot);
+        return;
     }
-#endif
-    for (i = 0; i < pollsetsize; i++)
-        pollfd_state_machine(&g_pollset[i]);
+
+    pollfd_state_machine(cbuf, revents);
+    if (cbuf->state != DISCONNECTED)
+        check_drained(cbuf);
+    pktevent_update(cbuf);
 }
 
 
@@ -407,7 +693,12 @@ int pktserv_init(char *config, pktserv_cb_t *cb)
        read_config(config);
      */
 
-    cbufs_init();
+    pktclock_update();
+
+    if (cbufs_init() < 0) {
+        vmdb(MSG_ERR, "%s: couldn't allocate the connection table", __FUNCTION__);
+        return -1;
+    }
 
     /* XXX set up default dispatch functions */
 
@@ -426,107 +717,224 @@ int pktserv_init(char *config, pktserv_cb_t *cb)
     if (cb->ok2read) {
         g_pktserv_cb.ok2read = cb->ok2read;
     }
+    if (cb->resolved) {
+        g_pktserv_cb.resolved = cb->resolved;
+    }
 
     return 0;
 }
 
 
-/*
- * Update pollfd events based on each connection's current state.
- * We only request POLLOUT when the connection actually needs to write
- * (pending data or SSL handshake/write retry).  Leaving POLLOUT set
- * on idle connections causes poll() to return immediately — spinning
- * the CPU at 100 %.
+/* pick the event notification backend. call this before
+ * pktserv_addport().
+ *
+ * returns 0 on success, -1 if the backend isn't available.
+ */
+int pktserv_set_backend(pktserv_backend_t backend)
+{
+    return pktevent_init(backend);
+}
+
+/* name of the event backend in use */
+const char *pktserv_backend_name(void)
+{
+    return pktevent_name();
+}
+
+/* set the limits on how much output can pile up for one connection.
+ *
+ * hiwat/lowat: once more than hiwat bytes are waiting to go out, the
+ *     connection is backed up and gets the overflow treatment (a mask
+ *     of pktserv_overflow_t) until it drains down to lowat.
+ * limit: packets that would take it past this many bytes are refused.
+ * deadline_ms: drop the connection if the oldest packet on its list
+ *     has been waiting this long. 0 means never.
+ */
+void pktserv_set_outlimits(size_t hiwat, size_t lowat, size_t limit,
+                           long deadline_ms, int overflow)
+{
+    if (lowat > hiwat)
+        lowat = hiwat;
+    if (limit < hiwat)
+        limit = hiwat;
+
+    g_out_hiwat = hiwat;
+    g_out_lowat = lowat;
+    g_out_limit = limit;
+    g_out_deadline = deadline_ms;
+    g_out_overflow = overflow;
+}
+
+/* cap the connection table. slot ids handed to the callbacks will
+ * always be < max. 0 means no limit (the table just keeps growing).
+ * connections that come in once the table is full are closed.
+ */
+void pktserv_set_maxconns(int max)
+{
+    cbufs_set_max(max);
+}
+
+/* a reverse lookup has come back. pass it up, and if the connection
+ * was being held until it did, see if it can go now.
  */
 static void
-update_pollfd_events(void)
+handle_resolved(int slot, u_int gen, const char *name)
 {
-    int i;
-    for (i = 0; i < g_pollsetsize; i++) {
-        int fd = g_pollset[i].fd;
-        if (fd < 0 || fd >= MAX_USERS)
-            continue;
+    cbuf_t *cbuf = cbuf_from_slot(slot);
 
-        cbuf_t *cbuf = &cbufs[fd];
-        short events = POLLIN;
+    if (cbuf == NULL || cbuf->gen != gen)
+        return;     /* they left while we were looking */
 
-        switch (cbuf->state) {
-            case ACCEPTED:
-                /* Freshly accepted: the state machine must run
-                 * immediately so the server can send the protocol
-                 * banner before the client sends anything. */
-            case WANT_WRITE:
-            case WANT_SSL_WRITE:
-            case WANT_SSL_ACCEPT:
-                /* These states need write-readiness notification. */
-            case WANT_DISCONNECT:
-            case WANT_RAW_DISCONNECT:
-                /* Disconnects should be processed promptly even if
-                 * the remote side has gone quiet. */
-                events |= POLLOUT;
-                break;
-            default:
-                break;
-        }
+    switch (cbuf->state) {
+        case DISCONNECTED:
+        case WANT_DISCONNECT:
+        case WANT_RAW_DISCONNECT:
+            return;
+        default:
+            break;
+    }
 
-        g_pollset[i].events = events;
+    if (g_pktserv_cb.resolved)
+        g_pktserv_cb.resolved(slot, name);
+
+    if (cbuf->disp == IGNORE && input_ready(cbuf) &&
+        (!g_pktserv_cb.ok2read || g_pktserv_cb.ok2read(slot))) {
+        cbuf->disp = OK;
+        handle_input(cbuf);
+        pktevent_update(cbuf);
     }
 }
 
+/* start nthreads threads to do reverse DNS lookups for
+ * pktserv_resolve(). call this after pktserv_set_backend(). with no
+ * threads, lookups are done inline and hold everything else up.
+ *
+ * returns 0 on success, -1 if the threads couldn't be started.
+ */
+int pktserv_set_resolvers(int nthreads)
+{
+    cbuf_t *cbuf;
+    int fd;
+
+    if (nthreads <= 0)
+        return 0;
+
+    if ((fd = pktresolve_init(nthreads, handle_resolved)) < 0)
+        return -1;
+
+    if ((cbuf = cbuf_from_fd(fd)) != NULL)
+        return 0;   /* already watching it */
+
+    if ((cbuf = cbuf_alloc(fd)) == NULL) {
+        vmdb(MSG_ERR, "%s: no free connection slot for the resolver", __FUNCTION__);
+        return -1;
+    }
+    cbuf->disp = OK;
+    cbuf->state = RESOLVER_PIPE;
+
+    if (pktevent_add(cbuf) < 0) {
+        vmdb(MSG_ERR, "%s: couldn't watch the resolver", __FUNCTION__);
+        cbuf_release(cbuf);
+        return -1;
+    }
+    return 0;
+}
+
+/* look up the host name of the client in slot s. the answer (or
+ * "[addr]" if there isn't one) goes to the resolved callback, from
+ * the event loop. without resolver threads the callback is called
+ * before this returns.
+ *
+ * returns -1 if it can't be looked up at all.
+ */
+int pktserv_resolve(int s)
+{
+    cbuf_t *cbuf = cbuf_from_slot(s);
+    struct sockaddr_storage rs;
+    socklen_t rs_size = sizeof(rs);
+    char name[PKTRESOLVE_NAMELEN];
+
+    if (cbuf == NULL || cbuf->state == DISCONNECTED)
+        return -1;
+
+    if (getpeername(cbuf->fd, (struct sockaddr *)&rs, &rs_size) < 0) {
+        vmdb(MSG_ERR, "%s: getpeername failed for fd%d", __FUNCTION__, cbuf->fd);
+        return -1;
+    }
+
+    /* a client we've seen lately doesn't need to wait on a thread */
+    if (getsockaddrcached((struct sockaddr *)&rs, rs_size, name, sizeof(name)) == 0) {
+        if (g_pktserv_cb.resolved)
+            g_pktserv_cb.resolved(s, name);
+        return 0;
+    }
+
+    if (pktresolve_request(s, cbuf->gen, (struct sockaddr *)&rs, rs_size) == 0)
+        return 0;
+
+    getsockaddrname((struct sockaddr *)&rs, rs_size, name, sizeof(name));
+    if (g_pktserv_cb.resolved)
+        g_pktserv_cb.resolved(s, name);
+    return 0;
+}
+
+/* the file descriptor behind a slot id, or -1 if there isn't one */
+int pktserv_getfd(int s)
+{
+    cbuf_t *cbuf = cbuf_from_slot(s);
+
+    if (cbuf == NULL)
+        return -1;
+    return cbuf->fd;
+}
+
+
 /* 
- * The main server loop. Polls the set of file descriptors looking for 
- * activity in the pollfdset. If there is, it gets handed off to 
- * handle_pollfds().
+ * The main server loop. Waits on the event backend for activity on
+ * the set of file descriptors. Each one with activity gets handed off
+ * to handle_pollfd().
  *
- * If there is no activity after a period of time, handle_idle() gets called.
- * This should be replaced by an event queue.
+ * The wait is bounded by the next deadline on the timer wheel, and
+ * whatever has expired gets run after each wakeup. The loop clock is
+ * read once per wakeup, so everything in one pass sees the same time.
+ * Packets sent along the way are written out in one go just before
+ * the next wait, and connections with input left over from the last
+ * pass get another turn before that.
  */
 void
 pktserv_run(void)
 {
     int ret;
-    long loopcount = 0;
-    int poll_timeout;
 
-    if (POLL_TIMEOUT < 0) 
-        poll_timeout = 0;
-    else
-        poll_timeout = POLL_TIMEOUT * 1000;
-
-#ifdef DEBUG
-    poll_timeout = -1; /* block indefinitely */
-#endif
+    pktclock_update();
+    pkttimer_init(&g_idle_timer, handle_idle, NULL);
+    pkttimer_schedule(&g_idle_timer, 0);
 
     for (;;) {
-        loopcount++;
+        run_backlog();
+        flush_dirty();
 
-        update_pollfd_events();
-        ret = poll(g_pollset, g_pollsetsize, poll_timeout); // millisec
+        /* don't sleep if there's input waiting to be handled */
+        ret = pktevent_wait(g_nbacklog > 0 ? 0 : pkttimer_next_timeout(),
+                            handle_pollfd); // millisec
         if (ret < 0) {
-            if (errno == EINTR)
-                ret = 0;
-            else
+            if (errno != EINTR)
                 vmdb(MSG_ERR, "%s: %s", __FUNCTION__, strerror(errno));
         }
 
-        if (ret > 0) {
-            handle_pollfds();
-        }
-
-        if (ret >= 0 || loopcount%10==0 ) {
-            loopcount = 0;
-            handle_idle();
-        }
+        pkttimer_run();
     }
 }
 
-int pktserv_addport(char *host_name, int port_number, int is_ssl)
+int pktserv_addport(char *host_name, int port_number, int is_ssl,
+                    pktserv_policy_t policy)
 {
     struct addrinfo hints, *res, *rp;
     char port_str[16];
     int one = 1;
     int s = -1;
     int flags;
+    cbuf_t *cbuf;
 
     snprintf(port_str, sizeof(port_str), "%d", port_number);
 
@@ -611,9 +1019,10 @@ int pktserv_addport(char *host_name, int port_number, int is_ssl)
         return(-1);
     }
 
-    /* Don't close on exec */
+    /* close on exec. a restarted server has it handed over (see
+     * pktserv_handoff()) rather than inheriting it. */
     flags = fcntl(s, F_GETFD, 0);
-    flags = flags & ~ FD_CLOEXEC;
+    flags = flags | FD_CLOEXEC;
     if (fcntl(s, F_SETFD, flags) < 0) {
         vmdb(MSG_ERR, "%s: fcntl(FD_CLOEXEC)", __FUNCTION__);
         exit (-1);
@@ -625,26 +1034,29 @@ int pktserv_addport(char *host_name, int port_number, int is_ssl)
         vmdb(MSG_ERR, "%s: setsockopt(SO_SNDBUF)", __FUNCTION__);
     }
 
-    /* Check bounds: file descriptor must be < MAX_USERS to use as array index */
-    if (s >= MAX_USERS) {
-        vmdb(MSG_ERR, "%s: file descriptor %d >= MAX_USERS (%d), cannot add listen port", __FUNCTION__, s, MAX_USERS);
+    if ((cbuf = cbuf_alloc(s)) == NULL) {
+        vmdb(MSG_ERR, "%s: no free connection slot for listen port fd%d", __FUNCTION__, s);
         close(s);
         return -1;
     }
 
     /* set this socket's state to be a non-blocked, unignored listen socket */
-    cbufs[s].disp = OK;
+    cbuf->disp = OK;
+    cbuf->policy = policy;
     if (is_ssl) {
-        cbufs[s].state = LISTEN_SOCKET_SSL;
+        cbuf->state = LISTEN_SOCKET_SSL;
     } else {
-        cbufs[s].state = LISTEN_SOCKET;
+        cbuf->state = LISTEN_SOCKET;
     }
 
-    vmdb(MSG_INFO, "%s: setting cbufs[%d].fd to %d", __FUNCTION__, s, s);
-    cbufs[s].fd = s;
+    vmdb(MSG_INFO, "%s: listen port fd%d is in slot %d", __FUNCTION__, s, cbuf->slot);
 
-    /* XXX error check this */
-    add_pollfd(s);
+    if (pktevent_add(cbuf) < 0) {
+        vmdb(MSG_ERR, "%s: couldn't watch listen port fd%d", __FUNCTION__, s);
+        cbuf_release(cbuf);
+        close(s);
+        return -1;
+    }
 
     /* allow us to handle problems gracefully */
     signal(SIGPIPE, SIG_IGN);
@@ -652,39 +1064,122 @@ int pktserv_addport(char *host_name, int port_number, int is_ssl)
     return s;
 }
 
-/* Send a packet to a client. adds a packet to a client's list of packets that
- * need to be sent, and then calls the lower networking calls to send them.
- *
- * if the client already has MAX_SENDPACKET_QUEUE packets waiting to go,
- * return -1.
+/* look up a slot we're about to queue len bytes for, making sure it
+ * can take them. a queue that looks full may just be one that hasn't
+ * been flushed yet, so give it a chance to drain first.
  *
+ * returns NULL if the packet can't be queued.
  */
-int pktserv_send(int s, char *pkt, size_t len)
+static cbuf_t *
+send_target(int s, const char *caller, size_t len, pktserv_prio_t prio)
 {
     cbuf_t *cbuf;
-    msgbuf_t *msgbuf;
 
-    /* XXX check this to be sure this socket makes sense */
-    cbuf = &(cbufs[s]);
+    cbuf = cbuf_from_slot(s);
+    if (cbuf == NULL || cbuf->state == DISCONNECTED) {
+        vmdb(MSG_ERR, "%s() called on unused slot %d", caller, s);
+        return NULL;
+    }
 
     if (cbuf->state == WANT_DISCONNECT || cbuf->state == WANT_RAW_DISCONNECT) {
-        vmdb(MSG_ERR, "%s() called on socket in DISCONNECT state", __FUNCTION__);
-        return -1;
+        vmdb(MSG_ERR, "%s() called on socket in DISCONNECT state", caller);
+        return NULL;
     }
 
+    if (cbuf->wbytes + len > g_out_hiwat && cbuf->dirty)
+        flush_cbuf(cbuf);
+
+    /* if we already have too much unwritten, bomb out */
+    if (cbuf->wbytes + len > g_out_limit) {
+        vmdb(MSG_DEBUG, "%s: fd%d already has %lu bytes in %d pending writes.",
+             caller, cbuf->fd, (unsigned long)cbuf->wbytes, cbuf->wlist_size);
+        g_out_drops++;
+        return NULL;
+    }
+
+    if (cbuf->wbytes + len > g_out_hiwat && !cbuf->backedup) {
+        vmdb(MSG_INFO, "fd%d: output backed up, %lu bytes in %d pending writes",
+             cbuf->fd, (unsigned long)cbuf->wbytes, cbuf->wlist_size);
+        cbuf->backedup = 1;
+        if (g_out_overflow & PKTSERV_OVERFLOW_PAUSE) {
+            cbuf->rpaused = 1;
+            pktevent_update(cbuf);
+        }
+    }
+
+    if (cbuf->backedup && prio == PKTSERV_PRIO_LOW &&
+        (g_out_overflow & PKTSERV_OVERFLOW_DROPLOW)) {
+        g_out_drops++;
+        return NULL;
+    }
+
+    return cbuf;
+}
+
+/* put a msgbuf on the end of a connection's write list, then either
+ * leave it for the end-of-loop flush or write it now, depending on the
+ * connection's policy.
+ *
+ * returns -1 if the connection failed.
+ */
+static int
+queue_msgbuf(cbuf_t *cbuf, msgbuf_t *msgbuf)
+{
+    msgbuf->queued = pktclock_ms();
+    TAILQ_INSERT_TAIL(&(cbuf->wlist), msgbuf, entries);
+    cbuf->wlist_size++;
+    cbuf->wbytes += msgbuf->len;
+
+    if (cbuf->policy != PKTSERV_POLICY_IMMEDIATE && mark_dirty(cbuf) == 0)
+        return 0;
+
     cbuf->state = WANT_WRITE;
 
+    if (pktsocket_write(cbuf) < 0) {
+        vmdb(MSG_WARN, "%s: fd%d, error sending packet.", __FUNCTION__, cbuf->fd);
+        cbuf->state = WANT_DISCONNECT;
+        pktevent_update(cbuf);
+        return -1;
+    }
+
+    /* if it didn't all go out, start watching for writeability */
+    pktevent_update(cbuf);
+
+    return 0;
+}
+
+/* Send a packet to a client. adds a packet to a client's list of packets that
+ * need to be sent. connections using PKTSERV_POLICY_IMMEDIATE have it
+ * written right away; for everyone else it goes out with the rest of
+ * the queue when the connection is flushed at the end of the loop.
+ *
+ * s is the client's slot id.
+ *
+ * if the client's output is over its limits (see pktserv_set_outlimits())
+ * the packet is refused, and -1 returned.
+ *
+ */
+int pktserv_send(int s, char *pkt, size_t len)
+{
+    return pktserv_send_prio(s, pkt, len, PKTSERV_PRIO_NORMAL);
+}
+
+/* pktserv_send(), for a packet that can be dropped if the client's
+ * falling behind when prio is PKTSERV_PRIO_LOW.
+ */
+int pktserv_send_prio(int s, char *pkt, size_t len, pktserv_prio_t prio)
+{
+    cbuf_t *cbuf;
+    msgbuf_t *msgbuf;
+
     vmdb(MSG_VERBOSE, "sendpacket: len=%d, pktlen=%d, pkt=\"%s\"", 
          len, (unsigned char)*pkt, pkt+1);
 
-    /* if we already have an unwritten message, bomb out */
-    if (cbuf->wlist_size >= MAX_SENDPACKET_QUEUE) {
-        vmdb(MSG_ERR, "%s: fd%d already has %d pending writes.", __FUNCTION__, cbuf->fd, cbuf->wlist_size);
+    if ((cbuf = send_target(s, __FUNCTION__, len, prio)) == NULL)
         return -1;
-    }
 
     /* allocate a write buffer */
-    msgbuf = _msgbuf_alloc(NULL, len);
+    msgbuf = _msgbuf_get(len);
     if (!msgbuf)
         return -1;
 
@@ -692,68 +1187,622 @@ int pktserv_send(int s, char *pkt, size_t len)
     msgbuf->len = len;
     msgbuf->pos = msgbuf->data;
 
-    if (TAILQ_EMPTY(&(cbuf->wlist))) {
-        TAILQ_INSERT_HEAD(&(cbuf->wlist), msgbuf, entries);
-    } else {
-        TAILQ_INSERT_TAIL(&(cbuf->wlist), msgbuf, entries);
-    }
-    cbuf->wlist_size++;
+    return queue_msgbuf(cbuf, msgbuf);
+}
 
-    cbuf->state = WANT_WRITE;
+/* Send the same packet to several clients. the packet is copied once,
+ * and each client's write list gets a reference to that one copy,
+ * which is freed after the last of them has written it out.
+ *
+ * targets are the clients' slot ids.
+ *
+ * returns -1 if it couldn't be queued to one or more of the targets
+ * (they're skipped, same as pktserv_send() would fail for them), or 0
+ * if it was queued to all of them.
+ */
+int pktserv_multicast(const int *targets, size_t n, const char *pkt, size_t len)
+{
+    return pktserv_multicast_prio(targets, n, pkt, len, PKTSERV_PRIO_NORMAL);
+}
 
-    if (pktsocket_write(cbuf) < 0) {
-        vmdb(MSG_WARN, "%s: fd%d, error sending packet.", __FUNCTION__, s);
-        cbuf->state = WANT_DISCONNECT;
+/* pktserv_multicast() with a priority, as for pktserv_send_prio() */
+int pktserv_multicast_prio(const int *targets, size_t n, const char *pkt,
+                           size_t len, pktserv_prio_t prio)
+{
+    cbuf_t *cbuf;
+    msgbuf_t *msgbuf;
+    msgpayload_t *payload;
+    size_t i;
+    int ret = 0;
+
+    if (n == 0)
+        return 0;
+
+    vmdb(MSG_VERBOSE, "multicast: %d targets, len=%d, pktlen=%d, pkt=\"%s\"", 
+         n, len, (unsigned char)*pkt, pkt+1);
+
+    payload = msgpayload_new(pkt, len);
+    if (!payload)
         return -1;
+
+    for (i = 0; i < n; i++) {
+        if ((cbuf = send_target(targets[i], __FUNCTION__, len, prio)) == NULL) {
+            ret = -1;
+            continue;
+        }
+
+        msgbuf = _msgbuf_share(payload);
+        if (!msgbuf) {
+            ret = -1;
+            continue;
+        }
+
+        if (queue_msgbuf(cbuf, msgbuf) < 0)
+            ret = -1;
     }
 
-    return 0;
+    /* drop our own reference. the write lists hold the rest. */
+    msgpayload_unref(payload);
+    return ret;
 }
 
 int pktserv_disconnect(int s) 
 {
     cbuf_t *cbuf;
 
-    /* XXX check this to be sure this socket makes sense */
-    cbuf = &(cbufs[s]);
+    cbuf = cbuf_from_slot(s);
+    if (cbuf == NULL || cbuf->state == DISCONNECTED)
+        return -1;
 
     cbuf->state = WANT_DISCONNECT;
+    pktevent_update(cbuf);
     return 0;
 }
 
-void pktserv_dumpsockets(FILE *dump)
+/* packet buffer pool counters: buffers handed out, buffers sitting on
+ * the free list, and the most ever handed out at once. any of the
+ * pointers may be NULL.
+ */
+void pktserv_bufstats(int *inuse, int *nfree, int *peak)
+{
+    msgpool_stats(inuse, nfree, peak);
+}
+
+/* start the peak buffer count over */
+void pktserv_bufstats_reset(void)
 {
+    msgpool_reset_peak();
+}
+
+/* how much output slot s has waiting: packets, bytes, and how long
+ * the oldest has been there. any of the pointers may be NULL.
+ *
+ * returns -1 if there's no such connection.
+ */
+int pktserv_outqueue(int s, int *depth, size_t *bytes, long *age_ms)
+{
+    cbuf_t *cbuf = cbuf_from_slot(s);
+
+    if (cbuf == NULL || cbuf->state == DISCONNECTED)
+        return -1;
+
+    if (depth)
+        *depth = cbuf->wlist_size;
+    if (bytes)
+        *bytes = cbuf->wbytes;
+    if (age_ms)
+        *age_ms = outqueue_age(cbuf, pktclock_ms());
+    return 0;
+}
+
+/* output queue counters across all connections: how many are backed
+ * up, the most bytes and the oldest packet any of them has waiting,
+ * and how many packets have been refused. any of the pointers may be
+ * NULL.
+ */
+void pktserv_outstats(int *nbacked, size_t *maxbytes, long *maxage_ms,
+                      unsigned long *drops)
+{
+    uint64_t now = pktclock_ms();
+    size_t mb = 0;
+    long ma = 0, age;
+    int i, nb = 0;
+
+    for (i = 1; i < cbufs_size; i++) {
+        if (cbufs[i]->state == DISCONNECTED)
+            continue;
+        if (cbufs[i]->backedup)
+            nb++;
+        if (cbufs[i]->wbytes > mb)
+            mb = cbufs[i]->wbytes;
+        age = outqueue_age(cbufs[i], now);
+        if (age > ma)
+            ma = age;
+    }
+
+    if (nbacked)
+        *nbacked = nb;
+    if (maxbytes)
+        *maxbytes = mb;
+    if (maxage_ms)
+        *maxage_ms = ma;
+    if (drops)
+        *drops = g_out_drops;
+}
+
+/* start the refused packet count over */
+void pktserv_outstats_reset(void)
+{
+    g_out_drops = 0;
+}
+
+/* size the reverse DNS cache and set how long it keeps answers, in
+ * milliseconds. negttl_ms is for addresses that didn't resolve. a
+ * size of 0 turns the cache off.
+ */
+void pktserv_set_dnscache(int size, long ttl_ms, long negttl_ms)
+{
+    pktdnscache_config(size, ttl_ms, negttl_ms);
+}
+
+/* reverse DNS cache counters: answers held, lookups answered from the
+ * cache, and lookups that had to go to the resolver. any of the
+ * pointers may be NULL.
+ */
+void pktserv_dnsstats(int *entries, unsigned long *hits, unsigned long *misses)
+{
+    pktdnscache_stats(entries, hits, misses);
+}
+
+/* start the cache hit and miss counts over */
+void pktserv_dnsstats_reset(void)
+{
+    pktdnscache_reset_stats();
+}
+
+/**************************************************************
+ * Restart handoff
+ *
+ * A restarting server hands its sockets to the new one over a Unix
+ * domain socket instead of leaving them lying around to be inherited
+ * by number. The stream is a header, then a record per connection
+ * with its fd attached (SCM_RIGHTS), each followed by the unhandled
+ * input and the unsent output the connection had, and finally the
+ * server's own state image. The new server answers with one byte
+ * once it's taken everything on, and only then does the old one go
+ * away; until that happens the old server still has everything, and
+ * carries on if the handoff fails.
+ *
+ * TLS connections can't be moved, since OpenSSL has no way to export
+ * a live session. pktserv_handoff_prepare() closes those down cleanly
+ * before the state is taken.
+ **************************************************************/
+
+#define HANDOFF_MAGIC   0x49434248  /* "ICBH" */
+#define HANDOFF_VERSION 1
+#define HANDOFF_ACK     'A'
+#define HANDOFF_TIMEOUT 10          /* seconds to wait on the other side */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nconns;
+    uint32_t statelen;
+} handoff_hdr_t;
+
+typedef struct {
+    int32_t slot;
+    int32_t state;          /* SocketState */
+    int32_t is_ssl;
+    int32_t policy;
+    uint32_t ilen;          /* bytes of input that follow */
+    uint32_t wlen;          /* bytes of output that follow */
+} handoff_conn_t;
+
+/* does this connection go to the new server? */
+static int
+handoff_movable(cbuf_t *cbuf)
+{
+    switch (cbuf->state) {
+        case DISCONNECTED:
+        case RESOLVER_PIPE:     /* close-on-exec; the new server makes its own */
+            return 0;
+        case LISTEN_SOCKET:
+        case LISTEN_SOCKET_SSL:
+            return 1;
+        default:
+            return !cbuf->is_ssl;
+    }
+}
+
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *)buf;
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, p, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int
+read_all(int fd, void *buf, size_t len)
+{
+    char *p = (char *)buf;
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = read(fd, p, len)) <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* send a record with an fd riding along with it */
+static int
+send_fd(int sock, const void *buf, size_t len, int fd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } cmsgbuf;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&cmsgbuf, 0, sizeof(cmsgbuf));
+    iov.iov_base = (void *)buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf.buf;
+    msg.msg_controllen = sizeof(cmsgbuf.buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    do {
+        n = sendmsg(sock, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return -1;
+
+    /* the fd went with the first byte. the rest can go plain. */
+    return write_all(sock, (const char *)buf + n, len - n);
+}
+
+/* receive a record sent by send_fd(). *fd is -1 if none came with it. */
+static int
+recv_fd(int sock, void *buf, size_t len, int *fd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } cmsgbuf;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    *fd = -1;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf.buf;
+    msg.msg_controllen = sizeof(cmsgbuf.buf);
+
+    do {
+        n = recvmsg(sock, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return -1;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    return read_all(sock, (char *)buf + n, len - n);
+}
+
+/* close a TLS connection down with a close_notify rather than just
+ * dropping it, and tell the server it's gone. */
+static void
+handoff_drop(cbuf_t *cbuf)
+{
+    struct linger linger;
+
+    if (g_pktserv_cb.lost_client)
+        g_pktserv_cb.lost_client(cbuf->slot);
+
+    handle_disconnect(cbuf);
+    sslsocket_shutdown(cbuf);
+
+    /* accepted connections are set to reset on close, which would
+     * throw the close_notify away */
+    linger.l_onoff = 0;
+    linger.l_linger = 0;
+    setsockopt(cbuf->fd, SOL_SOCKET, SO_LINGER, (char *)&linger, sizeof(linger));
+
+    handle_raw_disconnect(cbuf);
+}
+
+/* get ready to hand the server over: finish off anything that was on
+ * its way out, close the connections that can't be moved, and write
+ * out as much queued output as the sockets will take. call this before
+ * taking the state image, since it can change it.
+ */
+void pktserv_handoff_prepare(void)
+{
+    cbuf_t *cbuf;
     int i;
 
-    fprintf(dump, "%d\n", g_pollsetsize);
-    for (i = 0; i < g_pollsetsize; ++i) {
-        fprintf(dump, "%d\n", g_pollset[i].fd);
+    for (i = 1; i < cbufs_size; i++) {
+        cbuf = cbufs[i];
+        switch (cbuf->state) {
+            case DISCONNECTED:
+            case RESOLVER_PIPE:
+            case LISTEN_SOCKET:
+            case LISTEN_SOCKET_SSL:
+                break;
+
+            case WANT_DISCONNECT:
+                if (g_pktserv_cb.lost_client)
+                    g_pktserv_cb.lost_client(cbuf->slot);
+                handle_disconnect(cbuf);
+                handle_raw_disconnect(cbuf);
+                break;
+
+            case WANT_RAW_DISCONNECT:
+                handle_raw_disconnect(cbuf);
+                break;
+
+            default:
+                if (cbuf->is_ssl) {
+                    handoff_drop(cbuf);
+                } else if (cbuf->state == ACCEPTED) {
+                    /* introduce it now, so the state image has it */
+                    cbuf->state = WANT_HEADER;
+                    if (g_pktserv_cb.new_client)
+                        g_pktserv_cb.new_client(cbuf->slot, cbuf->is_ssl);
+                }
+                break;
+        }
     }
 
-    fprintf(dump, "%d\n", port_fd);
-    fprintf(dump, "%d\n", sslport_fd);
+    /* including whatever the above had to say about it */
+    flush_dirty();
 }
 
-/* I'm not sure this works. It'll probably work for regular sockets
- * if everything's flushed for that socket, but who knows. For SSL
- * sockets? It seems the SSL state would be all fubared.
+/* hand every movable connection and the server's state image over to
+ * the new server on the other end of sock, and wait for it to say it's
+ * taken over. nothing here is changed either way, so on failure the
+ * caller can just carry on.
  *
- * The fact that this *ever* worked (going back to 1988) is a complete
- * fluke as far as I know.
+ * returns 0 once the new server has everything, -1 if it didn't work.
  */
-void pktserv_loadsockets(FILE *dump)
+int pktserv_handoff(int sock, const char *state, size_t statelen)
 {
+    handoff_hdr_t hdr;
+    handoff_conn_t rec;
+    struct timeval tv;
+    msgbuf_t *msgbuf;
+    cbuf_t *cbuf;
+    size_t remain;
+    char ack;
     int i;
-    int k;
 
-    fscanf(dump, "%d\n", &k);
-    g_pollsetsize = k;
+    tv.tv_sec = HANDOFF_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv, sizeof(tv));
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = HANDOFF_MAGIC;
+    hdr.version = HANDOFF_VERSION;
+    hdr.statelen = (uint32_t)statelen;
+    for (i = 1; i < cbufs_size; i++) {
+        if (handoff_movable(cbufs[i]))
+            hdr.nconns++;
+    }
+
+    if (write_all(sock, &hdr, sizeof(hdr)) < 0)
+        goto fail;
+
+    for (i = 1; i < cbufs_size; i++) {
+        cbuf = cbufs[i];
+        if (!handoff_movable(cbuf))
+            continue;
+
+        memset(&rec, 0, sizeof(rec));
+        rec.slot = cbuf->slot;
+        rec.state = cbuf->state;
+        rec.is_ssl = cbuf->is_ssl;
+        rec.policy = cbuf->policy;
+        rec.ilen = (cbuf->ibuf != NULL) ? (uint32_t)cbuf->ilen : 0;
+        TAILQ_FOREACH(msgbuf, &(cbuf->wlist), entries)
+            rec.wlen += msgbuf->len - (msgbuf->pos - msgbuf->data);
+
+        if (send_fd(sock, &rec, sizeof(rec), cbuf->fd) < 0)
+            goto fail;
+
+        /* the first unhandled byte may be sitting in isaved, with the
+         * end of the packet being handled nulled over it */
+        if (rec.ilen > 0) {
+            if (cbuf->iheld) {
+                if (write_all(sock, &cbuf->isaved, 1) < 0 ||
+                    write_all(sock, cbuf->ibuf + cbuf->ihead + 1, rec.ilen - 1) < 0)
+                    goto fail;
+            } else if (write_all(sock, cbuf->ibuf + cbuf->ihead, rec.ilen) < 0) {
+                goto fail;
+            }
+        }
 
-    for (i = 0; i < g_pollsetsize; ++i) {
-        fscanf(dump, "%d\n", &k);
-        add_pollfd(k);
+        TAILQ_FOREACH(msgbuf, &(cbuf->wlist), entries) {
+            remain = msgbuf->len - (msgbuf->pos - msgbuf->data);
+            if (remain > 0 && write_all(sock, msgbuf->pos, remain) < 0)
+                goto fail;
+        }
     }
 
-    fscanf(dump, "%d\n", &port_fd);
-    fscanf(dump, "%d\n", &sslport_fd);
+    if (statelen > 0 && write_all(sock, state, statelen) < 0)
+        goto fail;
+
+    if (read_all(sock, &ack, 1) < 0 || ack != HANDOFF_ACK) {
+        vmdb(MSG_ERR, "%s: the new server didn't take over", __FUNCTION__);
+        return -1;
+    }
+
+    vmdb(MSG_INFO, "%s: handed over %u connections", __FUNCTION__, hdr.nconns);
+    return 0;
+
+fail:
+    vmdb(MSG_ERR, "%s: %s", __FUNCTION__, strerror(errno));
+    return -1;
+}
+
+/* take over from the old server on the other end of sock: pick up its
+ * connections, in the same slots, with their buffered input and
+ * output, and read its state image into *state (malloc'd, for the
+ * caller to free). call pktserv_takeover_done() once the state's been
+ * loaded to let the old server go.
+ *
+ * returns 0 on success, -1 if the takeover failed, in which case the
+ * old server is still running and this one should leave.
+ */
+int pktserv_takeover(int sock, char **state, size_t *statelen)
+{
+    handoff_hdr_t hdr;
+    handoff_conn_t rec;
+    msgbuf_t *msgbuf;
+    cbuf_t *cbuf;
+    char *buf;
+    uint32_t i;
+    int flags;
+    int fd;
+
+    *state = NULL;
+    *statelen = 0;
+
+    if (read_all(sock, &hdr, sizeof(hdr)) < 0) {
+        vmdb(MSG_ERR, "%s: no handoff from the old server", __FUNCTION__);
+        return -1;
+    }
+    if (hdr.magic != HANDOFF_MAGIC || hdr.version != HANDOFF_VERSION) {
+        vmdb(MSG_ERR, "%s: don't understand handoff version %u", __FUNCTION__,
+             hdr.version);
+        return -1;
+    }
+
+    for (i = 0; i < hdr.nconns; i++) {
+        if (recv_fd(sock, &rec, sizeof(rec), &fd) < 0 || fd < 0) {
+            vmdb(MSG_ERR, "%s: connection %u didn't come through", __FUNCTION__, i);
+            return -1;
+        }
+
+        flags = fcntl(fd, F_GETFD, 0);
+        if (flags >= 0)
+            fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+
+        /* nothing is queued past the send queue limit, so anything
+         * bigger means the stream is corrupt or from a stranger */
+        if (rec.ilen > PKT_INBUF_SZ || rec.wlen > g_out_limit + MAX_PKT_LEN ||
+            (cbuf = cbuf_claim(rec.slot, fd)) == NULL) {
+            vmdb(MSG_ERR, "%s: couldn't restore slot %d (fd%d)", __FUNCTION__,
+                 rec.slot, fd);
+            close(fd);
+            return -1;
+        }
+
+        cbuf->is_ssl = rec.is_ssl;
+        cbuf->policy = rec.policy;
+        cbuf->disp = OK;
+
+        if (rec.state == LISTEN_SOCKET || rec.state == LISTEN_SOCKET_SSL) {
+            cbuf->state = (SocketState)rec.state;
+        } else {
+            cbuf->state = WANT_HEADER;
+
+            if (rec.ilen > 0) {
+                cbuf->ibuf = (char *)malloc(PKT_INBUF_SZ + 1);
+                if (cbuf->ibuf == NULL ||
+                    read_all(sock, cbuf->ibuf, rec.ilen) < 0)
+                    return -1;
+                cbuf->ihead = 0;
+                cbuf->ilen = rec.ilen;
+                cbuf->iheld = 0;
+                cbuf->state = WANT_READ;
+
+                /* there may be whole packets in there already */
+                mark_backlogged(cbuf);
+            }
+
+            if (rec.wlen > 0) {
+                if ((msgbuf = _msgbuf_get(rec.wlen)) == NULL ||
+                    read_all(sock, msgbuf->data, rec.wlen) < 0)
+                    return -1;
+                msgbuf->len = rec.wlen;
+                msgbuf->queued = pktclock_ms();
+                TAILQ_INSERT_TAIL(&(cbuf->wlist), msgbuf, entries);
+                cbuf->wlist_size++;
+                cbuf->wbytes += rec.wlen;
+                mark_dirty(cbuf);
+            }
+        }
+
+        if (pktevent_add(cbuf) < 0) {
+            vmdb(MSG_ERR, "%s: couldn't watch slot %d (fd%d)", __FUNCTION__,
+                 rec.slot, fd);
+            return -1;
+        }
+    }
+
+    if ((buf = (char *)malloc(hdr.statelen + 1)) == NULL ||
+        read_all(sock, buf, hdr.statelen) < 0) {
+        vmdb(MSG_ERR, "%s: couldn't read the state image", __FUNCTION__);
+        free(buf);
+        return -1;
+    }
+    buf[hdr.statelen] = '\0';
+
+    *state = buf;
+    *statelen = hdr.statelen;
+    vmdb(MSG_INFO, "%s: took over %u connections", __FUNCTION__, hdr.nconns);
+    return 0;
+}
+
+/* tell the old server we've got it from here, so it can exit.
+ *
+ * returns -1 if it couldn't be told, in which case it will carry on
+ * and this server has to go.
+ */
+int pktserv_takeover_done(int sock)
+{
+    char ack = HANDOFF_ACK;
+    int ret;
+
+    ret = write_all(sock, &ack, 1);
+    close(sock);
+    return ret;
 }
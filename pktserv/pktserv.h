@@ -11,11 +11,49 @@
 
 #pragma once
 
+/* Connections are identified to the callbacks by a small integer slot
+ * id, not by their file descriptor. Slot ids start at 1 and are reused
+ * once a connection goes away.
+ */
 typedef void (pktserv_idle_cb)(int i);
 typedef void (pktserv_dispatch_cb)(int i, char *data);
 typedef void (pktserv_new_client_cb)(int i, int secure);
 typedef void (pktserv_lost_client_cb)(int i);
 typedef int  (pktserv_ok2read_cb)(int i);
+typedef void (pktserv_resolved_cb)(int i, const char *hostname);
+
+/* Event notification backends */
+typedef enum {
+    PKTSERV_BACKEND_DEFAULT,     /* epoll if it was compiled in, else poll */
+    PKTSERV_BACKEND_POLL,        /* portable poll() */
+    PKTSERV_BACKEND_EPOLL        /* Linux epoll() */
+} pktserv_backend_t;
+
+/* How a listen port's connections get their packets written. Under
+ * the deferred policies, packets sent while handling one batch of
+ * events are only queued, and each connection's queue is written out
+ * once at the end of the batch.
+ */
+typedef enum {
+    PKTSERV_POLICY_DEFERRED,     /* queue, then flush once per loop */
+    PKTSERV_POLICY_LOWLATENCY,   /* deferred, plus TCP_NODELAY */
+    PKTSERV_POLICY_IMMEDIATE     /* write each packet as it's sent */
+} pktserv_policy_t;
+
+/* What to do about a connection whose output is backing up, i.e. one
+ * with more than the high-water mark's worth of bytes waiting to go.
+ * It stays backed up until it drains to the low-water mark.
+ */
+typedef enum {
+    PKTSERV_OVERFLOW_DROPLOW = 0x01,  /* drop low priority packets to it */
+    PKTSERV_OVERFLOW_PAUSE   = 0x02   /* stop reading from it */
+} pktserv_overflow_t;
+
+/* Packet priorities, for deciding what to drop */
+typedef enum {
+    PKTSERV_PRIO_NORMAL,
+    PKTSERV_PRIO_LOW             /* chatter that can be lost under load */
+} pktserv_prio_t;
 
 /* Callback functions */
 typedef struct pktserv_cb_st {
@@ -24,18 +62,43 @@ typedef struct pktserv_cb_st {
     pktserv_new_client_cb        *new_client;
     pktserv_lost_client_cb       *lost_client;
     pktserv_ok2read_cb           *ok2read;
+    pktserv_resolved_cb          *resolved;
 } pktserv_cb_t;
 
 int pktserv_init(char *config, pktserv_cb_t *cb);
-int pktserv_addport(char *host_name, int port_number, int is_ssl);
+int pktserv_set_backend(pktserv_backend_t backend);
+const char *pktserv_backend_name(void);
+void pktserv_set_maxconns(int max);
+int pktserv_getfd(int s);
+int pktserv_set_resolvers(int nthreads);
+int pktserv_resolve(int s);
+int pktserv_addport(char *host_name, int port_number, int is_ssl,
+                    pktserv_policy_t policy);
+void pktserv_set_outlimits(size_t hiwat, size_t lowat, size_t limit,
+                           long deadline_ms, int overflow);
 int pktserv_send(int s, char *pkt, size_t len);
+int pktserv_send_prio(int s, char *pkt, size_t len, pktserv_prio_t prio);
+int pktserv_multicast(const int *targets, size_t n, const char *pkt, size_t len);
+int pktserv_multicast_prio(const int *targets, size_t n, const char *pkt,
+                           size_t len, pktserv_prio_t prio);
+int pktserv_outqueue(int s, int *depth, size_t *bytes, long *age_ms);
+void pktserv_outstats(int *nbacked, size_t *maxbytes, long *maxage_ms,
+                      unsigned long *drops);
+void pktserv_outstats_reset(void);
+void pktserv_set_dnscache(int size, long ttl_ms, long negttl_ms);
+void pktserv_dnsstats(int *entries, unsigned long *hits, unsigned long *misses);
+void pktserv_dnsstats_reset(void);
 int pktserv_disconnect(int s);
+void pktserv_bufstats(int *inuse, int *nfree, int *peak);
+void pktserv_bufstats_reset(void);
 
 
 void pktserv_run(void);
 
-void pktserv_dumpsockets(FILE *dump);
-void pktserv_loadsockets(FILE *dump);
+void pktserv_handoff_prepare(void);
+int pktserv_handoff(int sock, const char *state, size_t statelen);
+int pktserv_takeover(int sock, char **state, size_t *statelen);
+int pktserv_takeover_done(int sock);
 
 #ifdef HAVE_SSL
 #include <openssl/ssl.h>
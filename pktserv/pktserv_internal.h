@@ -22,7 +22,6 @@
 
 #include "pktbuffers.h"
 
-extern cbuf_t *cbufs;        /* user packet buffers. */
 
 #ifdef HAVE_SSL
 #include <openssl/ssl.h>
@@ -30,8 +29,6 @@ extern SSL_CTX *ctx;
 #endif
 
 
-int add_pollfd(int fd);
-void delete_pollfd(int fd);
 int _newconnect(int s, int is_ssl);
 int _readpacket(cbuf_t *cbuf);
 int _writepacket(cbuf_t* cbuf);
@@ -21,6 +21,9 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/file.h>
 #include <errno.h>
 #include <string.h>
@@ -34,6 +37,7 @@
 #include "pktserv_internal.h"
 #include "pktbuffers.h"
 #include "pktserv.h"
+#include "pktevent.h"
 #include "sslsocket.h"
 
 /* header length. right now it's just the length byte.
@@ -74,16 +78,6 @@ int pktsocket_accept(cbuf_t *listen_cbuf)
     }
     listen_cbuf->disp = OK;
 
-    /* Check bounds: file descriptor must be < MAX_USERS to use as array index */
-    if (ns >= MAX_USERS) {
-        vmdb(MSG_ERR, "pktsocket_accept: file descriptor %d >= MAX_USERS (%d), closing connection", ns, MAX_USERS);
-        close(ns);
-        return -1;
-    }
-
-    /* ok, got a new socket. point the cbuf to the new one's */
-    cbuf = &cbufs[ns];
-
     /* force occasional connection check */
     if (setsockopt(ns, SOL_SOCKET, SO_KEEPALIVE, (char *)&one, sizeof(one)) < 0)
     {
@@ -108,23 +102,36 @@ int pktsocket_accept(cbuf_t *listen_cbuf)
              strerror(errno));
     }
 
+    /* low-latency listeners turn off Nagle. their packets are already
+     * coalesced before they're written, so there's nothing to gain by
+     * having the kernel hold small writes back. */
+    if (listen_cbuf->policy == PKTSERV_POLICY_LOWLATENCY) {
+        one = 1;
+        if (setsockopt(ns, IPPROTO_TCP, TCP_NODELAY, (char *)&one, sizeof(one)) < 0) {
+            vmdb(MSG_WARN, "pktsocket_accept::setsockopt(TCP_NODELAY) - %s", 
+                 strerror(errno));
+        }
+    }
+
     /* make the socket non-blocking */
     if (fcntl(ns, F_SETFL, FNDELAY) < 0) {
         vmdb(MSG_WARN, "pktsocket_accept::fcntl(FNDELAY) - %s", strerror(errno));
+        close(ns);
         return -1;
     }
 
-    /* Don't close on exec */
+    /* close on exec, it gets handed over on a restart */
     flags = fcntl(ns, F_GETFD, 0);
-    flags = flags & ~ FD_CLOEXEC;
+    flags = flags | FD_CLOEXEC;
     fcntl(ns, F_SETFD, flags);
 
-    /* clear out the socket's cbuf */
-    memset(cbuf, 0, sizeof(cbuf_t));
-
-    /* we're starting with a new command */
-    cbuf->fd = ns;
-    cbuf->newmsg = 1;
+    /* ok, got a new socket. give it a slot (this clears it out and
+     * sets us up to start with a new command) */
+    if ((cbuf = cbuf_alloc(ns)) == NULL) {
+        vmdb(MSG_ERR, "pktsocket_accept: no free connection slot for fd%d, closing connection", ns);
+        close(ns);
+        return -1;
+    }
 
     /* set the new socket's state and disposition */
     if (listen_cbuf->state == LISTEN_SOCKET_SSL) {
@@ -134,15 +141,33 @@ int pktsocket_accept(cbuf_t *listen_cbuf)
         cbuf->state = ACCEPTED;
         cbuf->is_ssl = 0;
     }
+    cbuf->policy = listen_cbuf->policy;
     cbuf->disp = OK;
 
-    add_pollfd(cbuf->fd);
+    if (pktevent_add(cbuf) < 0) {
+        vmdb(MSG_WARN, "pktsocket_accept: couldn't watch fd%d, closing connection", ns);
+        cbuf_release(cbuf);
+        close(ns);
+        return -1;
+    }
 
     return 0;
 }
 
 
-/* read a packet of data into a cbuf's rbuf
+/* put back the byte we nulled out after the last packet handed out */
+static void
+inbuf_unhold(cbuf_t *cbuf)
+{
+    if (cbuf->iheld) {
+        cbuf->ibuf[cbuf->ihead] = cbuf->isaved;
+        cbuf->iheld = 0;
+    }
+}
+
+/* fill the cbuf's input buffer with as much as one read will get us.
+ * SSL connections keep reading while SSL has decrypted data waiting,
+ * since the socket won't show as readable for that.
  *
  * return 0 on success or non-critical error (like EWOULDBLOCK)
  * return -1 and set the cbuf state to WANT_DISCONNECT on error
@@ -150,31 +175,52 @@ int pktsocket_accept(cbuf_t *listen_cbuf)
 int pktsocket_read(cbuf_t *cbuf)
 {
     ssize_t result;
-    size_t remain;
+    size_t space;
+    int got = 0;
 
-    /* try to read the header unless we've already done that */
-    if (cbuf->state == WANT_HEADER) {
-
-        /* set up our packet buffer */
-        if ( (cbuf->rbuf = _msgbuf_alloc(cbuf->rbuf, MAX_PKT_LEN)) == NULL) {
+    if (cbuf->ibuf == NULL) {
+        /* one extra so there's always room for the null after a packet */
+        cbuf->ibuf = (char*)malloc(PKT_INBUF_SZ + 1);
+        if (cbuf->ibuf == NULL) {
             cbuf->state = WANT_DISCONNECT;
             return -1;
         }
+        cbuf->ihead = 0;
+        cbuf->ilen = 0;
+        cbuf->iheld = 0;
+    }
+
+    inbuf_unhold(cbuf);
+    if (cbuf->ilen == 0)
+        cbuf->ihead = 0;
+
+    /* slide what's left back to the front if there's not room for a
+     * full packet behind it. packets have to stay contiguous since
+     * they're handed out in place. */
+    if (cbuf->ihead > 0 &&
+        PKT_INBUF_SZ - (cbuf->ihead + cbuf->ilen) < MAX_PKT_LEN) {
+        memmove(cbuf->ibuf, cbuf->ibuf + cbuf->ihead, cbuf->ilen);
+        cbuf->ihead = 0;
+    }
+
+    do {
+        space = PKT_INBUF_SZ - (cbuf->ihead + cbuf->ilen);
+        if (space == 0)
+            break;  /* full of packets that haven't been handled yet */
 
-        /* read the packet header */
         if (cbuf->is_ssl) {
-            result = sslsocket_read(cbuf, cbuf->rbuf->data, PACKET_HEADER_LEN);
+            result = sslsocket_read(cbuf, cbuf->ibuf + cbuf->ihead + cbuf->ilen, space);
         } else {
-            result = read(cbuf->fd, cbuf->rbuf->data, PACKET_HEADER_LEN);
+            result = read(cbuf->fd, cbuf->ibuf + cbuf->ihead + cbuf->ilen, space);
         }
 
-        /* did we get an error or a partial read? */
+        /* did we get an error? */
         if (result < 0) {
-            if (errno == EWOULDBLOCK) {
-                /* incomplete read - sslsocket_read() will never return this. */
-                return 0;
+            if (!cbuf->is_ssl && (errno == EWOULDBLOCK || errno == EINTR)) {
+                /* nothing there - sslsocket_read() will never return this. */
+                break;
             }
-            vmdb(MSG_ERR, "fd%d%s: Couldn't read header packet.", cbuf->fd, 
+            vmdb(MSG_ERR, "fd%d%s: Couldn't read packet.", cbuf->fd, 
                  cbuf->is_ssl ? " (SSL)" : "");
             cbuf->state = WANT_DISCONNECT;
             return -1;
@@ -182,8 +228,12 @@ int pktsocket_read(cbuf_t *cbuf)
 
         if (result == 0) {
             if (cbuf->is_ssl) {
-                /* need a retry - read_ssl will have set the state */
-                return 0;
+                /* need a retry - sslsocket_read() will have set the
+                 * state, unless we've already got something to show
+                 * for this read */
+                if (!got)
+                    return 0;
+                break;
             } else {
                 /* EOF (closed connection) */
                 cbuf->state = WANT_DISCONNECT;
@@ -191,146 +241,229 @@ int pktsocket_read(cbuf_t *cbuf)
             }
         }
 
-        /* check to see if it's a valid packet header */
-        if (!VALID_PACKET_HEADER(cbuf->rbuf->data)) {
-            cbuf->state = WANT_DISCONNECT;
-            return -1;
-        }
+        cbuf->ilen += result;
+        got = 1;
+    } while (cbuf->is_ssl && sslsocket_pending(cbuf) > 0);
 
-        /* set our need-to-read size and scootch the pointer up 
-         * past the length byte 
-         */
-        cbuf->rbuf->len = (unsigned char)(*(cbuf->rbuf->data)) + 1;
-        cbuf->rbuf->pos++;
-        cbuf->newmsg = 0;
-
-        /*
-         * this is in case you've configured the server with
-         * the cbuf buffer size less than the maximum allowed
-         * by the size byte (255) in the protocol. not normal,
-         * but it's possible. the -1 is for the null we want to
-         * tack on at the end.
-         */
-        if ( cbuf->rbuf->len > (MAX_PKT_LEN-1) )
-        {
-            vmdb(MSG_ERR, 
-                 "fd#%d: sent oversized packet (%d>%d); terminating connection...",
-                 cbuf->fd, (size_t)(cbuf->rbuf->len), (MAX_PKT_LEN-1));
-            cbuf->state = WANT_DISCONNECT;
-            return -1;
-        }
-    }
+    vmdb(MSG_VERBOSE, "read_sock: fd%d has %d bytes buffered.", 
+         cbuf->fd, cbuf->ilen);
 
+    cbuf->state = (cbuf->ilen > 0) ? WANT_READ : WANT_HEADER;
+    return 0;
+}
 
-    /* ok, got the header */
+/* pull the next complete packet out of the cbuf's input buffer.
+ *
+ * returns a pointer to the packet, length byte first and null
+ * terminated, and sets the state to COMPLETE_PACKET. the packet lives
+ * in the input buffer, so it's only good until the next call to
+ * pktsocket_packet() or pktsocket_read().
+ *
+ * returns NULL if there isn't a complete packet buffered (the state
+ * is set to WANT_HEADER or WANT_READ), or if the client sent something
+ * bogus (the state is set to WANT_DISCONNECT).
+ */
+char *pktsocket_packet(cbuf_t *cbuf)
+{
+    char *pkt;
+    size_t len;
 
+    if (cbuf->ibuf == NULL || cbuf->ilen == 0) {
+        cbuf->state = WANT_HEADER;
+        return NULL;
+    }
 
-    /* read as much of the command packet as we can get */
-    remain = cbuf->rbuf->len - (cbuf->rbuf->pos - cbuf->rbuf->data);
-    if (cbuf->is_ssl) {
-        result = sslsocket_read(cbuf, cbuf->rbuf->pos, remain);
-    } else {
-        result = read(cbuf->fd, cbuf->rbuf->pos, remain);
+    inbuf_unhold(cbuf);
+
+    pkt = cbuf->ibuf + cbuf->ihead;
+
+    /* check to see if it's a valid packet header */
+    if (!VALID_PACKET_HEADER(pkt)) {
+        cbuf->state = WANT_DISCONNECT;
+        return NULL;
     }
 
-    /* did we get an error? */
-    if (result < 0) {
-        if (errno == EWOULDBLOCK) {
-            /* incomplete read - read_ssl() will never return this. */
-            cbuf->state = WANT_READ;
-            return 0;
-        }
-        vmdb(MSG_ERR, "fd%d%s: Couldn't read packet body.", cbuf->fd, 
-             cbuf->is_ssl ? " (SSL)" : "");
+    /* the length byte doesn't count itself */
+    len = (unsigned char)(*pkt) + PACKET_HEADER_LEN;
+
+    /*
+     * this is in case you've configured the server with
+     * the cbuf buffer size less than the maximum allowed
+     * by the size byte (255) in the protocol. not normal,
+     * but it's possible. the -1 is for the null we want to
+     * tack on at the end.
+     */
+    if (len > (MAX_PKT_LEN-1)) {
+        vmdb(MSG_ERR, 
+             "fd#%d: sent oversized packet (%d>%d); terminating connection...",
+             cbuf->fd, len, (MAX_PKT_LEN-1));
         cbuf->state = WANT_DISCONNECT;
-        return -1;
+        return NULL;
     }
 
-    if (result == 0) {
-        if (cbuf->is_ssl) {
-            /* need a retry - read_ssl() will have set the state */
-            return 0;
-        } else {
-            /* EOF (closed connection) */
-            cbuf->state = WANT_DISCONNECT;
-            return -1;
-        }
+    if (cbuf->ilen < len) {
+        /* the packet is still incomplete */
+        cbuf->state = WANT_READ;
+        return NULL;
     }
 
+    cbuf->ihead += len;
+    cbuf->ilen -= len;
 
-    /* advance read pointer */
-    cbuf->rbuf->pos += result;
+    /* nail down the end of the packet. that's the first byte of the
+     * next one (if there is one), so hang onto it. */
+    cbuf->isaved = pkt[len];
+    cbuf->iheld = 1;
+    pkt[len] = '\0';
 
-    if ((remain - result) == 0) {
-        cbuf->state = COMPLETE_PACKET;
+    vmdb(MSG_VERBOSE, "read_sock: len=%d, pktlen=%d, pkt=\"%s\"", 
+         len, (unsigned char)*pkt, pkt+1);
 
-        /* nail down the end of the read string */
-        *(cbuf->rbuf->pos) = '\0';
+    cbuf->state = COMPLETE_PACKET;
+    return pkt;
+}
 
-        vmdb(MSG_VERBOSE, "read_sock: len=%d, pktlen=%d, pkt=\"%s\"", 
-             cbuf->rbuf->len, (unsigned char)*(cbuf->rbuf->data), (cbuf->rbuf->data)+1);
 
-    } else {
-        /* the packet is still incomplete */
-        cbuf->state = WANT_READ;
-    }
 
+/* most packets we'll hand to a single writev() */
+#define PKT_IOV_MAX          64
+
+/* most bytes we'll coalesce into a single SSL_write(). this is the
+ * largest TLS record, so it all goes out as one record.
+ */
+#define SSL_COALESCE_MAX     16384
+
+/* drop len bytes off the front of the write list. fully sent msgbufs
+ * are freed, and a partially sent one has its position advanced.
+ *
+ * returns 1 if a partially sent msgbuf is left at the head, 0 otherwise.
+ */
+static int
+wlist_consume(cbuf_t *cbuf, size_t len)
+{
+    msgbuf_t *msgbuf;
+    size_t remain;
+
+    while (len > 0 && (msgbuf = TAILQ_FIRST(&(cbuf->wlist))) != NULL) {
+        remain = msgbuf->len - (msgbuf->pos - msgbuf->data);
+        if (len < remain) {
+            msgbuf->pos += len;
+            cbuf->wbytes -= len;
+            return 1;
+        }
+        len -= remain;
+        cbuf->wbytes -= remain;
+
+        TAILQ_REMOVE(&(cbuf->wlist), msgbuf, entries);
+        cbuf->wlist_size--;
+        _msgbuf_free(msgbuf);
+    }
     return 0;
 }
 
+/* merge the unsent packets at the head of the write list into a single
+ * msgbuf so they can go out in one SSL_write(). leaves the list alone
+ * if the head has already been partly handed to SSL_write(), since a
+ * retry has to be made with the same data.
+ */
+static void
+wlist_coalesce(cbuf_t *cbuf)
+{
+    msgbuf_t *head, *msgbuf, *next, *merged;
+    size_t total = 0;
+    int count = 0;
+
+    head = TAILQ_FIRST(&(cbuf->wlist));
+    if (head == NULL || head->pos != head->data || cbuf->retries > 0)
+        return;
+
+    for (msgbuf = head; msgbuf != NULL; msgbuf = TAILQ_NEXT(msgbuf, entries)) {
+        if (total + msgbuf->len > SSL_COALESCE_MAX)
+            break;
+        total += msgbuf->len;
+        count++;
+    }
+    if (count < 2)
+        return;
+
+    merged = _msgbuf_alloc(NULL, total);
+    if (merged == NULL)
+        return; /* just send them one at a time */
+    merged->queued = head->queued;
+
+    for (msgbuf = head; count > 0; msgbuf = next, count--) {
+        next = TAILQ_NEXT(msgbuf, entries);
+        memcpy(merged->data + merged->len, msgbuf->data, msgbuf->len);
+        merged->len += msgbuf->len;
+        TAILQ_REMOVE(&(cbuf->wlist), msgbuf, entries);
+        cbuf->wlist_size--;
+        _msgbuf_free(msgbuf);
+    }
 
+    TAILQ_INSERT_HEAD(&(cbuf->wlist), merged, entries);
+    cbuf->wlist_size++;
+}
 
 /*
- * write a date from the cbuf's send list to socket file descriptor 
- *
- * returns -1 on connection gone, too many retries have been attempted,
- *    or there was some other serious problem.
- * returns 0 if write or partial write succeeded.
+ * write the cbuf's send list out to its socket. plaintext connections
+ * get as much of the list as will fit in one writev(); SSL connections
+ * get the queued packets coalesced into one record.
  *
- * Note: this currently tries to write everything from the cbuf's
- *   sendlist at once.
+ * returns -1 on connection gone or some other serious problem.
+ * returns 0 if write or partial write succeeded. a client that stops
+ *    reading is dealt with by the output queue limits, not here.
  */
 int pktsocket_write(cbuf_t* cbuf)
 {
-    int result;
+    ssize_t result;
     msgbuf_t *msgbuf;
-    size_t remain;
+    struct iovec iov[PKT_IOV_MAX];
+    size_t total;
+    int n;
 
     vmdb(MSG_VERBOSE, "writepacket: fd%d has %d packets in queue.", 
          cbuf->fd, cbuf->wlist_size);
 
-    /* XXX set a backoff timer and check it */
-    if (cbuf->retries > MAX_SENDPACKET_RETRIES) {
-        return -1;
-    }
-
     while (!TAILQ_EMPTY(&(cbuf->wlist))) {
-        msgbuf = (msgbuf_t*)TAILQ_FIRST(&(cbuf->wlist));
+        if (cbuf->is_ssl) {
+            wlist_coalesce(cbuf);
+            msgbuf = (msgbuf_t*)TAILQ_FIRST(&(cbuf->wlist));
+            total = msgbuf->len - (msgbuf->pos - msgbuf->data);
 
-        remain = msgbuf->len - (msgbuf->pos - msgbuf->data);
+            vmdb(MSG_VERBOSE, "writepacket: fd%d sending %d bytes....", 
+                 cbuf->fd, total);
 
-        vmdb(MSG_VERBOSE, "writepacket: fd%d sending %d bytes....", 
-             cbuf->fd, remain);
+            result = sslsocket_write(cbuf, msgbuf->pos, total);
 
-        if (cbuf->is_ssl) {
-            result = sslsocket_write(cbuf, msgbuf->pos, remain);
+            /* do we need an SSL retry? */
+            if (result == 0) {
+                cbuf->state = WANT_SSL_WRITE;
+                vmdb(MSG_VERBOSE, 
+                     "writepacket: fd%d needs an SSL retry.", cbuf->fd);
+                cbuf->retries++;
+                return 0;
+            }
         } else {
-            result = write(cbuf->fd, msgbuf->pos, remain);
-        }
+            n = 0;
+            total = 0;
+            TAILQ_FOREACH(msgbuf, &(cbuf->wlist), entries) {
+                if (n == PKT_IOV_MAX)
+                    break;
+                iov[n].iov_base = msgbuf->pos;
+                iov[n].iov_len = msgbuf->len - (msgbuf->pos - msgbuf->data);
+                total += iov[n].iov_len;
+                n++;
+            }
 
+            vmdb(MSG_VERBOSE, "writepacket: fd%d sending %d bytes in %d packets....", 
+                 cbuf->fd, total, n);
 
-        /* do we need an SSL retry? */
-        if (result == 0  && cbuf->is_ssl) {
-            cbuf->state = WANT_SSL_WRITE;
-            vmdb(MSG_VERBOSE, 
-                 "writepacket: fd%d needs an SSL retry.", cbuf->fd);
-            cbuf->retries++;
-            return 0;
+            result = writev(cbuf->fd, iov, n);
         }
 
         /* did we have an error? */
         if ( result < 0 ) {
-            if (errno == EWOULDBLOCK) {
+            if (!cbuf->is_ssl && (errno == EWOULDBLOCK || errno == EINTR)) {
                 /* incomplete write - write_ssl() will never return this. */
                 cbuf->state = WANT_WRITE;
                 cbuf->retries++;
@@ -343,31 +476,22 @@ int pktsocket_write(cbuf_t* cbuf)
             return -1;
         }
 
-        /* did we send the whole packet? */
-        if (result < remain) {
-            /* try again later with the remaining amount */
+        /* pop whatever went out off the list. if the kernel didn't take
+         * it all, try again later with the remaining amount */
+        if (wlist_consume(cbuf, (size_t)result) || (size_t)result < total) {
             cbuf->state = WANT_WRITE;
-            msgbuf->pos += result;
             vmdb(MSG_VERBOSE, 
-                 "writepacket: fd%d sent partial packet (%d bytes). will retry sending later.",
-                 cbuf->fd, result);
+                 "writepacket: fd%d sent partial write (%d bytes). will retry sending later.",
+                 cbuf->fd, (int)result);
             cbuf->retries++;
             return 0;
         } 
 
-
-        /* SUCCESS! pop the msgbuf off the stack and delete it */
-        TAILQ_REMOVE(&(cbuf->wlist), msgbuf, entries);
-        cbuf->wlist_size--;
-
-        free(msgbuf->data);
-        free(msgbuf);
-
         /* also reset the retries */
         cbuf->retries = 0;
 
-        vmdb(MSG_VERBOSE, "writepacket: fd%d sent packet. queue is now %d.",
-             cbuf->fd, cbuf->wlist_size);
+        vmdb(MSG_VERBOSE, "writepacket: fd%d sent %d bytes. queue is now %d.",
+             cbuf->fd, (int)result, cbuf->wlist_size);
     }
 
     cbuf->state = WANT_HEADER;
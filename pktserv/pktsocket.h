@@ -22,23 +22,31 @@
  */
 int pktsocket_accept(cbuf_t *listen_cbuf);
 
-/* read a packet of data into a cbuf's rbuf
+/* fill the cbuf's input buffer with as much as one read will get us
  *
  * return 0 on success or non-critical error (like EWOULDBLOCK)
- *          if the packet is complete, call s_packet with the cbuf.
  * return -1 and set the cbuf state to WANT_DISCONNECT on error
  */
 int pktsocket_read(cbuf_t *cbuf);
 
+/* pull the next complete packet out of the cbuf's input buffer
+ *
+ * returns the packet, length byte first and null terminated, and sets
+ *          the state to COMPLETE_PACKET. it points into the input
+ *          buffer, so it's only good until the next pktsocket_packet()
+ *          or pktsocket_read().
+ * returns NULL if there's no complete packet buffered, or with the
+ *          state set to WANT_DISCONNECT if the client sent garbage.
+ */
+char *pktsocket_packet(cbuf_t *cbuf);
+
 /*
- * write a date from the cbuf's send list to socket file descriptor 
+ * write the cbuf's send list out to its socket. plaintext connections
+ * get as much of the list as will fit in one writev(); SSL connections
+ * get the queued packets coalesced into one record.
  *
- * returns -1 on connection gone, too many retries have been attempted,
- *    or there was some other serious problem.
+ * returns -1 on connection gone or some other serious problem.
  * returns 0 if write or partial write succeeded.
- *
- * Note: this currently tries to write everything from the cbuf's
- *   sendlist at once.
  */
 int pktsocket_write(cbuf_t* cbuf);
 
@@ -46,8 +54,7 @@ int pktsocket_write(cbuf_t* cbuf);
  * list of packets that need to be sent, and then tries to call _sendpacket
  * to send 'em.
  *
- * if the client already has MAX_SENDPACKET_QUEUE packets waiting to go,
- * return -1.
+ * if the client's output queue is over its limits, return -1.
  *
  */
 int pktsocket_send(int s, char *pkt, size_t len);
@@ -0,0 +1,340 @@
+/*
+ * pkttimer.c
+ *
+ * hierarchical timer wheel for the packet server.
+ *
+ * The wheel has WHEEL_LEVELS levels of WHEEL_SIZE buckets each. Level 0
+ * buckets are one millisecond wide, and each level up is WHEEL_SIZE
+ * times coarser than the one below it. A timer goes into the lowest
+ * level whose span covers its delay. Whenever the level 0 index wraps,
+ * the next bucket of level 1 gets "cascaded": its timers are re-filed
+ * into level 0, and so on up the levels.
+ *
+ * Scheduling and cancelling are O(1). Running the wheel costs one step
+ * per occupied millisecond plus one per WHEEL_SIZE ms of elapsed time,
+ * and a timer gets re-filed at most once per level, so the cost tracks
+ * the number of timers that expire rather than the number that exist.
+ *
+ * Author: Michel Hoche-Mong
+ * Copyright (c) 2001-2026 Michel Hoche-Mong
+ * All rights reserved.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <limits.h>
+#include <time.h>
+
+#include "bsdqueue.h"
+#include "pkttimer.h"
+#include "pktclock.h"
+
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS    5
+#define WHEEL_SPAN      ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+#define LEVEL_SHIFT(l)  (WHEEL_BITS * (l))
+#define LEVEL_INDEX(when, l) (int)(((when) >> LEVEL_SHIFT(l)) & WHEEL_MASK)
+
+static uint64_t loop_ms(void);
+
+static struct pkttimer_list g_wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t g_occupied[WHEEL_LEVELS];  /* bitmap of non-empty buckets */
+static struct pkttimer_list g_expired;     /* timers being fired */
+static uint64_t g_wheel_time;  /* next tick to be processed */
+static int g_npending = 0;
+static int g_initialized = 0;
+static int g_running = 0;
+static pkttimer_clock *g_clock = loop_ms;
+
+
+/* the wheel is only used from the loop thread, so it runs on the loop
+ * clock. until the loop has read that there's nothing to go on, and
+ * starting the wheel at 0 would have it grind through every tick
+ * since boot on its first run. */
+static uint64_t
+loop_ms(void)
+{
+    if (g_pktclock.mono.tv_sec == 0 && g_pktclock.mono.tv_nsec == 0)
+        pktclock_update();
+    return pktclock_ms();
+}
+
+/* index of the lowest set bit. v must be non-zero. */
+static int
+lowbit(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int i = 0;
+
+    while (!(v & 1)) {
+        v >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+static void
+wheel_setup(void)
+{
+    int l, i;
+
+    if (g_initialized)
+        return;
+
+    for (l = 0; l < WHEEL_LEVELS; l++) {
+        for (i = 0; i < WHEEL_SIZE; i++)
+            TAILQ_INIT(&g_wheel[l][i]);
+        g_occupied[l] = 0;
+    }
+    TAILQ_INIT(&g_expired);
+    g_wheel_time = g_clock();
+    g_initialized = 1;
+}
+
+/* file a timer into the bucket matching its expiry */
+static void
+wheel_insert(pkttimer_t *t)
+{
+    uint64_t delta;
+    int level, idx;
+
+    if (t->expires < g_wheel_time)
+        t->expires = g_wheel_time;
+
+    delta = t->expires - g_wheel_time;
+    if (delta >= WHEEL_SPAN) {
+        delta = WHEEL_SPAN - 1;
+        t->expires = g_wheel_time + delta;
+    }
+
+    for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+        if (delta < ((uint64_t)1 << LEVEL_SHIFT(level + 1)))
+            break;
+    }
+
+    idx = LEVEL_INDEX(t->expires, level);
+    TAILQ_INSERT_TAIL(&g_wheel[level][idx], t, entries);
+    t->bucket = &g_wheel[level][idx];
+    g_occupied[level] |= (uint64_t)1 << idx;
+}
+
+static void
+wheel_remove(pkttimer_t *t)
+{
+    struct pkttimer_list *b = t->bucket;
+    int off;
+
+    TAILQ_REMOVE(b, t, entries);
+    t->bucket = NULL;
+
+    if (b != &g_expired && TAILQ_EMPTY(b)) {
+        off = (int)(b - &g_wheel[0][0]);
+        g_occupied[off / WHEEL_SIZE] &= ~((uint64_t)1 << (off % WHEEL_SIZE));
+    }
+}
+
+/* re-file everything in one bucket of a higher level */
+static void
+cascade(int level, int idx)
+{
+    struct pkttimer_list tmp;
+    pkttimer_t *t;
+
+    if (!(g_occupied[level] & ((uint64_t)1 << idx)))
+        return;
+
+    TAILQ_INIT(&tmp);
+    TAILQ_CONCAT(&tmp, &g_wheel[level][idx], entries);
+    g_occupied[level] &= ~((uint64_t)1 << idx);
+
+    while ((t = TAILQ_FIRST(&tmp)) != NULL) {
+        TAILQ_REMOVE(&tmp, t, entries);
+        wheel_insert(t);
+    }
+}
+
+/* fire everything in a level 0 bucket */
+static void
+expire(int idx)
+{
+    pkttimer_t *t;
+
+    TAILQ_CONCAT(&g_expired, &g_wheel[0][idx], entries);
+    g_occupied[0] &= ~((uint64_t)1 << idx);
+    TAILQ_FOREACH(t, &g_expired, entries)
+        t->bucket = &g_expired;
+
+    /* the callbacks are free to cancel or reschedule any timer,
+     * including the ones still waiting on g_expired, so pull them off
+     * one at a time.
+     */
+    while ((t = TAILQ_FIRST(&g_expired)) != NULL) {
+        wheel_remove(t);
+        g_npending--;
+        t->cb(t, t->arg);
+    }
+}
+
+void
+pkttimer_init(pkttimer_t *t, pkttimer_cb *cb, void *arg)
+{
+    t->bucket = NULL;
+    t->expires = 0;
+    t->cb = cb;
+    t->arg = arg;
+}
+
+void
+pkttimer_schedule(pkttimer_t *t, long ms)
+{
+    uint64_t now;
+
+    wheel_setup();
+
+    if (t->bucket != NULL) {
+        wheel_remove(t);
+        g_npending--;
+    }
+
+    now = g_clock();
+
+    /* an empty wheel may not have been run in a while. bring it up to
+     * date so we don't have to walk all that dead time later. */
+    if (g_npending == 0)
+        g_wheel_time = now;
+
+    t->expires = now + (ms > 0 ? (uint64_t)ms : 0);
+    wheel_insert(t);
+    g_npending++;
+}
+
+void
+pkttimer_cancel(pkttimer_t *t)
+{
+    if (t->bucket == NULL)
+        return;
+
+    wheel_remove(t);
+    g_npending--;
+}
+
+int
+pkttimer_pending(const pkttimer_t *t)
+{
+    return t->bucket != NULL;
+}
+
+void
+pkttimer_run(void)
+{
+    uint64_t now, pending, next;
+    int idx, l, skip;
+
+    wheel_setup();
+    if (g_running)
+        return;
+    g_running = 1;
+
+    now = g_clock();
+    while (g_wheel_time <= now) {
+        if (g_npending == 0) {
+            g_wheel_time = now + 1;
+            break;
+        }
+
+        idx = LEVEL_INDEX(g_wheel_time, 0);
+        if (idx == 0) {
+            for (l = 1; l < WHEEL_LEVELS; l++) {
+                int i = LEVEL_INDEX(g_wheel_time, l);
+                cascade(l, i);
+                if (i != 0)
+                    break;
+            }
+        }
+
+        pending = g_occupied[0] >> idx;
+        if (pending == 0) {
+            /* nothing more at level 0 this time around. jump to the
+             * next cascade point. */
+            next = (g_wheel_time | WHEEL_MASK) + 1;
+            g_wheel_time = (next > now) ? now + 1 : next;
+            continue;
+        }
+
+        skip = lowbit(pending);
+        if (g_wheel_time + skip > now) {
+            g_wheel_time = now + 1;
+            break;
+        }
+        g_wheel_time += skip;
+        idx += skip;
+
+        g_wheel_time++;
+        expire(idx);
+    }
+
+    g_running = 0;
+}
+
+int
+pkttimer_next_timeout(void)
+{
+    uint64_t now, best, occ;
+    pkttimer_t *t;
+    int l, cur, start, idx;
+
+    if (g_npending == 0)
+        return -1;
+
+    best = UINT64_MAX;
+    for (l = 0; l < WHEEL_LEVELS; l++) {
+        occ = g_occupied[l];
+        if (occ == 0)
+            continue;
+
+        /* walk the buckets in time order. at level 0 that starts with
+         * the current tick. above that the current bucket has already
+         * been cascaded, so anything in it is a full turn away. */
+        cur = LEVEL_INDEX(g_wheel_time, l);
+        start = (l == 0) ? cur : ((cur + 1) & WHEEL_MASK);
+        if (start != 0)
+            occ = (occ >> start) | (occ << (WHEEL_SIZE - start));
+        idx = (start + lowbit(occ)) & WHEEL_MASK;
+
+        TAILQ_FOREACH(t, &g_wheel[l][idx], entries) {
+            if (t->expires < best)
+                best = t->expires;
+        }
+    }
+
+    now = g_clock();
+    if (best <= now)
+        return 0;
+    if (best - now > INT_MAX)
+        return INT_MAX;
+    return (int)(best - now);
+}
+
+uint64_t
+pkttimer_now(void)
+{
+    return g_clock();
+}
+
+void
+pkttimer_set_clock(pkttimer_clock *clock)
+{
+    g_clock = clock ? clock : loop_ms;
+    if (!g_initialized)
+        return;
+    if (g_npending == 0)
+        g_wheel_time = g_clock();
+}
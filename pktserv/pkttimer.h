@@ -0,0 +1,69 @@
+/*
+ * pkttimer.h
+ *
+ * hierarchical timer wheel for the packet server.
+ *
+ * Timers are embedded in the caller's own structures, so scheduling
+ * and cancelling never allocate. A zeroed pkttimer_t is a valid,
+ * unscheduled timer.
+ *
+ * Author: Michel Hoche-Mong
+ * Copyright (c) 2001-2026 Michel Hoche-Mong
+ * All rights reserved.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "bsdqueue.h"
+
+typedef struct pkttimer_st pkttimer_t;
+
+/* called when a timer expires. the timer is no longer pending when the
+ * callback runs, so it may reschedule itself.
+ */
+typedef void (pkttimer_cb)(pkttimer_t *t, void *arg);
+
+/* clock source, in milliseconds */
+typedef uint64_t (pkttimer_clock)(void);
+
+struct pkttimer_st {
+    TAILQ_ENTRY(pkttimer_st) entries;   /* bucket list entries */
+    struct pkttimer_list *bucket;       /* bucket we're on, NULL if idle */
+    uint64_t expires;                   /* when to fire, in ms */
+    pkttimer_cb *cb;
+    void *arg;
+};
+
+TAILQ_HEAD(pkttimer_list, pkttimer_st);
+
+/* set the callback and its argument. doesn't schedule anything. */
+void pkttimer_init(pkttimer_t *t, pkttimer_cb *cb, void *arg);
+
+/* fire the timer ms milliseconds from now. if it's already pending it
+ * gets moved. delays longer than the wheel can hold (about 12 days)
+ * are clamped.
+ */
+void pkttimer_schedule(pkttimer_t *t, long ms);
+
+/* unschedule the timer. harmless if it isn't pending. */
+void pkttimer_cancel(pkttimer_t *t);
+
+/* returns non-zero if the timer is scheduled */
+int pkttimer_pending(const pkttimer_t *t);
+
+/* fire everything that has expired */
+void pkttimer_run(void);
+
+/* milliseconds until the next timer expires, 0 if one already has, or
+ * -1 if nothing is scheduled. suitable as a poll() timeout.
+ */
+int pkttimer_next_timeout(void);
+
+/* current time on the wheel's clock, in milliseconds */
+uint64_t pkttimer_now(void);
+
+/* replace the clock (the loop clock by default). mostly for testing. */
+void pkttimer_set_clock(pkttimer_clock *clock);
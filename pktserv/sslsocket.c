@@ -46,6 +46,15 @@ int sslsocket_write(cbuf_t *cbuf, void* buf, size_t len)
     return -1;
 }
 
+int sslsocket_pending(cbuf_t *cbuf)
+{
+    return 0;
+}
+
+void sslsocket_shutdown(cbuf_t *cbuf)
+{
+}
+
 
 #else /* HAVE_SSL */
 
@@ -327,4 +336,28 @@ int sslsocket_write(cbuf_t *cbuf, void *buf, size_t nbytes)
 
 }
 
+/*
+ * number of decrypted bytes SSL is holding for a cbuf. the socket
+ * won't poll as readable for these, so they have to be read out
+ * before going back to wait.
+ */
+int sslsocket_pending(cbuf_t *cbuf)
+{
+    if (cbuf->ssl_con == NULL)
+        return 0;
+    return SSL_pending(cbuf->ssl_con);
+}
+
+/*
+ * send a close_notify on a connection that's about to be closed, so
+ * the client can tell it wasn't just cut off. this doesn't wait for
+ * the client's close_notify in return.
+ */
+void sslsocket_shutdown(cbuf_t *cbuf)
+{
+    if (cbuf->ssl_con == NULL)
+        return;
+    SSL_shutdown(cbuf->ssl_con);
+}
+
 #endif
@@ -20,4 +20,6 @@
 int sslsocket_accept(cbuf_t *cbuf);
 int sslsocket_read(cbuf_t *cbuf, void* buf, size_t len);
 int sslsocket_write(cbuf_t *cbuf, void* buf, size_t len);
+int sslsocket_pending(cbuf_t *cbuf);
+void sslsocket_shutdown(cbuf_t *cbuf);
 
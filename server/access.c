@@ -16,12 +16,14 @@
 #include "externs.h"
 #include "send.h"
 #include "users.h"
+#include "members.h"
 #include "mdb.h"
 #include "strutil.h"
 #include "unix.h"
 
 #include "s_commands.h"  /* for talk_report() */
 #include "icbdb.h"
+#include "timers.h"
 
 int setsecure(int forWhom, int secure, DBM *openDb)
 {
@@ -217,7 +219,7 @@ int nickwritemsg(int forWhom, char *user, char *message, DBM *openDb)
     icbdb_set (user, "nummsg", ICBDB_INT, &count);
 
     sendstatus(forWhom, "Message", "Text saved to file");
-    if ((i = find_user(user)) > 0) {
+    if ((i = find_user(user)) >= 0) {
         sprintf(line, "%s is logged in now.", u_tab[i].nickname);
         sendstatus(forWhom, "Warning", line);
         sprintf(line, "You have %d message", count);
@@ -511,12 +513,12 @@ int nickwrite(int forWhom, char *password, int verifyOnly, DBM *openDb)
                 {
                     g_tab[i].modtimeout = 0;
                     g_tab[i].mod = forWhom;
+                    group_timer_update(i);
                     memset(g_tab[i].missingmod, 0, MAX_NICKLEN);
                     sprintf(mbuf, "%s is the active moderator again.",
                             u_tab[forWhom].nickname);
-                    for (j = 1; j < MAX_REAL_USERS; j++)
-                        if ((strcasecmp(u_tab[j].group, g_tab[i].name)
-                             == 0) && (j != forWhom))
+                    for (j = members_first(i); j >= 0; j = members_next(j))
+                        if (j != forWhom && j != NICKSERV)
                             sendstatus(j, "Mod", mbuf);
                     sprintf(mbuf, "You are the moderator of group %s",
                             g_tab[i].name);
@@ -555,7 +557,7 @@ int nicklookup(int forWhom, const char *theNick, DBM *openDb)
 
     if (strlen(theNick) == 0)
     {
-        if ((forWhom > 0) && (forWhom < MAX_REAL_USERS))
+        if ((forWhom > NICKSERV) && (forWhom < max_users))
             sends_cmdout(forWhom, "Usage: whois nickname");
         return -1;
     }
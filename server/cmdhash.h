@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+/* the hash behind the command tables, shared by mkcmdtab.c, which
+ * picks the displacements at build time, and lookup.c, which uses
+ * them. it folds ASCII case the way strcasecmp() does.
+ *
+ * a name is found in a table of nkeys slots by
+ *
+ *     d = disp[cmdhash(name, 0) % nkeys];
+ *     slot = d < 0 ? -d - 1 : cmdhash(name, d) % nkeys;
+ *
+ * and confirmed with one strcasecmp() against what's in the slot.
+ */
+
+/* FNV-1a, started from a basis perturbed by d */
+static inline uint32_t
+cmdhash(const char *s, int32_t d)
+{
+    uint32_t h = (2166136261u ^ (uint32_t)d) * 16777619u;
+    unsigned char c;
+
+    for (; (c = (unsigned char)*s) != '\0'; s++) {
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        h = (h ^ c) * 16777619u;
+    }
+    return h;
+}
@@ -11,6 +11,7 @@
 #include "send.h"
 #include "msgs.h"
 #include "mdb.h"
+#include "timers.h"
 
 /* dispatch()
  *
@@ -26,7 +27,7 @@ void dispatch(int n, char *pkt)
     switch(*pkt) {
 
     case ICB_M_LOGIN:
-        if(n >= MAX_REAL_USERS) {
+        if(n >= max_users) {
             senderror(n, "ICB is full.");
             sendexit(n);
             pktserv_disconnect(n);
@@ -39,7 +40,7 @@ void dispatch(int n, char *pkt)
              * we set S_kill since we want to make sure
              * error msgs reach them before the disconnect
              */
-            S_kill[n]++;  
+            kill_user(n);
         }
         break;
 
@@ -17,9 +17,6 @@
 
 /* external definitions for "go" global variables */
 
-/* defined in split.c */
-extern char *fields[MAX_FIELDS];	/* split fields */
-
 /* global go variables settable with gorc */
 /* extern GLOBS gv; */
 	
@@ -28,27 +25,26 @@ extern char *pp;		/* packet pointer */
 extern char thishost[MAXHOSTNAMELEN+1];	/* our hostname */
 extern char *mbuf;
 extern time_t curtime;		/* current time */
-extern USER_ITEM u_tab[MAX_USERS];	/* user table */
+extern USER_ITEM *u_tab;	/* user table */
+extern int max_users;		/* how many slots it has */
+extern USER_HOT u_hot;		/* the much-scanned parts of it */
 extern GROUP_ITEM g_tab[MAX_GROUPS];	/* group table */
 
 /* lookup tables */
-/* commands */
-extern char *command_table[];
 /* status options */
 extern char *status_table[];
-/* automagic resident user commands */
-extern char *auto_table[];
+/* the commands are in commands.def */
 
 /* saved args for /restart */
 extern char **restart_argv;
 extern int restart_argc;
 
 /* if there is a connection to kill, else 0 */
-extern short S_kill[MAX_USERS];
+extern short *S_kill;
 
-extern int lpriv_id[MAX_USERS];
-extern int pong_req[MAX_USERS];
-extern struct timeval ping_time[MAX_USERS];
+extern int *lpriv_id;
+extern int *pong_req;
+extern struct timeval *ping_time;
 
 /* flags set in .gorc */
 extern int m_watchtime;		/* using boring time format */
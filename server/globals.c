@@ -18,7 +18,9 @@
 int debug_level;
 
 /* the world */
-USER_ITEM u_tab[MAX_USERS]; /* that many users possible */
+USER_ITEM *u_tab = NULL;    /* the users, max_users of them */
+int max_users = 0;          /* grown by users_grow() */
+USER_HOT u_hot;			/* and its hot fields, see server.h */
 GROUP_ITEM g_tab[MAX_GROUPS]; /* only one group for now */
 
 /* non-global definitions */
@@ -33,52 +35,12 @@ char thishost[MAXHOSTNAMELEN+1];/* our hostname */
 time_t curtime;			/* current time */
 char **restart_argv;		/* how we were invoked (for /restart) */
 int restart_argc;
-short S_kill[MAX_USERS];
-int lpriv_id[MAX_USERS];	/* last private message came from this id */
-int pong_req[MAX_USERS];
-struct timeval ping_time[MAX_USERS];
+short *S_kill = NULL;
+int *lpriv_id = NULL;	/* last private message came from this id */
+int *pong_req = NULL;
+struct timeval *ping_time = NULL;
 
-/* lookup tables */
-
-/* commands */
-const char *command_table[] =
-{
-    "drop",
-    "shutdown",
-    "wall",
-    "beep",
-    "cancel",
-    "g",
-    "invite",
-    "pass",
-    "boot",
-    "status",
-    "topic",
-    "motd",
-    "m",
-    "echoback",
-    "name",
-    "v",
-    "w",
-    "whereis",
-    "restart",
-    "news",
-    "hush",
-    "shush",
-    "s_help",
-    "exclude",
-    "shuttime",
-    "notify",
-    "talk",
-    "ping",
-    "nobeep",
-    "away",
-    "noaway",
-    "log",
-    "stats",
-    "brick",
-    (char *) 0
-};
+/* lookup tables; the commands are in commands.def */
 
 const char *status_table[] =
 {
@@ -101,28 +63,6 @@ const char *status_table[] =
     (char *) 0
 };
 
-const char *auto_table[] =
-{
-    "read",		/* read messages left for you */
-    "whois",	/* whois (lookup) */
-    "p",		/* register (loginid, nodeid, nickname, password) */
-    "rname",	/* set or change real name */
-    "write",	/* leave a message for someone */
-    "text",		/* text message */
-    "addr",		/* snailmail address */
-    "phone",	/* phone number */
-    "delete",	/* delete some item */
-    "info",		/* information on this service */
-    "help",		/* help for use of the service */
-    "?",		/* list this table */
-    "cp",		/* change password */
-    "email",	/* e-mail address */
-    "secure", 	/* Secure more secure */
-    "nosecure", 	/* Secure less secure */
-    "www", 		/* www home pageinfo */
-    (char *) 0
-};
-
 /* flags set in .icbdrc */
 int m_whoheader = 1;	/* who header output */
 int m_groupheader = 1;	/* group header output */
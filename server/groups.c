@@ -6,6 +6,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "server.h"
@@ -14,12 +15,73 @@
 #include "externs.h"
 #include "mdb.h"
 #include "namelist.h"
+#include "nameindex.h"
+#include "timers.h"
+
+/* group name -> g_tab slot */
+static nameindex_t *group_index = NULL;
+
+/* which g_tab slots are empty, one bit each, so finding one doesn't
+ * mean a strlen() of every slot. the lowest is handed out first, as
+ * the scan did. */
+#define FREE_WORDS  ((MAX_GROUPS + 63) / 64)
+static uint64_t group_free[FREE_WORDS];
+
+static void
+mark_free(int n, int isfree)
+{
+    if (isfree)
+        group_free[n / 64] |= (uint64_t)1 << (n % 64);
+    else
+        group_free[n / 64] &= ~((uint64_t)1 << (n % 64));
+}
+
+/* index of the lowest set bit. v must be non-zero. */
+static int
+lowbit(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int i = 0;
+
+    while (!(v & 1)) {
+        v >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/* set the name of a group, or with "" empty its slot, keeping the
+ * name index and free slots up to date. */
+void set_group_name(int n, const char *name)
+{
+    size_t len = strnlen(name, MAX_GROUPLEN);
+
+    memmove(g_tab[n].name, name, len);
+    memset(g_tab[n].name + len, 0, MAX_GROUPLEN + 1 - len);
+    nameindex_set(group_index, n, g_tab[n].name);
+    mark_free(n, g_tab[n].name[0] == '\0');
+}
+
+/* rebuild the name index and free slots after the table has been
+ * filled in behind our back, as by icbload() */
+void index_groups(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_GROUPS; i++) {
+        nameindex_set(group_index, i, g_tab[i].name);
+        mark_free(i, g_tab[i].name[0] == '\0');
+    }
+}
 
 
 /* clear a particular group entry */
 void clear_group_item(int n)
 {
-    memset(g_tab[n].name, 0, MAX_GROUPLEN+1);
+    set_group_name(n, "");
     memset(g_tab[n].topic, 0, MAX_TOPICLEN+1);
     memset(g_tab[n].missingmod, 0, MAX_NICKLEN+1);
     g_tab[n].visibility = VISIBLE;
@@ -41,6 +103,7 @@ void clear_group_item(int n)
     g_tab[n].idleboot = DEF_IDLE_BOOT;
     memset(g_tab[n].idleboot_msg, 0, sizeof(g_tab[n].idleboot_msg));
     g_tab[n].idlemod = DEF_IDLE_MOD;
+    pkttimer_cancel(&g_tab[n].mod_timer);
 }
 
 /* initialize the entire group table */
@@ -48,6 +111,12 @@ void init_groups(void)
 {
     int i;
 
+    nameindex_free(group_index);
+    if ((group_index = nameindex_new(MAX_GROUPS, MAX_GROUPLEN)) == NULL) {
+        mdb(MSG_ERR, "Cannot init group table");
+        exit(1);
+    }
+
     for (i=0; i<MAX_GROUPS; i++) {
         if ((g_tab[i].n_invites =
              (NAMLIST *) malloc(sizeof(NAMLIST))) == NULL) {
@@ -122,23 +191,16 @@ void init_groups(void)
  * name      groupname
  */
 
-int find_group(char *name)
+int find_group(const char *name)
 {
-    int result = -1;
-    int i;
-
-    /* don't attempt to find if null */
-    if (strlen(name) == 0)
-        return result;
+    return nameindex_find(group_index, name);
+}
 
-    /* search through table */
-    for (i=0; i<MAX_GROUPS; i++) {
-        if ( strcasecmp(g_tab[i].name, name) == 0) {
-            result = i;
-            break;
-        }
-    }
-    return result;
+/* the name of group gi, or "" for -1, the group of someone who isn't
+ * in one */
+const char *group_name(int gi)
+{
+    return gi < 0 ? "" : g_tab[gi].name;
 }
 
 /* find an empty slot in the group table
@@ -146,16 +208,12 @@ int find_group(char *name)
  */
 int find_empty_group(void)
 {
-    int result = -1;
     int i;
 
-    for (i=0; i<MAX_GROUPS; i++) {
-        if(strlen(g_tab[i].name) == 0) {
-            result = i;
-            break;
-        }
-    }
-    return result;
+    for (i = 0; i < FREE_WORDS; i++)
+        if (group_free[i] != 0)
+            return i * 64 + lowbit(group_free[i]);
+    return -1;
 }
 
 /* check the group table to see if user was mod of any
@@ -192,12 +250,13 @@ void fill_group_entry(int n,
                       int mod, 
                       int volume)
 {
-    strcpy( g_tab[n].name, name);
+    set_group_name(n, name);
     strcpy( g_tab[n].topic, topic);
 
     g_tab[n].visibility = visibility;
     g_tab[n].control = control;
     g_tab[n].volume = volume;
     g_tab[n].mod = mod;
+    group_timer_update(n);
 }
 
@@ -32,9 +32,18 @@ void init_groups(void);
  */
 
 
-int find_group(char *name);
+int find_group(const char *name);
 
 
+/* the name of group gi, or "" for -1 */
+const char *group_name(int gi);
+
+/* set the name of a group, or with "" empty its slot */
+void set_group_name(int n, const char *name);
+
+/* rebuild the group name index and free slots from the group table */
+void index_groups(void);
+
 /* find an empty slot in the group table
  * return that index if found, -1 otherwise 
  */
@@ -0,0 +1,284 @@
+/* who hushes whom, as bitsets over the user slots, see hushset.h
+ *
+ * Each slot that hushes anyone has one allocation holding its open
+ * bitset followed by its personal one. A slot that has hush lists but
+ * didn't get a row, because the cap was reached, is marked "over" and
+ * is matched the slow way until its lists next change. The slots with
+ * rows are also kept in a dense list, so a change of name only looks
+ * at them.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "server.h"
+#include "externs.h"
+#include "namelist.h"
+#include "hushset.h"
+#include "mdb.h"
+
+static int h_nslots = 0;
+static int h_words = 0;             /* uint64_t in one bitset */
+static size_t h_maxbytes = 0;
+static int h_maxrows = 0;
+static int h_nrows = 0;
+
+static uint64_t **h_rows = NULL;    /* slot -> its bitsets, or NULL */
+static unsigned char *h_over = NULL;    /* slot -> has lists but no row */
+static int *h_list = NULL;          /* the h_nrows slots with rows */
+static int *h_pos = NULL;           /* slot -> where in h_list, or -1 */
+
+#define ROW(r, which)   (h_rows[r] + (which) * h_words)
+
+static void
+free_all(void)
+{
+    int i;
+
+    if (h_rows)
+        for (i = 0; i < h_nslots; i++)
+            free(h_rows[i]);
+    free(h_rows);
+    free(h_over);
+    free(h_list);
+    free(h_pos);
+    h_rows = NULL;
+    h_over = NULL;
+    h_list = h_pos = NULL;
+    h_nslots = h_words = h_maxrows = h_nrows = 0;
+}
+
+/* the per-slot arrays for nslots, the new slots with no row */
+static int
+alloc_slots(int nslots)
+{
+    uint64_t **rows;
+    unsigned char *over;
+    int *list, *pos;
+    int i;
+
+    if ((rows = (uint64_t **)realloc(h_rows, nslots * sizeof(uint64_t *))) == NULL)
+        return -1;
+    h_rows = rows;
+    if ((over = (unsigned char *)realloc(h_over, nslots)) == NULL)
+        return -1;
+    h_over = over;
+    if ((list = (int *)realloc(h_list, nslots * sizeof(int))) == NULL)
+        return -1;
+    h_list = list;
+    if ((pos = (int *)realloc(h_pos, nslots * sizeof(int))) == NULL)
+        return -1;
+    h_pos = pos;
+
+    for (i = h_nslots; i < nslots; i++) {
+        h_rows[i] = NULL;
+        h_over[i] = 0;
+        h_pos[i] = -1;
+    }
+    return 0;
+}
+
+static void
+set_size(int nslots)
+{
+    h_nslots = nslots;
+    h_words = (nslots + 63) / 64;
+    h_maxrows = (int)(h_maxbytes / (2 * h_words * sizeof(uint64_t)));
+}
+
+int
+hushset_init(int nslots, size_t maxbytes)
+{
+    free_all();
+
+    if (alloc_slots(nslots) < 0) {
+        vmdb(MSG_ERR, "%s: no memory for %d slots", __FUNCTION__, nslots);
+        free_all();
+        return -1;
+    }
+
+    h_maxbytes = maxbytes;
+    set_size(nslots);
+    return 0;
+}
+
+/* what r's lists say about the names in slot s */
+static int
+matches(int r, int s, int which)
+{
+    if (which == HUSH_OPEN)
+        return nlmatch(u_tab[s].uc_addr, u_tab[r].pub_s_hushed) ||
+               nlmatch(u_tab[s].uc_nick, u_tab[r].pub_n_hushed);
+    return nlmatch(u_tab[s].uc_addr, u_tab[r].pri_s_hushed) ||
+           nlmatch(u_tab[s].uc_nick, u_tab[r].pri_n_hushed);
+}
+
+static void
+set_bit(int r, int s, int which, int on)
+{
+    uint64_t *row = ROW(r, which);
+    uint64_t bit = (uint64_t)1 << (s & 63);
+
+    if (on)
+        row[s >> 6] |= bit;
+    else
+        row[s >> 6] &= ~bit;
+}
+
+static void
+add_row(int r, uint64_t *row)
+{
+    h_rows[r] = row;
+    h_pos[r] = h_nrows;
+    h_list[h_nrows++] = r;
+}
+
+static void
+drop_row(int r)
+{
+    if (h_rows[r]) {
+        free(h_rows[r]);
+        h_rows[r] = NULL;
+        h_nrows--;
+        h_list[h_pos[r]] = h_list[h_nrows];
+        h_pos[h_list[h_nrows]] = h_pos[r];
+        h_pos[r] = -1;
+    }
+}
+
+int
+hushset_grow(int nslots)
+{
+    uint64_t *row;
+    int old_nslots = h_nslots, old_words = h_words;
+    int i, r, s, nold;
+
+    if (nslots <= h_nslots)
+        return 0;
+
+    if (alloc_slots(nslots) < 0) {
+        vmdb(MSG_ERR, "%s: no memory for %d slots", __FUNCTION__, nslots);
+        return -1;
+    }
+    set_size(nslots);
+
+    /* the rows are wider now. copy what they have, and work out the
+     * new slots. whatever no longer fits goes over to matching. */
+    nold = h_nrows;
+    for (i = nold - 1; i >= 0; i--) {
+        r = h_list[i];
+        if (h_nrows > h_maxrows ||
+            !(row = (uint64_t *)calloc(2 * h_words, sizeof(uint64_t)))) {
+            drop_row(r);
+            h_over[r] = 1;
+            continue;
+        }
+        memcpy(row, h_rows[r], old_words * sizeof(uint64_t));
+        memcpy(row + h_words, h_rows[r] + old_words, old_words * sizeof(uint64_t));
+        free(h_rows[r]);
+        h_rows[r] = row;
+        for (s = old_nslots; s < nslots; s++) {
+            if (matches(r, s, HUSH_OPEN))
+                set_bit(r, s, HUSH_OPEN, 1);
+            if (matches(r, s, HUSH_PERSONAL))
+                set_bit(r, s, HUSH_PERSONAL, 1);
+        }
+    }
+    return 0;
+}
+
+void
+hushset_update_lists(int r)
+{
+    int s;
+
+    if (r < 0 || r >= h_nslots)
+        return;
+
+    h_over[r] = 0;
+    if (nlcount(*u_tab[r].pub_n_hushed) == 0 &&
+        nlcount(*u_tab[r].pub_s_hushed) == 0 &&
+        nlcount(*u_tab[r].pri_n_hushed) == 0 &&
+        nlcount(*u_tab[r].pri_s_hushed) == 0) {
+        drop_row(r);
+        return;
+    }
+
+    if (!h_rows[r]) {
+        uint64_t *row;
+
+        if (h_nrows >= h_maxrows ||
+            !(row = (uint64_t *)malloc(2 * h_words * sizeof(uint64_t)))) {
+            h_over[r] = 1;
+            return;
+        }
+        add_row(r, row);
+    }
+
+    memset(h_rows[r], 0, 2 * h_words * sizeof(uint64_t));
+    for (s = 0; s < h_nslots; s++) {
+        if (matches(r, s, HUSH_OPEN))
+            set_bit(r, s, HUSH_OPEN, 1);
+        if (matches(r, s, HUSH_PERSONAL))
+            set_bit(r, s, HUSH_PERSONAL, 1);
+    }
+}
+
+void
+hushset_update_names(int s)
+{
+    int i, r;
+
+    if (s < 0 || s >= h_nslots)
+        return;
+
+    for (i = 0; i < h_nrows; i++) {
+        r = h_list[i];
+        set_bit(r, s, HUSH_OPEN, matches(r, s, HUSH_OPEN));
+        set_bit(r, s, HUSH_PERSONAL, matches(r, s, HUSH_PERSONAL));
+    }
+}
+
+int
+hushset_hushes(int r, int s, int which)
+{
+    if (r >= 0 && r < h_nslots && s >= 0 && s < h_nslots) {
+        if (h_rows[r])
+            return (ROW(r, which)[s >> 6] >> (s & 63)) & 1;
+        if (!h_over[r])
+            return 0;
+    }
+    return matches(r, s, which);
+}
+
+#ifdef CHECK_INDEXES
+void
+hushset_check(void)
+{
+    int r, s, which;
+
+    for (r = 0; r < h_nslots; r++) {
+        if (!h_rows[r] && !h_over[r] &&
+            (nlcount(*u_tab[r].pub_n_hushed) > 0 ||
+             nlcount(*u_tab[r].pub_s_hushed) > 0 ||
+             nlcount(*u_tab[r].pri_n_hushed) > 0 ||
+             nlcount(*u_tab[r].pri_s_hushed) > 0)) {
+            vmdb(MSG_ERR, "hush index: %d has hush lists but no row", r);
+            abort();
+        }
+        if (!h_rows[r])
+            continue;
+        for (s = 0; s < h_nslots; s++)
+            for (which = HUSH_OPEN; which <= HUSH_PERSONAL; which++)
+                if (hushset_hushes(r, s, which) != matches(r, s, which)) {
+                    vmdb(MSG_ERR, "hush index: %d hushing %d (%d) is %d, lists say %d",
+                         r, s, which, hushset_hushes(r, s, which),
+                         matches(r, s, which));
+                    abort();
+                }
+    }
+}
+#endif
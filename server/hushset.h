@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+
+/* hush index
+ *
+ * for each user slot, which slots it hushes: two bitsets over the
+ * slots, one for open messages and one for personal ones, so checking
+ * a message against a recipient's hush lists is a bit test rather
+ * than four nlmatch() calls. bit s of slot r's bitset is what r's
+ * lists say about the uc_nick and uc_addr now in slot s.
+ *
+ * a slot with empty hush lists has no bitsets, so the memory goes
+ * with how many people use /hush rather than the square of the table
+ * size, and it's capped besides. a slot that doesn't fit under the
+ * cap has its lists matched by hushset_hushes() as before.
+ */
+
+#define HUSH_OPEN       0       /* pub_n_hushed, pub_s_hushed */
+#define HUSH_PERSONAL   1       /* pri_n_hushed, pri_s_hushed */
+
+/* (re)size the index for user slots 0..nslots-1, keeping at most
+ * maxbytes of bitsets, and empty it.
+ *
+ * returns 0, or -1 if there wasn't the memory
+ */
+int hushset_init(int nslots, size_t maxbytes);
+
+/* make room for user slots up to nslots-1, keeping the bitsets there
+ * are. they get wider, so some may no longer fit under the cap.
+ *
+ * returns 0, or -1 if there wasn't the memory
+ */
+int hushset_grow(int nslots);
+
+/* slot r's hush lists changed; work out who it hushes again */
+void hushset_update_lists(int r);
+
+/* slot s's uc_nick or uc_addr changed; work out who hushes it again */
+void hushset_update_names(int s);
+
+/* does slot r hush slot s, in HUSH_OPEN or HUSH_PERSONAL messages */
+int hushset_hushes(int r, int s, int which);
+
+#ifdef CHECK_INDEXES
+/* check every bitset against the lists, and abort() if one's wrong */
+void hushset_check(void);
+#endif
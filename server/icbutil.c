@@ -18,6 +18,9 @@
 #include "externs.h"
 #include "namelist.h"
 #include "users.h"
+#include "groups.h"
+#include "timers.h"
+#include "snapshot.h"
 #include "pktserv/pktserv.h" /* for pktserv_disconnect() */
 #include "mdb.h"
 
@@ -71,8 +74,8 @@ void icbexit(int sig)
     int user;
 
     mdb(MSG_ALL, "Someone told us to exit!");
-    for (user=0; user < MAX_REAL_USERS; user++) {
-        if (u_tab[user].login > LOGIN_FALSE) {
+    for (user=1; user < max_users; user++) {
+        if (u_hot.login[user] > LOGIN_FALSE) {
             pktserv_disconnect(user);
         }
     }
@@ -87,390 +90,93 @@ void icbexit(int sig)
  */
 void icbdump(int sig)
 {
-    FILE *dump;
-    int i, j, k;
-
     vmdb(MSG_ALL, "dumping current state to %s...", dumpfile);
-    if ((dump = fopen(dumpfile, "w")) == NULL) {
-        vmdb(MSG_ERR, "%s open: %s", dumpfile, strerror(errno));
+    if (snapshot_save_file(dumpfile) < 0)
         return;
-    }
-
-    pktserv_dumpsockets(dump);
-
-    for (i = 0; i < MAX_USERS; i++)
-        fprintf (dump, "%d\n", S_kill[i]);
-
-    for (i = 0; i < MAX_USERS; i++)
-    {
-        fprintf(dump, "%sX\n", u_tab[i].loginid);
-        fprintf(dump, "%sX\n", u_tab[i].nodeid);
-        fprintf(dump, "%sX\n", u_tab[i].nickname);
-        fprintf(dump, "%sX\n", u_tab[i].password);
-        fprintf(dump, "%sX\n", u_tab[i].realname);
-        fprintf(dump, "%sX\n", u_tab[i].group);
-        fprintf(dump, "%sX\n", u_tab[i].awaymsg);
-        fprintf(dump, "%d\n", u_tab[i].lastaway);
-        fprintf(dump, "%ld\n", u_tab[i].lastawaytime);
-        fprintf(dump, "%d\n", u_tab[i].login);
-        fprintf(dump, "%d\n", u_tab[i].echoback);
-        fprintf(dump, "%d\n", u_tab[i].nobeep);
-        fprintf(dump, "%ld\n", u_tab[i].perms);
-        fprintf(dump, "%d\n", u_tab[i].t_notify);
-        fprintf(dump, "%ld\n", u_tab[i].t_on);
-        fprintf(dump, "%ld\n", u_tab[i].t_sent);
-        fprintf(dump, "%ld\n", u_tab[i].t_recv);
-        fprintf(dump, "%ld\n", u_tab[i].t_group);
-        k = nlcount(*u_tab[i].pri_n_hushed);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(u_tab[i].pri_n_hushed));
-        k = nlcount(*u_tab[i].pub_n_hushed);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(u_tab[i].pub_n_hushed));
-        k = nlcount(*u_tab[i].pri_s_hushed);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(u_tab[i].pri_s_hushed));
-        k = nlcount(*u_tab[i].pub_s_hushed);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(u_tab[i].pub_s_hushed));
-        k = nlcount(*u_tab[i].n_notifies);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(u_tab[i].n_notifies));
-        k = nlcount(*u_tab[i].s_notifies);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(u_tab[i].s_notifies));
-    }
-
-    for (i = 0; i < MAX_GROUPS; i++)
-    {
-        fprintf(dump, "%sX\n", g_tab[i].name);
-        fprintf(dump, "%sX\n", g_tab[i].topic);
-        fprintf(dump, "%d\n", g_tab[i].visibility);
-        fprintf(dump, "%d\n", g_tab[i].control);
-        fprintf(dump, "%d\n", g_tab[i].mod);
-        fprintf(dump, "%ld\n", g_tab[i].modtimeout);
-        fprintf(dump, "%sX\n", g_tab[i].missingmod);
-        fprintf(dump, "%d\n", g_tab[i].volume);
-        k = nlcount(*g_tab[i].n_invites);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(g_tab[i].n_invites));
-        k = nlcount(*g_tab[i].nr_invites);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(g_tab[i].nr_invites));
-        k = nlcount(*g_tab[i].s_invites);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(g_tab[i].s_invites));
-        k = nlcount(*g_tab[i].sr_invites);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(g_tab[i].sr_invites));
-        k = nlcount(*g_tab[i].n_bars);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(g_tab[i].n_bars));
-        k = nlcount(*g_tab[i].n_nr_bars);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(g_tab[i].n_nr_bars));
-        k = nlcount(*g_tab[i].s_bars);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(g_tab[i].s_bars));
-        k = nlcount(*g_tab[i].s_nr_bars);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(g_tab[i].s_nr_bars));
-
-        k = nlcount(*g_tab[i].n_talk);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(g_tab[i].n_talk));
-
-        k = nlcount(*g_tab[i].nr_talk);
-        fprintf(dump, "%d\n", k);
-        if (k > 0)
-            for (j = 0; j < k; j++)
-                fprintf(dump, "%sX\n", nlget(g_tab[i].nr_talk));
-
-        fprintf(dump, "%d\n", g_tab[i].size);
-
-        fprintf(dump, "%d\n", g_tab[i].idleboot);
-        fprintf(dump, "%sX\n", g_tab[i].idleboot_msg);
-        fprintf(dump, "%d\n", g_tab[i].idlemod);
-
-    }
-
-    fclose(dump);
     mdb(MSG_ALL, "state dumped.");
 }
 
 /* icbload
  *
- * load a server state from a file created by icbdump
+ * load a server state from a file created by icbdump, or an old text
+ * one
  */
 void icbload(int sig)
 {
     FILE *dump;
-    int i,j;
-    long k;
-    char name[256], name2[256];
+    int ret;
 
     vmdb(MSG_ALL, "loading state from %s...", dumpfile);
-    if ((dump = fopen(dumpfile, "r")) == NULL) {
-        vmdb(MSG_ERR, "%s open: %s", dumpfile, strerror(errno));
-        return;
+    if ((ret = snapshot_load_file(dumpfile)) == SNAPSHOT_NOTSNAP) {
+        mdb(MSG_ALL, "not a snapshot, reading it as a text dump");
+        if ((dump = fopen(dumpfile, "r")) == NULL) {
+            vmdb(MSG_ERR, "%s open: %s", dumpfile, strerror(errno));
+            return;
+        }
+        ret = snapshot_load_text(dump);
+        fclose(dump);
     }
+    if (ret < 0)
+        return;
 
-    init_groups();
-    clear_users();
+    index_groups();
+    index_users();
+    unlink(dumpfile);
+    rearm_timers();
+    mdb(MSG_ALL, "state loaded.");
+}
 
-    pktserv_loadsockets(dump);
+/* icbconvert
+ *
+ * turn an old text dump into a snapshot in dumpfile
+ */
+int icbconvert(const char *textfile)
+{
+    FILE *dump;
+    int ret;
 
-    for (i = 0; i < MAX_USERS; i++) {
-        fscanf(dump, "%ld\n", &k);
-        S_kill[i] = k;
+    if ((dump = fopen(textfile, "r")) == NULL) {
+        fprintf(stderr, "icbd: %s: %s\n", textfile, strerror(errno));
+        return -1;
     }
 
-    for (i = 0; i < MAX_USERS; i++)
-    {
-        fgets(name, sizeof(name), dump);
-        strncpy(u_tab[i].loginid, name, strlen(name) - 2);
-        u_tab[i].loginid[strlen(name)-2] = '\0';
-        fgets(name, sizeof(name), dump);
-        strncpy(u_tab[i].nodeid, name, strlen(name) - 2);
-        u_tab[i].nodeid[strlen(name)-2] = '\0';
-        fgets(name, sizeof(name), dump);
-        strncpy(u_tab[i].nickname, name, strlen(name) - 2);
-        u_tab[i].nickname[strlen(name)-2] = '\0';
-        fgets(name, sizeof(name), dump);
-        strncpy(u_tab[i].password, name, strlen(name) - 2);
-        u_tab[i].password[strlen(name)-2] = '\0';
-        fgets(name, sizeof(name), dump);
-        strncpy(u_tab[i].realname, name, strlen(name) - 2);
-        u_tab[i].realname[strlen(name)-2] = '\0';
-        fgets(name, sizeof(name), dump);
-        strncpy(u_tab[i].group, name, strlen(name) - 2);
-        u_tab[i].group[strlen(name)-2] = '\0';
-        fgets(name, sizeof(name), dump);
-        strncpy(u_tab[i].awaymsg, name, strlen(name) - 2);
-        u_tab[i].awaymsg[strlen(name)-2] = '\0';
-        fscanf(dump, "%d\n", &j);
-        u_tab[i].lastaway = j;
-        fscanf(dump, "%ld\n", &k);
-        u_tab[i].lastawaytime = j;
-        fscanf(dump, "%d\n", &j);
-        u_tab[i].login = j;
-        fscanf(dump, "%d\n", &j);
-        u_tab[i].echoback = j;
-        fscanf(dump, "%d\n", &j);
-        u_tab[i].nobeep = j;
-        fscanf(dump, "%ld\n", &k);
-        u_tab[i].perms = k;
-        fscanf(dump, "%d\n", &j);
-        u_tab[i].t_notify = j;
-        fscanf(dump, "%ld\n", &k);
-        u_tab[i].t_on = k;
-        fscanf(dump, "%ld\n", &k);
-        u_tab[i].t_sent = k;
-        fscanf(dump, "%ld\n", &k);
-        u_tab[i].t_recv = k;
-        fscanf(dump, "%ld\n", &k);
-        u_tab[i].t_group = k;
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(u_tab[i].pri_n_hushed, name2);
-        }
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(u_tab[i].pub_n_hushed, name2);
-        }
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(u_tab[i].pri_s_hushed, name2);
-        }
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(u_tab[i].pub_s_hushed, name2);
-        }
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(u_tab[i].n_notifies, name2);
-        }
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(u_tab[i].s_notifies, name2);
-        }
+    ret = snapshot_load_text(dump);
+    fclose(dump);
+    if (ret < 0) {
+        fprintf(stderr, "icbd: %s isn't a text dump this server can read\n", textfile);
+        return -1;
     }
 
-    for (i = 0; i < MAX_GROUPS; i++)
-    {
-        fgets(name, sizeof (name), dump);
-        strncpy(g_tab[i].name, name, strlen(name) - 2);
-        g_tab[i].name[strlen(name)-2] = '\0';
-
-        fgets(name, sizeof (name), dump);
-        strncpy(g_tab[i].topic, name, strlen(name) - 2);
-        g_tab[i].topic[strlen(name)-2] = '\0';
-
-        fscanf(dump, "%d\n", &j);
-        g_tab[i].visibility = j;
-
-        fscanf(dump, "%d\n", &j);
-        g_tab[i].control = j;
-
-        fscanf(dump, "%d\n", &j);
-        g_tab[i].mod = j;
-
-        fscanf(dump, "%ld\n", &k);
-        g_tab[i].modtimeout = k;
-
-        fgets(name, sizeof (name), dump);
-        strncpy(g_tab[i].missingmod, name, strlen(name) - 2);
-        g_tab[i].missingmod[strlen(name)-2] = '\0';
-
-        fscanf(dump, "%d\n", &j);
-        g_tab[i].volume = j;
-
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(g_tab[i].n_invites, name2);
-        }
-
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(g_tab[i].nr_invites, name2);
-        }
-
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(g_tab[i].s_invites, name2);
-        }
-
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(g_tab[i].sr_invites, name2);
-        }
-
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(g_tab[i].n_bars, name2);
-        }
-
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(g_tab[i].n_nr_bars, name2);
-        }
-
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(g_tab[i].s_bars, name2);
-        }
-
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--) {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(g_tab[i].s_nr_bars, name2);
-        }
-
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--)
-        {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(g_tab[i].n_talk, name2);
-        }
-
-        fscanf(dump, "%d\n", &j);
-        for (; j > 0; j--)
-        {
-            fgets(name, sizeof(name), dump);
-            memset(name2, 0, sizeof(name2));
-            strncpy(name2, name, strlen(name) - 2);
-            nlput(g_tab[i].nr_talk, name2);
-        }
-
-        fscanf(dump, "%d\n", &j);
-        g_tab[i].size = j;
-
-        fscanf(dump, "%d\n", &j);
-        g_tab[i].idleboot = j;
+    if (snapshot_save_file(dumpfile) < 0) {
+        fprintf(stderr, "icbd: couldn't write %s\n", dumpfile);
+        return -1;
+    }
+    printf("converted %s to %s\n", textfile, dumpfile);
+    return 0;
+}
 
-        fgets(name, sizeof(name), dump);
-        strncpy(g_tab[i].idleboot_msg, name, strlen(name) - 2);
-        g_tab[i].idleboot_msg[strlen(name)-2] = '\0';
+/* icbdump_image
+ *
+ * dump the current state into memory, to be handed to a restarted
+ * server. *image is malloc'd; the caller frees it.
+ */
+int icbdump_image(char **image, size_t *len)
+{
+    return snapshot_encode(image, len) < 0 ? -1 : 0;
+}
 
-        fscanf(dump, "%d\n", &j);
-        g_tab[i].idlemod = j;
-    }
+/* icbload_image
+ *
+ * load a server state handed over by icbdump_image()
+ */
+int icbload_image(char *image, size_t len)
+{
+    if (snapshot_load(image, len) < 0)
+        return -1;
 
-    fclose(dump);
-    unlink(dumpfile);
+    index_groups();
+    index_users();
+    rearm_timers();
     mdb(MSG_ALL, "state loaded.");
+    return 0;
 }
-
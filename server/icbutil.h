@@ -37,6 +37,26 @@ void icbdump(int sig);
 
 /* icbload
  *
- * load a server state from a file created by icbdump
+ * load a server state from a file created by icbdump, or an old text
+ * one
  */
 void icbload(int sig);
+
+/* icbconvert
+ *
+ * turn an old text dump into a snapshot in the dump file
+ */
+int icbconvert(const char *textfile);
+
+/* icbdump_image
+ *
+ * dump the current state into memory, for handing over to a restarted
+ * server. *image is malloc'd.
+ */
+int icbdump_image(char **image, size_t *len);
+
+/* icbload_image
+ *
+ * load a server state created by icbdump_image
+ */
+int icbload_image(char *image, size_t len);
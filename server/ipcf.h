@@ -6,7 +6,6 @@
 void c_packet(char *pkt);
 void c_didpoll(void);
 void c_lostcon(void);
-void s_didpoll(int n);
 void c_userchar(void);
 void s_lost_user(int n); 		/* n = fd of that user */
 void s_packet(int x, char *pkt);
@@ -4,9 +4,13 @@
 #include "config.h"
 
 #include <string.h>
-
+#include <strings.h>
+#include <time.h>
 
 #include "lookup.h"
+#include "cmdhash.h"
+#include "s_commands.h"
+#include "s_stats.h"
 
 /* look up a string in the command table */
 /* case insensitive compares */
@@ -25,3 +29,38 @@ int lookup(char *s, char *table[])
     return result;
 }
 
+struct command {
+    const char *name;
+    CMDFUNC fn;
+};
+
+struct autocmd {
+    const char *name;
+    int which;
+};
+
+/* cmd_disp[], cmd_tab[], auto_disp[] and auto_tab[], made from
+ * commands.def by mkcmdtab */
+#include "cmdtab.h"
+
+/* the slot name would be in, see cmdhash.h */
+static int slot(const int32_t *disp, int nkeys, const char *name)
+{
+    int32_t d = disp[cmdhash(name, 0) % nkeys];
+
+    return d < 0 ? -d - 1 : (int)(cmdhash(name, d) % nkeys);
+}
+
+CMDFUNC find_command(const char *name)
+{
+    const struct command *c = &cmd_tab[slot(cmd_disp, CMD_NKEYS, name)];
+
+    return strcasecmp(name, c->name) == 0 ? c->fn : NULL;
+}
+
+int find_autocmd(const char *name)
+{
+    const struct autocmd *a = &auto_tab[slot(auto_disp, AUTO_NKEYS, name)];
+
+    return strcasecmp(name, a->name) == 0 ? a->which : -1;
+}
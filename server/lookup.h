@@ -1,39 +1,6 @@
 #pragma once
 
-#define	CMD_DROP	0
-#define	CMD_SHUTDOWN	1
-#define	CMD_WALL	2
-#define	CMD_BEEP	3
-#define	CMD_CANCEL	4
-#define	CMD_G		5
-#define	CMD_INVITE	6
-#define	CMD_PASS	7
-#define	CMD_BOOT	8
-#define	CMD_STATUS	9
-#define	CMD_TOPIC	10
-#define	CMD_MOTD	11
-#define	CMD_M		12
-#define	CMD_ECHOBACK	13
-#define	CMD_NAME	14
-#define	CMD_V		15
-#define	CMD_W		16
-#define CMD_INFO	17
-#define CMD_RESTART	18
-#define CMD_NEWS	19
-#define CMD_HUSH	20
-#define CMD_SHUSH	21
-#define CMD_HELP	22
-#define CMD_EXCLUDE	23
-#define CMD_SHUTTIME	24
-#define CMD_NOTIFY	25
-#define CMD_TALK	26
-#define CMD_PING	27
-#define CMD_NOBEEP	28
-#define CMD_AWAY	29
-#define CMD_NOAWAY	30
-#define CMD_LOG 	31
-#define CMD_STATS 	32
-#define CMD_BRICK   33
+#include "strutil.h"
 
 #define SET_RESTRICT	0
 #define	SET_MODERATE	1
@@ -61,6 +28,7 @@
 #define SET_IDLEBOOT_MSG	14
 #define SET_IDLEMOD		15
 
+/* what the names in commands.def map to for s_auto() */
 #define AUTO_READ	0
 #define	AUTO_WHO	1
 #define	AUTO_REGISTER	2
@@ -79,5 +47,15 @@
 #define AUTO_NOSECURE	15
 #define AUTO_WWW	16
 
+typedef int (*CMDFUNC)(int n, int argc, TOKEN *argv);
 
+/* look up a string in a NULL terminated table, ignoring case.
+ * returns its index, or -1 */
 int lookup(char *s, char *table[]);
+
+/* the handler for a command packet's name, or NULL if there's no
+ * such command */
+CMDFUNC find_command(const char *name);
+
+/* the AUTO_ number of a command to the server's nick, or -1 */
+int find_autocmd(const char *name);
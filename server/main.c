@@ -37,8 +37,10 @@
 #include "access.h"
 #include "send.h"
 #include "s_stats.h"    /* for server_stats */
+#include "timers.h"
 
 #include "pktserv/pktserv.h"
+#include "pktserv/pktclock.h"
 
 void trapsignals(void)
 {
@@ -54,6 +56,33 @@ void trapsignals(void)
     signal(SIGUSR2, icbload);
 }
 
+/* a listen port is given as "port[/policy]", the policy being one of
+ * deferred, lowlatency or immediate (see PORT_POLICY, which is what a
+ * port gets without one). a port of 0 is left for the caller to
+ * default. */
+static void
+portspec(const char *spec, int *port, pktserv_policy_t *policy)
+{
+    const char *cp;
+
+    *port = atoi(spec);
+    *policy = PORT_POLICY;
+    if ((cp = strchr(spec, '/')) == NULL)
+        return;
+
+    cp++;
+    if (strcmp(cp, "deferred") == 0) {
+        *policy = PKTSERV_POLICY_DEFERRED;
+    } else if (strcmp(cp, "lowlatency") == 0) {
+        *policy = PKTSERV_POLICY_LOWLATENCY;
+    } else if (strcmp(cp, "immediate") == 0) {
+        *policy = PKTSERV_POLICY_IMMEDIATE;
+    } else {
+        printf("unknown port policy \"%s\"\n", cp);
+        exit(-1);
+    }
+}
+
 
 int main(int argc, char* argv[])
 {
@@ -67,9 +96,18 @@ int main(int argc, char* argv[])
     char *bindhost = (char *) NULL;
     struct rlimit rlp;
     int quiet_restart = 0;
+    int handoff = -1;
+    char *image = NULL;
+    size_t imagelen = 0;
+    char *cp;
+    char *convertfile = NULL;
     int port = DEFAULT_PORT;
+    int maxconns = 0;
+    pktserv_policy_t policy = PORT_POLICY;
+    pktserv_backend_t backend = PKTSERV_BACKEND_DEFAULT;
 #ifdef HAVE_SSL
     int sslport = 0;
+    pktserv_policy_t sslpolicy = PORT_POLICY;
     char *pem = ICBPEMFILE;
 #endif
 
@@ -93,7 +131,7 @@ int main(int argc, char* argv[])
 
     setbuf(stdout, (char *) 0);
 
-    while ((c = getopt(argc, argv, "cl:p:s::fRqb:")) != EOF) {
+    while ((c = getopt(argc, argv, "cl:p:s::fRqb:e:C:m:")) != EOF) {
 
         switch (c) {
 
@@ -121,8 +159,29 @@ int main(int argc, char* argv[])
                 clearargsflg++;
                 break;
 
+            case 'C':
+                convertfile = optarg;
+                break;
+
+            case 'm':
+                maxconns = atoi(optarg);
+                break;
+
             case 'p':
-                port = atoi(optarg);
+                portspec(optarg, &port, &policy);
+                if (port == 0)
+                    port = DEFAULT_PORT;
+                break;
+
+            case 'e':
+                if (strcmp(optarg, "poll") == 0) {
+                    backend = PKTSERV_BACKEND_POLL;
+                } else if (strcmp(optarg, "epoll") == 0) {
+                    backend = PKTSERV_BACKEND_EPOLL;
+                } else {
+                    printf("unknown event backend \"%s\"\n", optarg);
+                    exit(-1);
+                }
                 break;
 
             case 's':
@@ -133,9 +192,9 @@ int main(int argc, char* argv[])
                  * Users often type "-s 7327"; support that too by looking at argv[optind].
                  */
                 if (optarg) {
-                    sslport = atoi(optarg);
+                    portspec(optarg, &sslport, &sslpolicy);
                 } else if (optind < argc && argv[optind] && argv[optind][0] != '-') {
-                    sslport = atoi(argv[optind]);
+                    portspec(argv[optind], &sslport, &sslpolicy);
                     optind++; /* consume the port argument */
                 }
                 if (sslport == 0)
@@ -147,7 +206,7 @@ int main(int argc, char* argv[])
 
             case '?':
             default:
-                puts("usage: icbd [-b host] [-p port] [-s [port]] [-cRfq]");
+                puts("usage: icbd [-b host] [-p port[/policy]] [-s [port[/policy]]] [-e backend] [-m conns] [-C dump] [-cRfq]");
                 puts("-c     wipe args from command line");
                 puts("-R     restart mode");
                 puts("-q     quiet mode (for restart)");
@@ -155,7 +214,13 @@ int main(int argc, char* argv[])
                 puts("-f     don't fork");
                 puts("-p port     listen port (the default is 7326)");
                 puts("-s [port]   use SSL. port is optional (the default is 7327)");
+                puts("            either port may end in /deferred, /lowlatency or");
+                puts("            /immediate to pick how it writes to its clients");
                 puts("-b host     bind socket to \"host\"");
+                puts("-e backend  event backend: poll or epoll (the default is epoll if available)");
+                puts("-m conns    at most this many connections, listeners included");
+                puts("            (the default is as many as there are file descriptors)");
+                puts("-C dump     convert an old text state dump to a snapshot in icbd.dump, and exit");
                 puts("");
                 puts("Note: SSL must be compiled in to use it. This version "
 #ifdef HAVE_SSL
@@ -177,18 +242,16 @@ int main(int argc, char* argv[])
 
 
 #ifdef RLIMIT_NOFILE
-    getrlimit(RLIMIT_NOFILE, &rlp);
     /*
-     * The server indexes connection/user state by file descriptor.
-     * Keep RLIMIT_NOFILE within bounds so we don't generate fds >= MAX_USERS.
+     * Connection state is indexed by slot id rather than by file
+     * descriptor, so there's no reason to hold the fd limit down.
+     * Take as many as we're allowed.
      */
-    rlp.rlim_cur = MAX_USERS;
-    if (rlp.rlim_max < rlp.rlim_cur)
-        rlp.rlim_max = rlp.rlim_cur;
-    if (setrlimit(RLIMIT_NOFILE, &rlp) < 0)
+    if (getrlimit(RLIMIT_NOFILE, &rlp) == 0 && rlp.rlim_cur < rlp.rlim_max)
     {
-        perror("setrlimit");
-        exit(1);
+        rlp.rlim_cur = rlp.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rlp) < 0)
+            perror("setrlimit");
     }
 #endif
 
@@ -198,12 +261,39 @@ int main(int argc, char* argv[])
 
     /* initialize the network engine */
     pktserv_cb_t cb = {0};
-    cb.idle = s_didpoll;
     cb.dispatch = s_packet;
     cb.new_client = s_new_user;
     cb.lost_client = s_lost_user;
     cb.ok2read = ok2read;
+    cb.resolved = s_resolved;
     pktserv_init(NULL, &cb);
+    /* slot ids index u_tab[], which grows to keep up (see s_new_user()) */
+    pktserv_set_maxconns(maxconns);
+    pktserv_set_outlimits(SENDQUEUE_HIWAT, SENDQUEUE_LOWAT, SENDQUEUE_LIMIT,
+                          SENDQUEUE_DEADLINE * 1000L, SENDQUEUE_OVERFLOW);
+    pktserv_set_dnscache(DNSCACHE_SIZE, DNSCACHE_TTL * 1000L,
+                         DNSCACHE_NEGTTL * 1000L);
+    if (pktserv_set_backend(backend) < 0) {
+        fprintf(stderr, "icbd: event backend not available\n");
+        exit(-1);
+    }
+    if (users_grow(MAX_USERS) < 0) {
+        fprintf(stderr, "icbd: no memory for the user table\n");
+        exit(-1);
+    }
+    init_timers();
+
+    if (convertfile)
+        exit(icbconvert(convertfile) < 0 ? -1 : 0);
+
+    /* a restart needs the old server on the other end of this */
+    if (restart && (cp = getenv("ICBD_HANDOFF")) != NULL)
+        handoff = atoi(cp);
+    if (restart && handoff < 0)
+    {
+        fprintf(stderr, "icbd: nothing to restart from, starting fresh\n");
+        restart = 0;
+    }
 
     if (restart == 0)
     {
@@ -249,7 +339,7 @@ int main(int argc, char* argv[])
                 strncpy (thishost, bindhost, MAXHOSTNAMELEN);
         }
 
-        if (pktserv_addport(bindhost, port, 0) < 0)
+        if (pktserv_addport(bindhost, port, 0, policy) < 0)
         {
             vmdb (MSG_ERR, "pktserv_addport failed: %s", strerror(errno));
             exit (-1);
@@ -262,7 +352,7 @@ int main(int argc, char* argv[])
                 exit (-1);
             }
             vmdb(MSG_INFO, "Using SSL PEM file %s.", pem);
-            if ((pktserv_addport(bindhost, sslport, 1)) < 0) {
+            if ((pktserv_addport(bindhost, sslport, 1, sslpolicy)) < 0) {
                 vmdb (MSG_ERR, "pktserv_addport failed: %s", strerror(errno));
                 exit (-1);
             }
@@ -280,24 +370,25 @@ int main(int argc, char* argv[])
         init_groups();
         clear_users();
 
-        for (i = 0; i < MAX_REAL_USERS; i++)
-            S_kill[i] = 0;
-
-        /* invent our resident automagical user */
-        TheTime = time(NULL);
+        /* invent our resident automagical user, in group ICB, which
+         * is made in slot 0 just below */
+        TheTime = pktclock_time();
         fill_user_entry(NICKSERV, "server",thishost,
-                        "Server", "", "ICB", "", TheTime, 0, 1, PERM_NULL);
-        u_tab[NICKSERV].login = LOGIN_COMPLETE;
+                        "Server", "", 0, "", TheTime, 0, 1, PERM_NULL);
+        set_user_login(NICKSERV, LOGIN_COMPLETE);
         u_tab[NICKSERV].t_on = TheTime;
-        u_tab[NICKSERV].t_recv = TheTime;
+        set_user_recv(NICKSERV, TheTime);
         strcpy(u_tab[NICKSERV].realname, "registered");
         fill_group_entry(0, "ICB", "...here to serve you!", SUPERSECRET,
                          RESTRICTED, NICKSERV, QUIET);
         nickwritetime(NICKSERV, 0, NULL);
 
         vmdb(MSG_INFO, "ICB revision %s on %s.", VERSION, thishost);
-        vmdb(MSG_INFO, "There are %d users possible.", MAX_USERS);
-        vmdb(MSG_INFO, "Of those, %d are real.", MAX_REAL_USERS);
+        if (maxconns > 0)
+            vmdb(MSG_INFO, "There are %d connections possible.", maxconns);
+        else
+            vmdb(MSG_INFO, "There are as many connections possible as file descriptors.");
+        vmdb(MSG_INFO, "Using the %s event backend.", pktserv_backend_name());
 
         trapsignals();
     }
@@ -321,10 +412,27 @@ int main(int argc, char* argv[])
         init_groups();
         clear_users();
         trapsignals(); 
-        mdb(MSG_ALL, "[RESTART] Reloading server data");
-        icbload(0);
 
-        for (i = 0; i < MAX_USERS; i++)
+#ifdef HAVE_SSL
+        if (sslport && init_ssl(pem) != 0) {
+            mdb(MSG_ERR, "couldn't create SSL context. Do you have a valid PEM file?");
+            exit (-1);
+        }
+#endif
+
+        /* the old server is waiting to hand over its connections and
+         * state. if anything goes wrong it carries on, and we leave. */
+        mdb(MSG_ALL, "[RESTART] Taking over from the old server");
+        if (pktserv_takeover(handoff, &image, &imagelen) < 0 ||
+            icbload_image(image, imagelen) < 0 ||
+            pktserv_takeover_done(handoff) < 0)
+        {
+            mdb(MSG_ERR, "[RESTART] Takeover failed, leaving the old server running");
+            exit (-1);
+        }
+        free(image);
+
+        for (i = 1; i < max_users; i++)
             if (u_tab[i].login > LOGIN_FALSE)
             {
                 if ( ! quiet_restart ||
@@ -354,12 +462,16 @@ int main(int argc, char* argv[])
     vmdb(MSG_INFO, "Max fds set to %d", (int)(rlp.rlim_cur));
 #endif
 
-    for (i = 0; i < MAX_REAL_USERS; i++)
-    {
-        lpriv_id[i] = -1;
-        pong_req[i] = -1;
-        timerclear (&ping_time[i]);
-    }
+    /* after any forking and restarting, since it starts threads */
+    if (pktserv_set_resolvers(RESOLVER_THREADS) < 0)
+        vmdb(MSG_WARN, "Couldn't start the resolver threads, looking up hostnames inline.");
+
+    /* the lookups the old server had going didn't come over with their
+     * connections, so start them again */
+    if (restart)
+        for (i = 1; i < max_users; i++)
+            if (u_tab[i].resolving && pktserv_resolve(i) < 0)
+                u_tab[i].resolving = 0;
 
     /* start the serve loop */
     pktserv_run();
@@ -36,6 +36,7 @@ void mdb(int level, const char *message)
     char timebuf[64];
     char tmp[BUFSIZ];
     time_t now;
+    struct tm tm;
     const char* msgtype = NULL;
 
     if ((level == MSG_ALL || level <= log_level) && icbd_log >= 0) {
@@ -45,7 +46,8 @@ void mdb(int level, const char *message)
             msgtype = "";
 
         now = time(NULL);
-        strftime(timebuf, 64, "%b %d %Y %H:%M:%S", localtime(&now));
+        /* the resolver threads log too, so no shared buffers */
+        strftime(timebuf, 64, "%b %d %Y %H:%M:%S", localtime_r(&now, &tm));
         snprintf(tmp, BUFSIZ, "%s %s %s: %s\n", 
                  msgtype, timebuf, thishost, message);
 
@@ -0,0 +1,171 @@
+/* group -> member slots index, see members.h
+ *
+ * Each group has a member count and its first member. The members are
+ * a doubly linked list threaded through per-slot arrays, so nothing
+ * is allocated after members_init() but to grow them.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include "members.h"
+#include "mdb.h"
+
+static int g_nslots = 0;
+static int g_ngroups = 0;
+
+static int *g_head = NULL;      /* group -> first member slot, or -1 */
+static int *g_count = NULL;     /* group -> how many */
+
+static int *g_gid = NULL;       /* slot -> its group, or -1 */
+static int *g_next = NULL;      /* slot -> next member, or -1 */
+static int *g_prev = NULL;      /* slot -> previous member, or -1 */
+
+static void
+free_all(void)
+{
+    free(g_head);
+    free(g_count);
+    free(g_gid);
+    free(g_next);
+    free(g_prev);
+    g_head = g_count = NULL;
+    g_gid = g_next = g_prev = NULL;
+    g_nslots = g_ngroups = 0;
+}
+
+int
+members_init(int nslots, int ngroups)
+{
+    int i;
+
+    free_all();
+
+    g_head = (int *)malloc(ngroups * sizeof(int));
+    g_count = (int *)calloc(ngroups, sizeof(int));
+    g_gid = (int *)malloc(nslots * sizeof(int));
+    g_next = (int *)malloc(nslots * sizeof(int));
+    g_prev = (int *)malloc(nslots * sizeof(int));
+    if (!g_head || !g_count || !g_gid || !g_next || !g_prev) {
+        vmdb(MSG_ERR, "%s: no memory for %d slots", __FUNCTION__, nslots);
+        free_all();
+        return -1;
+    }
+
+    for (i = 0; i < ngroups; i++)
+        g_head[i] = -1;
+    for (i = 0; i < nslots; i++)
+        g_gid[i] = g_next[i] = g_prev[i] = -1;
+    g_nslots = nslots;
+    g_ngroups = ngroups;
+    return 0;
+}
+
+/* grow one per-slot array, with the new slots set to -1 */
+static int
+grow_slots(int **arr, int nslots)
+{
+    int *n;
+    int i;
+
+    if ((n = (int *)realloc(*arr, nslots * sizeof(int))) == NULL)
+        return -1;
+    for (i = g_nslots; i < nslots; i++)
+        n[i] = -1;
+    *arr = n;
+    return 0;
+}
+
+int
+members_grow(int nslots)
+{
+    if (nslots <= g_nslots)
+        return 0;
+
+    if (grow_slots(&g_gid, nslots) < 0 || grow_slots(&g_next, nslots) < 0 ||
+        grow_slots(&g_prev, nslots) < 0) {
+        vmdb(MSG_ERR, "%s: no memory for %d slots", __FUNCTION__, nslots);
+        return -1;
+    }
+    g_nslots = nslots;
+    return 0;
+}
+
+static void
+leave(int slot)
+{
+    int gid = g_gid[slot];
+
+    if (g_prev[slot] >= 0)
+        g_next[g_prev[slot]] = g_next[slot];
+    else
+        g_head[gid] = g_next[slot];
+    if (g_next[slot] >= 0)
+        g_prev[g_next[slot]] = g_prev[slot];
+
+    g_count[gid]--;
+    g_gid[slot] = g_next[slot] = g_prev[slot] = -1;
+}
+
+static void
+join(int slot, int gid)
+{
+    int i, prev;
+
+    /* keep them in slot order */
+    for (prev = -1, i = g_head[gid]; i >= 0 && i < slot; i = g_next[i])
+        prev = i;
+
+    g_prev[slot] = prev;
+    g_next[slot] = i;
+    if (prev >= 0)
+        g_next[prev] = slot;
+    else
+        g_head[gid] = slot;
+    if (i >= 0)
+        g_prev[i] = slot;
+
+    g_gid[slot] = gid;
+    g_count[gid]++;
+}
+
+void
+members_set(int slot, int gid)
+{
+    if (slot < 0 || slot >= g_nslots)
+        return;
+    if (gid >= g_ngroups)
+        gid = -1;
+
+    if (g_gid[slot] == gid)
+        return;
+    if (g_gid[slot] >= 0)
+        leave(slot);
+    if (gid >= 0)
+        join(slot, gid);
+}
+
+int
+members_count(int gid)
+{
+    if (gid < 0 || gid >= g_ngroups)
+        return 0;
+    return g_count[gid];
+}
+
+int
+members_first(int gid)
+{
+    if (gid < 0 || gid >= g_ngroups)
+        return -1;
+    return g_head[gid];
+}
+
+int
+members_next(int slot)
+{
+    if (slot < 0 || slot >= g_nslots)
+        return -1;
+    return g_next[slot];
+}
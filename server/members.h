@@ -0,0 +1,41 @@
+#pragma once
+
+/* group membership index
+ *
+ * which user slots are in which group, by g_tab index, so sending to a
+ * group or counting it doesn't mean a look at every slot. each group's
+ * members are kept in slot order, the order a scan of the table would
+ * find them in. users.c keeps it in step with u_tab[].gid.
+ *
+ * to walk a group:
+ *
+ *     for (i = members_first(gi); i >= 0; i = members_next(i))
+ */
+
+/* (re)size the index for user slots 0..nslots-1 and groups
+ * 0..ngroups-1, emptying it.
+ *
+ * returns 0, or -1 if there wasn't the memory
+ */
+int members_init(int nslots, int ngroups);
+
+/* make room for user slots up to nslots-1, keeping what's there. the
+ * new slots are in no group.
+ *
+ * returns 0, or -1 if there wasn't the memory
+ */
+int members_grow(int nslots);
+
+/* record that slot is now in group gid. a gid of -1 takes the slot
+ * out.
+ */
+void members_set(int slot, int gid);
+
+/* how many slots are in group gid */
+int members_count(int gid);
+
+/* the lowest slot in group gid, or -1 */
+int members_first(int gid);
+
+/* the next slot after slot in the same group, or -1 */
+int members_next(int slot);
@@ -0,0 +1,195 @@
+/* mkcmdtab - build the command tables from commands.def
+ *
+ * usage: mkcmdtab cmdtab.h
+ *
+ * run at build time. for each table it picks a minimal perfect hash
+ * over the names (see cmdhash.h): the keys are bucketed on
+ * cmdhash(name, 0), the biggest buckets are placed first by trying
+ * displacements until all their keys land in free slots, and the
+ * single keys go in whatever slots are left. then every name is looked
+ * up again the way lookup.c will, and the header is only written if
+ * they all come back to themselves. a name given twice, or a table
+ * that can't be placed, fails the build.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "cmdhash.h"
+
+struct key {
+    const char *name;
+    const char *value;          /* what goes beside it in the table */
+};
+
+static const struct key commands[] = {
+#define COMMAND(name, handler)  { name, #handler },
+#define AUTOCMD(name, which)
+#include "commands.def"
+#undef COMMAND
+#undef AUTOCMD
+};
+
+static const struct key autocmds[] = {
+#define COMMAND(name, handler)
+#define AUTOCMD(name, which)    { name, #which },
+#include "commands.def"
+#undef COMMAND
+#undef AUTOCMD
+};
+
+#define NELEM(a)    ((int)(sizeof(a) / sizeof((a)[0])))
+#define MAX_KEYS    256
+#define MAX_DISP    (1 << 20)
+
+struct table {
+    int nkeys;
+    int32_t disp[MAX_KEYS];     /* bucket -> displacement, or -slot-1 */
+    int key[MAX_KEYS];          /* slot -> key */
+};
+
+static int
+find(const struct table *t, const char *name)
+{
+    int32_t d = t->disp[cmdhash(name, 0) % t->nkeys];
+
+    return d < 0 ? -d - 1 : (int)(cmdhash(name, d) % t->nkeys);
+}
+
+/* returns 0, or -1 after saying why not */
+static int
+build(const char *what, const struct key *keys, int nkeys, struct table *t)
+{
+    int bucket[MAX_KEYS], size[MAX_KEYS], slots[MAX_KEYS];
+    int i, j, b, k, s, want, nslots;
+    int32_t d;
+
+    if (nkeys < 1 || nkeys > MAX_KEYS) {
+        fprintf(stderr, "mkcmdtab: %s: %d names, want 1 to %d\n",
+                what, nkeys, MAX_KEYS);
+        return -1;
+    }
+    for (i = 0; i < nkeys; i++)
+        for (j = 0; j < i; j++)
+            if (strcasecmp(keys[i].name, keys[j].name) == 0) {
+                fprintf(stderr, "mkcmdtab: %s: \"%s\" is there twice\n",
+                        what, keys[i].name);
+                return -1;
+            }
+
+    t->nkeys = nkeys;
+    for (i = 0; i < nkeys; i++) {
+        t->disp[i] = 0;
+        t->key[i] = -1;
+        size[i] = 0;
+    }
+    for (i = 0; i < nkeys; i++) {
+        bucket[i] = cmdhash(keys[i].name, 0) % nkeys;
+        size[bucket[i]]++;
+    }
+
+    /* the crowded buckets, biggest first */
+    for (want = nkeys; want > 1; want--) {
+        for (b = 0; b < nkeys; b++) {
+            if (size[b] != want)
+                continue;
+            for (d = 1; d < MAX_DISP; d++) {
+                nslots = 0;
+                for (k = 0; k < nkeys; k++) {
+                    if (bucket[k] != b)
+                        continue;
+                    s = cmdhash(keys[k].name, d) % nkeys;
+                    if (t->key[s] != -1)
+                        break;
+                    for (j = 0; j < nslots; j++)
+                        if (slots[j] == s)
+                            break;
+                    if (j < nslots)
+                        break;
+                    slots[nslots++] = s;
+                }
+                if (k == nkeys)
+                    break;
+            }
+            if (d == MAX_DISP) {
+                fprintf(stderr, "mkcmdtab: %s: can't place bucket %d\n",
+                        what, b);
+                return -1;
+            }
+            t->disp[b] = d;
+            for (k = 0, j = 0; k < nkeys; k++)
+                if (bucket[k] == b)
+                    t->key[slots[j++]] = k;
+        }
+    }
+
+    /* and the rest straight into the free slots */
+    for (k = 0, s = 0; k < nkeys; k++) {
+        if (size[bucket[k]] != 1)
+            continue;
+        while (t->key[s] != -1)
+            s++;
+        t->disp[bucket[k]] = -s - 1;
+        t->key[s] = k;
+    }
+
+    for (k = 0; k < nkeys; k++)
+        if (t->key[find(t, keys[k].name)] != k) {
+            fprintf(stderr, "mkcmdtab: %s: \"%s\" doesn't hash to itself\n",
+                    what, keys[k].name);
+            return -1;
+        }
+    return 0;
+}
+
+static void
+emit(FILE *fp, const char *macro, const char *prefix, const char *type,
+     const struct key *keys, const struct table *t)
+{
+    int i;
+
+    fprintf(fp, "\n#define %s_NKEYS %d\n\n", macro, t->nkeys);
+    fprintf(fp, "static const int32_t %s_disp[%s_NKEYS] = {", prefix, macro);
+    for (i = 0; i < t->nkeys; i++)
+        fprintf(fp, "%s%ld,", i % 8 ? " " : "\n    ", (long)t->disp[i]);
+    fprintf(fp, "\n};\n\n");
+    fprintf(fp, "static const %s %s_tab[%s_NKEYS] = {\n", type, prefix, macro);
+    for (i = 0; i < t->nkeys; i++)
+        fprintf(fp, "    { \"%s\", %s },\n",
+                keys[t->key[i]].name, keys[t->key[i]].value);
+    fprintf(fp, "};\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    static struct table cmd, autocmd;
+    FILE *fp;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: mkcmdtab cmdtab.h\n");
+        return 1;
+    }
+
+    if (build("commands", commands, NELEM(commands), &cmd) < 0 ||
+        build("autocmds", autocmds, NELEM(autocmds), &autocmd) < 0)
+        return 1;
+
+    if ((fp = fopen(argv[1], "w")) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    fprintf(fp, "/* generated by mkcmdtab from commands.def; do not edit */\n");
+    emit(fp, "CMD", "cmd", "struct command", commands, &cmd);
+    emit(fp, "AUTO", "auto", "struct autocmd", autocmds, &autocmd);
+    if (ferror(fp) | fclose(fp)) {
+        perror(argv[1]);
+        remove(argv[1]);
+        return 1;
+    }
+    return 0;
+}
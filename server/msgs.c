@@ -12,7 +12,8 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <sys/time.h>    /* for gettimeofday */
+#include <sys/stat.h>
+#include <sys/time.h>    /* for timersub */
 
 #include "server.h"
 #include "externs.h"
@@ -20,13 +21,20 @@
 #include "access.h"
 #include "lookup.h"
 #include "users.h"
+#include "members.h"
+#include "hushset.h"
+#include "notifyindex.h"
 #include "groups.h"
 #include "send.h"
 #include "namelist.h"
 #include "strutil.h"
 #include "s_commands.h"
+#include "msgs.h"
 #include "wildmat.h"
 #include "s_stats.h"    /* for server_stats */
+#include "timers.h"
+#include "pktserv/pktserv.h" /* for pktserv_getfd() */
+#include "pktserv/pktclock.h"
 
 #ifndef    timersub
 #define timersub(tvp, uvp, vvp)                             \
@@ -102,7 +110,7 @@ long get_perms (int n, char *login)
     char        *perms;
 
 
-    if (getpeername(n, (struct sockaddr *)&rs, &rs_size) < 0)
+    if (getpeername(pktserv_getfd(n), (struct sockaddr *)&rs, &rs_size) < 0)
     {
         sprintf(mbuf, "getpeername() failed: %s", strerror(errno));
         senderror(n, mbuf);
@@ -180,6 +188,91 @@ long get_perms (int n, char *login)
     return (perm);
 }
 
+/* does a host from the deny or perms file have to be matched against
+ * a looked-up hostname? "[addr]" forms and bare wildcards don't.
+ */
+static int names_a_host(const char *host)
+{
+    if (*host == '[')
+        return 0;
+
+    for ( ; *host != '\0'; host++)
+        if (*host != '*' && *host != '?')
+            return 1;
+
+    return 0;
+}
+
+/* scan a rules file for entries that need a hostname. deny file lines
+ * start with a login@host pattern; perms file "user" lines have the
+ * host as their third word.
+ */
+static int rules_file_names_host(const char *path, int is_perms)
+{
+    FILE *fp;
+    char buf[BUFSIZ];
+    char *type, *arg1, *arg2, *host;
+    int found = 0;
+
+    if ((fp = fopen(path, "r")) == NULL)
+        return 0;
+
+    while (!found && fgets(buf, BUFSIZ, fp) != NULL)
+    {
+        if (strchr("\n\t#", buf[0]) != NULL)
+            continue;
+
+        if (is_perms)
+        {
+            type = strtok(buf, " \t");
+            arg1 = strtok(NULL, " \t");
+            arg2 = strtok(NULL, " \t\n");
+            if (type == NULL || arg1 == NULL || arg2 == NULL)
+                continue;
+            found = !strcasecmp(type, "user") && names_a_host(arg2);
+        }
+        else
+        {
+            if ((arg1 = strtok(buf, " \t\n")) == NULL)
+                continue;
+            host = strrchr(arg1, '@');
+            found = names_a_host(host ? host + 1 : arg1);
+        }
+    }
+
+    fclose(fp);
+    return found;
+}
+
+/* do the deny or perms rules care what a client's hostname is? if
+ * not, there's no reason to make a login wait for the lookup. the
+ * answer is kept until one of the files changes.
+ */
+int rules_need_hostname(void)
+{
+    static const char *files[2] = { ACCESS_FILE, PERM_FILE };
+    static struct stat seen[2];
+    static int answer = -1;
+    struct stat st;
+    int i, changed = (answer < 0);
+
+    for (i = 0; i < 2; i++)
+    {
+        if (stat(files[i], &st) < 0)
+            memset(&st, 0, sizeof(st));
+        if (st.st_mtime != seen[i].st_mtime || st.st_size != seen[i].st_size ||
+            st.st_ino != seen[i].st_ino)
+            changed = 1;
+        seen[i] = st;
+    }
+
+    if (changed)
+        answer = rules_file_names_host(ACCESS_FILE, 0) ||
+                 rules_file_names_host(PERM_FILE, 1);
+
+    return answer;
+}
+
 /* open message
  *
  *  note that we need to know who sent the message.  it doesn't
@@ -190,10 +283,9 @@ long get_perms (int n, char *login)
  *   pkt        packet buffer
  */
 
-int u_recv_count[MAX_USERS];
-
 void openmsg(int n, char *pkt)
 {
+    TOKEN f[2];
     time_t TheTime;
     int gi;
 
@@ -202,14 +294,14 @@ void openmsg(int n, char *pkt)
         if (strlen(u_tab[n].awaymsg) > 0)
             sendstatus(n, "Away", "Your away is still set...");
 
-        TheTime = time(NULL);
+        TheTime = pktclock_time();
 
-        if ( !strcmp (u_tab[n].group, "1") )
+        if ( !strcmp (group_name(u_tab[n].gid), "1") )
         {
-            u_recv_count[n]++;
+            u_tab[n].recv_count++;
             if ( u_tab[n].t_recv == TheTime )
             {
-                if ( u_recv_count[n] > 2 )
+                if ( u_tab[n].recv_count > 2 )
                 {
                     extern int is_booting;
 
@@ -219,27 +311,28 @@ void openmsg(int n, char *pkt)
                             u_tab[n].nickname);
                     s_status_group(1,1,n, "Boot", mbuf);
                     /* fake an s_change to group ICB */
-                    strcpy (fields[1], "ICB");
+                    f[0] = tok_str("g");
+                    f[1] = tok_str("ICB");
                     is_booting = 1;
-                    s_change(n, 2);
+                    s_change(n, 2, f);
                     is_booting = 0;
                 }
             }
             else
             {
-                u_recv_count[n] = 0;
+                u_tab[n].recv_count = 0;
             }
         }
 
         /* record the time */
-        u_tab[n].t_recv= TheTime;
+        set_user_recv(n, TheTime);
 
-        if (split(pkt) != 1) {
+        if (tokenize(pkt, f, 2) != 1) {
             mdb(MSG_WARN, "got bad open message packet");
         } else {
             vmdb(MSG_INFO, "[OPEN] %d", n);
 
-            gi = find_group(u_tab[n].group);
+            gi = u_tab[n].gid;
             if (g_tab[gi].volume == QUIET)
                 senderror(n,
                           "Open messages not permitted in quiet groups.");
@@ -263,16 +356,15 @@ void openmsg(int n, char *pkt)
                          u_tab[g_tab[gi].mod].nickname);
                 sendstatus (n, "INFO", mbuf);
             }
-            else if (count_users_in_group(g_tab[gi].name) < 2)
+            else if (count_users_in_group(gi) < 2)
                 senderror(n,
                           "No one else in group!");
             else {
-                s_send_group(n);
+                s_send_group(n, f[0].s);
             }
         }
     } else {
-        vmdb(MSG_INFO, "%d: cannot send open messages until logged in (%s)",
-             n, fields[0]);
+        vmdb(MSG_INFO, "%d: cannot send open messages until logged in", n);
     }
 }
 
@@ -295,6 +387,7 @@ void openmsg(int n, char *pkt)
 
 int loginmsg(int n, char *pkt)
 {
+    TOKEN f[MAX_FIELDS];
     int num_fields;
     char which_group[MAX_NICKLEN+4];
     char temp[MAX_NICKLEN+4];
@@ -302,7 +395,8 @@ int loginmsg(int n, char *pkt)
     int len;
     int ret;
     int how_many;
-    int i, j;
+    int i, j, k, nto;
+    int to[max_users];
     time_t TheTime;
     int target_user;
     char * cp;
@@ -316,15 +410,15 @@ int loginmsg(int n, char *pkt)
         return 1;
     }
 
-    u_tab[n].login = LOGIN_FALSE;
+    set_user_login(n, LOGIN_FALSE);
     /* just in case */
-    TheTime = time(NULL);
+    TheTime = pktclock_time();
 
-    num_fields = split(pkt);
+    num_fields = tokenize(pkt, f, MAX_FIELDS);
 
     if (num_fields < 4) return -1;
 
-    len = strlen(fields[2]);
+    len = f[2].len;
 
     memset(temp, 0, MAX_NICKLEN+4);
     memset(which_group, 0, MAX_NICKLEN+4);
@@ -336,20 +430,19 @@ int loginmsg(int n, char *pkt)
     else
     {
         how_many = (len > (MAX_NICKLEN+3))? (MAX_NICKLEN+3): len;
-        strncpy(which_group, fields[2], how_many);
+        strncpy(which_group, f[2].s, how_many);
     }
 
-    if ( strcasecmp(fields[3],"w") == 0)
+    if ( strcasecmp(f[3].s,"w") == 0)
     {
-        sprintf(mbuf, "[WHO] %d: %s@%s", n, fields[0], u_tab[n].nodeid);
+        sprintf(mbuf, "[WHO] %d: %s@%s", n, f[0].s, u_tab[n].nodeid);
         mdb(MSG_INFO, mbuf);
 
         /* who only */
-        fields[0][0] = 'w';
-        fields[0][1] = '\000';
-        fields[1][0] = '\000';
+        f[0] = tok_str("w");
+        f[1] = tok_str("");
 
-        s_who(n, 2);
+        s_who(n, 2, f);
         return -1; /* fail */
     }
     /*
@@ -358,30 +451,29 @@ int loginmsg(int n, char *pkt)
      * group to "1" which makes "icb -w" only list group 1. yes, it's
      * wrong, but we want to keep people happy
      */
-    else if ( strcasecmp(fields[3],"wg") == 0)
+    else if ( strcasecmp(f[3].s,"wg") == 0)
     {
-        sprintf(mbuf, "[WHO] %d: %s@%s", n, fields[0], u_tab[n].nodeid);
+        sprintf(mbuf, "[WHO] %d: %s@%s", n, f[0].s, u_tab[n].nodeid);
         mdb(MSG_INFO, mbuf);
 
         /* who only */
-        fields[0][0] = 'w';
-        fields[0][1] = '\000';
+        f[0] = tok_str("w");
 
         /* if we got a groupname, use it */
-        if ( num_fields >= 3 && fields[2][0] != '\0' )
-            sprintf (fields[1], "%s%c", fields[2], 0);
+        if ( num_fields >= 3 && f[2].len > 0 )
+            f[1] = f[2];
         else
-            fields[1][0] = '\000';
+            f[1] = tok_str("");
 
-        s_who(n, 2);
+        s_who(n, 2, f);
         return -1; /* fail */
     }
-    else if ( !strcasecmp (fields[3], "login") )
+    else if ( !strcasecmp (f[3].s, "login") )
     {
         /* regular login */
 
         /* make sure the nickname hasn't already been taken */
-        if (find_user(fields[1]) >= 0)
+        if (find_user(f[1].s) >= 0)
         {
             /* oops, someone already has this nick */
             senderror(n,"Nickname already in use.");
@@ -389,7 +481,7 @@ int loginmsg(int n, char *pkt)
         }
 
         /* make sure it isn't a null nickname */
-        if ((strlen(fields[1]) == 0) || (strlen(fields[1]) > MAX_NICKLEN))
+        if ((f[1].len == 0) || (f[1].len > MAX_NICKLEN))
         {
             sprintf(mbuf, "Nickname must be between 1 and %d characters.",
                     MAX_NICKLEN);
@@ -398,7 +490,7 @@ int loginmsg(int n, char *pkt)
         }
 
         /* make sure the length of the loginid isn't wrong */
-        if ((strlen(fields[0]) == 0) || (strlen(fields[0]) > MAX_IDLEN))
+        if ((f[0].len == 0) || (f[0].len > MAX_IDLEN))
         {
             sprintf(mbuf, "Login id must be between 1 and %d characters.",
                     MAX_IDLEN);
@@ -406,8 +498,8 @@ int loginmsg(int n, char *pkt)
             return -1;
         }
 
-        for (i = 0; i < strlen(fields[0]); i++) {
-            if (isalnum(fields[0][i]) == 0)
+        for (i = 0; i < f[0].len; i++) {
+            if (isalnum(f[0].s[i]) == 0)
             {
                 senderror(n,
                           "Login id must contain only alphanumeric characters.");
@@ -418,7 +510,7 @@ int loginmsg(int n, char *pkt)
         /* This is set up in s_new_user now */
         cp = u_tab[n].nodeid;
 
-        perms = get_perms (n, fields[0]);
+        perms = get_perms (n, f[0].s);
         if ( perms < 0L )
         {
             return perms;
@@ -445,7 +537,7 @@ int loginmsg(int n, char *pkt)
 
         memset(one, 0, 255);
         memset(three, 0, 255);
-        sprintf(one, "%s@%s", fields[0], cp);
+        sprintf(one, "%s@%s", f[0].s, cp);
         ucaseit(one);
 
         /* Check the deny file */
@@ -507,17 +599,17 @@ int loginmsg(int n, char *pkt)
         }
 
         /* get rid of nasty characters in the nickname */
-        filternickname(fields[1]);
+        filternickname(f[1].s);
 
         /* fill in what we can */
-        fill_user_entry(n, fields[0], cp, fields[1],
-                        fields[4], "", "", LOGIN_FALSE, 0, 0, perms);
+        fill_user_entry(n, f[0].s, cp, f[1].s,
+                        num_fields > 4 ? f[4].s : "", -1, "", LOGIN_FALSE, 0, 0, perms);
 
-        sprintf(mbuf, "[LOGIN] %d: %s@%s", n, fields[0], cp);
+        sprintf(mbuf, "[LOGIN] %d: %s@%s", n, f[0].s, cp);
         mdb(MSG_INFO, mbuf);
 
         /* make sure they are allowed to use this nickname */
-        if (strcasecmp(fields[1],"admin") == 0)
+        if (strcasecmp(f[1].s,"admin") == 0)
         {
             if (!check_auth(n))
             {
@@ -529,7 +621,7 @@ int loginmsg(int n, char *pkt)
 
         send_loginok(n);
 
-        s_motd(n,2);
+        s_motd(n, 2, f);
 
         if (which_group[0] == '@')
         {
@@ -541,7 +633,7 @@ int loginmsg(int n, char *pkt)
             }
             else
             {
-                int    g = find_group(u_tab[target_user].group);
+                int    g = u_tab[target_user].gid;
 
                 if ( ((g_tab[g].visibility == SUPERSECRET)
                       || (g_tab[g].visibility == SECRET))
@@ -552,16 +644,15 @@ int loginmsg(int n, char *pkt)
                     return (-1);
                 }
                 else
-                    strcpy (which_group, u_tab[target_user].group);
+                    strcpy (which_group, group_name(g));
             }
         }
 
         /* could find group slot, all is ok */
         /* fill in last members of table entry */
-        /* strcpy(u_tab[n].group, which_group); */
-        u_tab[n].login = LOGIN_PENDING;
+        set_user_login(n, LOGIN_PENDING);
         u_tab[n].t_on = TheTime;
-        u_tab[n].t_recv = TheTime;
+        set_user_recv(n, TheTime);
         u_tab[n].t_sent = TheTime;
         nlclear(u_tab[n].pri_n_hushed);
         nlinit(u_tab[n].pri_n_hushed, MAX_HUSHED);
@@ -571,10 +662,12 @@ int loginmsg(int n, char *pkt)
         nlinit(u_tab[n].pri_s_hushed, MAX_HUSHED);
         nlclear(u_tab[n].pub_s_hushed);
         nlinit(u_tab[n].pub_s_hushed, MAX_HUSHED);
+        hushset_update_lists(n);
         nlclear(u_tab[n].n_notifies);
         nlinit(u_tab[n].n_notifies, MAX_NOTIFIES);
         nlclear(u_tab[n].s_notifies);
         nlinit(u_tab[n].s_notifies, MAX_NOTIFIES);
+        notifyindex_update(n);
 
         sprintf(mbuf, "Welcome to ICB %s", u_tab[n].nickname);
         sends_cmdout(n, mbuf);
@@ -638,12 +731,12 @@ int loginmsg(int n, char *pkt)
                     {
                         g_tab[i].modtimeout = 0;
                         g_tab[i].mod = n;
+                        group_timer_update(i);
                         memset(g_tab[i].missingmod, 0, MAX_NICKLEN);
                         sprintf(mbuf, "%s is the active moderator again.",
                                 u_tab[n].nickname);
-                        for (j = 1; j < MAX_REAL_USERS; j++)
-                            if ((strcasecmp(u_tab[j].group, g_tab[i].name) == 0)
-                                && (j != n))
+                        for (j = members_first(i); j >= 0; j = members_next(j))
+                            if (j != n && j != NICKSERV)
                                 sendstatus(j, "Mod", mbuf);
                         sprintf(mbuf, "You are the moderator of group %s",
                                 g_tab[i].name);
@@ -674,10 +767,10 @@ int loginmsg(int n, char *pkt)
         {
             if (
                 (nlpresent(u_tab[n].nickname, *g_tab[i].n_invites) > 0) ||
-                (nlmatch(one, *g_tab[i].s_invites)) ||
+                (nlmatch(one, g_tab[i].s_invites)) ||
                 (nlpresent(u_tab[n].nickname, *g_tab[i].nr_invites) &&
                  (strlen(u_tab[n].realname) > 0)) ||
-                (nlmatch(one, *g_tab[i].sr_invites) && 
+                (nlmatch(one, g_tab[i].sr_invites) && 
                  (strlen(u_tab[n].realname) > 0)))
             {
                 sprintf (mbuf, "Invited to: %s", g_tab[i].name);
@@ -696,32 +789,30 @@ int loginmsg(int n, char *pkt)
         }
 
         /* fake a s_change */
-        strcpy(fields[1], which_group);
-        if (s_change(n,3) < 0)
+        f[1] = tok_str(which_group);
+        if (s_change(n, 3, f) < 0)
         {
             /* login fails because can't get into that group */
             return(-1);
         }
 
         /* we've finally done the group change (s_change) */
-        u_tab[n].login = LOGIN_COMPLETE;
+        set_user_login(n, LOGIN_COMPLETE);
+        user_timer_update(n);
 
         server_stats.signons++;
 
         memset(one, 0, 255);
         memset(two, 0, 255);
-        memset(three, 0, 255);
         sprintf(one, "%s@%s", u_tab[n].loginid, u_tab[n].nodeid);
         ucaseit(one);
-        strcpy(three, u_tab[n].nickname);
-        ucaseit(three);
-        for (j = 0; j < MAX_USERS; j++)
+        nto = notifyindex_watchers(u_tab[n].uc_nick, u_tab[n].uc_addr, to);
+        for (k = 0; k < nto; k++)
+        {
+            j = to[k];
             if ((n != j) && (u_tab[j].login >= LOGIN_COMPLETE))
             {
-                if ((nlmatch(three, *u_tab[j].n_notifies) ||
-                     nlmatch(one, *u_tab[j].s_notifies)) && 
-                    (g_tab[find_group(u_tab[n].group)].visibility !=
-                     SUPERSECRET))
+                if (g_tab[u_tab[n].gid].visibility != SUPERSECRET)
                 {
                     /* ignore gripe that 'one' may be truncated when copying
                      * to 'three'.
@@ -732,12 +823,13 @@ int loginmsg(int n, char *pkt)
                     sendstatus(j, "Notify-On", two);
                 }
             }
+        }
 
         return 0;
     }
     else
     {
-        sprintf (mbuf, "Unknown login type \"%s\"", fields[3]);
+        sprintf (mbuf, "Unknown login type \"%s\"", f[3].s);
         senderror (n, mbuf);
         return -1;
     }
@@ -752,178 +844,50 @@ int loginmsg(int n, char *pkt)
 
 void cmdmsg(int n, char *pkt)
 {
+    TOKEN f[MAX_FIELDS];
     int argc;
+
+    argc = tokenize(pkt, f, MAX_FIELDS);
+    if (argc < 2)
+        f[1] = tok_str("");
+    runcmd(n, argc, f);
+}
+
+void runcmd(int n, int argc, TOKEN *f)
+{
+    CMDFUNC fn;
     time_t TheTime;
 
     if (u_tab[n].login >= LOGIN_COMPLETE) 
     {
         /* record the time */
-        TheTime = time(NULL);
-        u_tab[n].t_recv= TheTime;
-
-        argc = split(pkt);
+        TheTime = pktclock_time();
+        set_user_recv(n, TheTime);
 
-        if (strcmp(fields[0], "m") == 0)
-            sprintf(mbuf, "[COMMAND] %d: %s %s", n, fields[0],
-                    getword(fields[1]));
+        /* don't log what's said in private */
+        if (strcmp(f[0].s, "m") == 0)
+            vmdb(MSG_DEBUG, "[COMMAND] %d: %s %.*s", n, f[0].s,
+                 (int)strcspn(f[1].s, " \t"), f[1].s);
         else
-            sprintf(mbuf, "[COMMAND] %d: %s %s", n, fields[0], fields[1]);
-        mdb(MSG_DEBUG, mbuf);
-
-        switch(lookup(fields[0], command_table)) {
-
-            case CMD_DROP:
-                s_drop(n, argc);
-                break;
-
-            case CMD_RESTART:
-                s_restart(n, argc);
-                break;
-
-            case CMD_SHUTDOWN:
-                s_shutdown(n, argc);
-                break;
-
-            case CMD_WALL:
-                s_wall(n, argc);
-                break;
-
-            case CMD_BEEP:
-                s_beep(n, argc);
-                break;
-
-            case CMD_CANCEL:
-                s_cancel(n, argc);
-                break;
-
-            case CMD_G:
-                s_change(n, argc);
-                break;
-
-            case CMD_INVITE:
-                s_invite(n, argc);
-                break;
-
-            case CMD_PASS:
-                s_pass(n, argc);
-                break;
-
-            case CMD_BOOT:
-                s_boot(n, argc);
-                break;
-
-            case CMD_STATUS:
-                s_status(n, argc);
-                break;
-
-            case CMD_TOPIC:
-                s_topic(n, argc);
-                break;
-
-            case CMD_MOTD:
-                s_motd(n, argc);
-                break;
-
-            case CMD_M:
-                s_personal(n, argc);
-                break;
-
-            case CMD_ECHOBACK:
-                s_echoback(n, argc);
-                break;
-
-            case CMD_NAME:
-                s_name(n, argc);
-                break;
-
-            case CMD_V:
-                s_version(n, argc);
-                break;
-
-            case CMD_W:
-                s_who(n, argc);
-                break;
-
-            case CMD_INFO:
-                s_info(n, argc);
-                break;
-
-            case CMD_NEWS:
-                s_news(n, argc);
-                break;
-
-            case CMD_HUSH:
-            case CMD_SHUSH:
-                s_hush(n, argc);
-                break;
-
-            case CMD_HELP:
-                s_help(n, argc);
-                break;
-
-            case CMD_EXCLUDE:
-                s_exclude(n, argc);
-                break;
-
-            case CMD_SHUTTIME:
-                s_shuttime(n, argc);
-                break;
-
-            case CMD_NOTIFY:
-                s_notify(n, argc);
-                break;
-
-            case CMD_PING:
-                s_ping(n, argc);
-                break;
-
-            case CMD_TALK:
-                s_talk(n, argc);
-                break;
-
-            case CMD_NOBEEP:
-                s_nobeep(n, argc);
-                break;
-
-            case CMD_AWAY:
-                s_away(n, argc);
-                break;
-
-            case CMD_NOAWAY:
-                s_noaway(n, argc);
-                break;
-
-            case CMD_LOG:
-                s_log(n, argc);
-                break;
-
-            case CMD_STATS:
-                s_server_stats(n, argc);
-                break;
-
-#ifdef BRICK
-            case CMD_BRICK:
-                s_brick(n, argc);
-                break;
-#endif
-
-            default:
-                if (lookup(fields[0], auto_table) >= 0)
-                    s_auto(n, 0); /* XXX check return code? -hoche */
-                else {
-                    sendstatus(n, "Server", "Unknown command");
-                    sprintf(mbuf,
-                            "%d: Invalid command \"%s\"",
-                            n, fields[0]);
-                    mdb(MSG_INFO, mbuf);
-                }
+            vmdb(MSG_DEBUG, "[COMMAND] %d: %s %s", n, f[0].s, f[1].s);
+
+        if ((fn = find_command(f[0].s)) != NULL)
+            fn(n, argc, f);
+        else if (find_autocmd(f[0].s) >= 0)
+            s_auto(n, argc, f); /* XXX check return code? -hoche */
+        else {
+            sendstatus(n, "Server", "Unknown command");
+            sprintf(mbuf,
+                    "%d: Invalid command \"%s\"",
+                    n, f[0].s);
+            mdb(MSG_INFO, mbuf);
         }
     } 
     else 
     {
         sprintf (mbuf,
                  "%d: cannot issue command until logged in (%s)",
-                 n, fields[0]);
+                 n, f[0].s);
         mdb(MSG_INFO, mbuf);
     }
 }
@@ -942,7 +906,7 @@ void pong(int n, char *pkt)
 
     if (u_tab[n].login >= LOGIN_COMPLETE) {
         struct timeval now;
-        gettimeofday (&now, NULL);
+        pktclock_timeval(&now);
         if ( pong_req[n] != -1 )
         {
             struct timeval diff;
@@ -951,8 +915,7 @@ void pong(int n, char *pkt)
             sprintf (tbuf, "%s client responded in %ld.%02ld seconds.",
                      u_tab[n].nickname, (long)diff.tv_sec, (long)diff.tv_usec / 10000);
             sendstatus (pong_req[n], "PONG", tbuf);
-            pong_req[n] = -1;
-            timerclear (&ping_time[n]);
+            set_user_pong_req(n, -1);
         }
         else
         {
@@ -972,11 +935,18 @@ void pong(int n, char *pkt)
  */
 int ok2read(int n)
 {
+    /* hold their login until we know who they are, if it matters */
+    if ( u_tab[n].resolving && u_tab[n].login == LOGIN_FALSE &&
+         rules_need_hostname() )
+    {
+        return (0);
+    }
+
     if ( u_tab[n].perms & PERM_SLOWMSGS )
     {
         time_t TheTime;
 
-        TheTime = time(NULL);
+        TheTime = pktclock_time();
 
         /*
          * if the current time - the last time they sent something
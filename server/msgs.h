@@ -1,5 +1,7 @@
 #pragma once
 
+#include "strutil.h"
+
 /* open message
  *  note that we need to know who sent the message.  it doesn't
  *  come with the sender's nick, so we have to reformat the message
@@ -37,6 +39,16 @@ int loginmsg(int n, char *pkt);
 
 void cmdmsg(int n, char *pkt);
 
+/* run a command that's already been broken into its fields: argv[0]
+ * is the command and argv[1] its arguments, which must be there even
+ * if argc is 1. cmdmsg() and messages to the server's own nick end up
+ * here.
+ *
+ *   n   	who issued it
+ */
+
+void runcmd(int n, int argc, TOKEN *argv);
+
 
 /* pong message
  *
@@ -58,3 +70,11 @@ void pong(int n, char *pkt);
  */
 int ok2read(int n);
 
+/*
+ * rules_need_hostname()
+ *
+ * - returns non-zero if there are deny or perms rules that match on
+ *   hostnames, so logins have to wait for the client's to be looked up
+ */
+int rules_need_hostname(void);
+
@@ -0,0 +1,212 @@
+/* name -> slot index, see nameindex.h
+ *
+ * Chained hash on the case-folded name. The chains are threaded
+ * through a per-slot next[] array, so setting and clearing a slot
+ * doesn't allocate anything.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "nameindex.h"
+#include "mdb.h"
+
+struct nameindex {
+    int nslots;
+    int keysz;          /* maxlen + 1 */
+    unsigned int mask;
+    int *heads;         /* bucket -> first slot, or -1 */
+    int *next;          /* slot -> next slot in its chain */
+    char *keys;         /* slot -> folded name, "" if none */
+};
+
+#define KEY(ix, slot)   ((ix)->keys + (size_t)(slot) * (ix)->keysz)
+
+static char
+fold(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+/* fold name into key. returns -1 if it's empty or too long to be
+ * anyone's. */
+static int
+fold_key(const nameindex_t *ix, const char *name, char *key)
+{
+    int i;
+
+    if (name == NULL || name[0] == '\0')
+        return -1;
+    for (i = 0; name[i]; i++) {
+        if (i >= ix->keysz - 1)
+            return -1;
+        key[i] = fold(name[i]);
+    }
+    key[i] = '\0';
+    return 0;
+}
+
+/* FNV-1a */
+static unsigned int
+hash_key(const nameindex_t *ix, const char *key)
+{
+    uint32_t h = 2166136261u;
+
+    for (; *key; key++)
+        h = (h ^ (unsigned char)*key) * 16777619u;
+    return h & ix->mask;
+}
+
+nameindex_t *
+nameindex_new(int nslots, int maxlen)
+{
+    nameindex_t *ix;
+    unsigned int nbuckets;
+    int i;
+
+    /* at least two buckets per slot keeps the chains short */
+    for (nbuckets = 16; nbuckets < (unsigned int)nslots * 2; nbuckets <<= 1)
+        ;
+
+    if ((ix = (nameindex_t *)calloc(1, sizeof(nameindex_t))) == NULL)
+        goto nomem;
+    ix->heads = (int *)malloc(nbuckets * sizeof(int));
+    ix->next = (int *)malloc(nslots * sizeof(int));
+    ix->keys = (char *)calloc(nslots, maxlen + 1);
+    if (ix->heads == NULL || ix->next == NULL || ix->keys == NULL)
+        goto nomem;
+
+    ix->nslots = nslots;
+    ix->keysz = maxlen + 1;
+    ix->mask = nbuckets - 1;
+    for (i = 0; i < (int)nbuckets; i++)
+        ix->heads[i] = -1;
+    for (i = 0; i < nslots; i++)
+        ix->next[i] = -1;
+    return ix;
+
+nomem:
+    vmdb(MSG_ERR, "%s: no memory for %d slots", __FUNCTION__, nslots);
+    nameindex_free(ix);
+    return NULL;
+}
+
+void
+nameindex_free(nameindex_t *ix)
+{
+    if (ix == NULL)
+        return;
+    free(ix->heads);
+    free(ix->next);
+    free(ix->keys);
+    free(ix);
+}
+
+int
+nameindex_grow(nameindex_t *ix, int nslots)
+{
+    unsigned int nbuckets, b;
+    int *heads, *next;
+    char *keys;
+    int i;
+
+    if (ix == NULL || nslots <= ix->nslots)
+        return 0;
+
+    for (nbuckets = ix->mask + 1; nbuckets < (unsigned int)nslots * 2; nbuckets <<= 1)
+        ;
+
+    heads = (int *)malloc(nbuckets * sizeof(int));
+    next = (int *)malloc(nslots * sizeof(int));
+    keys = (char *)calloc(nslots, ix->keysz);
+    if (heads == NULL || next == NULL || keys == NULL) {
+        vmdb(MSG_ERR, "%s: no memory for %d slots", __FUNCTION__, nslots);
+        free(heads);
+        free(next);
+        free(keys);
+        return -1;
+    }
+
+    memcpy(keys, ix->keys, (size_t)ix->nslots * ix->keysz);
+    free(ix->heads);
+    free(ix->next);
+    free(ix->keys);
+    ix->heads = heads;
+    ix->next = next;
+    ix->keys = keys;
+    ix->nslots = nslots;
+    ix->mask = nbuckets - 1;
+
+    /* and chain them all again under the new mask */
+    for (b = 0; b < nbuckets; b++)
+        heads[b] = -1;
+    for (i = nslots - 1; i >= 0; i--) {
+        next[i] = -1;
+        if (KEY(ix, i)[0] != '\0') {
+            b = hash_key(ix, KEY(ix, i));
+            next[i] = heads[b];
+            heads[b] = i;
+        }
+    }
+    return 0;
+}
+
+static void
+unlink_slot(nameindex_t *ix, int slot)
+{
+    int *pp;
+
+    for (pp = &ix->heads[hash_key(ix, KEY(ix, slot))]; *pp >= 0; pp = &ix->next[*pp]) {
+        if (*pp == slot) {
+            *pp = ix->next[slot];
+            break;
+        }
+    }
+    ix->next[slot] = -1;
+    KEY(ix, slot)[0] = '\0';
+}
+
+void
+nameindex_set(nameindex_t *ix, int slot, const char *name)
+{
+    char key[ix ? ix->keysz : 1];
+    unsigned int b;
+
+    if (ix == NULL || slot < 0 || slot >= ix->nslots)
+        return;
+
+    if (fold_key(ix, name, key) < 0)
+        key[0] = '\0';
+
+    if (strcmp(key, KEY(ix, slot)) == 0)
+        return;
+
+    if (KEY(ix, slot)[0] != '\0')
+        unlink_slot(ix, slot);
+
+    if (key[0] != '\0') {
+        strcpy(KEY(ix, slot), key);
+        b = hash_key(ix, key);
+        ix->next[slot] = ix->heads[b];
+        ix->heads[b] = slot;
+    }
+}
+
+int
+nameindex_find(const nameindex_t *ix, const char *name)
+{
+    char key[ix ? ix->keysz : 1];
+    int slot, found = -1;
+
+    if (ix == NULL || fold_key(ix, name, key) < 0)
+        return -1;
+
+    for (slot = ix->heads[hash_key(ix, key)]; slot >= 0; slot = ix->next[slot]) {
+        if (strcmp(KEY(ix, slot), key) == 0 && (found < 0 || slot < found))
+            found = slot;
+    }
+    return found;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+/* name index
+ *
+ * maps a name, case-insensitively, to the table slot that has it, so
+ * finding a nickname or a group doesn't have to strcasecmp its way
+ * through the whole table. users.c keeps one for u_tab[].nickname and
+ * groups.c one for g_tab[].name.
+ */
+
+typedef struct nameindex nameindex_t;
+
+/* an empty index for slots 0..nslots-1 and names of up to maxlen
+ * characters.
+ *
+ * returns NULL if there wasn't the memory
+ */
+nameindex_t *nameindex_new(int nslots, int maxlen);
+
+void nameindex_free(nameindex_t *ix);
+
+/* make room for slots up to nslots-1, keeping the names that are
+ * there.
+ *
+ * returns 0, or -1 if there wasn't the memory, in which case the
+ * index is as it was
+ */
+int nameindex_grow(nameindex_t *ix, int nslots);
+
+/* record that slot now has name. a NULL or empty name takes the slot
+ * out of the index.
+ */
+void nameindex_set(nameindex_t *ix, int slot, const char *name);
+
+/* the slot with name, or -1. if more than one slot has it, the lowest
+ * one, as a scan of the table would find.
+ */
+int nameindex_find(const nameindex_t *ix, const char *name);
@@ -10,10 +10,40 @@
 
 #include "namelist.h"
 #include "strutil.h"
+#include "wildmat.h"
 #include "mdb.h"
 
 /* name list routines */
 
+/* a wildcard entry, and what a name has to have to match it */
+typedef struct {
+    char *pat;
+    size_t minlen;      /* a match is at least this long */
+    int fixedlen;       /* and with no '*' in pat, exactly that long */
+    char *lit;          /* the longest run of plain characters in pat */
+    size_t litlen;
+    int litfirst;       /* pat starts with lit */
+} nlglob_t;
+
+struct nlmatcher {
+    char **set;         /* the entries with no wildcards, open addressed */
+    unsigned int mask;
+    nlglob_t *globs;    /* the rest */
+    int nglobs;
+    char *lits;         /* where the globs' lits are kept */
+};
+
+static void nlforget(NAMLIST *nl)
+{
+    if (nl->matcher) {
+        free(nl->matcher->set);
+        free(nl->matcher->globs);
+        free(nl->matcher->lits);
+        free(nl->matcher);
+        nl->matcher = NULL;
+    }
+}
+
 /* add a name to the list */
 
 void nlput(NAMLIST *nl, char *name)
@@ -35,6 +65,7 @@ void nlput(NAMLIST *nl, char *name)
         }
 
     /* user wasn't found */
+    nlforget(nl);
     if (nl->num < nl->max) {
         /* make a new entry for the user */
         if ((sp = (STRLIST *) malloc (sizeof(STRLIST) + strlen(name))) == NULL) {
@@ -104,6 +135,7 @@ void nlclear(NAMLIST *nl)
         p = tmp;
     }
 
+    nlforget(nl);
     nl->num = 0;
     nl->p = nl->head = nl->tail = 0;
 }
@@ -117,6 +149,7 @@ void nlinit(NAMLIST *nl, int max)
     nl->num = 0;
     nl->p = nl->head = nl->tail = 0;
     nl->max = max;
+    nl->matcher = NULL;
 }
 
 int nldelete(NAMLIST *nl, char *name)
@@ -132,6 +165,7 @@ int nldelete(NAMLIST *nl, char *name)
         return -1;
     }
 
+    nlforget(nl);
     strunlink(namep, &nl->head, &nl->tail);
     free(namep);
     nl->p= nl->head;
@@ -151,8 +185,157 @@ int nlpresent(char name[], NAMLIST nl)
     else return (NULL != NULL);
 }
 
-int nlmatch(char name[], NAMLIST nl)
+/* FNV-1a */
+static unsigned int nlhash(const char *s)
 {
-    if (nl.num > 0) return (strgetnode(name, nl.head, 1, 1) != NULL);
-    else return (NULL != NULL);
+    unsigned int h = 2166136261u;
+
+    for (; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+/* work out what a name must have to match g->pat, keeping the
+ * literal part in lit. returns -1 for a pattern too odd to say
+ * anything about, which is then always handed to wildmat(). this
+ * has to read patterns the way DoMatch() in wildmat.c does. */
+static int nlglobneeds(nlglob_t *g, char *lit)
+{
+    const char *p, *run = NULL, *best = NULL;
+    size_t runlen = 0, bestlen = 0;
+
+    g->minlen = 0;
+    g->fixedlen = 1;
+    g->lit = NULL;
+    g->litlen = 0;
+    g->litfirst = 0;
+
+    for (p = g->pat; *p; p++) {
+        switch (*p) {
+            case '*':
+                g->fixedlen = 0;
+                break;
+            case '?':
+                g->minlen++;
+                break;
+            case '\\':
+                if (*++p == '\0')
+                    return -1;
+                g->minlen++;
+                break;
+            case '[':
+                if (p[1] == '^')
+                    p++;
+                if (p[1] == ']' || p[1] == '-')
+                    p++;
+                while (*++p && *p != ']')
+                    if (*p == '-' && p[1] != ']' && *++p == '\0')
+                        return -1;
+                if (*p == '\0')
+                    return -1;
+                g->minlen++;
+                break;
+            default:
+                if (runlen++ == 0)
+                    run = p;
+                if (runlen > bestlen) {
+                    best = run;
+                    bestlen = runlen;
+                }
+                g->minlen++;
+                continue;
+        }
+        runlen = 0;
+    }
+
+    if (bestlen > 0) {
+        memcpy(lit, best, bestlen);
+        lit[bestlen] = '\0';
+        g->lit = lit;
+        g->litlen = bestlen;
+        g->litfirst = (best == g->pat);
+    }
+    return 0;
+}
+
+static struct nlmatcher *nlcompile(NAMLIST *nl)
+{
+    struct nlmatcher *m;
+    STRLIST *sp;
+    nlglob_t *g;
+    unsigned int size, h;
+    size_t litsz = 0;
+    char *lit;
+
+    for (size = 8; size < (unsigned int)nl->num * 2; size <<= 1)
+        ;
+    for (sp = nl->head; sp; sp = sp->next)
+        litsz += strlen(sp->str) + 1;
+
+    if ((m = (struct nlmatcher *) calloc(1, sizeof(*m))) == NULL)
+        return NULL;
+    m->set = (char **) calloc(size, sizeof(char *));
+    m->globs = (nlglob_t *) malloc(nl->num * sizeof(nlglob_t));
+    m->lits = (char *) malloc(litsz);
+    if (!m->set || !m->globs || !m->lits) {
+        free(m->set);
+        free(m->globs);
+        free(m->lits);
+        free(m);
+        return NULL;
+    }
+    m->mask = size - 1;
+
+    lit = m->lits;
+    for (sp = nl->head; sp; sp = sp->next) {
+        if (strpbrk(sp->str, "*?[\\") == NULL) {
+            for (h = nlhash(sp->str) & m->mask; m->set[h]; h = (h + 1) & m->mask)
+                ;
+            m->set[h] = sp->str;
+        } else {
+            g = &m->globs[m->nglobs++];
+            g->pat = sp->str;
+            if (nlglobneeds(g, lit) < 0) {
+                g->minlen = g->fixedlen = 0;
+                g->litlen = 0;
+            }
+            lit += g->litlen + 1;
+        }
+    }
+    return m;
+}
+
+int nlmatch(const char *name, NAMLIST *nl)
+{
+    struct nlmatcher *m;
+    nlglob_t *g;
+    unsigned int h;
+    size_t len;
+    int i;
+
+    if (!nl || nl->num == 0)
+        return 0;
+
+    if (nl->matcher == NULL)
+        nl->matcher = nlcompile(nl);
+    if ((m = nl->matcher) == NULL)
+        return (strgetnode((char *)name, nl->head, 1, 1) != NULL);
+
+    for (h = nlhash(name) & m->mask; m->set[h]; h = (h + 1) & m->mask)
+        if (strcmp(m->set[h], name) == 0)
+            return 1;
+
+    len = strlen(name);
+    for (i = 0; i < m->nglobs; i++) {
+        g = &m->globs[i];
+        if (len < g->minlen || (g->fixedlen && len != g->minlen))
+            continue;
+        if (g->litlen > 0 &&
+            (g->litfirst ? strncmp(name, g->lit, g->litlen) != 0
+                         : strstr(name, g->lit) == NULL))
+            continue;
+        if (wildmat((char *)name, g->pat))
+            return 1;
+    }
+    return 0;
 }
@@ -2,12 +2,16 @@
 
 #include "strlist.h"
 
+struct nlmatcher;
+
 /* manages a name list */
 typedef struct Namlist {
     STRLIST *head, *tail;       /* head and tail of name list */
     STRLIST *p;	/* user current location in name list */
     int num;	/* current number of name list entries */
     int max;	/* max number of list entries before discard */
+    struct nlmatcher *matcher;	/* the list compiled for nlmatch(), or
+                                   NULL until it's next needed */
 } NAMLIST;
 
 
@@ -21,9 +25,20 @@ char *nlget(NAMLIST *nl);
 /* return number of names in name list */
 unsigned int nlcount(NAMLIST nl);
 
+/* empty a list, freeing its entries and compiled matcher */
 void nlclear(NAMLIST *nl);
+
+/* set up a new list. it doesn't free anything, so nlclear() a list
+ * that's in use instead */
 void nlinit(NAMLIST *nl, int max);
 int nldelete(NAMLIST *nl, char *name);
 int nlpresent(char name[], NAMLIST nl);
-int nlmatch(char name[], NAMLIST nl);
+
+/* does name match any of the wildmat() patterns in the list?
+ *
+ * the first call after the list changes compiles it: the entries with
+ * no wildcards go in a hash set, and each of the others keeps what a
+ * name must have to match it, so most are ruled out without wildmat().
+ */
+int nlmatch(const char *name, NAMLIST *nl);
 
@@ -0,0 +1,314 @@
+/* watched name -> watcher slots, see notifyindex.h
+ *
+ * Each plain entry on a notify list is a watch, hashed on the entry
+ * and which list it's on, and strung on its watcher's own list so the
+ * watcher's can all be dropped when their lists change. Entries with
+ * wildcards aren't indexed; their watchers are kept in a short array
+ * and matched with nlmatch() as before.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "server.h"
+#include "externs.h"
+#include "namelist.h"
+#include "notifyindex.h"
+#include "mdb.h"
+
+#define WATCH_NICK  0           /* on n_notifies */
+#define WATCH_SITE  1           /* on s_notifies */
+
+struct watch {
+    struct watch *next;         /* in its bucket */
+    struct watch *wnext;        /* the watcher's next one */
+    int slot;
+    int kind;
+    char key[];
+};
+
+static int n_nslots = 0;
+static unsigned int n_mask = 0;
+static struct watch **n_buckets = NULL;
+static struct watch **n_watches = NULL;     /* slot -> its watches */
+
+static int *n_globbers = NULL;      /* slots with wildcard entries */
+static int *n_globpos = NULL;       /* slot -> where in n_globbers, or -1 */
+static int n_nglobbers = 0;
+
+static unsigned int *n_seen = NULL; /* slot -> last lookup it was found by */
+static unsigned int n_stamp = 0;
+
+/* FNV-1a, with the kind mixed in */
+static unsigned int
+hash_key(const char *key, int kind)
+{
+    uint32_t h = 2166136261u;
+
+    h = (h ^ (unsigned char)kind) * 16777619u;
+    for (; *key; key++)
+        h = (h ^ (unsigned char)*key) * 16777619u;
+    return h & n_mask;
+}
+
+static void
+drop_watches(int w)
+{
+    struct watch *wp, **pp;
+
+    while ((wp = n_watches[w]) != NULL) {
+        n_watches[w] = wp->wnext;
+        for (pp = &n_buckets[hash_key(wp->key, wp->kind)]; *pp != wp; pp = &(*pp)->next)
+            ;
+        *pp = wp->next;
+        free(wp);
+    }
+
+    if (n_globpos[w] >= 0) {
+        n_nglobbers--;
+        n_globbers[n_globpos[w]] = n_globbers[n_nglobbers];
+        n_globpos[n_globbers[n_nglobbers]] = n_globpos[w];
+        n_globpos[w] = -1;
+    }
+}
+
+static void
+free_all(void)
+{
+    int i;
+
+    if (n_watches && n_globpos)
+        for (i = 0; i < n_nslots; i++)
+            drop_watches(i);
+    free(n_buckets);
+    free(n_watches);
+    free(n_globbers);
+    free(n_globpos);
+    free(n_seen);
+    n_buckets = n_watches = NULL;
+    n_globbers = n_globpos = NULL;
+    n_seen = NULL;
+    n_nslots = n_nglobbers = 0;
+    n_mask = 0;
+}
+
+int
+notifyindex_init(int nslots)
+{
+    unsigned int nbuckets;
+    int i;
+
+    free_all();
+
+    /* a few entries per slot, and most people have none */
+    for (nbuckets = 16; nbuckets < (unsigned int)nslots * 4; nbuckets <<= 1)
+        ;
+
+    n_buckets = (struct watch **)calloc(nbuckets, sizeof(struct watch *));
+    n_watches = (struct watch **)calloc(nslots, sizeof(struct watch *));
+    n_globbers = (int *)malloc(nslots * sizeof(int));
+    n_globpos = (int *)malloc(nslots * sizeof(int));
+    n_seen = (unsigned int *)calloc(nslots, sizeof(unsigned int));
+    if (!n_buckets || !n_watches || !n_globbers || !n_globpos || !n_seen) {
+        vmdb(MSG_ERR, "%s: no memory for %d slots", __FUNCTION__, nslots);
+        free_all();
+        return -1;
+    }
+
+    for (i = 0; i < nslots; i++)
+        n_globpos[i] = -1;
+    n_nslots = nslots;
+    n_mask = nbuckets - 1;
+    return 0;
+}
+
+int
+notifyindex_grow(int nslots)
+{
+    struct watch **watches, **buckets, **bp, *wp;
+    unsigned int nbuckets;
+    int *globbers, *globpos;
+    unsigned int *seen;
+    int i;
+
+    if (nslots <= n_nslots)
+        return 0;
+
+    if ((watches = (struct watch **)realloc(n_watches, nslots * sizeof(struct watch *))) == NULL)
+        goto nomem;
+    n_watches = watches;
+    if ((globbers = (int *)realloc(n_globbers, nslots * sizeof(int))) == NULL)
+        goto nomem;
+    n_globbers = globbers;
+    if ((globpos = (int *)realloc(n_globpos, nslots * sizeof(int))) == NULL)
+        goto nomem;
+    n_globpos = globpos;
+    if ((seen = (unsigned int *)realloc(n_seen, nslots * sizeof(unsigned int))) == NULL)
+        goto nomem;
+    n_seen = seen;
+
+    for (i = n_nslots; i < nslots; i++) {
+        n_watches[i] = NULL;
+        n_globpos[i] = -1;
+        n_seen[i] = 0;
+    }
+
+    /* more buckets to go with them, if there's the memory. the
+     * watches are all on their watchers' lists, so they're easily
+     * found again. */
+    for (nbuckets = n_mask + 1; nbuckets < (unsigned int)nslots * 4; nbuckets <<= 1)
+        ;
+    if (nbuckets > n_mask + 1 &&
+        (buckets = (struct watch **)calloc(nbuckets, sizeof(struct watch *))) != NULL) {
+        free(n_buckets);
+        n_buckets = buckets;
+        n_mask = nbuckets - 1;
+        for (i = 0; i < n_nslots; i++) {
+            for (wp = n_watches[i]; wp; wp = wp->wnext) {
+                bp = &n_buckets[hash_key(wp->key, wp->kind)];
+                wp->next = *bp;
+                *bp = wp;
+            }
+        }
+    }
+
+    n_nslots = nslots;
+    return 0;
+
+nomem:
+    vmdb(MSG_ERR, "%s: no memory for %d slots", __FUNCTION__, nslots);
+    return -1;
+}
+
+/* index the entries of one of w's lists. returns 1 if any of them
+ * have wildcards, 0 if not */
+static int
+add_watches(int w, NAMLIST *nl, int kind)
+{
+    STRLIST *sp;
+    struct watch *wp;
+    size_t len;
+    unsigned int h;
+    int globs = 0;
+
+    for (sp = nl->head; sp; sp = sp->next) {
+        if (strpbrk(sp->str, "*?[\\") != NULL) {
+            globs = 1;
+            continue;
+        }
+        len = strlen(sp->str);
+        if ((wp = (struct watch *)malloc(sizeof(struct watch) + len + 1)) == NULL) {
+            /* match this one the slow way */
+            vmdb(MSG_ERR, "%s: no memory for %s", __FUNCTION__, sp->str);
+            globs = 1;
+            continue;
+        }
+        memcpy(wp->key, sp->str, len + 1);
+        wp->slot = w;
+        wp->kind = kind;
+        h = hash_key(wp->key, kind);
+        wp->next = n_buckets[h];
+        n_buckets[h] = wp;
+        wp->wnext = n_watches[w];
+        n_watches[w] = wp;
+    }
+    return globs;
+}
+
+void
+notifyindex_update(int w)
+{
+    int globs;
+
+    if (w < 0 || w >= n_nslots)
+        return;
+
+    drop_watches(w);
+    globs = add_watches(w, u_tab[w].n_notifies, WATCH_NICK);
+    globs |= add_watches(w, u_tab[w].s_notifies, WATCH_SITE);
+    if (globs) {
+        n_globpos[w] = n_nglobbers;
+        n_globbers[n_nglobbers++] = w;
+    }
+}
+
+static int
+cmp_slot(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+static void
+found(int w, int *to, int *nto)
+{
+    if (n_seen[w] != n_stamp) {
+        n_seen[w] = n_stamp;
+        to[(*nto)++] = w;
+    }
+}
+
+int
+notifyindex_watchers(const char *uc_nick, const char *uc_addr, int *to)
+{
+    struct watch *wp;
+    int i, w, nto = 0;
+
+    if (n_nslots == 0)
+        return 0;
+
+    if (++n_stamp == 0) {
+        memset(n_seen, 0, n_nslots * sizeof(unsigned int));
+        n_stamp = 1;
+    }
+
+    for (wp = n_buckets[hash_key(uc_nick, WATCH_NICK)]; wp; wp = wp->next)
+        if (wp->kind == WATCH_NICK && strcmp(wp->key, uc_nick) == 0)
+            found(wp->slot, to, &nto);
+    for (wp = n_buckets[hash_key(uc_addr, WATCH_SITE)]; wp; wp = wp->next)
+        if (wp->kind == WATCH_SITE && strcmp(wp->key, uc_addr) == 0)
+            found(wp->slot, to, &nto);
+
+    for (i = 0; i < n_nglobbers; i++) {
+        w = n_globbers[i];
+        if (n_seen[w] != n_stamp &&
+            (nlmatch(uc_nick, u_tab[w].n_notifies) ||
+             nlmatch(uc_addr, u_tab[w].s_notifies)))
+            found(w, to, &nto);
+    }
+
+    qsort(to, nto, sizeof(int), cmp_slot);
+    return nto;
+}
+
+#ifdef CHECK_INDEXES
+void
+notifyindex_check(void)
+{
+    int to[n_nslots > 0 ? n_nslots : 1];
+    int s, j, k, nto;
+
+    for (s = 0; s < n_nslots; s++) {
+        if (u_tab[s].login == LOGIN_FALSE)
+            continue;
+        nto = notifyindex_watchers(u_tab[s].uc_nick, u_tab[s].uc_addr, to);
+        for (j = 0, k = 0; j < n_nslots; j++) {
+            if (!nlmatch(u_tab[s].uc_nick, u_tab[j].n_notifies) &&
+                !nlmatch(u_tab[s].uc_addr, u_tab[j].s_notifies))
+                continue;
+            if (k >= nto || to[k] != j) {
+                vmdb(MSG_ERR, "notify index: %d watches %d, index says %d",
+                     j, s, k < nto ? to[k] : -1);
+                abort();
+            }
+            k++;
+        }
+        if (k != nto) {
+            vmdb(MSG_ERR, "notify index: %d doesn't watch %d", to[k], s);
+            abort();
+        }
+    }
+}
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+/* notify index
+ *
+ * who is watching for whom: the plain names on everyone's notify
+ * lists, hashed to the slots whose lists they're on, and the slots
+ * whose lists have wildcards in them. so a sign-on or sign-off looks
+ * up the people watching for it instead of matching everyone's lists.
+ * users.c and the notify command keep it up to date.
+ */
+
+/* (re)size the index for user slots 0..nslots-1, emptying it.
+ *
+ * returns 0, or -1 if there wasn't the memory
+ */
+int notifyindex_init(int nslots);
+
+/* make room for user slots up to nslots-1, keeping what's indexed.
+ *
+ * returns 0, or -1 if there wasn't the memory
+ */
+int notifyindex_grow(int nslots);
+
+/* slot w's notify lists changed; index them again */
+void notifyindex_update(int w);
+
+/* the slots whose n_notifies match uc_nick or whose s_notifies match
+ * uc_addr, each once and in slot order, into to[], which has room for
+ * every slot.
+ *
+ * returns how many
+ */
+int notifyindex_watchers(const char *uc_nick, const char *uc_addr, int *to);
+
+#ifdef CHECK_INDEXES
+/* check the index against everyone's lists for each logged in user,
+ * and abort() if it's out of step */
+void notifyindex_check(void);
+#endif
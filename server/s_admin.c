@@ -6,7 +6,10 @@
 #include "config.h"
 
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 #include <unistd.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <string.h>
@@ -19,11 +22,13 @@
 #include "icbutil.h"
 #include "strutil.h"
 #include "mdb.h"
+#include "timers.h"
 #include "pktserv/pktserv.h"  /* for pkserv_disconnect() */
+#include "pktserv/pktclock.h"
 
 extern int log_level;
 
-int s_log(int n, int argc)
+int s_log(int n, int argc, TOKEN *argv)
 {
     int new_level;
 
@@ -37,8 +42,8 @@ int s_log(int n, int argc)
             return (-1);
         }
 
-        if (strlen(fields[1])) {
-            new_level = atoi(getword(fields[1]));
+        if (argv[1].len) {
+            new_level = atoi(argv[1].s);
             if (new_level < 0)
                 new_level = 0;
 
@@ -56,19 +61,21 @@ int s_log(int n, int argc)
     return 0;
 }
 
-int s_drop(int n, int argc)
+int s_drop(int n, int argc, TOKEN *argv)
 {
+    TOKEN args;
     int TheVictim;
 
     if (argc == 2) {
-        /* fields[1] can be a string, not just a single nick */
-        TheVictim = find_user(getword(fields[1]));
+        /* argv[1] is the nick, then the password if it's not an admin */
+        args = argv[1];
+        TheVictim = find_user(tok_word(&args).s);
         if (TheVictim < 0) {
             senderror(n, "User not found.");
         } else if (check_auth(n))
             pktserv_disconnect(TheVictim);
         else if (valuser(u_tab[TheVictim].nickname,
-                         getword(get_tail(fields[1])), NULL) == 0) 
+                         tok_word(&args).s, NULL) == 0) 
         {
             sprintf(mbuf,"You have been disconnected by %s",
                     u_tab[n].nickname);
@@ -77,7 +84,7 @@ int s_drop(int n, int argc)
                      u_tab[n].nickname, n, 
                      u_tab[TheVictim].nickname, TheVictim);
             mdb(MSG_INFO, mbuf);
-            S_kill[TheVictim]++;
+            kill_user(TheVictim);
         }
         else
             senderror(n, "Authentication failure.");
@@ -86,7 +93,7 @@ int s_drop(int n, int argc)
     return 0;
 }
 
-int s_shutdown(int n, int argc)
+int s_shutdown(int n, int argc, TOKEN *argv)
 {
     int user;
     char line[255];
@@ -97,34 +104,54 @@ int s_shutdown(int n, int argc)
         return (-1);
     }
     if (argc == 2) {
-        /* fields[1] is when and comments, separated by a blank */
-        /*		mdb(getword(fields[1])); */
-        /*		mdb(get_tail(fields[1]));  why we are shutting down*/
+        /* argv[1] is when and comments, separated by a blank */
         /* BUG	we are presuming when is always now.
            ...but then, I don't know how to schedule
            anything anyhow.
            we are presuming that no warning is given */
         /* icbexit(); */
         sprintf(line, "Server going down in %ld minute(s)!", 
-                atol(fields[1]));
-        for (user=0; user < MAX_REAL_USERS; user++)
-            if (u_tab[user].login > LOGIN_FALSE)
+                atol(argv[1].s));
+        for (user=1; user < max_users; user++)
+            if (u_hot.login[user] > LOGIN_FALSE)
                 sendimport(user,"Shutdown", line);
-        TimeToDie = time(NULL) + 60.0 * atol(fields[1]);
+        TimeToDie = pktclock_time() + 60.0 * atol(argv[1].s);
         ShutdownNotify = 0;
-        if (atol(fields[1]) < 300)
+        if (atol(argv[1].s) < 300)
             ShutdownNotify++;
+        shutdown_timer_update();
     } else {
         mdb(MSG_INFO, "shutdown: wrong number of parz");
     }
     return 0;
 }
 
-int s_restart(int n, int argc)
+/* let everyone who was told about a restart know it isn't happening */
+static void restart_failed(int n, int quiet)
+{
+    int user;
+
+    if ( !quiet )
+    {
+        for (user=1; user < max_users; user++)
+            if (u_hot.login[user] > LOGIN_FALSE)
+                sendimport (user, "Restart", "Restart not done.");
+    }
+    else
+        sendimport (n, "Quiet-Restart", "Restart not done.");
+
+    mdb(MSG_ALL, "[RESTART] Restart failed");
+}
+
+int s_restart(int n, int argc, TOKEN *argv)
 {
     int user, ret;
-    char *env[2];
-    char tbuf[255];
+    char *env[3];
+    char handoff[32];
+    int sv[2];
+    pid_t pid;
+    char *image;
+    size_t imagelen;
     int quiet = 0;
 
     /* before we even look at what they sent us, are the allowed? */
@@ -134,13 +161,13 @@ int s_restart(int n, int argc)
     }
 
     if (argc == 2)
-        if ( !strcasecmp (fields[1], "quiet") )
+        if ( !strcasecmp (argv[1].s, "quiet") )
             quiet = 1;
 
     if ( !quiet )
     {
-        for (user=0; user < MAX_REAL_USERS; user++)
-            if (u_tab[user].login > LOGIN_FALSE)
+        for (user=1; user < max_users; user++)
+            if (u_hot.login[user] > LOGIN_FALSE)
                 sendimport(user,"Restart", 
                            "Server restarting...please be patient.");
     }
@@ -151,8 +178,6 @@ int s_restart(int n, int argc)
     }
 
     mdb(MSG_ALL, "[RESTART] Server restarting");
-    icbdump(0);
-    icbcloselogs(0);
 
     /* determine if we need to add the -R flag or not */
     for ( ret =0; ret < restart_argc; ret++ )
@@ -189,37 +214,75 @@ int s_restart(int n, int argc)
         restart_argv[restart_argc-1] = NULL;
     }
 
-    env[0] = strdup("RESTART=Y");
-    env[1] = NULL;
-    ret = fcntl(6, F_GETFD, 0);
+    /* the new server gets our sockets and state over this, and
+     * tells us when it's taken over */
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+        vmdb(MSG_ERR, "[ERROR] RESTART failed: socketpair: %s", strerror(errno));
+        restart_failed(n, quiet);
+        return -1;
+    }
 
-    if (fork()) exit(0);
+    /* TLS connections can't be handed over; they're closed here. this
+     * has to come before the state is taken. */
+    pktserv_handoff_prepare();
 
-    if (execve(restart_argv[0], restart_argv, env) < 0)
+    if (icbdump_image(&image, &imagelen) < 0)
     {
-        sprintf(tbuf, "[ERROR] RESTART failed: %s", 
-                strerror(errno));
-
-        mdb(MSG_ALL, tbuf);
+        mdb(MSG_ERR, "[ERROR] RESTART failed: couldn't dump the state");
+        close(sv[0]);
+        close(sv[1]);
+        restart_failed(n, quiet);
+        return -1;
+    }
 
-        if ( !quiet )
-        {
-            for (user=0; user < MAX_REAL_USERS; user++)
-                if (u_tab[user].login > LOGIN_FALSE)
-                    sendimport (user, "Restart", "Restart not done.");
-        }
-        else
-            sendimport (n, "Quiet-Restart", "Restart not done.");
+    snprintf(handoff, sizeof(handoff), "ICBD_HANDOFF=%d", sv[1]);
+    env[0] = "RESTART=Y";
+    env[1] = handoff;
+    env[2] = NULL;
 
-        mdb(MSG_ALL, "[RESTART] Restart failed");
+    if ((pid = fork()) < 0)
+    {
+        vmdb(MSG_ERR, "[ERROR] RESTART failed: fork: %s", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        free(image);
+        restart_failed(n, quiet);
         return -1;
     }
-    return 0;
+
+    if (pid == 0)
+    {
+        close(sv[0]);
+        close(icbd_log);
+        execve(restart_argv[0], restart_argv, env);
+        _exit(1);   /* the old server will notice and carry on */
+    }
+
+    close(sv[1]);
+    if (pktserv_handoff(sv[0], image, imagelen) == 0)
+    {
+        vmdb(MSG_ALL, "[RESTART] Handed over to pid %d", (int)pid);
+        icbcloselogs(0);
+        exit(0);
+    }
+
+    /* the new server isn't going to be taking over, so make sure it
+     * doesn't try */
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    close(sv[0]);
+    free(image);
+
+    mdb(MSG_ALL, "[ERROR] RESTART failed: the new server didn't take over");
+    restart_failed(n, quiet);
+    return -1;
 }
 
-int s_wall(int n, int argc)
+int s_wall(int n, int argc, TOKEN *argv)
 {
-    int user;
+    int user, nto = 0;
+    int to[max_users];
 
     /* before we even look at what they sent us, are the allowed? */
     if (!check_auth(n)) {
@@ -227,13 +290,13 @@ int s_wall(int n, int argc)
         return (-1);
     }
     if (argc == 2) {
-        /*		mdb(fields[1]);  text of message */
         /* send it only to the real users */
-        for (user=0; user < MAX_REAL_USERS; user++) {
-            if (u_tab[user].login > LOGIN_FALSE) {
-                sendimport(user,"WALL", fields[1]);
+        for (user=1; user < max_users; user++) {
+            if (u_hot.login[user] > LOGIN_FALSE) {
+                to[nto++] = user;
             }
         }
+        sendimport_multi(to, nto, "WALL", argv[1].s);
     } else {
         mdb(MSG_INFO, "wall: wrong number of parz");
     }
@@ -17,99 +17,66 @@
 #include "protocol.h"
 #include "access.h"
 #include "send.h"
+#include "users.h"
+#include "pktserv/pktclock.h"
 
 /* basic dispatch routine */
-extern char packetbuffer[];
-
-int s_auto(int n, int f)
+int s_auto(int n, int argc, TOKEN *argv)
 {
+    TOKEN args = argv[1];
     char * cp;
+    char * word;
     int which;
     int ret = 0;
-    char p1[256];
-
-    if (f > 0)
-        split(packetbuffer);
 
-    cp = getword(fields[f]);
-
-    which = lookup(cp,auto_table);
+    which = find_autocmd(argv[0].s);
 
     switch(which) {
         case AUTO_READ:
             nickreadmsg(n, NULL);
             break;
         case AUTO_WHO:
-            if (f)
-                cp = getword(get_tail(fields[f]));
-            else
-                cp = getword(fields[f+1]);
+            cp = tok_word(&args).s;
             ret = nicklookup(n, cp, NULL);
             break;
         case AUTO_REGISTER:
-            if (f)
-                cp = getword(get_tail(fields[f]));
-            else
-                cp = getword(fields[f+1]);
+            cp = tok_word(&args).s;
             ret = nickwrite(n, cp, 0, NULL);
             break;
         case AUTO_REAL:
-            if (f)
-                cp = get_tail(fields[f]);
-            else
-                cp = fields[f+1];
+            cp = argv[1].s;
             if (strlen(cp) == 0)
                 sends_cmdout(n, "Usage: rname Real Name");
             else 
                 nickchinfo(n, "realname", cp, 25, "Real Name", NULL);
             break;
         case AUTO_WRITE:
-            if (f)
-                nickwritemsg(n, 
-                             getword(get_tail(fields[f])),
-                             get_tail(get_tail(fields[f])),
-                             NULL);
-            else
-                nickwritemsg(n, 
-                             getword(fields[f+1]),
-                             get_tail(fields[f+1]),
-                             NULL);
+            word = tok_word(&args).s;
+            nickwritemsg(n, word, args.s, NULL);
             break;
         case AUTO_TEXT:
-            if (f)
-                cp = get_tail(fields[f]);
-            else
-                cp = fields[f+1];
+            cp = argv[1].s;
             if (strlen(cp) == 0)
                 sends_cmdout(n, "Usage: text Message Text");
             else 
                 nickchinfo(n, "text", cp, 200, "Message text", NULL);
             break;
         case AUTO_ADDR:
-            if (f)
-                cp = get_tail(fields[f]);
-            else
-                cp = fields[f+1];
+            cp = argv[1].s;
             if (strlen(cp) == 0)
                 sends_cmdout(n, "Usage: addr Address Line 1 | Address Line 2 | Address Line 3");
             else 
                 nickchinfo(n, "addr", cp, 79, "Address", NULL);
             break;
         case AUTO_PHONE:
-            if (f)
-                cp = get_tail(fields[f]);
-            else
-                cp = fields[f+1];
+            cp = argv[1].s;
             if (strlen(cp) == 0)
                 sends_cmdout(n, "Usage: phone 1-800-555-1212");
             else 
                 nickchinfo(n, "phone", cp, 14, "Phone Number", NULL);
             break;
         case AUTO_DELETE:
-            if (f)
-                cp = getword(get_tail(fields[f]));
-            else
-                cp = getword(fields[f+1]);
+            cp = tok_word(&args).s;
             if ( strlen(cp) == 0 )
                 sends_cmdout(n, "Usage: delete password");
             else
@@ -160,19 +127,9 @@ int s_auto(int n, int f)
             sends_cmdout(n, "See also /s_help");
             break;
         case AUTO_CP:
-            if (f) {
-                strncpy(p1, getword(get_tail(fields[f])), 255);
-                nickchpass(n, p1, 
-                           getword(get_tail(get_tail(fields[f]))),
-                           NULL);
-            }
-            else
-            {
-                strncpy(p1, getword(fields[f+1]), 255);
-                nickchpass(n, p1, 
-                           getword(get_tail(fields[f+1])),
-                           NULL);
-            }
+            word = tok_word(&args).s;
+            cp = tok_word(&args).s;
+            nickchpass(n, word, cp, NULL);
             break;
         case AUTO_SECURE:
             setsecure(n, 1, NULL);
@@ -181,20 +138,14 @@ int s_auto(int n, int f)
             setsecure(n, 0, NULL);
             break;
         case AUTO_WWW:
-            if (f)
-                cp = get_tail(fields[f]);
-            else
-                cp = fields[f+1];
+            cp = argv[1].s;
             if (strlen(cp) == 0)
                 sends_cmdout(n, "Usage: www URL");
             else
                 nickchinfo(n, "www", cp, 80, "WWW", NULL);
             break;
         case AUTO_EMAIL:
-            if (f)
-                cp = get_tail(fields[f]);
-            else
-                cp = fields[f+1];
+            cp = argv[1].s;
             if (strlen(cp) == 0)
                 sends_cmdout(n, "Usage: email e-mail address");
             else 
@@ -206,7 +157,7 @@ int s_auto(int n, int f)
                        "usage: /m server {whois | p | cp | delete | rname | email | phone | addr | text | read | write | www | info | secure | nosecure | help | ?}");
             break;
     }
-    u_tab[NICKSERV].t_recv = time(NULL);
+    set_user_recv(NICKSERV, pktclock_time());
 
     return ret;
 }
@@ -14,9 +14,10 @@
 #include "send.h"
 
 /* basically just a rewriting of s_person */
-int s_beep(int n, int argc)
+int s_beep(int n, int argc, TOKEN *argv)
 {
     int dest;
+    TOKEN args;
     char * cp;
 
     if (argc == 2) {
@@ -24,11 +25,8 @@ int s_beep(int n, int argc)
            destination nickname is not null
            destination nickname exists */
 
-        cp = getword(fields[1]);
-        if (cp == NULL) {
-            mdb(MSG_INFO, "Null string in beep");
-            return 0;
-        }
+        args = argv[1];
+        cp = tok_word(&args).s;
         if (strlen(cp) == 0) {
             mdb(MSG_INFO, "Null string in beep");
         } else {
@@ -21,13 +21,17 @@
 #include "namelist.h"
 #include "send.h"
 #include "users.h"
+#include "members.h"
+#include "hushset.h"
 #include "mdb.h"
 #include "s_commands.h"
 #include "s_stats.h"    /* for server_stats */
+#include "timers.h"
+#include "pktserv/pktclock.h"
 
 int is_booting = 0;
 
-int s_cancel(int n, int argc)
+int s_cancel(int n, int argc, TOKEN *argv)
 {
     int gi;
     int is_restricted, is_moderator;
@@ -35,31 +39,33 @@ int s_cancel(int n, int argc)
     int i;
     int mode = -1;
     int quiet = -1;
+    TOKEN args;
     char *who, *flags;
 
     if (argc == 2)
     {
         /* constraints:
            group is restricted & inviter is mod & 
-           fields[1] is in invite list
+           argv[1] is in invite list
            change in invite list
            otherwise
            complain appropriately
            side-effects:
            none
 other:
-fields[1] is nickname of person for cancel
+argv[1] is nickname of person for cancel
          */
         /* gi is canceller's groupindex */
-        gi = find_group(u_tab[n].group);
+        gi = u_tab[n].gid;
 
         is_restricted = (g_tab[gi].control == RESTRICTED);
         is_moderator =(g_tab[gi].mod == n);
         can_do = (is_restricted && is_moderator) ;
-        who = fields[1];
+        args = argv[1];
+        who = args.s;
         while (who[0] == '-')
         {
-            flags = getword(who);
+            flags = tok_word(&args).s;
             for (i = 1; i < strlen(flags); i++)
                 switch (flags[i]) {
                     case 'q':
@@ -90,7 +96,7 @@ fields[1] is nickname of person for cancel
                         senderror(n, "Usage: cancel {-q} {-n nickname | -s address}");
                         return -1;
                 }
-            who = get_tail(who);
+            who = args.s;
         }
 
         if (mode == -1) mode = 0;
@@ -153,7 +159,7 @@ fields[1] is nickname of person for cancel
    n is mod
  */
 
-int s_change(int n, int argc)
+int s_change(int n, int argc, TOKEN *argv)
 {
     int group_exists;
     int is_restricted;
@@ -162,10 +168,12 @@ int s_change(int n, int argc)
     int is_invited;
     int target_user;
     int ngi, ogi; /* new and old group indices */
-    int len, how_many, i;
+    int len, how_many;
     char n_g_n[MAX_GROUPLEN+3]; /* new group name */
     long TheTime;
     char useraddr[255];
+    char target_group[MAX_GROUPLEN+1];
+    TOKEN args[2];
     int login_status = 0;
 
     /* this is a silly hack, but so is this entire server, really */
@@ -211,24 +219,27 @@ if failure, message given and return is -1
         memset(useraddr, 0, sizeof (useraddr));
         sprintf(useraddr, "%s@%s", u_tab[n].loginid, u_tab[n].nodeid);
         ucaseit(useraddr);
-        len = strlen(fields[1]);
+        len = argv[1].len;
 
-        if (fields[1][0] == '@')
+        if (argv[1].s[0] == '@')
         {
-            if ((target_user = find_user(&fields[1][1])) < 0)
+            if ((target_user = find_user(&argv[1].s[1])) < 0)
             {
                 senderror(n, "User not found.");
                 return(-1);
             }
-            else if (g_tab[find_group(u_tab[target_user].group)].visibility != VISIBLE)
+            else if (g_tab[u_tab[target_user].gid].visibility != VISIBLE)
             {
                 senderror(n, "User not found.");
                 return(-1);
             }
             else
             {
-                strcpy (fields[1], u_tab[target_user].group);
-                return(s_change(n, argc));
+                snprintf(target_group, sizeof(target_group), "%s",
+                         group_name(u_tab[target_user].gid));
+                args[0] = argv[0];
+                args[1] = tok_str(target_group);
+                return(s_change(n, argc, args));
             }
         }
 
@@ -241,25 +252,25 @@ if failure, message given and return is -1
 
         memset(n_g_n, 0, sizeof (n_g_n));
 
-        if (fields[1][0] == '.')
+        if (argv[1].s[0] == '.')
         {
-            if (fields[1][1] == '.')
+            if (argv[1].s[1] == '.')
             {
                 how_many = (MAX_GROUPLEN + 2> len) ? len:MAX_GROUPLEN + 2;
-                strncpy(n_g_n, &fields[1][2], how_many - 2);
+                strncpy(n_g_n, &argv[1].s[2], how_many - 2);
                 visibility = SUPERSECRET;
             }
             else
             {
                 how_many = (MAX_GROUPLEN + 1> len) ? len:MAX_GROUPLEN + 1;
-                strncpy(n_g_n, &fields[1][1], how_many - 1);
+                strncpy(n_g_n, &argv[1].s[1], how_many - 1);
                 visibility = SECRET;
             }
         }
         else
         {
             how_many = (MAX_GROUPLEN > len) ? len:MAX_GROUPLEN;
-            strncpy(n_g_n, fields[1], how_many);
+            strncpy(n_g_n, argv[1].s, how_many);
             visibility = VISIBLE;
         }
 
@@ -285,10 +296,10 @@ if failure, message given and return is -1
         if (group_exists)
             is_invited = ((nlpresent(u_tab[n].nickname, 
                                      *g_tab[ngi].n_invites) > 0) ||
-                          (nlmatch(useraddr, *g_tab[ngi].s_invites)) ||
+                          (nlmatch(useraddr, g_tab[ngi].s_invites)) ||
                           (nlpresent(u_tab[n].nickname, *g_tab[ngi].nr_invites) &&
                            (strlen(u_tab[n].realname) > 0)) ||
-                          (nlmatch(useraddr, *g_tab[ngi].sr_invites) &&
+                          (nlmatch(useraddr, g_tab[ngi].sr_invites) &&
                            (strlen(u_tab[n].realname) > 0)));
         else
             is_invited = 0;
@@ -307,7 +318,7 @@ if failure, message given and return is -1
 
             /* could create it, so fill in the info */
             g_tab[ngi].visibility = visibility;
-            strcpy(g_tab[ngi].name, n_g_n);
+            set_group_name(ngi, n_g_n);
 
             /* special settings employed for special groups */
             if ( strcasecmp (BOOT_GROUP, n_g_n) == 0 )
@@ -338,14 +349,14 @@ if failure, message given and return is -1
             }
 
             /* initialize the invitation list */
-            nlinit(g_tab[ngi].n_invites, MAX_INVITES);
-            nlinit(g_tab[ngi].nr_invites, MAX_INVITES);
-            nlinit(g_tab[ngi].s_invites, MAX_INVITES);
-            nlinit(g_tab[ngi].sr_invites, MAX_INVITES);
-            nlinit(g_tab[ngi].n_bars, MAX_INVITES);
-            nlinit(g_tab[ngi].n_nr_bars, MAX_INVITES);
-            nlinit(g_tab[ngi].s_bars, MAX_INVITES);
-            nlinit(g_tab[ngi].s_nr_bars, MAX_INVITES);
+            nlclear(g_tab[ngi].n_invites);
+            nlclear(g_tab[ngi].nr_invites);
+            nlclear(g_tab[ngi].s_invites);
+            nlclear(g_tab[ngi].sr_invites);
+            nlclear(g_tab[ngi].n_bars);
+            nlclear(g_tab[ngi].n_nr_bars);
+            nlclear(g_tab[ngi].s_bars);
+            nlclear(g_tab[ngi].s_nr_bars);
         }
 
         /* if we get here, the destination group exists */
@@ -362,10 +373,10 @@ if failure, message given and return is -1
                 /* are we invited? */
                 is_invited = ((nlpresent(u_tab[n].nickname, 
                                          *g_tab[ngi].n_invites) > 0) ||
-                              (nlmatch(useraddr, *g_tab[ngi].s_invites)) ||
+                              (nlmatch(useraddr, g_tab[ngi].s_invites)) ||
                               (nlpresent(u_tab[n].nickname, *g_tab[ngi].nr_invites) &&
                                (strlen(u_tab[n].realname) > 0)) ||
-                              (nlmatch(useraddr, *g_tab[ngi].sr_invites) &&
+                              (nlmatch(useraddr, g_tab[ngi].sr_invites) &&
                                (strlen(u_tab[n].realname) > 0)));
 
                 if (!is_invited && is_booting == 0)
@@ -380,17 +391,9 @@ if failure, message given and return is -1
                     if ((g_tab[ngi].mod > 0) && 
                         (g_tab[ngi].volume == LOUD))
                     {
-                        char one[255], two[255];
                         int    gm = g_tab[ngi].mod;
 
-                        sprintf(one, "%s@%s", u_tab[n].loginid,
-                                u_tab[n].nodeid);
-                        ucaseit(one);
-                        strcpy(two, u_tab[n].nickname);
-                        ucaseit(two);
-
-                        if ( !nlmatch(one, *u_tab[gm].pri_s_hushed) &&
-                             !nlmatch(two, *u_tab[gm].pri_n_hushed) )
+                        if ( !hushset_hushes(gm, n, HUSH_PERSONAL) )
                         {
                             sprintf (mbuf,
                                      "%s tried to enter the group.",
@@ -401,7 +404,7 @@ if failure, message given and return is -1
                              * this counts as if it was a private
                              * message for /whereis 
                              */
-                            lpriv_id[gm] = n;
+                            set_user_lpriv(gm, n);
                         }
 
                     }
@@ -414,19 +417,7 @@ if failure, message given and return is -1
            what was its index
          */
 
-        if (strlen(u_tab[n].group) == 0)
-        {
-            ogi = -1;
-        }
-        else
-        {
-            ogi = find_group(u_tab[n].group);
-            if (ogi < 0)
-            {
-                sprintf(mbuf, "Can't find group %s\n", u_tab[n].group);
-                mdb(MSG_ERR, mbuf);
-            }
-        }
+        ogi = u_tab[n].gid;
 
         /*
          * if it's not a restricted or public group
@@ -438,14 +429,12 @@ if failure, message given and return is -1
         {
             if ( g_tab[ngi].size > 0 )
             {
-                int num = 0;
+                int num;
 
-                /* count the users in this group */
-                for ( i = 0; i < MAX_REAL_USERS; i++ )
-                {
-                    if ( !strcasecmp (u_tab[i].group, g_tab[ngi].name) )
-                        ++num;
-                }
+                /* count the real users in this group */
+                num = members_count(ngi);
+                if ( u_tab[NICKSERV].gid == ngi )
+                    --num;
 
                 /* if it's full, and we're not mod */
                 if ( num >= g_tab[ngi].size && g_tab[ngi].mod != n )
@@ -453,17 +442,9 @@ if failure, message given and return is -1
                     if ( (g_tab[ngi].mod > 0) && 
                          (g_tab[ngi].volume == LOUD) )
                     {
-                        char one[255], two[255];
                         int    gm = g_tab[ngi].mod;
 
-                        sprintf(one, "%s@%s", u_tab[n].loginid,
-                                u_tab[n].nodeid);
-                        ucaseit(one);
-                        strcpy(two, u_tab[n].nickname);
-                        ucaseit(two);
-
-                        if ( !nlmatch(one, *u_tab[gm].pri_s_hushed) &&
-                             !nlmatch(two, *u_tab[gm].pri_n_hushed) )
+                        if ( !hushset_hushes(gm, n, HUSH_PERSONAL) )
                         {
                             sprintf (mbuf,
                                      "%s tried to enter the group, but it's full.",
@@ -473,7 +454,7 @@ if failure, message given and return is -1
                              * this counts as if it was a private
                              * message for /whereis 
                              */
-                            lpriv_id[gm] = n;
+                            set_user_lpriv(gm, n);
                         }
                     }
 
@@ -488,7 +469,7 @@ if failure, message given and return is -1
         /* is the new group different than the old group? */
         if (ngi != ogi) {
             /* the group exists and we are allowed in. */
-            strcpy(u_tab[n].group, g_tab[ngi].name);
+            set_user_group(n, ngi);
 
             /* tell the new group about the arrival */
             sprintf(mbuf,"%s (%s@%s) entered group",
@@ -509,13 +490,15 @@ if failure, message given and return is -1
                 strcat (mbuf, " as moderator");
             sendstatus(n,"Status",mbuf);
 
-            TheTime = time(NULL);
+            TheTime = pktclock_time();
             u_tab[n].t_group = TheTime;
+            user_timer_update(n);
+            group_timer_update(ngi);
 
             /* did the old group exist? */
             if (ogi >= 0) {
                 /* is there anyone left? */
-                if(count_users_in_group(g_tab[ogi].name)>0) {
+                if(count_users_in_group(ogi)>0) {
                     /* tell them user left */
                     sprintf(mbuf,"%s (%s@%s) just left",
                             u_tab[n].nickname,
@@ -631,7 +614,7 @@ int list_invites (int n, int gi)
 }
 
 
-int s_invite(int n, int argc)
+int s_invite(int n, int argc, TOKEN *argv)
 {
     int gi;
     int is_restricted, is_moderator;
@@ -640,6 +623,7 @@ int s_invite(int n, int argc)
     int r = -1;
     int i;
     int quiet = -1;
+    TOKEN args;
     char *who = (char *)NULL;
     char *flags;
 
@@ -653,17 +637,18 @@ int s_invite(int n, int argc)
            side-effects:
            if invitee is signed on, send status message
 other:
-fields[1] is nickname of person to invite
+argv[1] is nickname of person to invite
          */
 
-        gi = find_group(u_tab[n].group);
+        gi = u_tab[n].gid;
 
         is_restricted = (g_tab[gi].control == RESTRICTED);
         is_moderator =(g_tab[gi].mod == n);
-        who = fields[1];
+        args = argv[1];
+        who = args.s;
         while (who[0] == '-')
         {
-            flags = getword(who);
+            flags = tok_word(&args).s;
             for (i = 1; i < strlen(flags); i++)
                 switch (flags[i])
                 {
@@ -707,7 +692,7 @@ fields[1] is nickname of person to invite
                         senderror(n, "Usage: invite {-q} {-r} {-n nickname | -s address}");
                         return -1;
                 }
-            who = get_tail(who);
+            who = args.s;
         }
 
         if ( who == (char *)NULL || *who == '\0' )
@@ -715,7 +700,7 @@ fields[1] is nickname of person to invite
             /*
                senderror(n,
                "Usage: invite {-q} {-r} {-n nickname | -s address}");
-               s_status(n, argc);
+               s_status(n, argc, argv);
              */
             if ( !is_restricted )
             {
@@ -768,7 +753,7 @@ fields[1] is nickname of person to invite
             if((dest = find_user(who)) >= 0) {
                 if ((strlen(u_tab[dest].realname) > 0) || (r == 0)) {
                     sprintf(mbuf, "You are invited to group %s by %s",
-                            u_tab[n].group, u_tab[n].nickname);
+                            group_name(u_tab[n].gid), u_tab[n].nickname);
                     sendstatus(dest,"RSVP",mbuf);
                 }
             } else {
@@ -787,11 +772,12 @@ fields[1] is nickname of person to invite
     return 0;
 }
 
-int s_pass(int n, int argc)
+int s_pass(int n, int argc, TOKEN *argv)
 {
     int is_moderator;
     int gi;
     int dest;
+    TOKEN args;
     char * cp;
 
     if (argc == 2) {
@@ -808,7 +794,7 @@ int s_pass(int n, int argc)
          */
 
         /* what is the user's group? */
-        gi = find_group(u_tab[n].group);
+        gi = u_tab[n].gid;
 
         /* are they the mod or admin? */
         is_moderator = (check_auth(n) || (g_tab[gi].mod == n));
@@ -821,9 +807,10 @@ int s_pass(int n, int argc)
         /* they are the mod */
 
         /* do they want to pass or relinquish? */
-        if( strlen(fields[1]) == 0) {
+        if( argv[1].len == 0) {
             /* relinquish mod */
             g_tab[gi].mod = -1;
+            group_timer_update(gi);
 
             /* tell people */
             sprintf(mbuf, "%s just relinquished the mod.",
@@ -845,7 +832,8 @@ int s_pass(int n, int argc)
 
         } else {
             /* check dest. nickname */
-            cp = getword(fields[1]);
+            args = argv[1];
+            cp = tok_word(&args).s;
             if (strlen(cp) == 0) {
                 mdb(MSG_INFO, "null string in pass");
                 return 0;
@@ -863,6 +851,7 @@ int s_pass(int n, int argc)
             if (dest >= 0) {
                 /* fix the mod-ship */
                 g_tab[gi].mod = dest;
+                group_timer_update(gi);
 
                 /* send message to dest.*/
                 sprintf(mbuf,
@@ -890,32 +879,33 @@ int s_pass(int n, int argc)
     return 0;
 }
 
-int s_boot(int n, int argc)
+int s_boot(int n, int argc, TOKEN *argv)
 {
     int gi;
     int is_moderator;
     int dest;
     int destgi;
+    TOKEN args, bootargs[2];
     char *msg;
     char *user;
 
     if (argc == 2) 
     {
         /* constraints:
-           inviter is mod & fields[1] is in this group
-           put fields[1] in group 1
-           send boot message to fields[1]
+           inviter is mod & argv[1] is in this group
+           put argv[1] in group 1
+           send boot message to argv[1]
            otherwise
            complain appropriately
            if group is QUIET, no messages sent.
            side-effects:
            if boot occurs, inform others in group
 other:
-fields[1] is nickname of person to boot
+argv[1] is nickname of person to boot
          */
 
         /* gi is canceller's groupindex */
-        gi = find_group(u_tab[n].group);
+        gi = u_tab[n].gid;
 
         /* are they the mod or admin? */
         /*is_moderator =(g_tab[gi].mod == n); */
@@ -923,8 +913,9 @@ fields[1] is nickname of person to boot
 
         if (is_moderator) 
         {
-            user = getword (fields[1]);
-            msg = get_tail (fields[1]);
+            args = argv[1];
+            user = tok_word(&args).s;
+            msg = args.s;
             dest = find_user(user);
             if (dest < 0) 
             {
@@ -960,7 +951,7 @@ fields[1] is nickname of person to boot
                 }
                 else
                     msg = (char *)NULL;
-                destgi = find_group(u_tab[dest].group);
+                destgi = u_tab[dest].gid;
                 if (gi == destgi) {
                     /* send status to group */
                     if ((nldelete(g_tab[destgi].n_invites,
@@ -993,9 +984,10 @@ fields[1] is nickname of person to boot
                             u_tab[n].nickname);
                     sendstatus(dest,"Boot",mbuf);
                     /* fake s_change to group BOOT_GROUP */
-                    strcpy(fields[1],BOOT_GROUP);
+                    bootargs[0] = tok_str("g");
+                    bootargs[1] = tok_str(BOOT_GROUP);
                     is_booting = 1;
-                    s_change(dest,2);
+                    s_change(dest, 2, bootargs);
                     is_booting = 0;
                     server_stats.boots++;
                     /* note: although s_change returns a result, we presume that we can
@@ -1003,7 +995,7 @@ fields[1] is nickname of person to boot
                 } else {
                     sprintf(mbuf,
                             "%s is not in your group",
-                            fields[1]);
+                            user);
                     senderror(n,mbuf);
                 }
             }
@@ -1042,8 +1034,6 @@ void dump_table(int n)
 /* used by s_status() */
 int set_name(int n, int group, char *name)
 {
-    char * cp;
-    int i;
     char n_g_n[MAX_GROUPLEN + 1];
 
     /* make sure they gave us a name to change to */
@@ -1066,26 +1056,16 @@ int set_name(int n, int group, char *name)
         return -1;
     }
 
-    /* get a copy to the old name */
-    cp = g_tab[group].name;
-
-    /* check through the user table to see who is in that group */
-    /* and change their group name entries */
-    for (i=0; i< MAX_REAL_USERS; i++) {
-        if (strcasecmp(u_tab[i].group, cp) == 0) {
-            strcpy(u_tab[i].group, n_g_n);
-        }
-    }
-
-    /* finally change the name of the group itself */
-    strcpy(g_tab[group].name, n_g_n);
+    /* the members have its index, not its name, so only the group
+     * itself changes */
+    set_group_name(group, n_g_n);
     return 0;
 }
 
 
 
 
-int s_status(int n, int argc)
+int s_status(int n, int argc, TOKEN *argv)
 {
     int count;
     int i;
@@ -1098,6 +1078,7 @@ int s_status(int n, int argc)
     int is_moderator;
     int is_public;
     int has_mod;
+    TOKEN args;
     char * p1;
     char * p2;
     int gi;
@@ -1106,9 +1087,9 @@ int s_status(int n, int argc)
 
     if (argc == 2)
     {
-        if( strlen(fields[1]) == 0)
+        if( argv[1].len == 0)
         {
-            gi = find_group(u_tab[n].group); /* is n's groupindex */
+            gi = u_tab[n].gid; /* is n's groupindex */
 
             /* visibility */
             switch(g_tab[gi].visibility)
@@ -1269,7 +1250,7 @@ int s_status(int n, int argc)
         else
         {
             /* gi is n's group's index */
-            gi = find_group(u_tab[n].group);
+            gi = u_tab[n].gid;
 
             is_public = (g_tab[gi].control == PUBLIC);
             is_moderator = (g_tab[gi].mod == n);
@@ -1322,8 +1303,8 @@ and thus the ability to boot.
 but:  group 1 is still always public and
 visible.
              */
-            p1 = fields[1];
-            while(strlen(p2=getword(p1)) > 0)
+            args = argv[1];
+            while ((p2 = tok_word(&args).s)[0] != '\0')
             {
                 int    lu,
                     process = 1;
@@ -1359,8 +1340,7 @@ visible.
                         /* IDLE_BOOT & SET_IDLEMOD have args we need to eat */
                         if ( lu == SET_IDLEBOOT || lu == SET_IDLEMOD )
                         {
-                            p1 = get_tail(p1);
-                            p2 = getword(p1);
+                            p2 = tok_word(&args).s;
                         }
 
                         /* keep it from being processed */
@@ -1374,14 +1354,13 @@ visible.
                     {
                         case SET_RESTRICT:
                             g_tab[gi].control = RESTRICTED;
-                            nlinit(g_tab[gi].n_bars, MAX_INVITES);
-                            nlinit(g_tab[gi].n_nr_bars, MAX_INVITES);
-                            nlinit(g_tab[gi].s_bars, MAX_INVITES);
-                            nlinit(g_tab[gi].s_nr_bars, MAX_INVITES);
+                            nlclear(g_tab[gi].n_bars);
+                            nlclear(g_tab[gi].n_nr_bars);
+                            nlclear(g_tab[gi].s_bars);
+                            nlclear(g_tab[gi].s_nr_bars);
                             cp = "Group is now restricted.";
 
-                            for (i=0; i<MAX_USERS; i++)
-                                if (strcasecmp(u_tab[i].group,g_tab[gi].name) == 0)
+                            for (i = members_first(gi); i >= 0; i = members_next(i))
                                 {
                                     if (strlen(u_tab[i].realname) == 0)
                                         nlput(g_tab[gi].n_invites,
@@ -1405,45 +1384,39 @@ visible.
 
                         case SET_MODERATE:
                             g_tab[gi].control = MODERATED;
-                            nlinit(g_tab[gi].n_invites, MAX_INVITES);
-                            nlinit(g_tab[gi].nr_invites, MAX_INVITES);
-                            nlinit(g_tab[gi].s_invites, MAX_INVITES);
-                            nlinit(g_tab[gi].sr_invites, MAX_INVITES);
+                            nlclear(g_tab[gi].n_invites);
+                            nlclear(g_tab[gi].nr_invites);
+                            nlclear(g_tab[gi].s_invites);
+                            nlclear(g_tab[gi].sr_invites);
                             cp = "Group is now moderated.";
                             break;
 
 
                         case SET_CONTROL:
                             g_tab[gi].control = CONTROLLED;
-                            nlinit(g_tab[gi].n_invites, MAX_INVITES);
-                            nlinit(g_tab[gi].nr_invites, MAX_INVITES);
-                            nlinit(g_tab[gi].s_invites, MAX_INVITES);
-                            nlinit(g_tab[gi].sr_invites, MAX_INVITES);
+                            nlclear(g_tab[gi].n_invites);
+                            nlclear(g_tab[gi].nr_invites);
+                            nlclear(g_tab[gi].s_invites);
+                            nlclear(g_tab[gi].sr_invites);
                             cp = "Group is now controlled.";
                             break;
 
                         case SET_SIZE:
                             {
-                                p1 = get_tail(p1);
-                                p2 = getword(p1);
+                                p2 = tok_word(&args).s;
 
                                 if ( p2 == (char *) NULL || *p2 == '\0' )
                                 {
-                                    sprintf(mbuf, "Size must be between 0 and %d.",
-                                            MAX_REAL_USERS);
-                                    senderror (n, mbuf);
+                                    senderror (n, "Size must be 0 or more.");
                                     cp = NULL;
                                 }
                                 else
                                 {
                                     int new_size = atoi (p2);
 
-                                    if ( new_size < 0 || new_size > MAX_REAL_USERS )
+                                    if ( new_size < 0 )
                                     {
-                                        sprintf(mbuf,
-                                                "Size must be between 0 and %d.",
-                                                MAX_REAL_USERS);
-                                        senderror(n,mbuf);
+                                        senderror(n, "Size must be 0 or more.");
                                         cp = NULL;
                                     }
                                     else
@@ -1470,8 +1443,7 @@ visible.
 
                         case SET_IDLEBOOT:
                             {
-                                p1 = get_tail(p1);
-                                p2 = getword(p1);
+                                p2 = tok_word(&args).s;
 
                                 if ( p2 == (char *) NULL || *p2 == '\0' )
                                 {
@@ -1510,6 +1482,12 @@ visible.
                                     {
                                         g_tab[gi].idleboot = new_ib;
 
+                                        /* the members' idle-boot deadlines moved */
+                                        for (i = members_first(gi);
+                                             i >= 0;
+                                             i = members_next(i))
+                                            user_timer_update(i);
+
                                         if ( new_ib == 0 )
                                         {
                                             sprintf (cp2,
@@ -1549,7 +1527,7 @@ visible.
                             break;
 
                         case SET_IDLEBOOT_MSG:
-                            p1 = get_tail(p1);
+                            p1 = args.s;
 
                             if ( p1 == (char *) NULL || *p1 == '\0'
                                  || strlen (p1) > IDLEBOOT_MSG_LEN )
@@ -1584,14 +1562,13 @@ visible.
                             }
 
                             /* skip to the end */
-                            while(strlen(p2=getword(p1)) > 0)
-                                p1 = get_tail(p2);
+                            args.s += args.len;
+                            args.len = 0;
                             break;
 
                         case SET_IDLEMOD:
                             {
-                                p1 = get_tail(p1);
-                                p2 = getword(p1);
+                                p2 = tok_word(&args).s;
 
                                 if ( p2 == (char *) NULL || *p2 == '\0' )
                                 {
@@ -1651,14 +1628,14 @@ visible.
 
                         case SET_PUBLIC:
                             g_tab[gi].control = PUBLIC;
-                            nlinit(g_tab[gi].n_invites, MAX_INVITES);
-                            nlinit(g_tab[gi].nr_invites, MAX_INVITES);
-                            nlinit(g_tab[gi].s_invites, MAX_INVITES);
-                            nlinit(g_tab[gi].sr_invites, MAX_INVITES);
-                            nlinit(g_tab[gi].n_bars, MAX_INVITES);
-                            nlinit(g_tab[gi].n_nr_bars, MAX_INVITES);
-                            nlinit(g_tab[gi].s_bars, MAX_INVITES);
-                            nlinit(g_tab[gi].s_nr_bars, MAX_INVITES);
+                            nlclear(g_tab[gi].n_invites);
+                            nlclear(g_tab[gi].nr_invites);
+                            nlclear(g_tab[gi].s_invites);
+                            nlclear(g_tab[gi].sr_invites);
+                            nlclear(g_tab[gi].n_bars);
+                            nlclear(g_tab[gi].n_nr_bars);
+                            nlclear(g_tab[gi].s_bars);
+                            nlclear(g_tab[gi].s_nr_bars);
                             /* cp = "Group is now public."; */
                             sprintf (cp2, "%s made group public.", 
                                      u_tab[n].nickname);
@@ -1714,8 +1691,7 @@ visible.
                             break;
 
                         case SET_NAME:
-                            p1 = get_tail(p1);
-                            p2=getword(p1);
+                            p2 = tok_word(&args).s;
                             filtergroupname(p2);
                             if (set_name(n, gi, p2) < 0) {
                                 cp = "";
@@ -1745,9 +1721,10 @@ visible.
                         if (strlen(cp) > 0) {
                             s_status_group(1,1,n,"Change",cp);
                         }
-                }
 
-                p1 = get_tail(p1);
+                    /* control or idle-mod may have changed */
+                    group_timer_update(gi);
+                }
             }
         }
     } else {
@@ -1756,16 +1733,16 @@ visible.
     return 0;
 }
 
-int s_topic(int n, int argc)
+int s_topic(int n, int argc, TOKEN *argv)
 {
     int t_group;
     int is_moderator;
     int has_moderator;
 
     if (argc == 2) {
-        t_group = find_group(u_tab[n].group);
+        t_group = u_tab[n].gid;
 
-        if (strlen(fields[1]) == 0) {
+        if (argv[1].len == 0) {
             if(strlen(g_tab[t_group].topic) == 0) {
                 strcpy(mbuf,"The topic is not set.");
             } else {
@@ -1804,7 +1781,7 @@ int s_topic(int n, int argc)
         }
 
         memset(g_tab[t_group].topic, 0, MAX_TOPICLEN+1);
-        strncpy(g_tab[t_group].topic, fields[1], MAX_TOPICLEN);
+        strncpy(g_tab[t_group].topic, argv[1].s, MAX_TOPICLEN);
         if (g_tab[t_group].volume != QUIET) {
             sprintf(mbuf, "%s changed the topic to \"%s\"",
                     u_tab[n].nickname,
@@ -1825,72 +1802,66 @@ int s_topic(int n, int argc)
 /*   make sure they aren't us unless echoback is on */
 /*   look for other user being in this user's group */
 /* strings comparisons are done case-insensitive */
-int s_send_group(int n)
+int s_send_group(int n, const char *message)
 {
-    int i;
-    char my_group[MAX_GROUPLEN+1];
-    char one[255], two[255];
+    int i, nto = 0;
+    int to[max_users];
+    int my_group;
 
-    strcpy(my_group, u_tab[n].group);
-    sprintf(one, "%s@%s", u_tab[n].loginid, u_tab[n].nodeid);
-    ucaseit(one);
-    strcpy(two, u_tab[n].nickname);
-    ucaseit(two);
+    my_group = u_tab[n].gid;
 
-    /* send it to all of the real users */
-    for (i=0; i<MAX_REAL_USERS; i++) {
+    /* send it to all of the real users in the group */
+    for (i = members_first(my_group); i >= 0; i = members_next(i)) {
+        if (i == NICKSERV)
+            continue;
         if ((i != n) || u_tab[n].echoback)
-            if ((strcasecmp(my_group, u_tab[i].group) == 0) &&
-                (!nlmatch(one, *u_tab[i].pub_s_hushed)) &&
-                (!nlmatch(two, *u_tab[i].pub_n_hushed)) &&
-                (u_tab[i].login == LOGIN_COMPLETE))
-                sendopen(n, i, fields[0]);
+            if ((!hushset_hushes(i, n, HUSH_OPEN)) &&
+                (u_hot.login[i] == LOGIN_COMPLETE))
+                to[nto++] = i;
     }
+    sendopen_multi(n, to, nto, message);
     return 0;
 }
 
-int s_exclude(int n, int argc)
+int s_exclude(int n, int argc, TOKEN *argv)
 {
-    int i, j;
-    char my_group[MAX_GROUPLEN+1];
-    char one[255], two[255];
+    int i, j, nto = 0;
+    int to[max_users];
+    TOKEN args;
+    char *who;
 
     if (argc == 2)
     {
-        if (strlen(get_tail(fields[1])) > 0)
+        args = argv[1];
+        who = tok_word(&args).s;
+        if (args.len > 0)
         {
-            int gi = find_group(u_tab[n].group);
+            int gi = u_tab[n].gid;
             if (gi != -1 && g_tab[gi].volume == QUIET) {
                 senderror (n, "Open messages not permitted in quiet groups.");
                 return 0;
             }
 
-            strcpy(my_group, u_tab[n].group);
-            sprintf(one, "%s@%s", u_tab[n].loginid, u_tab[n].nodeid);
-            ucaseit(one);
-            strcpy(two, u_tab[n].nickname);
-            ucaseit(two);
-
-            /* send it to all of the real users */
-            for (i=0; i<MAX_REAL_USERS; i++)
+            /* send it to all of the real users in the group */
+            for (i = members_first(gi); i >= 0; i = members_next(i))
             {
+                if (i == NICKSERV)
+                    continue;
                 if ((i != n) || u_tab[n].echoback)
-                    if ((strcasecmp(my_group, u_tab[i].group) == 0) &&
-                        (!nlmatch(one, *u_tab[i].pub_s_hushed)) &&
-                        (!nlmatch(two, *u_tab[i].pub_n_hushed)) &&
-                        (u_tab[i].login >= LOGIN_COMPLETE) && 
-                        (strcasecmp(u_tab[i].nickname, getword(fields[1]))))
-                    {
-                        if ((j = find_user(getword(fields[1]))) > 0)
-                            sprintf(mbuf, "%s's next message excludes %s:",
-                                    u_tab[n].nickname, u_tab[j].nickname);
-                        else
-                            sprintf(mbuf, "%s's next message excludes %s:",
-                                    u_tab[n].nickname, getword(fields[1]));
-                        sendstatus(i, "Exclude", mbuf);
-                        sendopen(n, i, get_tail(fields[1]));
-                    }
+                    if ((!hushset_hushes(i, n, HUSH_OPEN)) &&
+                        (u_hot.login[i] >= LOGIN_COMPLETE) && 
+                        (strcasecmp(u_tab[i].nickname, who)))
+                        to[nto++] = i;
             }
+
+            if ((j = find_user(who)) >= 0)
+                sprintf(mbuf, "%s's next message excludes %s:",
+                        u_tab[n].nickname, u_tab[j].nickname);
+            else
+                sprintf(mbuf, "%s's next message excludes %s:",
+                        u_tab[n].nickname, who);
+            sendstatus_multi(to, nto, "Exclude", mbuf);
+            sendopen_multi(n, to, nto, args.s);
         } else { senderror(n, "Empty message."); }
     }
     return 0;
@@ -1910,35 +1881,37 @@ int s_exclude(int n, int argc)
 int s_status_group(int k, 
                    int tellme, int n, const char *class_string, const char *message_string)
 {
-    int i;
-    char my_group[MAX_GROUPLEN+1];
+    int i, nto = 0;
+    int to[max_users];
+    int my_group;
 
     if (k==1) {
-        strcpy(my_group, u_tab[n].group);
-        if (strlen(my_group) == 0) {
+        my_group = u_tab[n].gid;
+        if (my_group < 0) {
             mdb(MSG_WARN, "bad u_tab entry");
         }
     } else {
-        strcpy(my_group, g_tab[n].name);
-        if (strlen(my_group) == 0) {
+        my_group = n;
+        if (strlen(g_tab[n].name) == 0) {
             mdb(MSG_WARN, "bad g_tab entry");
         }
     }
 
     /* do it only for real users */
-    for (i=0; i<MAX_REAL_USERS; i++) {
-        if (strcasecmp(my_group, u_tab[i].group) == 0) {
-            /* n means something different here */
-            /* for k=1 (u_tab entry) vs k=2 ( g_tab entry) */
-            /* so n for k=2 doesn't make sense. */
-            /* 'cuz it'd mean don't do this when user i was
-               equal to group n...*/
-            if (tellme || (k != 1) || ((k==1) && (i != n))) {
-                /* actually send it */
-                sendstatus(i,class_string, message_string);
-            }
+    for (i = members_first(my_group); i >= 0; i = members_next(i)) {
+        if (i == NICKSERV)
+            continue;
+        /* n means something different here */
+        /* for k=1 (u_tab entry) vs k=2 ( g_tab entry) */
+        /* so n for k=2 doesn't make sense. */
+        /* 'cuz it'd mean don't do this when user i was
+           equal to group n...*/
+        if (tellme || (k != 1) || ((k==1) && (i != n))) {
+            /* actually send it */
+            to[nto++] = i;
         }
     }
+    sendstatus_multi(to, nto, class_string, message_string);
     return 0;
 }
 
@@ -1973,7 +1946,7 @@ int talk_delete (char *who, int gi)
             {
                 sprintf(mbuf,
                         "You no longer can talk in group %s (no thanks to %s)",
-                        u_tab[g_tab[gi].mod].group, u_tab[g_tab[gi].mod].nickname);
+                        group_name(u_tab[g_tab[gi].mod].gid), u_tab[g_tab[gi].mod].nickname);
                 sendstatus(dest,"TALK",mbuf);
             }
         }
@@ -2000,7 +1973,7 @@ void talk_report (int n, int gi)
  * - function to modify the group list of nicknames with permission to
  *   talk within a controlled group
  */
-int s_talk(int n, int argc)
+int s_talk(int n, int argc, TOKEN *argv)
 {
     int is_public,
         is_moderator;
@@ -2011,6 +1984,7 @@ int s_talk(int n, int argc)
         addmode = -1;
     int i;
     int quiet = -1;
+    TOKEN args;
     char *who;
     char *flags;
     const char *talk_usage = "Usage: talk {-a} {-q} {-r} {-d} nickname";
@@ -2023,17 +1997,18 @@ int s_talk(int n, int argc)
            side-effects:
            if talkee is signed on, send status message
 other:
-fields[1] is nickname of person to invite
+argv[1] is nickname of person to invite
          */
 
-        gi = find_group(u_tab[n].group);
+        gi = u_tab[n].gid;
 
         is_public = (g_tab[gi].control == PUBLIC);
         is_moderator = (g_tab[gi].mod == n);
-        who = fields[1];
+        args = argv[1];
+        who = args.s;
         while (who[0] == '-') 
         {
-            flags = getword(who);
+            flags = tok_word(&args).s;
             for (i = 1; i < strlen(flags); i++)
                 switch (flags[i]) {
                     case 'q':
@@ -2077,7 +2052,7 @@ fields[1] is nickname of person to invite
                         return -1;
                 }
 
-            who = get_tail(who);
+            who = args.s;
         }
 
         if (r == -1) r = 0;
@@ -2189,7 +2164,7 @@ fields[1] is nickname of person to invite
                     {
                         sprintf(mbuf,
                                 "You can talk in group %s (courtesy of %s)",
-                                u_tab[n].group, u_tab[n].nickname);
+                                group_name(u_tab[n].gid), u_tab[n].nickname);
                         sendstatus(dest,"TALK",mbuf);
                     }
                 }
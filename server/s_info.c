@@ -18,20 +18,23 @@
 #include "users.h"
 #include "mdb.h"
 #include "send.h"
+#include "pktserv/pktserv.h" /* for pktserv_getfd() */
+#include "pktserv/pktclock.h"
 
-int s_info(int n, int argc)
+int s_info(int n, int argc, TOKEN *argv)
 {
-    char TheirName[20];
+    TOKEN args;
+    char *TheirName;
     char loginid[MAX_IDLEN+1];
     char nodeid[MAX_NODELEN+1];
     int TheirIndex;
 
     if (argc == 2) 
     {
-        memset(TheirName, 0, 20);
         memset(loginid, 0, MAX_IDLEN + 1);
         memset(nodeid, 0, MAX_NODELEN + 1);
-        strncpy(TheirName, getword(fields[1]), 19);
+        args = argv[1];
+        TheirName = tok_word(&args).s;
 
         if ( TheirName[0] == '\0' )
             TheirIndex = lpriv_id[n];
@@ -49,10 +52,10 @@ int s_info(int n, int argc)
             char addrstr[NI_MAXHOST];
             int aw, idle;
 
-            idle = time(NULL) - u_tab[TheirIndex].t_recv;
+            idle = pktclock_time() - u_tab[TheirIndex].t_recv;
 
             aw = (strlen(u_tab[TheirIndex].awaymsg) > 0);
-            getpeername(TheirIndex, (struct sockaddr*)&rs, &rs_size);
+            getpeername(pktserv_getfd(TheirIndex), (struct sockaddr*)&rs, &rs_size);
 
             /* Get numeric IP address string (works for both IPv4 and IPv6) */
             if (getnameinfo((struct sockaddr *)&rs, rs_size,
@@ -15,9 +15,10 @@
 #include "externs.h"
 #include "mdb.h"
 #include "send.h"
+#include "s_commands.h"
 #include "icbdb.h"
 
-int s_motd(int n, int argc)
+int s_motd(int n, int argc, TOKEN *argv)
 {
     int motd_fd;
     char c;
@@ -16,10 +16,11 @@
 #include "externs.h"
 #include "mdb.h"
 #include "send.h"
+#include "s_commands.h"
 
 #define MAX_NEWS_FILES 10
 
-int s_news(int n, int argc)
+int s_news(int n, int argc, TOKEN *argv)
 {
     int             i, j, first;
     int             news_fd;
@@ -30,7 +31,7 @@ int s_news(int n, int argc)
      * I don't know where clients get this (null) from, but we might as
      * well take care of it
      */
-    if ((strlen(fields[1]) == 0) || (strcmp(fields[1], "(null)") == 0)) {
+    if ((argv[1].len == 0) || (strcmp(argv[1].s, "(null)") == 0)) {
         for (i = 1; i < MAX_NEWS_FILES; i++) {
             memset(tbuf, 0, 255);
             sprintf(fname, "news.%d", i);
@@ -62,7 +63,7 @@ int s_news(int n, int argc)
         if (first == 0)
             sendstatus(n, "News", "No news.");
     } else {
-        sprintf(fname, "news.%s", fields[1]);
+        snprintf(fname, sizeof(fname), "news.%s", argv[1].s);
         if ((news_fd = open(fname, O_RDONLY)) >= 0) {
             sends_cmdout(n, "--------------------------------------");
             memset(tbuf, 0, 255);
@@ -21,10 +21,13 @@
 #include "unix.h"
 #include "send.h"
 #include "mdb.h"
+#include "pktserv/pktclock.h"
 
-int s_personal(int n, int argc)
+int s_personal(int n, int argc, TOKEN *argv)
 {
     int dest;
+    TOKEN args;
+    char *nick;
     char tbuf[MAX_PKT_DATA];
 
     if (argc != 2)
@@ -36,24 +39,22 @@ int s_personal(int n, int argc)
     /* constraints: 
        destination nickname exists */
 
-    if( (dest = find_user(getword(fields[1]))) < 0) 
+    args = argv[1];
+    nick = tok_word(&args).s;
+    if( (dest = find_user(nick)) < 0) 
     {
         /* error - no such nick */
-        sprintf(mbuf,"%s not signed on.", getword(fields[1]));
+        sprintf(mbuf,"%s not signed on.", nick);
         senderror(n, mbuf);
     } 
     else 
     {
-        char    *tail,
-                *args = (char *)NULL;
+        char    *tail = args.s;
 
         /* check to see if their away is set and pester them if so. */
         if ( strlen(u_tab[n].awaymsg) > 0 && dest != NICKSERV )
             sendstatus(n, "Away", "Your away is still set...");
 
-        tail = get_tail (fields[1]);
-        args = strdup (tail);
-
         /* send a message to that nick */
         sendperson(n, dest, tail);
 
@@ -61,20 +62,13 @@ int s_personal(int n, int argc)
         {
             snprintf(tbuf, MAX_PKT_DATA, "<*to: %s*> %s", 
                      u_tab[dest].nickname,
-                     (args == (char *)NULL) ? "" : args);
+                     tail);
 
             sends_cmdout(n, tbuf);
         }
 
         /* send an away message if need-be */
         away_handle(n, dest);
-
-        /* free temporary memory */
-        if ( args != (char *)NULL )
-        {
-            free (args);
-            args = (char *) NULL;
-        }
     }
     return 0;
 }
@@ -99,10 +93,10 @@ void away_handle (int src, int dest)
     if ( strlen(u_tab[dest].awaymsg) > 0 )
     {
         if ((u_tab[dest].lastaway != src) || 
-            (time(NULL) - u_tab[dest].lastawaytime > AWAY_NOSEND_TIME))
+            (pktclock_time() - u_tab[dest].lastawaytime > AWAY_NOSEND_TIME))
         {
             u_tab[dest].lastaway = src;
-            u_tab[dest].lastawaytime = time(NULL);
+            u_tab[dest].lastawaytime = pktclock_time();
             /* sendperson(dest, src, u_tab[dest].awaymsg); */
             snprintf(mbuf, MAX_PKT_DATA, "%s", u_tab[dest].awaymsg);
             sendstatus(src, "Away", mbuf);
@@ -14,9 +14,11 @@
 #include "server.h"
 #include "externs.h"
 #include "send.h"
+#include "s_commands.h"
 #include "mdb.h"
+#include "pktserv/pktclock.h"
 
-int s_shuttime(int n, int argc)
+int s_shuttime(int n, int argc, TOKEN *argv)
 {
     extern long TimeToDie;
     long TheTime, TimeLeft;
@@ -27,7 +29,7 @@ int s_shuttime(int n, int argc)
             sendstatus(n, "Shutdown", "No shutdown time scheduled.");
         else {
             memset(line, 0, 256);
-            TheTime = time(NULL);
+            TheTime = pktclock_time();
             TimeLeft = TimeToDie - TheTime;
             if (TimeLeft >= 3600.0) 
                 sprintf(line, "%d hour(s), %d minute(s) left until scheduled shutdown.", (int) (TimeLeft / 3600.0), (int) (((int) TimeLeft % 3600) / 60.0));
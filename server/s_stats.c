@@ -11,22 +11,29 @@
 #include "send.h"    /* for senderror() */
 #include "users.h"    /* for count_users_in_groups() */
 #include "s_stats.h"
+#include "pktserv/pktserv.h" /* for pktserv_bufstats(), pktserv_outstats() */
 
 struct _server_stats server_stats;
 
 /*
  * s_server_stats() - display various statistics about the server
  */
-int s_server_stats (int who, int argc)
+int s_server_stats (int who, int argc, TOKEN *argv)
 {
     int i,
         num_users = 0,
         num_groups = 0,
-        num_away = 0;
+        num_away = 0,
+        bufs_inuse, bufs_free, bufs_peak,
+        out_backed,
+        dns_entries;
+    size_t out_bytes;
+    long out_age;
+    unsigned long out_drops, dns_hits, dns_misses;
 
     if ( argc == 2 )
     {
-        if ( strlen (fields[1]) > 0 && !strcmp (fields[1], "reset") )
+        if ( argv[1].len > 0 && !strcmp (argv[1].s, "reset") )
         {
             if ( !check_auth (who) )
             {
@@ -36,6 +43,9 @@ int s_server_stats (int who, int argc)
 
             memset (&server_stats, '\0', sizeof (server_stats));
             time (&server_stats.start_time);
+            pktserv_bufstats_reset ();
+            pktserv_outstats_reset ();
+            pktserv_dnsstats_reset ();
             sendstatus (who, "Stats", "Stats have been reset.");
             return 0;
         }
@@ -49,7 +59,7 @@ int s_server_stats (int who, int argc)
     sends_cmdout (who, mbuf);
 
     snprintf (mbuf, MSG_BUF_SIZE, "  Max Users: %d Max Groups: %d",
-              MAX_REAL_USERS, MAX_GROUPS);
+              max_users - 1, MAX_GROUPS);
     sends_cmdout (who, mbuf);
 
     /* server stats */
@@ -74,8 +84,8 @@ int s_server_stats (int who, int argc)
     sends_cmdout (who, mbuf);
 
     /* count logged in and away users */
-    for (i = 0; i < MAX_REAL_USERS; i++)
-        if (u_tab[i].login > LOGIN_FALSE)
+    for (i = 1; i < max_users; i++)
+        if (u_hot.login[i] > LOGIN_FALSE)
         {
             num_users++;
             if ( u_tab[i].awaymsg[0] != '\0' )
@@ -86,7 +96,7 @@ int s_server_stats (int who, int argc)
     for (i = 0; i < MAX_GROUPS; i++)
         if (strlen(g_tab[i].name) > 0)
             if ((strcmp(g_tab[i].name, "ICB") != 0) ||
-                (count_users_in_group("ICB") > 1))
+                (count_users_in_group(i) > 1))
                 num_groups++;
 
     snprintf (mbuf, MSG_BUF_SIZE,
@@ -96,5 +106,23 @@ int s_server_stats (int who, int argc)
               num_away, num_away != 1 ? "s" : "");
     sends_cmdout (who, mbuf);
 
+    pktserv_bufstats (&bufs_inuse, &bufs_free, &bufs_peak);
+    snprintf (mbuf, MSG_BUF_SIZE,
+              "  Packet buffers: %d in use, %d free, %d peak",
+              bufs_inuse, bufs_free, bufs_peak);
+    sends_cmdout (who, mbuf);
+
+    pktserv_outstats (&out_backed, &out_bytes, &out_age, &out_drops);
+    snprintf (mbuf, MSG_BUF_SIZE,
+              "  Output queues: %d backed up, largest %lu bytes, oldest %ldms, %lu dropped",
+              out_backed, (unsigned long) out_bytes, out_age, out_drops);
+    sends_cmdout (who, mbuf);
+
+    pktserv_dnsstats (&dns_entries, &dns_hits, &dns_misses);
+    snprintf (mbuf, MSG_BUF_SIZE,
+              "  DNS cache: %d hosts, %lu hits, %lu misses",
+              dns_entries, dns_hits, dns_misses);
+    sends_cmdout (who, mbuf);
+
     return 0;
 }
@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include "strutil.h"
+
 struct _server_stats
 {
     time_t	start_time;	/* when this server started */
@@ -18,5 +20,5 @@ struct _server_stats
 
 extern struct _server_stats server_stats;
 
-int s_server_stats (int who, int argc);
+int s_server_stats (int who, int argc, TOKEN *argv);
 
@@ -12,7 +12,7 @@
 #include <fcntl.h>
 #endif
 #ifdef HAVE_SYS_TIME_H
-#include <sys/time.h>    /* for gettimeofday & struct tm */
+#include <sys/time.h>    /* for struct timeval & struct tm */
 #endif
 
 #include "server.h"
@@ -24,10 +24,15 @@
 #include "namelist.h"
 #include "access.h"
 #include "users.h"
+#include "members.h"
+#include "hushset.h"
+#include "notifyindex.h"
 #include "s_commands.h"
 #include "unix.h"
+#include "timers.h"
+#include "pktserv/pktclock.h"
 
-int s_help(int n, int argc)
+int s_help(int n, int argc, TOKEN *argv)
 {
     int help_fd;
     char c;
@@ -66,18 +71,22 @@ int s_help(int n, int argc)
     return 0;
 }
 
-int s_hush(int n, int argc)
+int s_hush(int n, int argc, TOKEN *argv)
 {
     int i;
     int personal = -1;
     int public = -1;
     int mode = -1;
     int quiet = -1;
+    TOKEN args;
     char *flags;
     char *who = NULL;
 
     if (argc >= 2)
-        who = fields[1];
+    {
+        args = argv[1];
+        who = args.s;
+    }
     else
         who = (char *) NULL;
 
@@ -85,7 +94,7 @@ int s_hush(int n, int argc)
     {
         while (*who == '-')
         {
-            flags = getword(who);
+            flags = tok_word(&args).s;
             for (i = 1; i < strlen(flags); i++)
             {
                 switch(flags[i])
@@ -141,7 +150,7 @@ int s_hush(int n, int argc)
                         break;
                 }
             }
-            who = get_tail(who);
+            who = args.s;
         }
 
         if (quiet == -1) quiet = 0;
@@ -194,6 +203,7 @@ int s_hush(int n, int argc)
                     return -1;
                 }
                 nlput(u_tab[n].pri_s_hushed, who);
+                hushset_update_lists(n);
                 if (quiet == 0) {
                     sprintf(mbuf, "%s added to site personal hush list.", who);
                     sendstatus(n, "Hush", mbuf);
@@ -201,6 +211,7 @@ int s_hush(int n, int argc)
             }
             else {
                 nldelete(u_tab[n].pri_s_hushed, who);
+                hushset_update_lists(n);
                 if (quiet == 0) {
                     sprintf(mbuf, "%s removed from site personal hush list.", who);
                     sendstatus(n, "Hush", mbuf);
@@ -214,6 +225,7 @@ int s_hush(int n, int argc)
                     return -1;
                 }
                 nlput(u_tab[n].pub_s_hushed, who);
+                hushset_update_lists(n);
                 if (quiet == 0) {
                     sprintf(mbuf, "%s added to site open hush list.", who);
                     sendstatus(n, "Hush", mbuf);
@@ -221,6 +233,7 @@ int s_hush(int n, int argc)
             }
             else {
                 nldelete(u_tab[n].pub_s_hushed, who);
+                hushset_update_lists(n);
                 if (quiet == 0) {
                     sprintf(mbuf, "%s removed from site open hush list.", who);
                     sendstatus(n, "Hush", mbuf);
@@ -236,6 +249,7 @@ int s_hush(int n, int argc)
                     return -1;
                 }
                 nlput(u_tab[n].pri_n_hushed, who);
+                hushset_update_lists(n);
                 if (quiet == 0) {
                     sprintf(mbuf, "%s added to nickname personal hush list.", who);
                     sendstatus(n, "Hush", mbuf);
@@ -243,6 +257,7 @@ int s_hush(int n, int argc)
             }
             else {
                 nldelete(u_tab[n].pri_n_hushed, who);
+                hushset_update_lists(n);
                 if (quiet == 0) {
                     sprintf(mbuf, "%s removed from nickname personal hush list.", who);
                     sendstatus(n, "Hush", mbuf);
@@ -256,6 +271,7 @@ int s_hush(int n, int argc)
                     return -1;
                 }
                 nlput(u_tab[n].pub_n_hushed, who);
+                hushset_update_lists(n);
                 if (quiet == 0) {
                     sprintf(mbuf, "%s added to nickname open hush list.", who);
                     sendstatus(n, "Hush", mbuf);
@@ -263,6 +279,7 @@ int s_hush(int n, int argc)
             }
             else {
                 nldelete(u_tab[n].pub_n_hushed, who);
+                hushset_update_lists(n);
                 if (quiet == 0) {
                     sprintf(mbuf, "%s removed from nickname open hush list.", who);
                     sendstatus(n, "Hush", mbuf);
@@ -273,7 +290,7 @@ int s_hush(int n, int argc)
     return 0;
 }
 
-int s_name(int n, int argc)
+int s_name(int n, int argc, TOKEN *argv)
 {
     int len, i, j;
     int how_many;
@@ -290,7 +307,7 @@ int s_name(int n, int argc)
          */
 
         /* only use so much of it, but at least some of it */
-        len = strlen(fields[1]);
+        len = argv[1].len;
         if (len <= 0) {
             /* oops, too short */
             senderror(n,"The nickname may not be null.");
@@ -299,7 +316,7 @@ int s_name(int n, int argc)
 
         how_many = (MAX_NICKLEN > len) ? len:MAX_NICKLEN;
         memset(new_name, 0, MAX_NICKLEN+1);
-        strncpy(new_name, fields[1], how_many);
+        strncpy(new_name, argv[1].s, how_many);
         filternickname(new_name);
 
         /* make sure the nickname hasn't already been taken */
@@ -324,7 +341,7 @@ int s_name(int n, int argc)
                 u_tab[n].nickname, new_name);
         s_status_group(1,0,n,"Name",mbuf);
         nickwritetime(n, 1, NULL);
-        strcpy(u_tab[n].nickname, new_name);
+        set_user_nick(n, new_name);
 
 
 
@@ -347,12 +364,12 @@ int s_name(int n, int argc)
                     (strcmp(g_tab[i].missingmod, u_tab[n].nickname)==0)){
                     g_tab[i].modtimeout = 0;
                     g_tab[i].mod = n;
+                    group_timer_update(i);
                     memset(g_tab[i].missingmod, 0, MAX_NICKLEN);
                     sprintf(mbuf, "%s is the active moderator again.",
                             u_tab[n].nickname);
-                    for (j = 1; j < MAX_REAL_USERS; j++)
-                        if ((strcasecmp(u_tab[j].group, g_tab[i].name)
-                             == 0) && (j != n))
+                    for (j = members_first(i); j >= 0; j = members_next(j))
+                        if (j != n && j != NICKSERV)
                             sendstatus(j, "Mod", mbuf);
                     sprintf(mbuf, "You are the moderator of group %s",
                             g_tab[i].name);
@@ -398,15 +415,19 @@ int s_name(int n, int argc)
     return 0;
 }
 
-int s_notify(int n, int argc)
+int s_notify(int n, int argc, TOKEN *argv)
 {
+    TOKEN args;
     char *who, *flags;
     int quiet = -1;
     int mode = -1;
     int i;
 
     if ( argc >= 2 )
-        who = fields[1];
+    {
+        args = argv[1];
+        who = args.s;
+    }
     else
         who = (char *)NULL;
 
@@ -414,7 +435,7 @@ int s_notify(int n, int argc)
     {
         while (who[0] == '-')
         {
-            flags = getword(who);
+            flags = tok_word(&args).s;
             for (i = 1; i < strlen(flags); i++)
             {
                 switch(flags[i])
@@ -452,7 +473,7 @@ int s_notify(int n, int argc)
                         break;
                 }
             }
-            who = get_tail(who);
+            who = args.s;
         }
 
         if (strlen(who) == 0)
@@ -499,6 +520,7 @@ int s_notify(int n, int argc)
                 return -1;
             }
             nlput(u_tab[n].s_notifies, who);
+            notifyindex_update(n);
             if (quiet == 0)
             {
                 sprintf(mbuf, "%s added to site notify list.", who);
@@ -508,6 +530,7 @@ int s_notify(int n, int argc)
         else
         {
             nldelete(u_tab[n].s_notifies, who);
+            notifyindex_update(n);
             if (quiet == 0)
             {
                 sprintf(mbuf, "%s removed from site notify list.", who);
@@ -525,11 +548,12 @@ int s_notify(int n, int argc)
                 return -1;
             }
             nlput(u_tab[n].n_notifies, who);
+            notifyindex_update(n);
             if (quiet == 0)
             {
                 sprintf(mbuf, "%s added to nickname notify list.", who);
                 sendstatus(n, "Notify", mbuf);
-                if ((i = find_user(who)) > 0)
+                if ((i = find_user(who)) >= 0)
                 {
                     sprintf(mbuf, "%s is logged in now.", u_tab[i].nickname);
                     sendstatus(n, "Notify", mbuf);
@@ -539,6 +563,7 @@ int s_notify(int n, int argc)
         else
         {
             nldelete(u_tab[n].n_notifies, who);
+            notifyindex_update(n);
             if (quiet == 0)
             {
                 sprintf(mbuf, "%s removed from nickname notify list.", who);
@@ -549,17 +574,17 @@ int s_notify(int n, int argc)
     return 0;
 }
 
-int s_echoback(int n, int argc)
+int s_echoback(int n, int argc, TOKEN *argv)
 {
     if (argc == 2) {
-        if(strcasecmp(fields[1],"off") == 0) {
-            u_tab[n].echoback = 0; /* off */
+        if(strcasecmp(argv[1].s,"off") == 0) {
+            set_user_echoback(n, 0); /* off */
             sendstatus(n, "Echo","Echoback off");
-        } else if (strcasecmp(fields[1],"on") == 0) {
-            u_tab[n].echoback = 1; /* on */
+        } else if (strcasecmp(argv[1].s,"on") == 0) {
+            set_user_echoback(n, 1); /* on */
             sendstatus(n,"Echo","Echoback on");
-        } else if (strcasecmp(fields[1],"verbose") == 0) {
-            u_tab[n].echoback = 2; /* verbose */
+        } else if (strcasecmp(argv[1].s,"verbose") == 0) {
+            set_user_echoback(n, 2); /* verbose */
             sendstatus(n,"Echo","Echoback on verbose");
         } else {
             senderror(n,"Echoback: needs on/off/verbose");
@@ -570,16 +595,16 @@ int s_echoback(int n, int argc)
     return 0;
 }
 
-int s_nobeep(int n, int argc)
+int s_nobeep(int n, int argc, TOKEN *argv)
 {
     if (argc == 2) {
-        if(strcasecmp(fields[1],"off") == 0) {
+        if(strcasecmp(argv[1].s,"off") == 0) {
             u_tab[n].nobeep = 0; /* off */
             sendstatus(n, "No-Beep","No-Beep off");
-        } else if (strcasecmp(fields[1],"on") == 0) {
+        } else if (strcasecmp(argv[1].s,"on") == 0) {
             u_tab[n].nobeep = 1; /* on */
             sendstatus(n,"No-Beep","No-Beep on");
-        } else if (strcasecmp(fields[1],"verbose") == 0) {
+        } else if (strcasecmp(argv[1].s,"verbose") == 0) {
             u_tab[n].nobeep = 2; /* verbose */
             sendstatus(n,"No-Beep","No-Beep on (verbose)");
         } else {
@@ -591,8 +616,9 @@ int s_nobeep(int n, int argc)
     return 0;
 }
 
-int s_ping (int n, int argc)
+int s_ping (int n, int argc, TOKEN *argv)
 {
+    TOKEN args;
     char *p;
     int sendto = n;    /* default ping yourself */
 
@@ -602,13 +628,14 @@ int s_ping (int n, int argc)
         return (-1);
     }
 
-    p = getword (fields[1]);
+    args = argv[1];
+    p = tok_word(&args).s;
 
     if ( p && *p )
     {
         int i;
 
-        if ( (i = find_user(p)) > 0 )
+        if ( (i = find_user(p)) >= 0 )
         {
             sendto = i;
         }
@@ -620,14 +647,14 @@ int s_ping (int n, int argc)
         }
     }
 
-    gettimeofday (&ping_time[sendto], NULL);
-    pong_req[sendto] = n;
+    pktclock_timeval(&ping_time[sendto]);
+    set_user_pong_req(sendto, n);
 
     sendping (sendto, u_tab[n].nickname);
     return 0;
 }
 
-int s_noaway(int n, int argc)
+int s_noaway(int n, int argc, TOKEN *argv)
 {
     if (argc == 0 || argc > 2)
     {
@@ -648,7 +675,7 @@ int s_noaway(int n, int argc)
     return 0;
 }
 
-int s_away(int n, int argc)
+int s_away(int n, int argc, TOKEN *argv)
 {
     struct tm *t;
     char  *retstr;
@@ -660,7 +687,7 @@ int s_away(int n, int argc)
         return -1;
     }
 
-    if ( strlen (fields[1]) == 0 )
+    if ( argv[1].len == 0 )
     {
         if ( strlen (u_tab[n].awaymsg) > 0 )
         {
@@ -675,7 +702,7 @@ int s_away(int n, int argc)
 
     /* make sure there aren't more than 1 %s subs */
     num_s = 1;
-    if ( (retstr = filterfmt (fields[1], &num_s)) != (char *)NULL )
+    if ( (retstr = filterfmt (argv[1].s, &num_s)) != (char *)NULL )
     {         
         senderror (n, retstr);
         return 0;
@@ -687,7 +714,7 @@ int s_away(int n, int argc)
              (t->tm_hour>12) ? (t->tm_hour-12) : ((t->tm_hour==0) ? 12 : t->tm_hour),
              t->tm_min,
              t->tm_hour > 11 ? "pm" : "am",
-             fields[1]);
+             argv[1].s);
     snprintf(mbuf, MSG_BUF_SIZE, "Away message set to \"%s\"",
              u_tab[n].awaymsg);
     u_tab[n].lastaway = 0;
@@ -702,7 +729,7 @@ int s_away(int n, int argc)
  * From Scott Reynold's hacked ICB.
  */
 int
-s_brick(int n, int argc)
+s_brick(int n, int argc, TOKEN *argv)
 {
 	char    target[MAX_NICKLEN + 1];
 	char	line[MAX_INPUTSTR];
@@ -710,7 +737,7 @@ s_brick(int n, int argc)
 	int		bricks;
 
 	if (argc == 2) {
-		strncpy(target, fields[1], MAX_NICKLEN+1);
+		strncpy(target, argv[1].s, MAX_NICKLEN+1);
 		target[sizeof(target) - 1] = '\0';
 		filternickname(target);
 		t = find_user(target);
@@ -740,7 +767,7 @@ s_brick(int n, int argc)
 		snprintf(line, MAX_INPUTSTR, "out of bricks; dropped %s (%d)",
 				u_tab[n].nickname, n);
 		s_status_group(1, 1, n, "DROP", line);
-		S_kill[n]++;
+		kill_user(n);
 	} else if (bricks < (-4)) {
 		snprintf(line, MAX_INPUTSTR, "%s has fallen, and can't get up.",
 				u_tab[n].nickname);
@@ -758,7 +785,7 @@ s_brick(int n, int argc)
 		}
 		snprintf(line, MAX_INPUTSTR, "%s has been bricked.", target);
 		s_status_group(1, 1, n, "FYI", line);
-		if (strcasecmp(u_tab[n].group, u_tab[t].group) != 0) {
+		if (u_tab[n].gid != u_tab[t].gid) {
 			s_status_group(1, 1, t, "FYI", line);
 		}
 	}
@@ -12,15 +12,16 @@
 #include "server.h"
 #include "externs.h"
 #include "send.h"
+#include "s_commands.h"
 #include "mdb.h"
 
-int s_version(int n, int argc)
+int s_version(int n, int argc, TOKEN *argv)
 {
     if (argc == 2) {
         sprintf(mbuf, "%s", VERSION);
         sends_cmdout(n, mbuf);
         sprintf(mbuf, "Proto Level: %d Max Users: %d Max Groups: %d", 
-                PROTO_LEVEL, MAX_REAL_USERS, MAX_GROUPS);
+                PROTO_LEVEL, max_users - 1, MAX_GROUPS);
         sends_cmdout(n, mbuf);
     } else {
         mdb(MSG_INFO, "version: wrong number of parz");
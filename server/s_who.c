@@ -16,7 +16,9 @@
 #include "strutil.h"
 #include "mdb.h"
 #include "users.h"
+#include "members.h"
 #include "send.h"
+#include "pktserv/pktclock.h"
 
 #define DOGROUPONLY    1
 #define DOSHORT        2
@@ -48,19 +50,16 @@ void pgm_short(int n, int which)
     int num_users;
     char line[MAX_LINE];
 
-    num_users = count_users_in_group(g_tab[which].name);
+    num_users = count_users_in_group(which);
     memset(line, 0, MAX_LINE);
 
     add_item(n, "    Members: ", line);
 
-    for(user=0; user<MAX_USERS; user++) {
-        /* are they in this group? */
-        if(which == find_group(u_tab[user].group)) {
-            add_item(n, u_tab[user].nickname, line);
-            num_users--;
-            if (num_users != 0) {
-                add_item(n, ", ", line);
-            }
+    for (user = members_first(which); user >= 0; user = members_next(user)) {
+        add_item(n, u_tab[user].nickname, line);
+        num_users--;
+        if (num_users != 0) {
+            add_item(n, ", ", line);
         }
     }
     /* flush last line if any */
@@ -79,37 +78,34 @@ void pgm_long(int n, int which)
     char cp[5];
     char status[8];
     int nr = 0, aw = 0, sec=0;
-    int user_list[MAX_REAL_USERS];
+    int user_list[max_users + 1];
     int i, j;
     int users = 0;
 
 
-    TheTime = time(NULL);
+    TheTime = pktclock_time();
 
-    num_users = count_users_in_group(g_tab[which].name);
+    num_users = count_users_in_group(which);
     if (num_users >= 2)      /* bweh! */
         user_whead(n);
-    for(user=0; user<MAX_USERS; user++) {
-        /* are they in this group? */
-        if(which == find_group(u_tab[user].group)) {
-            if (users == 0) 
-                user_list[0] = user;
-            else {
-                i = 0;
+    for (user = members_first(which); user >= 0; user = members_next(user)) {
+        if (users == 0) 
+            user_list[0] = user;
+        else {
+            i = 0;
 #ifdef SORT_BY_NICKNAME
-                while ((i < users) && (strcasecmp(u_tab[user].nickname,
-                                                  u_tab[user_list[i]].nickname) > 0))
+            while ((i < users) && (strcasecmp(u_tab[user].nickname,
+                                              u_tab[user_list[i]].nickname) > 0))
 #else
-                    while ((i < users) && u_tab[user].t_group >
-                           u_tab[user_list[i]].t_group)
+                while ((i < users) && u_tab[user].t_group >
+                       u_tab[user_list[i]].t_group)
 #endif
-                        i++;
-                for (j = (users + 1); j > i; j--)
-                    user_list[j] = user_list[j - 1];
-                user_list[i] = user;
-            }
-            users++;
+                    i++;
+            for (j = (users + 1); j > i; j--)
+                user_list[j] = user_list[j - 1];
+            user_list[i] = user;
         }
+        users++;
     }
     for (i = 0; i < users; i++)
     {
@@ -201,7 +197,7 @@ void print_group_header(int n, int grp)
         if (g_tab[grp].modtimeout == 0.0)
             strcpy(TheMod, "(None)");
         else {
-            TheTime = time(NULL);
+            TheTime = pktclock_time();
             sprintf(TheMod, "%s (%d)", g_tab[grp].missingmod, 
                     (int) (g_tab[grp].modtimeout - TheTime));
         }
@@ -221,15 +217,15 @@ void print_group_header(int n, int grp)
             vis[g_tab[grp].visibility],
             vol[g_tab[grp].volume]);
 
-    isMyGroup = (find_group(u_tab[n].group) == grp);
+    isMyGroup = (u_tab[n].gid == grp);
     memset(GroupName, 0, MAX_GROUPLEN + 1);
     is_invited = (nlpresent(u_tab[n].nickname, 
                             *g_tab[grp].n_invites) || 
                   ((nlpresent(u_tab[n].nickname, 
                               *g_tab[grp].nr_invites)) && 
                    (strlen(u_tab[n].realname) > 0)) ||
-                  (nlmatch(one, *g_tab[grp].s_invites)) ||
-                  ((nlmatch(one, *g_tab[grp].s_invites)) &&
+                  (nlmatch(one, g_tab[grp].s_invites)) ||
+                  ((nlmatch(one, g_tab[grp].s_invites)) &&
                    (strlen(u_tab[n].realname) > 0)) ||
                   (! strncmp("ADMIN", u_tab[n].nickname, MAX_NICKLEN)));
     if ((g_tab[grp].visibility == SECRET) ||
@@ -288,7 +284,7 @@ void doAll(int n, int flags)
     int i, j, groups = 0;
     char one[255];
 
-    my_group = find_group(u_tab[n].group);
+    my_group = u_tab[n].gid;
 
     sprintf(one, "%s@%s", u_tab[n].loginid, u_tab[n].nodeid);
     ucaseit(one);
@@ -298,8 +294,8 @@ void doAll(int n, int flags)
                       ((nlpresent(u_tab[n].nickname, 
                                   *g_tab[group].nr_invites)) && 
                        (strlen(u_tab[n].realname) > 0)) ||
-                      (nlmatch(one, *g_tab[group].s_invites)) ||
-                      ((nlmatch(one, *g_tab[group].s_invites)) &&
+                      (nlmatch(one, g_tab[group].s_invites)) ||
+                      ((nlmatch(one, g_tab[group].s_invites)) &&
                        (strlen(u_tab[n].realname) > 0)) ||
                       (! strncmp("ADMIN", u_tab[n].nickname, MAX_NICKLEN)));
         if( (strlen(g_tab[group].name)!=0) &&
@@ -322,13 +318,13 @@ void doAll(int n, int flags)
     for (i = 0; i < groups; i++)
         doOne(n, flags, g_tab[group_list[i]].name, 0);
 
-    for (i = 0; i < MAX_REAL_USERS; i++)
-        if (u_tab[i].login > LOGIN_FALSE)
+    for (i = 1; i < max_users; i++)
+        if (u_hot.login[i] > LOGIN_FALSE)
             num_users++;
     for (i = 0; i < MAX_GROUPS; i++)
         if (strlen(g_tab[i].name) > 0)
             if ((strcmp(g_tab[i].name, "ICB") != 0) ||
-                (count_users_in_group("ICB") > 1))
+                (count_users_in_group(i) > 1))
                 num_groups++;
     if (num_users == 0)
         sprintf (mbuf, "No users found.");
@@ -351,22 +347,25 @@ void doAll(int n, int flags)
 }
 
 
-int s_who(int n, int argc)
+int s_who(int n, int argc, TOKEN *argv)
 {
     int len;
     int how_many;
     int flags;
     int target_user;
     char tgrp[MAX_GROUPLEN + 1];
+    TOKEN args, word;
     char * cp;
 
     if (argc == 2) {
 
-        /* fields[0] was "w" */
-        /* fields[1] is a string indicating the kind of who */
+        /* argv[0] was "w" */
+        /* argv[1] is a string indicating the kind of who */
 
         /* handle the flags (if any) */
-        cp = getword(fields[1]);
+        args = argv[1];
+        word = tok_word(&args);
+        cp = word.s;
         if (strcasecmp(cp, "-g") == 0) {
             flags = DOGROUPONLY;
         } else if (strcasecmp(cp, "-s") == 0){
@@ -379,47 +378,39 @@ int s_who(int n, int argc)
         }
 
         /*
-           use fields[1] if no flag
-           otherwise use get_tail(fields[1])
+           the group is the first word if no flag
+           otherwise the one after it
          */
-        if (flags == 0) {
-            len = strlen(getword(fields[1]));
-        } else {
-            len = strlen(getword(get_tail(fields[1])));
-        }
+        if (flags != 0)
+            word = tok_word(&args);
+        len = word.len;
 
         how_many = (MAX_GROUPLEN > len) ? len:MAX_GROUPLEN;
         memset(tgrp, 0, MAX_GROUPLEN + 1);
-
-        if (flags == 0) {
-            strncpy(tgrp, getword(fields[1]),how_many);
-        } else {
-            strncpy(tgrp, getword(get_tail(fields[1])),
-                    how_many);
-        }
+        strncpy(tgrp, word.s, how_many);
 
         if (len == 0) {
             /* of all groups */
             doAll(n, flags);
         } else {
             /* on some particular group */
-            if (fields[1][0] == '@') {
-                if ((target_user = find_user(&fields[1][1])) < 0) {
+            if (argv[1].s[0] == '@') {
+                if ((target_user = find_user(&argv[1].s[1])) < 0) {
                     senderror(n, "User not found.");
                     return -1;
                 } else {
-                    if ((g_tab[find_group(u_tab[target_user].group)].visibility == SUPERSECRET) && (strncmp("ADMIN", u_tab[n].nickname, MAX_NICKLEN))) {
+                    if ((g_tab[u_tab[target_user].gid].visibility == SUPERSECRET) && (strncmp("ADMIN", u_tab[n].nickname, MAX_NICKLEN))) {
                         senderror(n, "User not found.");
                         return -1;
                     } else {
-                        strcpy(tgrp, u_tab[target_user].group);
+                        strcpy(tgrp, group_name(u_tab[target_user].gid));
                     }
                 }
             }
 
             if (strcmp(tgrp, ".")==0) {
                 /* n's group */
-                strcpy(tgrp, u_tab[n].group);
+                strcpy(tgrp, group_name(u_tab[n].gid));
             }
             doOne(n, flags, tgrp, 1);
         }
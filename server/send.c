@@ -19,122 +19,199 @@
 #include "protocol.h"
 #include "strutil.h"
 #include "msgs.h"
+#include "users.h"
+#include "hushset.h"
 #include "mdb.h"
 #include "send.h"
 
-#include "pktserv/pktserv.h" /* for pktserv_send() */
+#include "pktserv/pktserv.h" /* for pktserv_send(), pktserv_resolve() */
+#include "pktserv/pktclock.h"
 
-extern char * getremotename(int socketfd);
+extern char * getremoteaddr(int socketfd);
 
-char packetbuffer[MAX_PKT_LEN]; /* packet buffer */
 
+/* start a packet of the given type */
+void pkt_begin(PACKET *p, char type)
+{
+    p->buf[1] = type;
+    p->len = 2;
+    p->nfields = 0;
+}
+
+/* room left for field bytes, keeping the last byte for the NUL */
+static size_t pkt_room(const PACKET *p)
+{
+    return MAX_PKT_LEN - 1 - p->len;
+}
+
+static void pkt_sep(PACKET *p)
+{
+    if (p->nfields++ > 0 && pkt_room(p) > 0)
+        p->buf[p->len++] = '\001';
+}
+
+/* add a field of text, filtered on the way in */
+void pkt_text(PACKET *p, const char *s, size_t max)
+{
+    size_t room;
+
+    pkt_sep(p);
+    if ((room = pkt_room(p)) == 0)
+        return;
+    if (max > room)
+        max = room;
+    p->len += filtertext(s, &p->buf[p->len], max);
+}
+
+/* add a field that's clean already */
+void pkt_raw(PACKET *p, const char *s)
+{
+    size_t n = strlen(s);
+
+    pkt_sep(p);
+    if (n > pkt_room(p))
+        n = pkt_room(p);
+    memcpy(&p->buf[p->len], s, n);
+    p->len += n;
+}
+
+/* add a number as a field */
+void pkt_num(PACKET *p, long n)
+{
+    char num[24];
+
+    snprintf(num, sizeof(num), "%ld", n);
+    pkt_raw(p, num);
+}
+
+/* NUL-terminate a packet and put its length in front */
+static void pkt_finish(PACKET *p)
+{
+    p->buf[p->len] = '\0';
+    p->buf[0] = (unsigned char)p->len;
+}
 
 /* send an error message to the client */
 void senderror(int to, const char *message)
 {
-    char msgbuf[MAX_PKT_DATA];
-    filtertext(message, msgbuf, MAX_PKT_DATA);
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%s",
-            ICB_M_ERROR, msgbuf);
-    doSend(-1, to);
+    PACKET p;
+
+    pkt_begin(&p, ICB_M_ERROR);
+    pkt_text(&p, message, MAX_PKT_DATA);
+    pkt_send(&p, -1, to);
 }
 
 /* send personal message to a client */
 void sendperson(int from, int to, const char *message)
 {
+    PACKET p;
 
-    char nickbuf[MAX_NICKLEN+1];
-    char msgbuf[MAX_PKT_DATA-MAX_NICKLEN-1];
-
-    filtertext(u_tab[from].nickname, nickbuf, MAX_NICKLEN+1);
-    filtertext(message, msgbuf, MAX_PKT_DATA-MAX_NICKLEN-1);
-
-    char one[255], two[MAX_NICKLEN+1];
-    snprintf(one, 255, "%s@%s", u_tab[from].loginid, u_tab[from].nodeid);
-    ucaseit(one);
-    snprintf(two, sizeof(two), "%s", u_tab[from].nickname);
-    ucaseit(two);
-
-    if ((!nlmatch(one, *u_tab[to].pri_s_hushed)) &&
-        (!nlmatch(two, *u_tab[to].pri_n_hushed))) 
+    if (!hushset_hushes(to, from, HUSH_PERSONAL))
     {
         /* see note below in sendopen() as it applies here too */
-        snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%s\001%s", 
-                 ICB_M_PERSONAL, nickbuf, msgbuf);
-        lpriv_id[to] = from;
-        doSend(from, to);
+        pkt_begin(&p, ICB_M_PERSONAL);
+        pkt_text(&p, u_tab[from].nickname, MAX_NICKLEN+1);
+        pkt_text(&p, message, MAX_PKT_DATA-MAX_NICKLEN-1);
+        set_user_lpriv(to, from);
+        pkt_send(&p, from, to);
     }
     else
         sendstatus(from, "Bounce", "Message did not go through");
 }
 
+/* build an open group message */
+static void fmt_open(PACKET *p, int from, const char *message)
+{
+    pkt_begin(p, ICB_M_OPEN);
+    pkt_text(p, u_tab[from].nickname, MAX_NICKLEN+1);
+    pkt_text(p, message, MAX_PKT_DATA-MAX_NICKLEN-1);
+}
+
 /* send normal open group message to the client */
 void sendopen(int from, int to, const char *message)
 {
-    char nickbuf[MAX_NICKLEN+1];
-    char msgbuf[MAX_PKT_DATA-MAX_NICKLEN-1];
+    PACKET p;
 
-    filtertext(u_tab[from].nickname, nickbuf, MAX_NICKLEN+1);
-    filtertext(message, msgbuf, MAX_PKT_DATA-MAX_NICKLEN-1);
+    fmt_open(&p, from, message);
+    pkt_send(&p, from, to);
+}
 
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%s\001%s",
-            ICB_M_OPEN, nickbuf, msgbuf);
-    doSend(from, to);
+/* send the same open group message to several clients */
+void sendopen_multi(int from, const int *to, int nto, const char *message)
+{
+    PACKET p;
+
+    fmt_open(&p, from, message);
+    pkt_multicast(&p, from, to, nto, 1);
 }
 
 /* send an exit message to the client -- makes the client disconnect */
 void sendexit(int to)
 {
-    /* construct exit message */
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c",
-            ICB_M_EXIT);
-    doSend(-1, to);
+    PACKET p;
+
+    pkt_begin(&p, ICB_M_EXIT);
+    pkt_send(&p, -1, to);
 }
 
 /* send a ping */
 void sendping(int to, const char *who)
 {
-    /* construct ping message */
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%s",
-            ICB_M_PING, who);
-    doSend(-1, to);
+    PACKET p;
+
+    pkt_begin(&p, ICB_M_PING);
+    pkt_raw(&p, who);
+    pkt_send(&p, -1, to);
+}
+
+/* build a status or important message */
+static void fmt_status(PACKET *p, char type, const char *status, const char *message)
+{
+#define MAX_STATUS_LEN 20
+    pkt_begin(p, type);
+    pkt_text(p, status, MAX_STATUS_LEN+1);
+    pkt_text(p, message, MAX_PKT_DATA-MAX_STATUS_LEN-1);
 }
 
 /* send a status message to the client */
 void sendstatus(int to, const char *status, const char *message)
 {
-#define MAX_STATUS_LEN 20
-    char statusbuf[MAX_STATUS_LEN+1];
-    char msgbuf[MAX_PKT_DATA-MAX_STATUS_LEN-1];
+    PACKET p;
 
-    filtertext(status, statusbuf, MAX_STATUS_LEN+1);
-    filtertext(message, msgbuf, MAX_PKT_DATA-MAX_STATUS_LEN-1);
+    fmt_status(&p, ICB_M_STATUS, status, message);
+    pkt_send(&p, -1, to);
+}
 
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%s\001%s", 
-             ICB_M_STATUS, statusbuf, msgbuf);
-    doSend(-1, to);
+/* send the same status message to several clients */
+void sendstatus_multi(const int *to, int nto, const char *status, const char *message)
+{
+    PACKET p;
+
+    fmt_status(&p, ICB_M_STATUS, status, message);
+    pkt_multicast(&p, -1, to, nto, 1);
 }
 
 /* send "end of command" to the client */
 void send_cmdend(int to, const char *message)
 {
-    char msgbuf[MAX_PKT_DATA-4];
+    PACKET p;
 
-    filtertext(message, msgbuf, MAX_PKT_DATA-4);
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%s\001\001%s", 
-             ICB_M_CMDOUT, "ec", msgbuf);
-    doSend(-1, to);
+    pkt_begin(&p, ICB_M_CMDOUT);
+    pkt_raw(&p, "ec");
+    pkt_raw(&p, "");
+    pkt_text(&p, message, MAX_PKT_DATA-4);
+    pkt_send(&p, -1, to);
 }
 
 /* send simple command output message to the client */
 void sends_cmdout(int to, const char *message)
 {
-    char msgbuf[MAX_PKT_DATA-3];
+    PACKET p;
 
-    filtertext(message, msgbuf, MAX_PKT_DATA-3);
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%s\001%s", 
-             ICB_M_CMDOUT, "co", msgbuf);
-    doSend(-1, to);
+    pkt_begin(&p, ICB_M_CMDOUT);
+    pkt_raw(&p, "co");
+    pkt_text(&p, message, MAX_PKT_DATA-3);
+    pkt_send(&p, -1, to);
 }
 
 /* send a personal message to a user, using a custom nick. This is
@@ -143,21 +220,20 @@ void sends_cmdout(int to, const char *message)
  */
 void send_person_stored(int to, const char* fromNick, const char *message)
 {
-    char nickbuf[MAX_NICKLEN+1];
-    char msgbuf[MAX_PKT_DATA-MAX_NICKLEN-1];
-
-    filtertext(fromNick, nickbuf, MAX_NICKLEN+1);
-    filtertext(message, msgbuf, MAX_PKT_DATA-MAX_NICKLEN-1);
+    PACKET p;
 
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%s\001%s",
-            ICB_M_PERSONAL, nickbuf, msgbuf);
-    doSend(-1, to);
+    pkt_begin(&p, ICB_M_PERSONAL);
+    pkt_text(&p, fromNick, MAX_NICKLEN+1);
+    pkt_text(&p, message, MAX_PKT_DATA-MAX_NICKLEN-1);
+    pkt_send(&p, -1, to);
 }
 
 
 /* send beep message to a client */
 void sendbeep(int from, int to)
 {
+    PACKET p;
+
     if ( u_tab[to].nobeep != 0 )
     {
         senderror(from, "User has nobeep enabled.");
@@ -173,46 +249,73 @@ void sendbeep(int from, int to)
         return;
     }
 
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%s",
-        ICB_M_BEEP, u_tab[from].nickname);
-    doSend(from, to);
+    pkt_begin(&p, ICB_M_BEEP);
+    pkt_raw(&p, u_tab[from].nickname);
+    pkt_send(&p, from, to);
 }
 
 
 void autoBeep(int to)
 {
     sendperson(NICKSERV, to, "Beep yerself!");
-    u_tab[NICKSERV].t_recv = time(NULL);
+    set_user_recv(NICKSERV, pktclock_time());
 }
 
-/* n  =  fd of their socket */
+/* n  =  connection slot id of their socket */
 void s_new_user(int n, int secure)
 {
+    PACKET p;
     char *cp;
 
-    /* Check bounds: file descriptor must be < MAX_USERS to use as array index */
-    if (n < 0 || n >= MAX_USERS) {
-        vmdb(MSG_ERR, "s_new_user: invalid file descriptor %d (must be 0-%d), closing connection", n, MAX_USERS - 1);
+    /* the slot id is our index into u_tab[], which may have to grow
+     * to have it */
+    if (n <= 0) {
+        vmdb(MSG_ERR, "s_new_user: invalid slot %d, closing connection", n);
+        pktserv_disconnect(n);
+        return;
+    }
+    if (n >= max_users && users_grow(n + 1) < 0) {
+        vmdb(MSG_ERR, "s_new_user: no room for slot %d, closing connection", n);
         pktserv_disconnect(n);
         return;
     }
 
     /* construct proto(col) message */
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%d\001%s\001%s",
-             ICB_M_PROTO, PROTO_LEVEL, thishost, VERSION);
-    doSend(-1, n);
+    pkt_begin(&p, ICB_M_PROTO);
+    pkt_num(&p, PROTO_LEVEL);
+    pkt_raw(&p, thishost);
+    pkt_raw(&p, VERSION);
+    pkt_send(&p, -1, n);
 
-    cp = getremotename(n);
+    /* go by their address until we know their name. looking it up
+     * can take a while, so it's done in the background. */
+    cp = getremoteaddr(pktserv_getfd(n));
 
     if (cp == NULL) {
         vmdb(MSG_INFO, "[CONNECT%s] %d", (secure?" (SSL)":""), n);
         return;
     }
 
-    if (strlen(cp) == 0) {
-        vmdb(MSG_INFO, "[CONNECT%s] %d", (secure?" (SSL)":""), n);
+    snprintf(u_tab[n].nodeid, MAX_NODELEN+1, "%s", cp);
+    update_match_names(n);
+    u_tab[n].secure = secure;
+
+    vmdb(MSG_INFO, "[CONNECT%s] %d: %s", (secure?" (SSL)":""), n, cp);
+
+    /* this may call s_resolved() before it returns */
+    u_tab[n].resolving = 1;
+    if (pktserv_resolve(n) < 0)
+        u_tab[n].resolving = 0;
+}
+
+/* n  =  connection slot id, cp = their host name, or "[addr]" if it
+ * couldn't be looked up */
+void s_resolved(int n, const char *cp)
+{
+    if (n <= 0 || n >= max_users)
         return;
-    }
+
+    u_tab[n].resolving = 0;
 
 #if defined(SHORT_HOSTNAME) && defined(FQDN)
     if(strcasecmp(SHORT_HOSTNAME, cp) == 0) {
@@ -220,33 +323,39 @@ void s_new_user(int n, int secure)
     }
 #endif    /* SHORT_HOSTNAME && FQDN */
 
-    snprintf(u_tab[n].nodeid, MAX_NODELEN+1, "%s", cp);
-    u_tab[n].secure = secure;
+    if (strcmp(u_tab[n].nodeid, cp) == 0)
+        return;
 
-    vmdb(MSG_INFO, "[CONNECT%s] %d: %s", (secure?" (SSL)":""), n, cp);
+    snprintf(u_tab[n].nodeid, MAX_NODELEN+1, "%s", cp);
+    update_match_names(n);
+    vmdb(MSG_INFO, "[RESOLVED] %d: %s", n, cp);
 }
 
 void send_loginok(int to)
 {
+    PACKET p;
+
     /* construct loginok message */
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c",
-            ICB_M_LOGINOK);
-    doSend(-1, to);
+    pkt_begin(&p, ICB_M_LOGINOK);
+    pkt_send(&p, -1, to);
 }
 
 /* send an important message to the client */
 void sendimport(int to, const char *status, const char *message)
 {
-#define MAX_STATUS_LEN 20
-    char statusbuf[MAX_STATUS_LEN+1];
-    char msgbuf[MAX_PKT_DATA-MAX_STATUS_LEN-1];
+    PACKET p;
 
-    filtertext(status, statusbuf, MAX_STATUS_LEN+1);
-    filtertext(message, msgbuf, MAX_PKT_DATA-MAX_STATUS_LEN-1);
+    fmt_status(&p, ICB_M_IMPORTANT, status, message);
+    pkt_send(&p, -1, to);
+}
 
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%c%s\001%s", 
-             ICB_M_IMPORTANT, statusbuf, msgbuf);
-    doSend(-1, to);
+/* send the same important message to several clients */
+void sendimport_multi(const int *to, int nto, const char *status, const char *message)
+{
+    PACKET p;
+
+    fmt_status(&p, ICB_M_IMPORTANT, status, message);
+    pkt_multicast(&p, -1, to, nto, 0);
 }
 
 
@@ -267,96 +376,117 @@ void user_wline(int to,
                 char *site, 
                 char *name)
 { 
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1,
-             "%cwl\001%s\001%s\001%ld\001%ld\001%ld\001%s\001%s\001%s%c",
-             ICB_M_CMDOUT, mod, nick, (long)idle, (long)resp, (long)login, user, site, name, 0);
-    doSend(-1, to);
+    PACKET p;
+
+    pkt_begin(&p, ICB_M_CMDOUT);
+    pkt_raw(&p, "wl");
+    pkt_raw(&p, mod);
+    pkt_raw(&p, nick);
+    pkt_num(&p, idle);
+    pkt_num(&p, resp);
+    pkt_num(&p, login);
+    pkt_raw(&p, user);
+    pkt_raw(&p, site);
+    pkt_raw(&p, name);
+    pkt_send(&p, -1, to);
 }
 
 void user_whead(int to)
 { 
-    snprintf(&packetbuffer[1], MAX_PKT_LEN-1, "%cwh%c",
-        ICB_M_CMDOUT, 0);
-    doSend(-1, to);
+    PACKET p;
+
+    pkt_begin(&p, ICB_M_CMDOUT);
+    pkt_raw(&p, "wh");
+    pkt_send(&p, -1, to);
 }
 
-/* This expects packetbuffer to be filled with the command byte
- * at packetbuffer[1] and any data following that. It also
- * expects that the data is NULL terminated.
- *
- * It will put the packet length into packetbuffer[0].
- *
- * Note that the length does not include the length byte itself
- * but does include the trailing NULL.
- *
- * Thus, the maximum we *ever* send is 256 bytes; the length byte
- * plus 255 bytes of packet contents.
- */
-int doSend(int from,int to)
+/* put a finished frame on a client's queue */
+static int send_frame(int to, char *frame, size_t len)
 {
     int ret;
-    int max_users = MAX_REAL_USERS; /* for debugging purposes */
-    char line[MAX_PKT_DATA];
-    size_t len;
 
-    if (to < 0) {
-        vmdb(MSG_ERR, "Attempted to send to negative fd: %d", to);
+    if (S_kill[to] > 0) 
         return -1;
+
+    /* refused: the connection is gone, or it's backed up past the
+     * send queue limit and the deadline check will drop it */
+    if ((ret = pktserv_send(to, frame, len)) < 0)
+        vmdb(MSG_ERR, "pkt_send: %d: %s (%d)", to, strerror(errno), ret);
+
+    return 0;
+}
+
+/* a packet for the server's own nick. it doesn't go anywhere; the
+ * server acts on it here */
+static int send_to_server(PACKET *p, int from)
+{
+    TOKEN f[2], argv[2];
+
+    switch (p->buf[1]) {
+        case ICB_M_BEEP: /* someone beeped us */
+            autoBeep(from);
+            break;
+        case ICB_M_PERSONAL: /* someone sent us a message */
+            /* it's a command: the first word of it, then the rest */
+            if (tokenize(&p->buf[2], f, 2) == 2) {
+                argv[1] = f[1];
+                argv[0] = tok_word(&argv[1]);
+                runcmd(from, 2, argv);
+            }
+            break;
+        default: /* do nothing -- ignore */
+            break;
     }
+    return 0;
+}
 
-    if (to >= max_users) /* talking to the server */
-    {
-        packetbuffer[0] = ' ';
-        switch (packetbuffer[1]) {
-            case ICB_M_BEEP: /* someone beeped us */
-                autoBeep(from);
-                break;
-            case ICB_M_PERSONAL: /* someone sent us a message */
-                split(packetbuffer);
-                snprintf(line, MAX_PKT_DATA-2, "%s\001%s", getword(fields[1]), 
-                         get_tail(fields[1]));
-                cmdmsg(from, line);
-                break;
-            default: /* do nothing -- ignore */
-                break;
-        }
-        return 0;
-    } 
-
-    /*
-     * note: we compare against MAX_PKT_LEN
-     * to make sure that no packets slipped through
-     * that are too big.
-     */
-    len = strlen(&packetbuffer[1]) + 1; /* include the null terminator */
-    if (len > (MAX_PKT_LEN - 1)) { /* reserve room for the length byte itself*/
-        mdb(MSG_ERR, "doSend: pbuf too large:");
-        vmdb(MSG_ERR, "from=%d to=%d pbuf=%s len=%d",
-                from, to, &packetbuffer[1], len);
-        snprintf(mbuf, MSG_BUF_SIZE, "Cannot transmit packet: too large");
-        senderror(from, mbuf);
+/* Send a finished packet to a client.
+ *
+ * The maximum we *ever* send is 256 bytes; the length byte plus 255
+ * bytes of packet contents, the last of them the NUL.
+ */
+int pkt_send(PACKET *p, int from, int to)
+{
+    if (to < 0) {
+        vmdb(MSG_ERR, "Attempted to send to negative fd: %d", to);
         return -1;
     }
 
-    if (S_kill[to] > 0) 
-        return -1;
+    pkt_finish(p);
+
+    if (to == NICKSERV) /* talking to the server */
+        return send_to_server(p, from);
+
+    return send_frame(to, p->buf, p->len + 1);
+}
 
-    packetbuffer[0] = (unsigned char)len;
-    if ((ret = pktserv_send(to, packetbuffer, len + 1 )) < 0) {
-        vmdb(MSG_ERR, "doSend: %d: %s (%d)", to, strerror(errno), ret);
-        if (ret == -2) {
-            /* bad news! */
-            S_kill[to]++;
-            /* need to clear the notifies of this user,
-               lest he try to someone else who's dead
-               who has this guy in his notify. Endless
-               loop! */
-            /* Don't know if it's still needed, but it
-               doesn't hurt */
-            nlclear(u_tab[to].n_notifies);
-            nlclear(u_tab[to].s_notifies);
+/* Send a packet to every client in to[] at once. The packet is only
+ * copied once for the lot of them.
+ *
+ * If lowprio is set, it's something that can be dropped for clients
+ * who are falling behind on their output.
+ */
+int pkt_multicast(PACKET *p, int from, const int *to, int nto, int lowprio)
+{
+    int targets[nto > 0 ? nto : 1];
+    int i, n = 0;
+
+    pkt_finish(p);
+
+    for (i = 0; i < nto; i++) {
+        if (to[i] <= NICKSERV || to[i] >= max_users) {
+            vmdb(MSG_ERR, "Attempted to multicast to bad slot: %d", to[i]);
+            continue;
         }
+        if (S_kill[to[i]] > 0)
+            continue;
+        targets[n++] = to[i];
     }
 
+    if (pktserv_multicast_prio(targets, (size_t)n, p->buf, p->len + 1,
+                               lowprio ? PKTSERV_PRIO_LOW : PKTSERV_PRIO_NORMAL) < 0)
+        vmdb(MSG_DEBUG, "pkt_multicast: %d: couldn't send to all %d targets",
+             from, n);
+
     return 0;
 }
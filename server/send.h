@@ -1,5 +1,37 @@
 #pragma once
 
+#include <stddef.h>
+
+/* a packet being put together: the length byte, the type, then the
+ * fields, separated by \001 and ending in a NUL. the length is kept as
+ * fields go in, so the finished packet needn't be strlen()'d, and one
+ * built once can go out to any number of clients as is.
+ */
+typedef struct {
+    char buf[MAX_PKT_LEN];
+    size_t len;         /* bytes in buf so far, counting the length byte */
+    int nfields;
+} PACKET;
+
+/* start a packet of the given type */
+void pkt_begin(PACKET *p, char type);
+
+/* add a field of text, run through filtertext() on the way in. it gets
+ * at most max bytes, as filtertext() would give it, and is cut short
+ * if the packet is full. */
+void pkt_text(PACKET *p, const char *s, size_t max);
+
+/* add a field that's known to be clean already, like a nickname */
+void pkt_raw(PACKET *p, const char *s);
+
+/* add a number as a field */
+void pkt_num(PACKET *p, long n);
+
+/* send a packet to a client, or to several at once. lowprio packets
+ * may be dropped for clients whose output is backed up. */
+int pkt_send(PACKET *p, int from, int to);
+int pkt_multicast(PACKET *p, int from, const int *to, int nto, int lowprio);
+
 /* send an error message to the client */
 void senderror(int to, const char *error_string);
 
@@ -9,6 +41,9 @@ void sendperson(int from, int to, const char *message_string);
 /* send normal open group message to the client */
 void sendopen(int from, int to, const char *txt);
 
+/* send the same open group message to several clients */
+void sendopen_multi(int from, const int *to, int nto, const char *txt);
+
 /* send an exit message to the client -- makes the client disconnect */
 void sendexit(int to);
 
@@ -18,6 +53,10 @@ void sendping(int to, const char *who);
 /* send a status message to the client */
 void sendstatus(int to, const char *class_string, const char *message_string);
 
+/* send the same status message to several clients */
+void sendstatus_multi(const int *to, int nto, const char *class_string,
+                      const char *message_string);
+
 /* send "end of command" to the client */
 void send_cmdend(int to, const char *output_string);
 
@@ -38,6 +77,7 @@ void sendbeep(int from, int to);
  * secure = SSL connection
  */ 
 void s_new_user(int n, int secure);
+void s_resolved(int n, const char *cp);
 
 /* construct loginok message */
 void send_loginok(int to);
@@ -45,6 +85,10 @@ void send_loginok(int to);
 /* send an important message to the client */
 void sendimport(int to, const char *class_string, const char *output_string);
 
+/* send the same important message to several clients */
+void sendimport_multi(const int *to, int nto, const char *class_string,
+                      const char *output_string);
+
 /* send an autobeep to the client */
 void autoBeep(int to);
 
@@ -67,11 +111,8 @@ void user_wline(int to,
    sprintf(pbuf,
    "%cwg\001%s\001%s\001%s\001%s\000",
    ICB_M_CMDOUT, group, topic, c, d);
-   doSend(-1, to);
+   pkt_send(&p, -1, to);
    }
  */
 
 void user_whead(int to);
-
-/* send a text message to the client */
-int  doSend(int from, int to);
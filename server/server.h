@@ -13,13 +13,16 @@
 
 #include "protocol.h"
 #include "namelist.h"
+#include "pktserv/pkttimer.h"
 
 /*
-   BEWARE!! of the relationship between MAX_REAL_USERS and the various
-   resident automagical users -- esp. for fencepost errors.
+   the per-slot tables (u_tab[], u_hot, S_kill[] and the rest) have
+   max_users entries, MAX_USERS to start with, and grow along with
+   pktserv's slot table; see users_grow(). NICKSERV, the resident
+   automagical user, has slot 0, which pktserv never hands out, so the
+   real users are slots 1 to max_users - 1.
  */
-#define	MAX_REAL_USERS (MAX_USERS - 1)
-#define	NICKSERV (MAX_USERS - 1)
+#define	NICKSERV 0
 
 /*
  * define's for various permission bit settings
@@ -48,7 +51,9 @@ typedef struct {
     char nickname [MAX_NICKLEN+1];  /* their nickname */
     char password [MAX_PASSWDLEN+1];  /* their password */
     char realname [MAX_REALLEN+1];  /* their real name */
-    char group[MAX_GROUPLEN+1];  /* name of which group they are in */
+    char uc_nick [MAX_NICKLEN+1];  /* nickname upper-cased, as hush and notify lists are matched */
+    char uc_addr [MAX_IDLEN+MAX_NODELEN+2];  /* and loginid@nodeid, likewise */
+    int gid;  /* which group they are in, its g_tab index, or -1 */
     char awaymsg[MAX_AWAY_LEN+1]; /* their away msg, or \0 if not set */
     int lastaway;  /* the last person to whom they sent an away msg */
     time_t lastawaytime; /* and the time they sent it */
@@ -62,6 +67,8 @@ typedef struct {
     time_t t_recv;	/* last time they sent us something -- */
     time_t t_group;   /* last time they changed groups */
     int secure;   /* Are they on an SSL connection? */
+    int resolving;   /* still looking up their nodeid? */
+    int recv_count;  /* messages to group 1 this second */
 #ifdef BRICK
     int bricks;    /* number of bricks the user has */
 #endif
@@ -72,8 +79,24 @@ typedef struct {
     NAMLIST * pub_s_hushed;
     NAMLIST * n_notifies;
     NAMLIST * s_notifies;
+    pkttimer_t idle_timer;	/* next idle-boot/MAX_IDLE check */
+    pkttimer_t kill_timer;	/* pending S_kill disconnect */
 } USER_ITEM;
 
+/* the fields of u_tab that loops over the users look at, kept apart in
+ * packed arrays so a scan reads a few cache lines instead of a whole
+ * USER_ITEM per slot, max_users of each. they're copies: u_tab is
+ * still the record, and users.c keeps these in step through
+ * set_user_login(), set_user_echoback(), set_user_group() and
+ * set_user_recv().
+ */
+typedef struct {
+    signed char *login;                 /* u_tab[].login */
+    signed char *echoback;              /* u_tab[].echoback */
+    int *gid;                           /* u_tab[].gid */
+    time_t *t_recv;                     /* u_tab[].t_recv */
+} USER_HOT;
+
 typedef struct {
     char name [MAX_GROUPLEN+1];  /* the name of the group */
     /* if inactive, then NULL */
@@ -107,6 +130,7 @@ typedef struct {
      * 2 = "%s" which is replaced by nickname
      */
     int	idlemod;	/* how idle mods can be before they /pass */
+    pkttimer_t mod_timer;	/* next idle-mod/mod timeout check */
     /*
        next group  (if it was a linked list instead of a table)
      */
@@ -0,0 +1,993 @@
+/*
+ * snapshot.c
+ *
+ * the binary snapshot of the user and group tables that icbdump()
+ * writes and icbload() and the restart handoff read. See snapshot.h
+ * for the layout.
+ *
+ * Loading is done in two passes over the image, the first only
+ * checking that every record and field lies inside it, the second
+ * filling the tables, so a bad image never leaves them half loaded.
+ * Fields are described by the tables below; to add one, give it a
+ * new tag and never reuse an old one.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "server.h"
+#include "externs.h"
+#include "namelist.h"
+#include "users.h"
+#include "groups.h"
+#include "snapshot.h"
+#include "mdb.h"
+
+#define SNAP_MAGIC      "ICBS"
+#define SNAP_VERSION    2
+#define SNAP_HDRLEN     32
+
+#define SNAP_RECHDR     9       /* u8 type, u32 slot, u32 length */
+#define SNAP_FLDHDR     5       /* u8 tag, u32 length */
+
+/* record types */
+#define REC_USER        1
+#define REC_GROUP       2
+
+/* field kinds */
+#define F_STR           1       /* char array */
+#define F_NUM           2       /* int, long or time_t */
+#define F_LIST          3       /* NAMLIST * */
+
+typedef struct {
+    int tag;
+    int kind;
+    size_t off;
+    size_t size;
+} snapfield_t;
+
+#define SNAPFIELD(tag, kind, type, member) \
+    { tag, kind, offsetof(type, member), sizeof(((type *)0)->member) }
+
+/* USER_ITEM has its group's g_tab index, which means nothing outside
+ * this server, so the group is written by name under a tag of its own
+ * and found again once the groups are loaded */
+#define U_GROUP         6
+
+/* S_kill[] isn't in USER_ITEM, so it has a tag of its own */
+#define U_KILL          25
+
+static const snapfield_t user_fields[] = {
+    SNAPFIELD(1,  F_STR,  USER_ITEM, loginid),
+    SNAPFIELD(2,  F_STR,  USER_ITEM, nodeid),
+    SNAPFIELD(3,  F_STR,  USER_ITEM, nickname),
+    SNAPFIELD(4,  F_STR,  USER_ITEM, password),
+    SNAPFIELD(5,  F_STR,  USER_ITEM, realname),
+    SNAPFIELD(7,  F_STR,  USER_ITEM, awaymsg),
+    SNAPFIELD(8,  F_NUM,  USER_ITEM, lastaway),
+    SNAPFIELD(9,  F_NUM,  USER_ITEM, lastawaytime),
+    SNAPFIELD(10, F_NUM,  USER_ITEM, login),
+    SNAPFIELD(11, F_NUM,  USER_ITEM, echoback),
+    SNAPFIELD(12, F_NUM,  USER_ITEM, nobeep),
+    SNAPFIELD(13, F_NUM,  USER_ITEM, perms),
+    SNAPFIELD(14, F_NUM,  USER_ITEM, t_notify),
+    SNAPFIELD(15, F_NUM,  USER_ITEM, t_on),
+    SNAPFIELD(16, F_NUM,  USER_ITEM, t_sent),
+    SNAPFIELD(17, F_NUM,  USER_ITEM, t_recv),
+    SNAPFIELD(18, F_NUM,  USER_ITEM, t_group),
+    SNAPFIELD(19, F_LIST, USER_ITEM, pri_n_hushed),
+    SNAPFIELD(20, F_LIST, USER_ITEM, pub_n_hushed),
+    SNAPFIELD(21, F_LIST, USER_ITEM, pri_s_hushed),
+    SNAPFIELD(22, F_LIST, USER_ITEM, pub_s_hushed),
+    SNAPFIELD(23, F_LIST, USER_ITEM, n_notifies),
+    SNAPFIELD(24, F_LIST, USER_ITEM, s_notifies),
+    SNAPFIELD(26, F_NUM,  USER_ITEM, secure),
+    SNAPFIELD(27, F_NUM,  USER_ITEM, resolving),
+};
+
+static const snapfield_t group_fields[] = {
+    SNAPFIELD(1,  F_STR,  GROUP_ITEM, name),
+    SNAPFIELD(2,  F_STR,  GROUP_ITEM, topic),
+    SNAPFIELD(3,  F_NUM,  GROUP_ITEM, visibility),
+    SNAPFIELD(4,  F_NUM,  GROUP_ITEM, control),
+    SNAPFIELD(5,  F_NUM,  GROUP_ITEM, mod),
+    SNAPFIELD(6,  F_NUM,  GROUP_ITEM, modtimeout),
+    SNAPFIELD(7,  F_STR,  GROUP_ITEM, missingmod),
+    SNAPFIELD(8,  F_NUM,  GROUP_ITEM, volume),
+    SNAPFIELD(9,  F_LIST, GROUP_ITEM, n_invites),
+    SNAPFIELD(10, F_LIST, GROUP_ITEM, nr_invites),
+    SNAPFIELD(11, F_LIST, GROUP_ITEM, s_invites),
+    SNAPFIELD(12, F_LIST, GROUP_ITEM, sr_invites),
+    SNAPFIELD(13, F_LIST, GROUP_ITEM, n_bars),
+    SNAPFIELD(14, F_LIST, GROUP_ITEM, n_nr_bars),
+    SNAPFIELD(15, F_LIST, GROUP_ITEM, s_bars),
+    SNAPFIELD(16, F_LIST, GROUP_ITEM, s_nr_bars),
+    SNAPFIELD(17, F_LIST, GROUP_ITEM, n_talk),
+    SNAPFIELD(18, F_LIST, GROUP_ITEM, nr_talk),
+    SNAPFIELD(19, F_NUM,  GROUP_ITEM, size),
+    SNAPFIELD(20, F_NUM,  GROUP_ITEM, idleboot),
+    SNAPFIELD(21, F_STR,  GROUP_ITEM, idleboot_msg),
+    SNAPFIELD(22, F_NUM,  GROUP_ITEM, idlemod),
+};
+
+#define NFIELDS(t)  (sizeof(t) / sizeof((t)[0]))
+
+
+/* CRC-32 (IEEE), table built on first use */
+static uint32_t
+snap_crc32(const unsigned char *p, size_t len)
+{
+    static uint32_t table[256];
+    static int built = 0;
+    uint32_t c;
+    size_t i;
+    int k;
+
+    if (!built) {
+        for (i = 0; i < 256; i++) {
+            c = (uint32_t)i;
+            for (k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        built = 1;
+    }
+
+    c = 0xffffffffu;
+    for (i = 0; i < len; i++)
+        c = table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+    return c ^ 0xffffffffu;
+}
+
+static uint32_t
+get_u16(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t
+get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int64_t
+get_i64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return (int64_t)v;
+}
+
+
+/*
+ * encoding
+ */
+
+typedef struct {
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+    int err;
+} snapbuf_t;
+
+static unsigned char *
+snap_room(snapbuf_t *sb, size_t n)
+{
+    unsigned char *nbuf;
+    size_t ncap;
+
+    if (sb->err)
+        return NULL;
+    if (sb->len + n > sb->cap) {
+        for (ncap = sb->cap ? sb->cap : 4096; ncap < sb->len + n; ncap *= 2)
+            ;
+        if ((nbuf = (unsigned char *)realloc(sb->buf, ncap)) == NULL) {
+            sb->err = 1;
+            return NULL;
+        }
+        sb->buf = nbuf;
+        sb->cap = ncap;
+    }
+    sb->len += n;
+    return sb->buf + sb->len - n;
+}
+
+static void
+set_u32(unsigned char *p, uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static void
+put_u8(snapbuf_t *sb, unsigned int v)
+{
+    unsigned char *p;
+
+    if ((p = snap_room(sb, 1)) != NULL)
+        p[0] = v & 0xff;
+}
+
+static void
+put_u16(snapbuf_t *sb, unsigned int v)
+{
+    unsigned char *p;
+
+    if ((p = snap_room(sb, 2)) != NULL) {
+        p[0] = v & 0xff;
+        p[1] = (v >> 8) & 0xff;
+    }
+}
+
+static void
+put_u32(snapbuf_t *sb, uint32_t v)
+{
+    unsigned char *p;
+
+    if ((p = snap_room(sb, 4)) != NULL)
+        set_u32(p, v);
+}
+
+static void
+put_bytes(snapbuf_t *sb, const void *data, size_t n)
+{
+    unsigned char *p;
+
+    if ((p = snap_room(sb, n)) != NULL)
+        memcpy(p, data, n);
+}
+
+/* start something with a length after its header; returns where the
+ * length goes, for snap_end() to fill in */
+static size_t
+snap_begin(snapbuf_t *sb)
+{
+    put_u32(sb, 0);
+    return sb->len - 4;
+}
+
+static void
+snap_end(snapbuf_t *sb, size_t lenoff)
+{
+    if (!sb->err)
+        set_u32(sb->buf + lenoff, (uint32_t)(sb->len - lenoff - 4));
+}
+
+static int64_t
+num_get(const char *p, size_t size)
+{
+    switch (size) {
+    case sizeof(int16_t): { int16_t v; memcpy(&v, p, sizeof(v)); return v; }
+    case sizeof(int32_t): { int32_t v; memcpy(&v, p, sizeof(v)); return v; }
+    default:              { int64_t v; memcpy(&v, p, sizeof(v)); return v; }
+    }
+}
+
+static void
+num_set(char *p, size_t size, int64_t v)
+{
+    switch (size) {
+    case sizeof(int16_t): { int16_t n = (int16_t)v; memcpy(p, &n, sizeof(n)); break; }
+    case sizeof(int32_t): { int32_t n = (int32_t)v; memcpy(p, &n, sizeof(n)); break; }
+    default:              { memcpy(p, &v, sizeof(v)); break; }
+    }
+}
+
+static void
+put_num(snapbuf_t *sb, int tag, int64_t v)
+{
+    unsigned char *p;
+    uint64_t u = (uint64_t)v;
+    int i;
+
+    put_u8(sb, tag);
+    put_u32(sb, 8);
+    if ((p = snap_room(sb, 8)) != NULL)
+        for (i = 0; i < 8; i++, u >>= 8)
+            p[i] = u & 0xff;
+}
+
+/* a namelist goes out oldest first, so putting the names back with
+ * nlput() leaves them in the same order */
+static void
+put_list(snapbuf_t *sb, int tag, NAMLIST *nl)
+{
+    STRLIST *sp;
+    size_t lenoff, n;
+
+    if (nl == NULL || nlcount(*nl) == 0)
+        return;
+
+    put_u8(sb, tag);
+    lenoff = snap_begin(sb);
+    for (sp = nl->tail; sp; sp = sp->prev) {
+        n = strlen(sp->str);
+        if (n > 0xffff)
+            n = 0xffff;
+        put_u16(sb, n);
+        put_bytes(sb, sp->str, n);
+    }
+    snap_end(sb, lenoff);
+}
+
+static void
+put_str(snapbuf_t *sb, int tag, const char *s, size_t size)
+{
+    size_t n;
+
+    /* empty strings are what a cleared slot has anyway */
+    if ((n = strnlen(s, size)) > 0) {
+        put_u8(sb, tag);
+        put_u32(sb, n);
+        put_bytes(sb, s, n);
+    }
+}
+
+static void
+put_fields(snapbuf_t *sb, const char *item,
+           const snapfield_t *fields, size_t nfields)
+{
+    const snapfield_t *f;
+    size_t i;
+
+    for (i = 0; i < nfields; i++) {
+        f = &fields[i];
+        switch (f->kind) {
+        case F_STR:
+            put_str(sb, f->tag, item + f->off, f->size);
+            break;
+        case F_NUM:
+            put_num(sb, f->tag, num_get(item + f->off, f->size));
+            break;
+        case F_LIST:
+            put_list(sb, f->tag, *(NAMLIST **)(item + f->off));
+            break;
+        }
+    }
+}
+
+int
+snapshot_encode(char **image, size_t *len)
+{
+    snapbuf_t sb;
+    size_t lenoff;
+    uint32_t nrecords = 0;
+    unsigned char *hdr;
+    int i;
+
+    *image = NULL;
+    *len = 0;
+    memset(&sb, 0, sizeof(sb));
+
+    /* filled in once the body is done */
+    snap_room(&sb, SNAP_HDRLEN);
+
+    /* a connection that hasn't logged in yet still has its nodeid, set
+     * when it connected, and it's carried over a restart with the rest */
+    for (i = 0; i < max_users; i++) {
+        if (u_tab[i].login == LOGIN_FALSE && S_kill[i] == 0 &&
+            u_tab[i].nodeid[0] == '\0')
+            continue;
+        put_u8(&sb, REC_USER);
+        put_u32(&sb, i);
+        lenoff = snap_begin(&sb);
+        put_fields(&sb, (const char *)&u_tab[i], user_fields, NFIELDS(user_fields));
+        if (u_tab[i].gid >= 0)
+            put_str(&sb, U_GROUP, g_tab[u_tab[i].gid].name, sizeof(g_tab[0].name));
+        if (S_kill[i])
+            put_num(&sb, U_KILL, S_kill[i]);
+        snap_end(&sb, lenoff);
+        nrecords++;
+    }
+
+    for (i = 0; i < MAX_GROUPS; i++) {
+        if (g_tab[i].name[0] == '\0')
+            continue;
+        put_u8(&sb, REC_GROUP);
+        put_u32(&sb, i);
+        lenoff = snap_begin(&sb);
+        put_fields(&sb, (const char *)&g_tab[i], group_fields, NFIELDS(group_fields));
+        snap_end(&sb, lenoff);
+        nrecords++;
+    }
+
+    if (sb.err || sb.len - SNAP_HDRLEN > 0xffffffffu) {
+        vmdb(MSG_ERR, "%s: no memory for the snapshot", __FUNCTION__);
+        free(sb.buf);
+        return SNAPSHOT_ERR;
+    }
+
+    hdr = sb.buf;
+    memset(hdr, 0, SNAP_HDRLEN);
+    memcpy(hdr, SNAP_MAGIC, 4);
+    hdr[4] = SNAP_VERSION & 0xff;
+    hdr[5] = (SNAP_VERSION >> 8) & 0xff;
+    hdr[6] = SNAP_HDRLEN;
+    set_u32(hdr + 8, max_users);
+    set_u32(hdr + 12, MAX_GROUPS);
+    set_u32(hdr + 16, nrecords);
+    set_u32(hdr + 20, (uint32_t)(sb.len - SNAP_HDRLEN));
+    set_u32(hdr + 24, snap_crc32(sb.buf + SNAP_HDRLEN, sb.len - SNAP_HDRLEN));
+
+    *image = (char *)sb.buf;
+    *len = sb.len;
+    return 0;
+}
+
+
+/*
+ * decoding
+ */
+
+/* the group names of the users being loaded, until the groups are */
+static char (*user_groups)[MAX_GROUPLEN+1] = NULL;
+
+/* the image's version, and how many user slots its server had */
+static int snap_version;
+static uint32_t snap_nusers;
+
+/* where a user record's slot goes. version 1 servers kept NICKSERV in
+ * their last slot, not slot 0, which they never gave anyone, so the
+ * two trade places. */
+static uint32_t
+user_slot(uint32_t slot)
+{
+    if (snap_version == 1) {
+        if (slot == snap_nusers - 1)
+            return NICKSERV;
+        if (slot == NICKSERV)
+            return snap_nusers - 1;
+    }
+    return slot;
+}
+
+/* and the same for the moderators the groups point at */
+static void
+remap_mods(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_GROUPS; i++)
+        if (g_tab[i].mod >= 0)
+            g_tab[i].mod = (int)user_slot((uint32_t)g_tab[i].mod);
+}
+
+/* get the tables ready to load a server with nusers slots into */
+static int
+load_begin(int version, uint32_t nusers)
+{
+    if (users_grow((int)nusers) < 0)
+        return -1;
+    free(user_groups);
+    if ((user_groups = calloc(max_users, sizeof(*user_groups))) == NULL) {
+        vmdb(MSG_ERR, "%s: no memory for %d slots", __FUNCTION__, max_users);
+        return -1;
+    }
+    snap_version = version;
+    snap_nusers = nusers;
+    init_groups();
+    clear_users();
+    return 0;
+}
+
+/* point everyone at the group they were in, by name */
+static void
+resolve_groups(void)
+{
+    int i, j;
+
+    for (i = 0; i < max_users; i++) {
+        u_tab[i].gid = -1;
+        if (user_groups[i][0] == '\0')
+            continue;
+        for (j = 0; j < MAX_GROUPS; j++) {
+            if (strcasecmp(g_tab[j].name, user_groups[i]) == 0) {
+                u_tab[i].gid = j;
+                break;
+            }
+        }
+    }
+    free(user_groups);
+    user_groups = NULL;
+}
+
+static const snapfield_t *
+find_field(const snapfield_t *fields, size_t nfields, int tag)
+{
+    size_t i;
+
+    for (i = 0; i < nfields; i++)
+        if (fields[i].tag == tag)
+            return &fields[i];
+    return NULL;
+}
+
+static void
+load_list(NAMLIST *nl, const unsigned char *p, size_t len)
+{
+    char name[256];
+    size_t n, off = 0;
+
+    while (off + 2 <= len) {
+        n = get_u16(p + off);
+        off += 2;
+        memcpy(name, p + off, n < sizeof(name) ? n : sizeof(name) - 1);
+        name[n < sizeof(name) ? n : sizeof(name) - 1] = '\0';
+        off += n;
+        nlput(nl, name);
+    }
+}
+
+static void
+load_field(char *item, const snapfield_t *f, const unsigned char *p, size_t len)
+{
+    size_t n;
+
+    switch (f->kind) {
+    case F_STR:
+        n = len < f->size ? len : f->size - 1;
+        memcpy(item + f->off, p, n);
+        item[f->off + n] = '\0';
+        break;
+    case F_NUM:
+        num_set(item + f->off, f->size, get_i64(p));
+        break;
+    case F_LIST:
+        load_list(*(NAMLIST **)(item + f->off), p, len);
+        break;
+    }
+}
+
+/* check the fields of one record, or load them into item */
+static int
+walk_fields(const unsigned char *p, size_t len, char *item, int slot,
+            const snapfield_t *fields, size_t nfields)
+{
+    const snapfield_t *f;
+    size_t off = 0, flen, n, loff;
+    int tag;
+
+    while (off < len) {
+        if (len - off < SNAP_FLDHDR)
+            return -1;
+        tag = p[off];
+        flen = get_u32(p + off + 1);
+        off += SNAP_FLDHDR;
+        if (flen > len - off)
+            return -1;
+
+        f = find_field(fields, nfields, tag);
+        if (item == NULL) {
+            if (f && f->kind == F_NUM && flen != 8)
+                return -1;
+            if (f && f->kind == F_LIST) {
+                for (loff = 0; loff < flen; loff += n) {
+                    if (flen - loff < 2)
+                        return -1;
+                    n = get_u16(p + off + loff);
+                    loff += 2;
+                    if (n > flen - loff)
+                        return -1;
+                }
+            }
+            if (fields == user_fields && tag == U_KILL && flen != 8)
+                return -1;
+        } else if (f) {
+            load_field(item, f, p + off, flen);
+        } else if (fields == user_fields && tag == U_KILL) {
+            S_kill[slot] = (short)get_i64(p + off);
+        } else if (fields == user_fields && tag == U_GROUP) {
+            n = flen < MAX_GROUPLEN ? flen : MAX_GROUPLEN;
+            memcpy(user_groups[slot], p + off, n);
+            user_groups[slot][n] = '\0';
+        }
+        /* anything else is from a newer server; skip it */
+
+        off += flen;
+    }
+    return 0;
+}
+
+/* check the whole body, or, with load set, load it */
+static int
+walk_records(const unsigned char *p, size_t len, uint32_t nrecords, int load)
+{
+    size_t off = 0, rlen;
+    uint32_t slot, n;
+    int type, r;
+
+    for (n = 0; off < len; n++) {
+        if (len - off < SNAP_RECHDR)
+            return -1;
+        type = p[off];
+        slot = get_u32(p + off + 1);
+        rlen = get_u32(p + off + 5);
+        off += SNAP_RECHDR;
+        if (rlen > len - off)
+            return -1;
+
+        switch (type) {
+        case REC_USER:
+            if (slot >= snap_nusers)
+                return -1;
+            slot = user_slot(slot);
+            r = walk_fields(p + off, rlen, load ? (char *)&u_tab[slot] : NULL,
+                            slot, user_fields, NFIELDS(user_fields));
+            break;
+        case REC_GROUP:
+            if (slot >= MAX_GROUPS)
+                return -1;
+            r = walk_fields(p + off, rlen, load ? (char *)&g_tab[slot] : NULL,
+                            slot, group_fields, NFIELDS(group_fields));
+            break;
+        default:
+            r = 0;
+            break;
+        }
+        if (r < 0)
+            return -1;
+
+        off += rlen;
+    }
+    return n == nrecords ? 0 : -1;
+}
+
+int
+snapshot_load(const char *image, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)image;
+    uint32_t hdrlen, bodylen, nrecords, nusers;
+    int version;
+
+    if (len < 4 || memcmp(p, SNAP_MAGIC, 4) != 0)
+        return SNAPSHOT_NOTSNAP;
+
+    if (len < SNAP_HDRLEN) {
+        vmdb(MSG_ERR, "%s: short snapshot header", __FUNCTION__);
+        return SNAPSHOT_ERR;
+    }
+    version = get_u16(p + 4);
+    if (version < 1 || version > SNAP_VERSION) {
+        vmdb(MSG_ERR, "%s: snapshot version %u, we read 1 to %d", __FUNCTION__,
+             version, SNAP_VERSION);
+        return SNAPSHOT_ERR;
+    }
+
+    hdrlen = get_u16(p + 6);
+    nusers = get_u32(p + 8);
+    nrecords = get_u32(p + 16);
+    bodylen = get_u32(p + 20);
+    if (hdrlen < SNAP_HDRLEN || hdrlen > len || bodylen != len - hdrlen) {
+        vmdb(MSG_ERR, "%s: snapshot is %lu bytes, header says %lu",
+             __FUNCTION__, (unsigned long)len,
+             (unsigned long)hdrlen + bodylen);
+        return SNAPSHOT_ERR;
+    }
+    if (snap_crc32(p + hdrlen, bodylen) != get_u32(p + 24)) {
+        vmdb(MSG_ERR, "%s: snapshot checksum mismatch", __FUNCTION__);
+        return SNAPSHOT_ERR;
+    }
+    if (nusers < 2 || nusers > INT_MAX) {
+        vmdb(MSG_ERR, "%s: snapshot has %lu user slots", __FUNCTION__,
+             (unsigned long)nusers);
+        return SNAPSHOT_ERR;
+    }
+    snap_version = version;
+    snap_nusers = nusers;
+    if (walk_records(p + hdrlen, bodylen, nrecords, 0) < 0) {
+        vmdb(MSG_ERR, "%s: snapshot is damaged", __FUNCTION__);
+        return SNAPSHOT_ERR;
+    }
+
+    if (load_begin(version, nusers) < 0)
+        return SNAPSHOT_ERR;
+    walk_records(p + hdrlen, bodylen, nrecords, 1);
+    remap_mods();
+    resolve_groups();
+    return 0;
+}
+
+int
+snapshot_save_file(const char *path)
+{
+    char tmp[MAXPATHLEN];
+    char *image;
+    size_t len, off;
+    ssize_t n;
+    int fd, err;
+
+    if (snapshot_encode(&image, &len) < 0)
+        return SNAPSHOT_ERR;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    /* there are passwords in it */
+    if ((fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0600)) < 0) {
+        vmdb(MSG_ERR, "%s open: %s", tmp, strerror(errno));
+        free(image);
+        return SNAPSHOT_ERR;
+    }
+
+    for (off = 0; off < len; off += n) {
+        if ((n = write(fd, image + off, len - off)) < 0) {
+            if (errno == EINTR) {
+                n = 0;
+                continue;
+            }
+            break;
+        }
+    }
+
+    /* the first thing to go wrong, and the fd gets closed regardless */
+    err = 0;
+    if (off < len)
+        err = errno;
+    else if (fsync(fd) < 0)
+        err = errno;
+    if (close(fd) < 0 && err == 0)
+        err = errno;
+    free(image);
+    if (err) {
+        vmdb(MSG_ERR, "%s write: %s", tmp, strerror(err));
+        unlink(tmp);
+        return SNAPSHOT_ERR;
+    }
+    if (rename(tmp, path) < 0) {
+        vmdb(MSG_ERR, "%s rename: %s", tmp, strerror(errno));
+        unlink(tmp);
+        return SNAPSHOT_ERR;
+    }
+    return 0;
+}
+
+int
+snapshot_load_file(const char *path)
+{
+    struct stat st;
+    void *image;
+    int fd, ret;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        vmdb(MSG_ERR, "%s open: %s", path, strerror(errno));
+        return SNAPSHOT_ERR;
+    }
+    if (fstat(fd, &st) < 0) {
+        vmdb(MSG_ERR, "%s stat: %s", path, strerror(errno));
+        close(fd);
+        return SNAPSHOT_ERR;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return SNAPSHOT_NOTSNAP;
+    }
+
+    image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        vmdb(MSG_ERR, "%s mmap: %s", path, strerror(errno));
+        return SNAPSHOT_ERR;
+    }
+
+    ret = snapshot_load((const char *)image, (size_t)st.st_size);
+
+    munmap(image, (size_t)st.st_size);
+    return ret;
+}
+
+
+/*
+ * the old text format, one field per line, every slot whether it was
+ * in use or not. strings had an "X" stuck on the end so an empty one
+ * still made a line.
+ */
+
+typedef struct {
+    FILE *fp;
+    char line[1024];
+    int held;           /* line was read ahead and not used yet */
+    int err;
+} textin_t;
+
+static char *
+text_line(textin_t *t)
+{
+    size_t n;
+
+    if (t->held) {
+        t->held = 0;
+        return t->line;
+    }
+    if (t->err || fgets(t->line, sizeof(t->line), t->fp) == NULL) {
+        t->err = 1;
+        t->line[0] = '\0';
+        return t->line;
+    }
+    n = strlen(t->line);
+    if (n > 0 && t->line[n-1] == '\n')
+        t->line[--n] = '\0';
+    else if (!feof(t->fp))
+        t->err = 1;     /* longer than any field can be */
+    return t->line;
+}
+
+static int
+text_isnum(const char *s)
+{
+    if (*s == '-')
+        s++;
+    if (*s == '\0')
+        return 0;
+    for (; *s; s++)
+        if (*s < '0' || *s > '9')
+            return 0;
+    return 1;
+}
+
+static long
+text_num(textin_t *t)
+{
+    char *s = text_line(t);
+
+    if (!text_isnum(s))
+        t->err = 1;
+    return strtol(s, NULL, 10);
+}
+
+static void
+text_str(textin_t *t, char *dst, size_t size)
+{
+    char *s = text_line(t);
+    size_t n = strlen(s);
+
+    if (n == 0 || s[n-1] != 'X') {
+        t->err = 1;
+        return;
+    }
+    s[--n] = '\0';
+    snprintf(dst, size, "%s", s);
+}
+
+/* the names were written newest first; put them back oldest first so
+ * they keep their order */
+static void
+text_list(textin_t *t, NAMLIST *nl)
+{
+    char name[sizeof(t->line)];
+    char **names;
+    long i, k;
+
+    if ((k = text_num(t)) <= 0 || t->err)
+        return;
+    if ((names = (char **)calloc(k, sizeof(char *))) == NULL) {
+        t->err = 1;
+        return;
+    }
+    for (i = 0; i < k && !t->err; i++) {
+        text_str(t, name, sizeof(name));
+        if ((names[i] = strdup(name)) == NULL)
+            t->err = 1;
+    }
+    for (i = k - 1; i >= 0; i--) {
+        if (names[i] && !t->err)
+            nlput(nl, names[i]);
+        free(names[i]);
+    }
+    free(names);
+}
+
+int
+snapshot_load_text(FILE *dump)
+{
+    textin_t t;
+    long *nums = NULL, *nnums;
+    size_t nnum = 0, maxnum = 0;
+    char *s;
+    int i, j;
+
+    memset(&t, 0, sizeof(t));
+    t.fp = dump;
+
+    /* the text dumps have the version 1 layout */
+    if (load_begin(1, MAX_USERS) < 0)
+        return SNAPSHOT_ERR;
+
+    /* everything up to the first login id is numbers: S_kill[], and
+     * before it the sockets, in dumps that had them */
+    while (!t.err && text_isnum(s = text_line(&t))) {
+        if (nnum == maxnum) {
+            maxnum = maxnum ? maxnum * 2 : MAX_USERS + 64;
+            if ((nnums = (long *)realloc(nums, maxnum * sizeof(long))) == NULL) {
+                t.err = 1;
+                break;
+            }
+            nums = nnums;
+        }
+        nums[nnum++] = strtol(s, NULL, 10);
+    }
+    t.held = 1;
+    if (t.err || nnum < MAX_USERS) {
+        mdb(MSG_ERR, "text dump doesn't start with the kill table");
+        free(nums);
+        return SNAPSHOT_ERR;
+    }
+    for (i = 0; i < MAX_USERS; i++)
+        S_kill[user_slot(i)] = (short)nums[nnum - MAX_USERS + i];
+    free(nums);
+
+    for (j = 0; j < MAX_USERS && !t.err; j++) {
+        i = user_slot(j);
+        text_str(&t, u_tab[i].loginid, sizeof(u_tab[i].loginid));
+        text_str(&t, u_tab[i].nodeid, sizeof(u_tab[i].nodeid));
+        text_str(&t, u_tab[i].nickname, sizeof(u_tab[i].nickname));
+        text_str(&t, u_tab[i].password, sizeof(u_tab[i].password));
+        text_str(&t, u_tab[i].realname, sizeof(u_tab[i].realname));
+        text_str(&t, user_groups[i], sizeof(user_groups[i]));
+        text_str(&t, u_tab[i].awaymsg, sizeof(u_tab[i].awaymsg));
+        u_tab[i].lastaway = text_num(&t);
+        u_tab[i].lastawaytime = text_num(&t);
+        u_tab[i].login = text_num(&t);
+        u_tab[i].echoback = text_num(&t);
+        u_tab[i].nobeep = text_num(&t);
+        u_tab[i].perms = text_num(&t);
+        u_tab[i].t_notify = text_num(&t);
+        u_tab[i].t_on = text_num(&t);
+        u_tab[i].t_sent = text_num(&t);
+        u_tab[i].t_recv = text_num(&t);
+        u_tab[i].t_group = text_num(&t);
+        text_list(&t, u_tab[i].pri_n_hushed);
+        text_list(&t, u_tab[i].pub_n_hushed);
+        text_list(&t, u_tab[i].pri_s_hushed);
+        text_list(&t, u_tab[i].pub_s_hushed);
+        text_list(&t, u_tab[i].n_notifies);
+        text_list(&t, u_tab[i].s_notifies);
+    }
+
+    for (i = 0; i < MAX_GROUPS && !t.err; i++) {
+        text_str(&t, g_tab[i].name, sizeof(g_tab[i].name));
+        text_str(&t, g_tab[i].topic, sizeof(g_tab[i].topic));
+        g_tab[i].visibility = text_num(&t);
+        g_tab[i].control = text_num(&t);
+        g_tab[i].mod = text_num(&t);
+        g_tab[i].modtimeout = text_num(&t);
+        text_str(&t, g_tab[i].missingmod, sizeof(g_tab[i].missingmod));
+        g_tab[i].volume = text_num(&t);
+        text_list(&t, g_tab[i].n_invites);
+        text_list(&t, g_tab[i].nr_invites);
+        text_list(&t, g_tab[i].s_invites);
+        text_list(&t, g_tab[i].sr_invites);
+        text_list(&t, g_tab[i].n_bars);
+        text_list(&t, g_tab[i].n_nr_bars);
+        text_list(&t, g_tab[i].s_bars);
+        text_list(&t, g_tab[i].s_nr_bars);
+        text_list(&t, g_tab[i].n_talk);
+        text_list(&t, g_tab[i].nr_talk);
+        g_tab[i].size = text_num(&t);
+        g_tab[i].idleboot = text_num(&t);
+        text_str(&t, g_tab[i].idleboot_msg, sizeof(g_tab[i].idleboot_msg));
+        g_tab[i].idlemod = text_num(&t);
+    }
+
+    if (t.err) {
+        mdb(MSG_ERR, "text dump is truncated or damaged");
+        return SNAPSHOT_ERR;
+    }
+    remap_mods();
+    resolve_groups();
+    return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* binary snapshot of the user and group tables
+ *
+ * A snapshot is a fixed header followed by a body of records, one per
+ * occupied user or group slot. Every record and every field in it is
+ * tagged and length-prefixed, so a reader skips what it doesn't know,
+ * and the body carries a CRC-32 so a damaged file is refused before
+ * anything in the tables is touched. Integers are little-endian.
+ *
+ *   header   "ICBS" u16 version u16 header length
+ *            u32 user slots u32 MAX_GROUPS
+ *            u32 record count u32 body length u32 body crc32 u32 flags
+ *   record   u8 type u32 slot u32 length, then fields
+ *   field    u8 tag u32 length, then the value:
+ *              strings   the bytes, no NUL
+ *              numbers   i64
+ *              namelists u16 length + bytes per name, oldest first
+ *
+ * Version 1 images, and the text dumps, are from servers that kept
+ * NICKSERV in their last user slot; it's moved to slot 0 as they load.
+ */
+
+#define SNAPSHOT_ERR        -1      /* damaged, or couldn't read/write */
+#define SNAPSHOT_NOTSNAP    -2      /* not a snapshot; maybe an old text dump */
+
+/* encode the user and group tables. *image is malloc'd; the caller
+ * frees it.
+ *
+ * returns 0 or SNAPSHOT_ERR
+ */
+int snapshot_encode(char **image, size_t *len);
+
+/* check an image, then load it into freshly cleared tables. if the
+ * check fails the tables aren't touched.
+ *
+ * returns 0, SNAPSHOT_ERR or SNAPSHOT_NOTSNAP
+ */
+int snapshot_load(const char *image, size_t len);
+
+/* write a snapshot to path. it goes to a temporary file first and is
+ * renamed into place, so a reader never sees half of one.
+ *
+ * returns 0 or SNAPSHOT_ERR
+ */
+int snapshot_save_file(const char *path);
+
+/* mmap path and snapshot_load() it
+ *
+ * returns 0, SNAPSHOT_ERR or SNAPSHOT_NOTSNAP
+ */
+int snapshot_load_file(const char *path);
+
+/* load a dump in the old one-field-per-line text format into freshly
+ * cleared tables, for converting it. the sockets section servers
+ * before the restart handoff put at the top is skipped.
+ *
+ * returns 0 or SNAPSHOT_ERR
+ */
+int snapshot_load_text(FILE *dump);
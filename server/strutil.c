@@ -14,11 +14,17 @@
 
 #include <ctype.h>
 #include <stdarg.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "utf8.h"
 
 #include "server.h"
 #include "externs.h"
+#include "strutil.h"
 
 extern char *charmap;
 
@@ -45,24 +51,63 @@ void filternickname(char *txt)
 }
 
 #if ALLOW_UTF8_MESSAGES
+/* How many of the n bytes at s are printable ASCII (0x20-0x7F), which
+ * filtertext() copies through untouched. Most messages are nothing
+ * else, so this looks at them 16 (or 8) at a time instead of feeding
+ * each one through the decoder.
+ */
+static size_t ascii_run(const char *s, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    /* as signed bytes, the printable ones are the ones over 0x1F */
+    const __m128i lo = _mm_set1_epi8(0x1F);
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(v, lo)) != 0xFFFF)
+            break;
+    }
+#else
+    /* a word at a time: no high bits, and no byte under 0x20 */
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    uint64_t v;
+
+    for (; i + 8 <= n; i += 8) {
+        memcpy(&v, s + i, sizeof(v));
+        if ((v | ((v - ones * 0x20) & ~v)) & highs)
+            break;
+    }
+#endif
+    /* and the rest one at a time */
+    for (; i < n; i++)
+        if ((unsigned char)s[i] < 0x20 || (unsigned char)s[i] > 0x7F)
+            break;
+    return i;
+}
+
 /* Filters things to len chars.
  * Anything longer get truncated.
  * if you have a multibyte char that would go beyond that, it gets stripped
  * out and the string is truncated prior to that byte.
  * Added by hoche, 5/28/19
  */
-void filtertext(const char *src, char *dest, size_t len)
+size_t filtertext(const char *src, char *dest, size_t len)
 {
     uint32_t codepoint;
     uint32_t prevState = UTF8_ACCEPT;
     uint32_t curState = UTF8_ACCEPT;
-    int offset = 0;
+    size_t offset = 0;
+    size_t n, run;
     const char *s = src;
 
     // DEBUG ONLY
     //printCodePoints(src);
 
-    memset(dest, 0, len);
+    // we never look further than this
+    n = strnlen(src, len);
 
     for (prevState = curState = UTF8_ACCEPT; *s; prevState = curState, ++s) {
 
@@ -71,6 +116,16 @@ void filtertext(const char *src, char *dest, size_t len)
             break;
         }
 
+        // between characters, copy any plain ascii across in one go
+        if (curState == UTF8_ACCEPT &&
+            (unsigned char)*s >= 0x20 && (unsigned char)*s <= 0x7F &&
+            (run = ascii_run(s, n - (s - src))) > 0) {
+            memcpy(&dest[offset], s, run);
+            offset += run;
+            s += run - 1;
+            continue;
+        }
+
         // now check the next char
         switch (decode(&curState, &codepoint, *s)) {
             case UTF8_ACCEPT:
@@ -115,12 +170,15 @@ void filtertext(const char *src, char *dest, size_t len)
                 ;
         }
     }
+    if (offset < len)
+        dest[offset] = '\0';
+    return offset;
 }
 #else
 /* replace illegal characters in a regular line of text. Assumes
  * the line is null-terminated.
  */
-void filtertext(const char *s, char *dest, size_t len)
+size_t filtertext(const char *s, char *dest, size_t len)
 {
     size_t i;
 
@@ -132,6 +190,7 @@ void filtertext(const char *s, char *dest, size_t len)
         }
     }
     dest[i] = '\0';
+    return i;
 }
 #endif
 
@@ -220,65 +279,60 @@ void ucaseit(char *s)
             *s ^= 040;
 }
 
-char *getword(char *s)
+TOKEN tok_str(char *s)
 {
-    static char word[64];
-    char *w = word;
-    while (*s != ' ' && *s != '\t' && *s != '\0' && ((w - word) < 64))
-        *w++ = *s++;
-    *w = '\0';
-    return(word);
+    TOKEN t;
+
+    t.s = s;
+    t.len = strlen(s);
+    return t;
 }
 
-char *get_tail(char *s)
+int tokenize(char *pkt, TOKEN *tok, int max)
 {
-    /* skip first word */
-    while (*s != ' ' && *s != '\t' && *s != '\0' )
-        s++;
-    /* skip white space */
-    while ((*s == ' ' || *s == '\t') && *s != '\0' )
-        s++;
-    return(s);
-}
+    char *p = pkt;
+    int i = 0;
 
+    if (max <= 0)
+        return 0;
 
-/* Read a line containing zero or more \001's (^A's). Split the
- * string into an array of strings, and return the number of fields
- * found.
- */
+    tok[0].s = pkt;
+    for (;;) {
+        /* the last one we have room for takes the rest */
+        if (i == max - 1) {
+            tok[i].len = strlen(tok[i].s);
+            return max;
+        }
 
-char *fields[MAX_FIELDS];
+        /* find delim or EOS */
+        while (*p != '\001' && *p != '\0')
+            p++;
+        tok[i].len = p - tok[i].s;
 
-int split(char *s)
-{
-    char *p = s;
-    int i = 0;
+        if (*p == '\0')
+            return i + 1;
 
-    fields[i] = s;
-    for(;;) {
+        *p++ = '\0';
+        tok[++i].s = p;
+    }
+}
 
-        i++;
+TOKEN tok_word(TOKEN *t)
+{
+    TOKEN w;
+    size_t i = 0;
 
-        /*
-         * prevent writing off the end of our memory!
-         * normally we'd return an error code of some
-         * so the calling routine could know something bad
-         * happened, but some code still calls this without
-         * bothering to check the return values, so until that
-         * is all cleaned up, we just stop at the MAX_FIELDS
-         * which is only slightly better.
-         */
-        if ( i > MAX_FIELDS )
-            return (MAX_FIELDS);
+    w.s = t->s;
+    while (i < t->len && t->s[i] != ' ' && t->s[i] != '\t')
+        i++;
+    w.len = i;
+    while (i < t->len && (t->s[i] == ' ' || t->s[i] == '\t'))
+        i++;
 
-        /* find delim or EOS */
-        while(*p != '\001' && *p != '\0') p++;
-
-        if (*p == '\001') {
-            /* got delim */
-            *p = '\0';
-            fields[i] = ++p;
-        } else
-            return(i);
-    }
+    /* end the word on the first blank after it, if there is one */
+    if (w.len < t->len)
+        w.s[w.len] = '\0';
+    t->s += i;
+    t->len -= i;
+    return w;
 }
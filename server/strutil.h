@@ -2,13 +2,15 @@
 
 #include <ctype.h>
 #include <stdarg.h>
+#include <stddef.h>
 
 
 /* replace illegal characters in a nickname */
 void filternickname(char *txt);
 
-/* replace illegal characters in a regular line of text */
-void filtertext(const char *src, char *dest, size_t len);
+/* replace illegal characters in a regular line of text. returns how
+ * many bytes went into dest, not counting any NUL */
+size_t filtertext(const char *src, char *dest, size_t len);
 
 /* replace illegal characters from a groupname */
 void filtergroupname(char *txt);
@@ -28,11 +30,25 @@ void lcaseit(char *s);
 /* convert a string to upper case */
 void ucaseit(char *s);
 
-char *getword(char *s);
+/* a piece of a packet -- a field, or a word of one. s points into the
+ * packet itself; nothing is copied out of it. */
+typedef struct {
+    char *s;
+    size_t len;
+} TOKEN;
 
-char *get_tail(char *s);
+/* a TOKEN covering all of the string s */
+TOKEN tok_str(char *s);
 
-/* Read a line containing zero or more colons. Split the string into */
-/* an array of strings, and return the number of fields found. */
+/* Break a packet into its \001-separated fields, in place. Each field
+ * is NUL-terminated where its separator was, so tok[i].s is a string
+ * as well. If there are more than max fields, the last one gets the
+ * rest of the packet. Returns the number of fields found.
+ */
+int tokenize(char *pkt, TOKEN *tok, int max);
 
-int split(char *s);
+/* Take the first blank-separated word off the front of *t and return
+ * it, NUL-terminated in place. *t is left at what follows, less the
+ * blanks; once it's used up, the words are empty.
+ */
+TOKEN tok_word(TOKEN *t);
@@ -0,0 +1,430 @@
+/* Copyright (c) 1991 by John Atwood deVries II. */
+/* For copying and distribution information, see the file COPYING. */
+
+/* timed events (these used to be swept for in s_didpoll()) */
+
+#include "config.h"
+
+#include <stdint.h>
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+#include <string.h>
+
+#include "server.h"
+#include "externs.h"
+#include "mdb.h"
+#include "icbutil.h"
+#include "send.h"
+#include "groups.h"
+#include "members.h"
+#include "s_commands.h"
+#include "s_stats.h"    /* for server_stats */
+#include "timers.h"
+#include "pktserv/pktserv.h" /* for pktserv_disconnect() */
+#include "pktserv/pkttimer.h"
+#include "pktserv/pktclock.h"
+
+static pkttimer_t shutdown_timer;
+
+/*
+ * arm a timer for a pktclock_time() deadline. never less than a second out,
+ * so a check that can't make progress yet (say, there's no one to pass
+ * mod to) retries at the same rate the old idle sweep did.
+ */
+static void schedule_at(pkttimer_t *t, time_t when)
+{
+    long secs = (long)(when - pktclock_time());
+
+    if (secs < 1)
+        secs = 1;
+    pkttimer_schedule(t, secs * 1000L);
+}
+
+static void shutdown_expired(pkttimer_t *t, void *arg)
+{
+    int i;
+    long TheTime;
+
+    TheTime = pktclock_time();
+    if ((TheTime >= TimeToDie) && (TimeToDie > 0.0))
+        icbexit(0);
+
+    if (((TheTime >= (TimeToDie - 300)) && (TimeToDie > 0.0)) &&
+        (ShutdownNotify == 0)) {
+        for (i = 1; i < max_users; i++) {
+            if (u_hot.login[i] > LOGIN_FALSE)
+                sendimport(i, "Shutdown",
+                           "Server shutting down in 5 minutes!");
+        }
+        ShutdownNotify++;
+    }
+
+    if (((TheTime >= (TimeToDie - 60)) && (TimeToDie > 0.0)) &&
+        (ShutdownNotify == 1)) {
+        for (i = 1; i < max_users; i++) {
+            if (u_hot.login[i] > LOGIN_FALSE)
+                sendimport(i, "Shutdown",
+                           "Server shutting down in 1 minute!");
+        }
+        ShutdownNotify++;
+    }
+
+    shutdown_timer_update();
+}
+
+void shutdown_timer_update(void)
+{
+    if (TimeToDie <= 0.0) {
+        pkttimer_cancel(&shutdown_timer);
+        return;
+    }
+
+    if (ShutdownNotify == 0)
+        schedule_at(&shutdown_timer, TimeToDie - 300);
+    else if (ShutdownNotify == 1)
+        schedule_at(&shutdown_timer, TimeToDie - 60);
+    else
+        schedule_at(&shutdown_timer, TimeToDie);
+}
+
+static void kill_expired(pkttimer_t *t, void *arg)
+{
+    int i = (int)(intptr_t)arg;
+
+    if ( u_tab[i].login > LOGIN_FALSE && S_kill[i] > 0 ) {
+        sprintf(mbuf, "[KILL] killing %d (%d)", i, S_kill[i]);
+        mdb(MSG_INFO, mbuf);
+        server_stats.drops++;
+        pktserv_disconnect(i);
+    }
+}
+
+void kill_user(int n)
+{
+    S_kill[n]++;
+    pkttimer_schedule(&u_tab[n].kill_timer, 0);
+}
+
+/* pick the least idle user in group gi who isn't away, or -1 */
+static int pick_newmod(int gi, int skip_away)
+{
+    int j, newmod = -1;
+
+    for (j = members_first(gi); j >= 0; j = members_next(j))
+    {
+        if ((u_hot.login[j] >= LOGIN_COMPLETE)
+            && (!skip_away || u_tab[j].awaymsg[0] == '\0'))
+        {
+            if (newmod == -1)
+                newmod = j;
+            else if ((u_hot.t_recv[j] - u_hot.t_recv[newmod]) > 0)
+                newmod = j;
+        }
+    }
+    return newmod;
+}
+
+static void group_expired(pkttimer_t *t, void *arg)
+{
+    int i = (int)(intptr_t)arg;
+    int newmod;
+    long TheTime;
+
+    TheTime = pktclock_time();
+
+    /* look at non-public groups w/ mods for mods who are idle */
+    if ( g_tab[i].control != PUBLIC && g_tab[i].mod >= 0 )
+    {
+        int mod = g_tab[i].mod;
+        int mod_idle = TheTime - u_tab[mod].t_recv;
+
+        /* if the group's mod is too idle, check further */
+        if ( mod_idle > g_tab[i].idlemod )
+        {
+            int ui;
+
+            /*
+             * check to make sure that there are other users
+             * in this group who are less idle than the mod
+             * and not away.
+             */
+
+            for ( ui = members_first(i); ui >= 0; ui = members_next(ui) )
+            {
+                if ( (ui != mod)
+                     && (u_hot.login[ui] >= LOGIN_COMPLETE)
+                     && ((TheTime - u_hot.t_recv[ui]) < mod_idle)
+                     && (u_tab[ui].awaymsg[0] == '\0') )
+                {
+                    break;
+                }
+            }
+
+            /* reliquish that group's mod */
+            if ( ui >= 0 )
+            {
+                const char *modmsg = IDLE_MOD_MSG;
+
+                /* let them know */
+                sprintf (mbuf, modmsg, "you", g_tab[i].name);
+                sendstatus(mod, "Idle-Mod", mbuf);
+
+                /* let their group know */
+                if (g_tab[i].volume != QUIET)
+                {
+                    sprintf (mbuf, modmsg, u_tab[mod].nickname,
+                             g_tab[i].name);
+
+                    /* if the mod is in that group, send the
+                     * message to to all in the group but the mod
+                     */
+                    if ( u_tab[mod].gid == i )
+                        s_status_group (1, 0, mod, "Idle-Mod", mbuf);
+                    else
+                        /* otherwise send to all in the group */
+                        s_status_group (2, 0, i, "Idle-Mod", mbuf);
+                }
+
+                /* guaranteed to trigger the below assignment of new mod */
+                g_tab[i].modtimeout = 1;
+                server_stats.idlemods++;
+            }
+        }
+    }
+
+    /*
+     * if the modtimeout has passed, select the least-idle
+     * user in the group to pass mod to
+     */
+    if ((g_tab[i].modtimeout > 0.0) &&
+        (g_tab[i].modtimeout < TheTime))
+    {
+        newmod = pick_newmod(i, 1);
+
+        /*
+         * if we didn't find a new mod (possible if other users
+         * have /away set), skip til next check, otherwise set the
+         * new mod.
+         */
+        if ( newmod != -1 )
+        {
+            g_tab[i].mod = newmod;
+            g_tab[i].modtimeout = 0.0;
+            memset(g_tab[i].missingmod, 0, MAX_NICKLEN);
+            sprintf (mbuf, "%s is now mod.", u_tab[newmod].nickname);
+            s_status_group (2,0,i, "Timeout", mbuf);
+        }
+    }
+
+    group_timer_update(i);
+}
+
+void group_timer_update(int gi)
+{
+    time_t when = 0, t;
+
+    if (gi < 0 || gi >= MAX_GROUPS)
+        return;
+
+    if ( g_tab[gi].control != PUBLIC && g_tab[gi].mod >= 0 )
+        when = u_tab[g_tab[gi].mod].t_recv + g_tab[gi].idlemod + 1;
+
+    if ( g_tab[gi].modtimeout > 0.0 ) {
+        t = g_tab[gi].modtimeout + 1;
+        if (when == 0 || t < when)
+            when = t;
+    }
+
+    if (when == 0)
+        pkttimer_cancel(&g_tab[gi].mod_timer);
+    else
+        schedule_at(&g_tab[gi].mod_timer, when);
+}
+
+/* move an idle user to IDLE_GROUP, handing off any groups they moderate */
+static void idle_boot(int i, int gi)
+{
+    extern int is_booting;
+    const char *bootmsg = IDLE_BOOT_MSG;
+    TOKEN args[2];
+    long TheTime;
+    int j;
+
+    if ( g_tab[gi].idleboot_msg[0] != '\0' )
+        bootmsg = g_tab[gi].idleboot_msg;
+
+    TheTime = pktclock_time();
+
+    /* logfile message */
+    sprintf(mbuf, "[IDLE_BOOT] %d (%ld > %d)",
+            i, (TheTime - u_tab[i].t_recv), g_tab[gi].idleboot);
+    mdb(MSG_INFO, mbuf);
+
+    /* let them know */
+    sprintf (mbuf, bootmsg, "you");
+    sendstatus(i, "Idle-Boot", mbuf);
+
+    /* let their group know */
+    if(g_tab[gi].volume != QUIET) {
+        sprintf (mbuf, bootmsg, u_tab[i].nickname);
+        s_status_group (1, 0, i, "Idle-Boot", mbuf);
+    }
+
+    /* this is done after they are moved so the
+     * don't see the messages since s_status_group
+     * doesn't have a nice interface for groups
+     * we aren't actually in
+     */
+
+    /* check for groups they were mod of and let go */
+    for ( j = 0; j < MAX_GROUPS; j++ ) {
+        if ( g_tab[j].mod == i ) {
+            int newmod;
+
+            newmod = pick_newmod(j, 0);
+            g_tab[j].mod = newmod;
+            if (newmod >= 0) {
+                sprintf (mbuf, "%s is now mod.", u_tab[newmod].nickname);
+                if (j == u_tab[i].gid)
+                    s_status_group(1, 0, i, "Pass", mbuf);
+                else
+                    s_status_group(2, 0, j, "Pass", mbuf);
+            }
+            group_timer_update(j);
+        }
+    }
+
+    /* fake an s_change to group IDLE_GROUP */
+    args[0] = tok_str("g");
+    args[1] = tok_str(IDLE_GROUP);
+    is_booting = 1;
+    s_change(i, 2, args);
+    is_booting = 0;
+    server_stats.idleboots++;
+}
+
+static void user_expired(pkttimer_t *t, void *arg)
+{
+    int i = (int)(intptr_t)arg;
+    int gi;
+    long TheTime;
+
+    /* they must be logged in */
+    if (u_tab[i].login < LOGIN_COMPLETE )
+        return;
+
+    TheTime = pktclock_time();
+
+#ifdef MAX_IDLE
+    if((TheTime - u_tab[i].t_recv) > MAX_IDLE) {
+        /* kill that puppy */
+        sprintf(mbuf, "[TIMEOUT] %d (%ld - %ld > %d)",
+                i, TheTime, u_tab[i].t_recv, MAX_IDLE);
+        mdb(MSG_INFO, mbuf);
+        sendstatus(i, "Drop",
+                   "Your connection has been idled out.");
+        pktserv_disconnect(i);
+        return;
+    }
+    else if ((TheTime - u_tab[i].t_recv) > (MAX_IDLE - IDLE_WARN))
+    {
+        if (u_tab[i].t_notify == 0)
+        {
+            char tbuf[MAX_INPUTSTR];
+            snprintf (tbuf, MAX_INPUTSTR, IDLE_WARN_MSG,
+                      (int) (IDLE_WARN / 60));
+            sendstatus (i, "Drop", tbuf);
+            u_tab[i].t_notify++;
+        }
+    }
+    else u_tab[i].t_notify = 0;
+#endif    /* MAX_IDLE */
+
+    if ( (gi = u_tab[i].gid) < 0 ) {
+        sprintf(mbuf,
+                "Can't locate group of possible idler %s",
+                u_tab[i].nickname);
+        mdb(MSG_INFO, mbuf);
+    }
+    /* look at folx who in group w/out idleboot disabled
+     * and not already in group idle */
+    else if ( g_tab[gi].idleboot > 0
+              && (TheTime - u_tab[i].t_recv) > g_tab[gi].idleboot
+              && gi != find_group (IDLE_GROUP) ) {
+        /* boot that puppy */
+        idle_boot(i, gi);
+    }
+
+    user_timer_update(i);
+}
+
+void user_timer_update(int n)
+{
+    time_t when = 0, t;
+    int gi;
+
+    if (n == NICKSERV || n < 0 || n >= max_users)
+        return;
+
+    if (u_tab[n].login < LOGIN_COMPLETE) {
+        pkttimer_cancel(&u_tab[n].idle_timer);
+        return;
+    }
+
+#ifdef MAX_IDLE
+    if (u_tab[n].t_notify == 0)
+        when = u_tab[n].t_recv + (MAX_IDLE - IDLE_WARN) + 1;
+    else
+        when = u_tab[n].t_recv + MAX_IDLE + 1;
+#endif    /* MAX_IDLE */
+
+    if ( (gi = u_tab[n].gid) >= 0
+         && g_tab[gi].idleboot > 0
+         && gi != find_group (IDLE_GROUP) ) {
+        t = u_tab[n].t_recv + g_tab[gi].idleboot + 1;
+        if (when == 0 || t < when)
+            when = t;
+    }
+
+    if (when == 0)
+        pkttimer_cancel(&u_tab[n].idle_timer);
+    else
+        schedule_at(&u_tab[n].idle_timer, when);
+}
+
+void init_timers(void)
+{
+    int i;
+
+    pkttimer_init(&shutdown_timer, shutdown_expired, NULL);
+
+    for (i = 0; i < MAX_GROUPS; i++)
+        pkttimer_init(&g_tab[i].mod_timer, group_expired, (void *)(intptr_t)i);
+}
+
+void init_user_timers(int n)
+{
+    pkttimer_init(&u_tab[n].idle_timer, user_expired, (void *)(intptr_t)n);
+    pkttimer_init(&u_tab[n].kill_timer, kill_expired, (void *)(intptr_t)n);
+}
+
+void rearm_user_timers(int n)
+{
+    user_timer_update(n);
+    if (S_kill[n] > 0)
+        pkttimer_schedule(&u_tab[n].kill_timer, 0);
+}
+
+void rearm_timers(void)
+{
+    int i;
+
+    for (i = 1; i < max_users; i++)
+        rearm_user_timers(i);
+
+    for (i = 0; i < MAX_GROUPS; i++)
+        group_timer_update(i);
+
+    shutdown_timer_update();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+/* timed events: idle boots, idle mods, mod timeouts, MAX_IDLE drops,
+ * deferred kills and the shutdown countdown. each one lives on the
+ * pktserv timer wheel instead of being swept for once a second.
+ *
+ * the timers are lazy. they're armed for the earliest time anything
+ * could happen, and when they go off they recheck the tables and
+ * re-arm. so they only need to be updated when a deadline might move
+ * earlier, not every time a user sends something.
+ */
+
+/* set up the timers in g_tab and the shutdown timer. call once at
+ * startup. */
+void init_timers(void);
+
+/* set up the timers in u_tab[n], for users_grow() */
+void init_user_timers(int n);
+
+/* put user n's timers back on the wheel, from what's in the tables */
+void rearm_user_timers(int n);
+
+/* recompute when user n might idle out or get idle-booted. call after
+ * they finish logging in and whenever their group changes.
+ */
+void user_timer_update(int n);
+
+/* recompute when group gi's mod might idle out or time out. call after
+ * changing the group's mod, control, modtimeout or idlemod.
+ */
+void group_timer_update(int gi);
+
+/* mark user n to be dropped once the current packet has been handled */
+void kill_user(int n);
+
+/* rearm the shutdown countdown after TimeToDie changes */
+void shutdown_timer_update(void);
+
+/* rearm everything after the tables were reloaded by icbload() */
+void rearm_timers(void);
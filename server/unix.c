@@ -14,12 +14,13 @@
 
 #include "server.h"
 #include "externs.h"
+#include "pktserv/pktclock.h"
 
 
-/* stash the current time in curtime */
+/* stash the loop clock's time in curtime */
 void gettime(void)
 {
-    time(&curtime);
+    curtime = pktclock_time();
 }
 
 
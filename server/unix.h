@@ -1,6 +1,6 @@
 #pragma once
 
-/* stash the current time in curtime */
+/* stash the loop clock's time in curtime */
 void gettime(void);
 
 /* set line buffering for an open file pointer */
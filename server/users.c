@@ -12,9 +12,70 @@
 #endif
 
 #include "server.h"
+#include "users.h"
 #include "groups.h"
 #include "externs.h"
 #include "access.h"
+#include "nameindex.h"
+#include "members.h"
+#include "hushset.h"
+#include "notifyindex.h"
+#include "strutil.h"
+#include "timers.h"
+#include "mdb.h"
+
+/* nickname -> u_tab slot */
+static nameindex_t *nick_index = NULL;
+
+/* the slots whose lpriv_id or pong_req is each slot, so clearing a slot
+ * finds them without a scan. they're doubly linked lists threaded
+ * through per-slot arrays, as in members.c. */
+struct backrefs {
+    int *ref;                   /* lpriv_id or pong_req */
+    int *head;                  /* slot -> first slot pointing at it, or -1 */
+    int *next;                  /* slot -> next pointing at the same one */
+    int *prev;
+};
+
+static struct backrefs lpriv_refs = { NULL, NULL, NULL, NULL };
+static struct backrefs pong_refs = { NULL, NULL, NULL, NULL };
+
+static void
+init_refs(struct backrefs *br, int from, int to)
+{
+    int i;
+
+    for (i = from; i < to; i++)
+        br->ref[i] = br->head[i] = br->next[i] = br->prev[i] = -1;
+}
+
+/* point slot i at slot to, or at nobody with -1 */
+static void
+set_ref(struct backrefs *br, int i, int to)
+{
+    int old = br->ref[i];
+
+    if (old == to)
+        return;
+    if (old >= 0) {
+        if (br->prev[i] >= 0)
+            br->next[br->prev[i]] = br->next[i];
+        else
+            br->head[old] = br->next[i];
+        if (br->next[i] >= 0)
+            br->prev[br->next[i]] = br->prev[i];
+    }
+
+    br->ref[i] = to;
+    br->prev[i] = -1;
+    br->next[i] = -1;
+    if (to >= 0) {
+        br->next[i] = br->head[to];
+        if (br->head[to] >= 0)
+            br->prev[br->head[to]] = i;
+        br->head[to] = i;
+    }
+}
 
 /* clear a particular user entry */
 void clear_user_item(int n)
@@ -26,21 +87,24 @@ void clear_user_item(int n)
     memset(u_tab[n].loginid, 0, MAX_IDLEN+1);
     memset(u_tab[n].nodeid, 0, MAX_NODELEN+1);
     memset(u_tab[n].nickname, 0, MAX_NICKLEN+1);
+    nameindex_set(nick_index, n, NULL);
+    update_match_names(n);
     memset(u_tab[n].password, 0, MAX_PASSWDLEN+1);
     memset(u_tab[n].realname, 0, MAX_REALLEN+1);
-    memset(u_tab[n].group, 0, MAX_GROUPLEN+1);
+    set_user_group(n, -1);
     memset(u_tab[n].awaymsg, 0, MAX_AWAY_LEN+1);
     u_tab[n].lastaway = 0;
     u_tab[n].lastawaytime = (time_t)0;
-    u_tab[n].login = LOGIN_FALSE;
-    u_tab[n].echoback = 0;
+    set_user_login(n, LOGIN_FALSE);
+    set_user_echoback(n, 0);
     u_tab[n].nobeep = 0;
     u_tab[n].perms = PERM_NULL;
     u_tab[n].t_on = (time_t) 0;
     u_tab[n].t_sent= (time_t) 0;
-    u_tab[n].t_recv = (time_t) 0;
+    set_user_recv(n, (time_t) 0);
     u_tab[n].t_group = (time_t) 0;
     u_tab[n].secure = 0;
+    u_tab[n].resolving = 0;
 #ifdef BRICK
     u_tab[n].bricks = STARTING_BRICKS;
 #endif
@@ -48,28 +112,24 @@ void clear_user_item(int n)
     nlclear(u_tab[n].pub_n_hushed);
     nlclear(u_tab[n].pri_s_hushed);
     nlclear(u_tab[n].pub_s_hushed);
+    hushset_update_lists(n);
     nlclear(u_tab[n].n_notifies);
     nlclear(u_tab[n].s_notifies);
+    notifyindex_update(n);
     S_kill[n] = 0;
-    lpriv_id[n] = -1;
-    pong_req[n] = -1;
-    timerclear (&ping_time[n]);
+    pkttimer_cancel(&u_tab[n].idle_timer);
+    pkttimer_cancel(&u_tab[n].kill_timer);
+    set_user_lpriv(n, -1);
+    set_user_pong_req(n, -1);
 
     /* clear out anyone that has this slot:
      *   a) listed as their last priv msg
      *   b) as a pending pong request
      */
-    for ( i = 0; i < MAX_USERS; i++ )
-    {
-        if ( lpriv_id[i] == n )
-            lpriv_id[i] = -1;
-
-        if ( pong_req[i] == n )
-        {
-            pong_req[i] = -1;
-            timerclear (&ping_time[n]);
-        }
-    }
+    while ((i = lpriv_refs.head[n]) >= 0)
+        set_user_lpriv(i, -1);
+    while ((i = pong_refs.head[n]) >= 0)
+        set_user_pong_req(i, -1);
 }
 
 static void
@@ -101,7 +161,7 @@ void fill_user_entry(int n,
                      const char *nodeid, 
                      const char *nickname, 
                      const char *password, 
-                     const char *group,
+                     int gid,
                      const char *awaymsg,
                      int mylogin, 
                      int echoback, 
@@ -112,10 +172,12 @@ void fill_user_entry(int n,
     copy_user_field(u_tab[n].nodeid, MAX_NODELEN + 1, nodeid);
     copy_user_field(u_tab[n].password, MAX_PASSWDLEN + 1, password);
     copy_user_field(u_tab[n].nickname, MAX_NICKLEN + 1, nickname);
+    nameindex_set(nick_index, n, u_tab[n].nickname);
+    update_match_names(n);
     copy_user_field(u_tab[n].awaymsg, MAX_AWAY_LEN + 1, awaymsg);
-    copy_user_field(u_tab[n].group, MAX_GROUPLEN + 1, group);
-    u_tab[n].login = mylogin;
-    u_tab[n].echoback = echoback;
+    set_user_group(n, gid);
+    set_user_login(n, mylogin);
+    set_user_echoback(n, echoback);
     u_tab[n].t_notify = 0;
     u_tab[n].nobeep = nobeep;
     u_tab[n].perms = perms;
@@ -131,59 +193,309 @@ void clear_users(void)
 {
     int i;
 
-    for (i=0; i<MAX_USERS; i++ ) {
-        u_tab[i].pri_n_hushed = (NAMLIST *) malloc(sizeof(NAMLIST));
-        nlinit(u_tab[i].pri_n_hushed, MAX_HUSHED);
-        u_tab[i].pub_n_hushed = (NAMLIST *) malloc(sizeof(NAMLIST));
-        nlinit(u_tab[i].pub_n_hushed, MAX_HUSHED);
-        u_tab[i].pri_s_hushed = (NAMLIST *) malloc(sizeof(NAMLIST));
-        nlinit(u_tab[i].pri_s_hushed, MAX_HUSHED);
-        u_tab[i].pub_s_hushed = (NAMLIST *) malloc(sizeof(NAMLIST));
-        nlinit(u_tab[i].pub_s_hushed, MAX_HUSHED);
-        u_tab[i].n_notifies = (NAMLIST *) malloc(sizeof(NAMLIST));
-        nlinit(u_tab[i].n_notifies, MAX_HUSHED);
-        u_tab[i].s_notifies = (NAMLIST *) malloc(sizeof(NAMLIST));
-        nlinit(u_tab[i].s_notifies, MAX_HUSHED);
+    nameindex_free(nick_index);
+    nick_index = nameindex_new(max_users, MAX_NICKLEN);
+    if (nick_index == NULL || members_init(max_users, MAX_GROUPS) < 0 ||
+        hushset_init(max_users, HUSH_INDEX_MAX) < 0 ||
+        notifyindex_init(max_users) < 0) {
+        mdb(MSG_ERR, "Cannot init user table");
+        exit(1);
+    }
+    init_refs(&lpriv_refs, 0, max_users);
+    init_refs(&pong_refs, 0, max_users);
+
+    for (i = 0; i < max_users; i++)
         clear_user_item(i);
+}
+
+static NAMLIST *
+new_list(void)
+{
+    NAMLIST *nl;
+
+    if ((nl = (NAMLIST *) malloc(sizeof(NAMLIST))) != NULL)
+        nlinit(nl, MAX_HUSHED);
+    return nl;
+}
+
+#define GROW(tab, n) \
+    ((p = realloc((tab), (size_t)(n) * sizeof(*(tab)))) == NULL ? -1 : ((tab) = p, 0))
+
+/* make the per-slot tables big enough for slot want - 1. they double,
+ * so pktserv's slot table growing a slot at a time doesn't mean a copy
+ * every time, and the new slots are empty.
+ *
+ * returns 0, or -1 if there wasn't the memory, in which case they
+ * keep the size they had
+ */
+int users_grow(int want)
+{
+    static int ready = 0;       /* rows set up, even by a grow that failed */
+    USER_ITEM *nu;
+    void *p;
+    int n, i;
+
+    if (want <= max_users)
+        return 0;
+    for (n = max_users > 0 ? max_users : MAX_USERS; n < want; n *= 2)
+        ;
+
+    /* the timers are linked through u_tab[], so they come off the
+     * wheel while it moves */
+    for (i = 0; i < max_users; i++) {
+        pkttimer_cancel(&u_tab[i].idle_timer);
+        pkttimer_cancel(&u_tab[i].kill_timer);
+    }
+    if ((nu = (USER_ITEM *) realloc(u_tab, n * sizeof(USER_ITEM))) != NULL)
+        u_tab = nu;
+    for (i = 0; i < max_users; i++)
+        rearm_user_timers(i);
+    if (nu == NULL)
+        goto nomem;
+
+    if (GROW(u_hot.login, n) < 0 || GROW(u_hot.echoback, n) < 0 ||
+        GROW(u_hot.gid, n) < 0 || GROW(u_hot.t_recv, n) < 0 ||
+        GROW(S_kill, n) < 0 || GROW(lpriv_id, n) < 0 ||
+        GROW(pong_req, n) < 0 || GROW(ping_time, n) < 0 ||
+        GROW(lpriv_refs.head, n) < 0 || GROW(lpriv_refs.next, n) < 0 ||
+        GROW(lpriv_refs.prev, n) < 0 || GROW(pong_refs.head, n) < 0 ||
+        GROW(pong_refs.next, n) < 0 || GROW(pong_refs.prev, n) < 0)
+        goto nomem;
+    lpriv_refs.ref = lpriv_id;
+    pong_refs.ref = pong_req;
+
+    for (i = ready; i < n; i++) {
+        memset(&u_tab[i], 0, sizeof(USER_ITEM));
+        if ((u_tab[i].pri_n_hushed = new_list()) == NULL ||
+            (u_tab[i].pub_n_hushed = new_list()) == NULL ||
+            (u_tab[i].pri_s_hushed = new_list()) == NULL ||
+            (u_tab[i].pub_s_hushed = new_list()) == NULL ||
+            (u_tab[i].n_notifies = new_list()) == NULL ||
+            (u_tab[i].s_notifies = new_list()) == NULL) {
+            free(u_tab[i].pri_n_hushed);
+            free(u_tab[i].pub_n_hushed);
+            free(u_tab[i].pri_s_hushed);
+            free(u_tab[i].pub_s_hushed);
+            free(u_tab[i].n_notifies);
+            goto nomem;
+        }
+        u_tab[i].gid = -1;
+        update_match_names(i);
+        init_user_timers(i);
+        u_hot.login[i] = LOGIN_FALSE;
+        u_hot.echoback[i] = 0;
+        u_hot.gid[i] = -1;
+        u_hot.t_recv[i] = 0;
+        S_kill[i] = 0;
+        timerclear(&ping_time[i]);
+        init_refs(&lpriv_refs, i, i + 1);
+        init_refs(&pong_refs, i, i + 1);
+        ready = i + 1;
     }
+
+    /* before clear_users() there are no indexes yet; it makes them
+     * the size the tables are by then */
+    if (nick_index != NULL &&
+        (nameindex_grow(nick_index, n) < 0 || members_grow(n) < 0 ||
+         hushset_grow(n) < 0 || notifyindex_grow(n) < 0))
+        goto nomem;
+
+    vmdb(MSG_INFO, "user tables grown to %d slots", n);
+    max_users = n;
+    return 0;
+
+nomem:
+    vmdb(MSG_ERR, "%s: no memory for %d slots", __FUNCTION__, n);
+    return -1;
 }
 
-/* check the user table to see how many of them belong to a particular group */
-int count_users_in_group(const char *group)
+/* change a user's nickname */
+void set_user_nick(int n, const char *nickname)
+{
+    copy_user_field(u_tab[n].nickname, MAX_NICKLEN + 1, nickname);
+    nameindex_set(nick_index, n, u_tab[n].nickname);
+    update_match_names(n);
+}
+
+/* work out the upper-cased names that hush and notify lists are
+ * matched against, so that isn't done for every message, and who
+ * hushes the new ones */
+void update_match_names(int n)
+{
+    size_t len;
+
+    copy_user_field(u_tab[n].uc_nick, MAX_NICKLEN + 1, u_tab[n].nickname);
+    ucaseit(u_tab[n].uc_nick);
+
+    copy_user_field(u_tab[n].uc_addr, MAX_IDLEN + 1, u_tab[n].loginid);
+    len = strlen(u_tab[n].uc_addr);
+    u_tab[n].uc_addr[len++] = '@';
+    copy_user_field(u_tab[n].uc_addr + len, MAX_NODELEN + 1, u_tab[n].nodeid);
+    ucaseit(u_tab[n].uc_addr);
+
+    hushset_update_names(n);
+}
+
+/* rebuild the nickname, group, hush and notify indexes and u_hot
+ * after the table has been filled in behind our back, as by icbload() */
+void index_users(void)
 {
-    int result = 0;
     int i;
 
-    /* don't attempt to find if null */
-    if (strlen(group) == 0)
-        return result;
+    for (i = 0; i < max_users; i++) {
+        nameindex_set(nick_index, i, u_tab[i].nickname);
+        update_match_names(i);
+        set_user_group(i, u_tab[i].gid);
+        set_user_login(i, u_tab[i].login);
+        set_user_echoback(i, u_tab[i].echoback);
+        set_user_recv(i, u_tab[i].t_recv);
+    }
+    for (i = 0; i < max_users; i++) {
+        hushset_update_lists(i);
+        notifyindex_update(i);
+    }
+}
+
+#ifdef CHECK_INDEXES
+/* every slot pointing somewhere is on that slot's list, and nothing
+ * else is on any list */
+static void
+check_refs(const struct backrefs *br, const char *what)
+{
+    int i, j, count = 0;
 
-    for (i=0; i<MAX_USERS; i++) {
-        if (strcasecmp(u_tab[i].group,group) == 0) {
-            result++;
+    for (i = 0; i < max_users; i++) {
+        for (j = br->head[i]; j >= 0; j = br->next[j]) {
+            if (br->ref[j] != i) {
+                vmdb(MSG_ERR, "%s: %d is on %d's list but has %d",
+                     what, j, i, br->ref[j]);
+                abort();
+            }
+            count++;
         }
     }
-    return result;
+    for (i = 0; i < max_users; i++)
+        if (br->ref[i] >= 0)
+            count--;
+    if (count != 0) {
+        vmdb(MSG_ERR, "%s: lists are off by %d", what, count);
+        abort();
+    }
 }
 
-/* find a slot in the user table with a particular name */
-/* return that index if found, -1 otherwise */
-/* case insensitive */
-int find_user(char *name)
+/* compare the nickname, group, hush and notify indexes and u_hot with
+ * what a scan of the table finds, and stop dead if they differ */
+void check_user_indexes(void)
 {
-    int result = -1;
-    int i;
+    int i, j, k;
 
-    /* don't attempt to find if null */
-    if (strlen(name) == 0)
-        return result;
+    for (i = 0; i < max_users; i++) {
+        if (u_tab[i].nickname[0] != '\0') {
+            for (j = 0; strcasecmp(u_tab[j].nickname, u_tab[i].nickname) != 0; j++)
+                ;
+            if (nameindex_find(nick_index, u_tab[i].nickname) != j) {
+                vmdb(MSG_ERR, "nick index: %s is at %d, index says %d",
+                     u_tab[i].nickname, j,
+                     nameindex_find(nick_index, u_tab[i].nickname));
+                abort();
+            }
+        }
+
+        if (u_tab[i].gid >= 0) {
+            if (g_tab[u_tab[i].gid].name[0] == '\0') {
+                vmdb(MSG_ERR, "group index: %d is in empty group %d",
+                     i, u_tab[i].gid);
+                abort();
+            }
+            k = members_first(u_tab[i].gid);
+            for (j = 0; j < max_users; j++) {
+                if (u_tab[j].gid != u_tab[i].gid)
+                    continue;
+                if (k != j) {
+                    vmdb(MSG_ERR, "group index: %s has %d, index says %d",
+                         g_tab[u_tab[i].gid].name, j, k);
+                    abort();
+                }
+                k = members_next(k);
+            }
+            if (k != -1) {
+                vmdb(MSG_ERR, "group index: %d isn't in %s",
+                     k, g_tab[u_tab[i].gid].name);
+                abort();
+            }
+        }
+    }
+
+    hushset_check();
+    notifyindex_check();
+    check_refs(&lpriv_refs, "lpriv_id");
 
-    /* search through table */
-    for (i=0; i<MAX_USERS; i++) {
-        if ( strcasecmp(u_tab[i].nickname, name) == 0) {
-            result = i;
-            break;
+    for (i = 0; i < max_users; i++) {
+        if (u_hot.login[i] != u_tab[i].login ||
+            u_hot.echoback[i] != u_tab[i].echoback ||
+            u_hot.gid[i] != u_tab[i].gid ||
+            u_hot.t_recv[i] != u_tab[i].t_recv) {
+            vmdb(MSG_ERR, "hot table: slot %d is out of step", i);
+            abort();
         }
     }
-    return result;
+    check_refs(&pong_refs, "pong_req");
+}
+#endif
+
+/* change the group a user is in */
+void set_user_group(int n, int gid)
+{
+    u_tab[n].gid = gid;
+    u_hot.gid[n] = gid;
+    members_set(n, gid);
+}
+
+/* change a user's login state */
+void set_user_login(int n, int login)
+{
+    u_tab[n].login = login;
+    u_hot.login[n] = login;
+}
+
+/* turn a user's echoback off, on or verbose */
+void set_user_echoback(int n, int echoback)
+{
+    u_tab[n].echoback = echoback;
+    u_hot.echoback[n] = echoback;
+}
+
+/* note the last time we heard from a user */
+void set_user_recv(int n, time_t t)
+{
+    u_tab[n].t_recv = t;
+    u_hot.t_recv[n] = t;
+}
+
+/* record who sent user n their last personal message */
+void set_user_lpriv(int n, int from)
+{
+    set_ref(&lpriv_refs, n, from);
+}
+
+/* record who is waiting on a pong from user n, or -1 for nobody */
+void set_user_pong_req(int n, int from)
+{
+    set_ref(&pong_refs, n, from);
+    if (from < 0)
+        timerclear (&ping_time[n]);
+}
+
+/* check the user table to see how many of them belong to a particular group */
+int count_users_in_group(int gid)
+{
+    return members_count(gid);
+}
+
+/* find a slot in the user table with a particular name */
+/* return that index if found, -1 otherwise */
+/* case insensitive */
+int find_user(char *name)
+{
+    return nameindex_find(nick_index, name);
 }
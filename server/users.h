@@ -9,7 +9,7 @@ void fill_user_entry(int n,
                      const char *nodeid, 
                      const char *nickname, 
                      const char *password, 
-                     const char *group,
+                     int gid,
                      const char *awaymsg,
                      int mylogin, 
                      int echoback, 
@@ -19,8 +19,50 @@ void fill_user_entry(int n,
 /* clear the entire user table */
 void clear_users(void);
 
+/* make room in u_tab[] and the rest of the per-slot tables for slot
+ * want - 1, keeping everything in them. the new slots are empty.
+ *
+ * returns 0, or -1 if there wasn't the memory
+ */
+int users_grow(int want);
+
+/* change a user's nickname, keeping the nickname index up to date */
+void set_user_nick(int n, const char *nickname);
+
+/* recompute u_tab[n].uc_nick and uc_addr, after the nickname, loginid
+ * or nodeid changes */
+void update_match_names(int n);
+
+/* rebuild the nickname, group, hush and notify indexes and u_hot from
+ * the user table */
+void index_users(void);
+
+#ifdef CHECK_INDEXES
+/* check the nickname, group, hush and notify indexes and u_hot against
+ * a scan of the table, and abort() if they're out of step */
+void check_user_indexes(void);
+#endif
+
+/* change the group a user is in, keeping the group index and u_hot up
+ * to date */
+void set_user_group(int n, int gid);
+
+/* record who sent user n their last personal message, keeping track
+ * of it so clearing that slot can forget it */
+void set_user_lpriv(int n, int from);
+
+/* record who is waiting on a pong from user n, or -1 for nobody,
+ * likewise. -1 clears ping_time[n] too. */
+void set_user_pong_req(int n, int from);
+
+/* change a user's login state, echoback setting, or the last time we
+ * heard from them, keeping u_hot up to date */
+void set_user_login(int n, int login);
+void set_user_echoback(int n, int echoback);
+void set_user_recv(int n, time_t t);
+
 /* check the user table to see how many of them belong to a particular group */
-int count_users_in_group(const char *group);
+int count_users_in_group(int gid);
 
 /* find a slot in the user table with a particular name */
 /* return that index if found, -1 otherwise */
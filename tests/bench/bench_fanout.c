@@ -0,0 +1,124 @@
+/*
+ * Microbenchmark for a scan of the user table picking out the logged in
+ * members of one group, the shape of the broadcast and idle loops:
+ * reading login and gid out of each USER_ITEM against reading them
+ * out of the packed USER_HOT arrays, with a table of 10k users.
+ *
+ * Not run by ctest; build icbd_bench_fanout and run it by hand.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "server/server.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#define NUSERS      10000
+#define NGROUPS     50
+#define NSCANS      2000
+
+/* the same layout as u_tab and u_hot, but bigger */
+static USER_ITEM users[NUSERS];
+static struct {
+    signed char login[NUSERS];
+    signed char echoback[NUSERS];
+    int gid[NUSERS];
+    time_t t_recv[NUSERS];
+} hot;
+
+static int to[NUSERS];
+
+static int scan_cold(int from, int gid) {
+    int i, nto = 0;
+
+    for (i = 0; i < NUSERS; i++)
+        if (users[i].gid == gid && users[i].login == LOGIN_COMPLETE &&
+            (i != from || users[from].echoback))
+            to[nto++] = i;
+    return nto;
+}
+
+static int scan_hot(int from, int gid) {
+    int i, nto = 0;
+
+    for (i = 0; i < NUSERS; i++)
+        if (hot.gid[i] == gid && hot.login[i] == LOGIN_COMPLETE &&
+            (i != from || hot.echoback[from]))
+            to[nto++] = i;
+    return nto;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long cycles(void) {
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void report(const char *what, double secs, unsigned long long cyc,
+                   long recipients, long slots) {
+    printf("  %-5s %8.2f ns/slot  %8.2f ns/recipient", what,
+           secs * 1e9 / slots, secs * 1e9 / recipients);
+    if (cyc)
+        printf("  %8.1f cycles/recipient", (double)cyc / recipients);
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    int nscans = argc > 1 ? atoi(argv[1]) : NSCANS;
+    long sum_cold = 0, sum_hot = 0;
+    unsigned long long c0, c_cold, c_hot;
+    double t0, t_cold, t_hot;
+    int i;
+
+    srand(1);
+    for (i = 0; i < NUSERS; i++) {
+        users[i].gid = hot.gid[i] = rand() % NGROUPS;
+        users[i].login = hot.login[i] = (rand() % 10) ? LOGIN_COMPLETE : LOGIN_PENDING;
+        users[i].echoback = hot.echoback[i] = rand() % 2;
+        users[i].t_recv = hot.t_recv[i] = 1700000000 + i;
+    }
+
+    /* both sweep the whole table every time, so neither stays in cache
+     * on the other's account */
+    t0 = now_s();
+    c0 = cycles();
+    for (i = 0; i < nscans; i++)
+        sum_cold += scan_cold(i % NUSERS, i % NGROUPS);
+    c_cold = cycles() - c0;
+    t_cold = now_s() - t0;
+
+    t0 = now_s();
+    c0 = cycles();
+    for (i = 0; i < nscans; i++)
+        sum_hot += scan_hot(i % NUSERS, i % NGROUPS);
+    c_hot = cycles() - c0;
+    t_hot = now_s() - t0;
+
+    if (sum_cold != sum_hot) {
+        fprintf(stderr, "cold and hot scans disagree\n");
+        return 1;
+    }
+
+    printf("%d users (%zu bytes each in u_tab), %d groups, %d scans, %ld recipients\n",
+           NUSERS, sizeof(USER_ITEM), NGROUPS, nscans, sum_hot);
+    report("u_tab", t_cold, c_cold, sum_cold, (long)nscans * NUSERS);
+    report("u_hot", t_hot, c_hot, sum_hot, (long)nscans * NUSERS);
+    printf("  speedup: %.1fx\n", t_cold / (t_hot > 0 ? t_hot : 1e-9));
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Microbenchmark for filtertext(): the old byte-at-a-time pass through
+ * the UTF-8 decoder against the current one, which copies runs of
+ * plain ascii across in bulk, over a plain ascii chat line, one with a
+ * few accented letters in it, and one that's all multibyte.
+ *
+ * Not run by ctest; build icbd_bench_filtertext and run it by hand.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "server/mdb.h"
+#include "server/strutil.h"
+#include "server/utf8.h"
+
+#define NLOOPS      1000000
+
+int icbd_log = -1;
+int log_level = 0;
+
+void mdb(int level, const char *message) {
+    (void)level;
+    (void)message;
+}
+
+void vmdb(int level, const char *fmt, ...) {
+    (void)level;
+    (void)fmt;
+}
+
+/* what filtertext() used to do */
+static size_t old_filtertext(const char *src, char *dest, size_t len) {
+    uint32_t codepoint;
+    uint32_t prevState = UTF8_ACCEPT;
+    uint32_t curState = UTF8_ACCEPT;
+    size_t offset = 0;
+    const char *s = src;
+
+    memset(dest, 0, len);
+
+    for (; *s; prevState = curState, ++s) {
+        if ((size_t)(s - src) >= len)
+            break;
+        switch (decode(&curState, &codepoint, *s)) {
+            case UTF8_ACCEPT:
+                if (codepoint >= 0x20 && codepoint <= 0x7F) {
+                    dest[offset++] = *s;
+                } else if (codepoint >= 0x80 && codepoint <= 0x7FF) {
+                    dest[offset++] = *(s-1);
+                    dest[offset++] = *s;
+                } else if (codepoint >= 0x800 && codepoint <= 0xFFFF) {
+                    dest[offset++] = *(s-2);
+                    dest[offset++] = *(s-1);
+                    dest[offset++] = *s;
+                } else if (codepoint >= 0x10000 && codepoint <= 0x10FFFF) {
+                    dest[offset++] = *(s-3);
+                    dest[offset++] = *(s-2);
+                    dest[offset++] = *(s-1);
+                    dest[offset++] = *s;
+                }
+                break;
+            case UTF8_REJECT:
+                dest[offset++] = '?';
+                curState = UTF8_ACCEPT;
+                if (prevState != UTF8_ACCEPT)
+                    s--;
+                break;
+            default:
+                ;
+        }
+    }
+    return offset;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *what, const char *line, int nloops) {
+    char dest[MAX_PKT_LEN];
+    double t0, t_old, t_new;
+    size_t sum_old = 0, sum_new = 0;
+    int i;
+
+    t0 = now_s();
+    for (i = 0; i < nloops; i++)
+        sum_old += old_filtertext(line, dest, sizeof(dest) - 16);
+    t_old = now_s() - t0;
+
+    t0 = now_s();
+    for (i = 0; i < nloops; i++)
+        sum_new += filtertext(line, dest, sizeof(dest) - 16);
+    t_new = now_s() - t0;
+
+    if (sum_old != sum_new) {
+        fprintf(stderr, "old and new filtertext disagree\n");
+        exit(1);
+    }
+
+    printf("  %-9s %3zu bytes  old %7.1f ns  new %7.1f ns  speedup %.1fx\n",
+           what, strlen(line), t_old * 1e9 / nloops, t_new * 1e9 / nloops,
+           t_old / (t_new > 0 ? t_new : 1e-9));
+}
+
+int main(int argc, char **argv) {
+    int nloops = argc > 1 ? atoi(argv[1]) : NLOOPS;
+
+    printf("%d calls each\n", nloops);
+    run("ascii",
+        "Anyone around who knows why the build broke after last night's "
+        "merge? I get a link error in pktserv, something about a missing "
+        "symbol, and a clean checkout didn't help either. Ideas welcome!",
+        nloops);
+    run("accented",
+        "Caf\xc3\xa9 au lait at the usual place? The na\xc3\xafve plan was "
+        "to meet at noon, but Ren\xc3\xa9""e says the cr\xc3\xa8me br\xc3\xbbl\xc3\xa9""e "
+        "sells out by eleven, so let's say half past ten instead.",
+        nloops);
+    run("multibyte",
+        "\xe4\xbb\x8a\xe6\x97\xa5\xe3\x81\xaf\xe3\x80\x82\xe3\x81\x8a\xe5\x85\x83"
+        "\xe6\xb0\x97\xe3\x81\xa7\xe3\x81\x99\xe3\x81\x8b\xef\xbc\x9f\xe4\xbb\x8a"
+        "\xe6\x97\xa5\xe3\x81\xaf\xe3\x80\x82\xe3\x81\x8a\xe5\x85\x83\xe6\xb0\x97",
+        nloops);
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Microbenchmark for find_user(): the old strcasecmp() scan of the
+ * user table against the nickname index, with a table of 10k users.
+ *
+ * Not run by ctest; build icbd_bench_find_user and run it by hand.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "config.h"
+#include "server/mdb.h"
+#include "server/nameindex.h"
+
+#define NUSERS      10000
+#define NLOOKUPS    200000
+
+int icbd_log = -1;
+int log_level = 0;
+
+void mdb(int level, const char *message) {
+    (void)level;
+    (void)message;
+}
+
+void vmdb(int level, const char *fmt, ...) {
+    (void)level;
+    (void)fmt;
+}
+
+static char nicks[NUSERS][MAX_NICKLEN + 1];
+
+/* what find_user() used to do */
+static int scan_find(const char *name) {
+    int i;
+
+    if (name[0] == '\0')
+        return -1;
+    for (i = 0; i < NUSERS; i++)
+        if (strcasecmp(nicks[i], name) == 0)
+            return i;
+    return -1;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    static char queries[1024][MAX_NICKLEN + 1];
+    nameindex_t *ix;
+    double t0, t_scan, t_index;
+    long sum_scan = 0, sum_index = 0;
+    int nlookups = argc > 1 ? atoi(argv[1]) : NLOOKUPS;
+    int i;
+
+    srand(1);
+    if ((ix = nameindex_new(NUSERS, MAX_NICKLEN)) == NULL)
+        return 1;
+    for (i = 0; i < NUSERS; i++) {
+        snprintf(nicks[i], sizeof(nicks[i]), "User%05d", i);
+        nameindex_set(ix, i, nicks[i]);
+    }
+
+    /* mostly people who are on, some who aren't, different case */
+    for (i = 0; i < 1024; i++) {
+        if (i % 8 == 0)
+            snprintf(queries[i], sizeof(queries[i]), "nobody%d", i);
+        else
+            snprintf(queries[i], sizeof(queries[i]), "uSER%05d", rand() % NUSERS);
+    }
+
+    t0 = now_s();
+    for (i = 0; i < nlookups; i++)
+        sum_scan += scan_find(queries[i & 1023]);
+    t_scan = now_s() - t0;
+
+    t0 = now_s();
+    for (i = 0; i < nlookups; i++)
+        sum_index += nameindex_find(ix, queries[i & 1023]);
+    t_index = now_s() - t0;
+
+    if (sum_scan != sum_index) {
+        fprintf(stderr, "scan and index disagree\n");
+        return 1;
+    }
+
+    printf("%d users, %d lookups\n", NUSERS, nlookups);
+    printf("  scan:  %8.1f ns/lookup\n", t_scan * 1e9 / nlookups);
+    printf("  index: %8.1f ns/lookup\n", t_index * 1e9 / nlookups);
+    printf("  speedup: %.0fx\n", t_scan / (t_index > 0 ? t_index : 1e-9));
+    return 0;
+}
@@ -215,12 +215,18 @@ def start_server(
     ssl_port: Optional[int],
     log_level: int = 0,
 ) -> subprocess.Popen:
-    cmd = [str(icbd_path), "-f", "-p", str(clear_port), "-l", str(log_level)]
+    # A listen port policy, e.g. "immediate", given to both ports.
+    policy = os.environ.get("ICBD_PORT_POLICY")
+    suffix = f"/{policy}" if policy else ""
+    cmd = [str(icbd_path), "-f", "-p", f"{clear_port}{suffix}", "-l", str(log_level)]
+    backend = os.environ.get("ICBD_EVENT_BACKEND")
+    if backend:
+        cmd += ["-e", backend]
     if ssl_port is not None:
         # Note: icbd uses getopt() optional-arg parsing for -s (s::), which in
         # GNU getopt requires the argument be attached (e.g. "-s7327"), not
         # separated ("-s 7327").
-        cmd += [f"-s{ssl_port}"]
+        cmd += [f"-s{ssl_port}{suffix}"]
     return subprocess.Popen(
         cmd,
         cwd=str(run_dir),
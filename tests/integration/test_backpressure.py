@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+
+import argparse
+import socket
+import ssl
+import time
+from pathlib import Path
+
+from icb import ICBClient, Packet, login_and_sync, with_server
+
+
+def frame(payload: bytes) -> bytes:
+    return bytes([len(payload)]) + payload
+
+
+def connect_small(port: int, use_tls: bool, timeout_s: float) -> ICBClient:
+    # A client with a tiny receive window, so the server can't hide its
+    # output queue in the kernel for long.
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+    s.settimeout(timeout_s)
+    s.connect(("127.0.0.1", port))
+    if use_tls:
+        ctx = ssl.create_default_context()
+        ctx.check_hostname = False
+        ctx.verify_mode = ssl.CERT_NONE
+        s = ctx.wrap_socket(s, server_hostname="127.0.0.1")
+    return ICBClient(s)
+
+
+def stats_line(client: ICBClient, io_timeout_s: float) -> bytes:
+    line = b""
+
+    def got_it(p: Packet) -> bool:
+        nonlocal line
+        if p.ptype == "i" and b"Output queues:" in p.payload:
+            line = p.payload
+            return True
+        return False
+
+    client.send_cmd("stats")
+    client.wait_for(got_it, timeout_s=io_timeout_s)
+    return line
+
+
+def run(enable_tls: bool) -> None:
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--icbd", required=True)
+    ap.add_argument("--fixtures", required=True)
+    ap.add_argument("--io-timeout-s", type=float, default=2.0)
+    ap.add_argument("--tls", action="store_true", help="Connect to the TLS listener (requires TLS-enabled build)")
+    args = ap.parse_args()
+
+    icbd_path = Path(args.icbd)
+    fixtures_dir = Path(args.fixtures)
+
+    server, clear_port, ssl_port = with_server(icbd_path, fixtures_dir, enable_tls=enable_tls)
+    try:
+        port = ssl_port if enable_tls else clear_port
+        assert port is not None
+
+        alice = ICBClient.connect("127.0.0.1", port, use_tls=enable_tls, timeout_s=args.io_timeout_s)
+        bob = connect_small(port, use_tls=enable_tls, timeout_s=args.io_timeout_s)
+        try:
+            # group 1 boots anyone who talks this fast, so use another
+            login_and_sync(alice, loginid="testidA", nick="alice", group="flood", io_timeout_s=args.io_timeout_s)
+            login_and_sync(bob, loginid="testidB", nick="bob", group="flood", io_timeout_s=args.io_timeout_s)
+            bob.drain_for(0.20)
+
+            # 1) Bob stops reading while alice floods the group. His
+            #    queue backs up, and the open messages to him get dropped
+            #    instead of piling up without limit.
+            for j in range(200):
+                alice.sock.sendall(
+                    b"".join(frame(b"b" + b"x" * 200 + f" {j} {i}".encode("ascii") + b"\x00") for i in range(100))
+                )
+            time.sleep(0.50)
+            alice.drain_for(0.20)
+
+            # 2) Alice is still being served, and the server noticed.
+            line = stats_line(alice, args.io_timeout_s * 2)
+            fields = line.split()
+            dropped = int(fields[fields.index(b"dropped\x00") - 1])
+            if dropped <= 0:
+                raise AssertionError(f"nothing dropped for a stalled client: {line!r}")
+
+            # 3) Normal priority traffic still gets through once bob
+            #    catches up.
+            alice.send_cmd("m", "bob still there?")
+
+            def bob_got_private(p: Packet) -> bool:
+                if p.ptype == "c":
+                    f = p.fields()
+                    return len(f) >= 2 and f[0] == b"alice" and f[1] == b"still there?"
+                return False
+
+            bob.wait_for(bob_got_private, timeout_s=args.io_timeout_s * 10)
+
+            # 4) Having drained, he's not backed up any more.
+            line = stats_line(alice, args.io_timeout_s)
+            if b" 0 backed up" not in line:
+                raise AssertionError(f"client still backed up after draining: {line!r}")
+        finally:
+            alice.close()
+            bob.close()
+    finally:
+        server.stop()
+
+
+def main() -> int:
+    enable_tls = "--tls" in __import__("sys").argv
+    run(enable_tls=enable_tls)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -69,7 +69,10 @@ def run(enable_tls: bool) -> None:
             login_and_sync(b, loginid="testidB", nick="bob", group="1", io_timeout_s=args.io_timeout_s)
 
             # Make a fresh group where we can change topic/status.
+            # alice has to get there first so she ends up as the moderator;
+            # don't rely on the server servicing connections in fd order.
             a.send_cmd("g", "TST")
+            time.sleep(0.10)
             b.send_cmd("g", "TST")
             time.sleep(0.10)
 
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+
+import argparse
+import os
+import signal
+from pathlib import Path
+
+from icb import ICBClient, Packet, login_and_sync, with_server
+
+
+# more than the user tables start with (MAX_USERS, 255 by default), so
+# they have to grow to take everyone
+NUSERS = 300
+
+
+def is_back_up(p: Packet) -> bool:
+    return p.ptype == "f" and b"Server is back up." in p.payload
+
+
+def got_open(sender: bytes, text: bytes):
+    def pred(p: Packet) -> bool:
+        if p.ptype == "b":
+            f = p.fields()
+            return len(f) >= 2 and f[0] == sender and f[1] == text
+        return False
+
+    return pred
+
+
+def run(enable_tls: bool) -> None:
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--icbd", required=True)
+    ap.add_argument("--fixtures", required=True)
+    ap.add_argument("--io-timeout-s", type=float, default=2.0)
+    ap.add_argument("--tls", action="store_true", help="Connect to the TLS listener (requires TLS-enabled build)")
+    args = ap.parse_args()
+
+    icbd_path = Path(args.icbd)
+    fixtures_dir = Path(args.fixtures)
+
+    server, clear_port, ssl_port = with_server(icbd_path, fixtures_dir, enable_tls=enable_tls)
+    new_pid = None
+    clients: list[ICBClient] = []
+    try:
+        old_pid = server.proc.pid
+
+        # The admin stays on the cleartext port, so it's there to see
+        # the restart through.
+        admin = ICBClient.connect("127.0.0.1", clear_port, use_tls=False, timeout_s=args.io_timeout_s)
+        clients.append(admin)
+        admin.recv_packet(timeout_s=args.io_timeout_s)   # protocol banner
+        admin.send_login(loginid="testidA", nick="admin", group="many", password="test")
+        admin.wait_for(lambda p: p.ptype == "a", timeout_s=args.io_timeout_s)
+
+        port = ssl_port if enable_tls else clear_port
+        assert port is not None
+        for i in range(NUSERS):
+            c = ICBClient.connect("127.0.0.1", port, use_tls=enable_tls, timeout_s=args.io_timeout_s)
+            clients.append(c)
+            login_and_sync(c, loginid=f"testid{i}", nick=f"u{i}", group="many", io_timeout_s=args.io_timeout_s)
+        first, last = clients[1], clients[-1]
+        first.drain_for(0.20)
+        admin.drain_for(0.20)
+
+        # 1) Everyone got in, and the last of them, well past where the
+        #    tables started, is heard by the rest.
+        last.send_open("from the back")
+        first.wait_for(got_open(f"u{NUSERS - 1}".encode("ascii"), b"from the back"),
+                       timeout_s=args.io_timeout_s)
+        admin.wait_for(got_open(f"u{NUSERS - 1}".encode("ascii"), b"from the back"),
+                       timeout_s=args.io_timeout_s)
+
+        # 2) A restart carries the grown tables over. TLS connections
+        #    don't survive it, so that part is only for cleartext.
+        if not enable_tls:
+            admin.send_cmd("restart")
+            admin.wait_for(is_back_up, timeout_s=args.io_timeout_s * 5)
+            server.proc.wait(timeout=args.io_timeout_s * 5)
+
+            new_pid = int((server.run_dir / "icbd.pid").read_text().split()[0])
+            if new_pid == old_pid:
+                raise AssertionError("server didn't restart")
+
+            first.drain_for(0.20)
+            last.send_open("still at the back")
+            first.wait_for(got_open(f"u{NUSERS - 1}".encode("ascii"), b"still at the back"),
+                           timeout_s=args.io_timeout_s * 2)
+    finally:
+        for c in clients:
+            c.close()
+        if new_pid is not None:
+            try:
+                os.kill(new_pid, signal.SIGTERM)
+            except ProcessLookupError:
+                pass
+        server.stop()
+
+
+def main() -> int:
+    enable_tls = "--tls" in __import__("sys").argv
+    run(enable_tls=enable_tls)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+
+import argparse
+import time
+from pathlib import Path
+
+from icb import ICBClient, Packet, login_and_sync, with_server
+
+
+def frame(payload: bytes) -> bytes:
+    return bytes([len(payload)]) + payload
+
+
+def run(enable_tls: bool) -> None:
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--icbd", required=True)
+    ap.add_argument("--fixtures", required=True)
+    ap.add_argument("--io-timeout-s", type=float, default=2.0)
+    ap.add_argument("--tls", action="store_true", help="Connect to the TLS listener (requires TLS-enabled build)")
+    args = ap.parse_args()
+
+    icbd_path = Path(args.icbd)
+    fixtures_dir = Path(args.fixtures)
+
+    server, clear_port, ssl_port = with_server(icbd_path, fixtures_dir, enable_tls=enable_tls)
+    try:
+        port = ssl_port if enable_tls else clear_port
+        assert port is not None
+
+        alice = ICBClient.connect("127.0.0.1", port, use_tls=enable_tls, timeout_s=args.io_timeout_s)
+        bob = ICBClient.connect("127.0.0.1", port, use_tls=enable_tls, timeout_s=args.io_timeout_s)
+        try:
+            login_and_sync(alice, loginid="testidA", nick="alice", group="1", io_timeout_s=args.io_timeout_s)
+            login_and_sync(bob, loginid="testidB", nick="bob", group="1", io_timeout_s=args.io_timeout_s)
+
+            alice.send_cmd("g", "TST")
+            bob.send_cmd("g", "TST")
+            time.sleep(0.10)
+            bob.drain_for(0.20)
+
+            # 1) A burst of packets in a single write, more than one pass
+            #    through the server loop will handle for one client. They
+            #    all have to come out the other side, in order.
+            count = 20
+            burst = b"".join(frame(b"b" + f"burst {i}".encode("ascii") + b"\x00") for i in range(count))
+            alice.sock.sendall(burst)
+
+            got: list[bytes] = []
+
+            def bob_got_all(p: Packet) -> bool:
+                if p.ptype == "b":
+                    f = p.fields()
+                    if len(f) >= 2 and f[0] == b"alice":
+                        got.append(f[1])
+                return len(got) == count
+
+            bob.wait_for(bob_got_all, timeout_s=args.io_timeout_s * 2)
+            expected = [f"burst {i}".encode("ascii") for i in range(count)]
+            if got != expected:
+                raise AssertionError(f"burst arrived out of order or mangled: {got!r}")
+
+            # 2) A packet split across writes, with the start of the next
+            #    packet tacked onto the end of the second piece.
+            first = frame(b"b" + b"split one" + b"\x00")
+            second = frame(b"b" + b"split two" + b"\x00")
+            alice.sock.sendall(first[:4])
+            time.sleep(0.10)
+            alice.sock.sendall(first[4:] + second[:3])
+            time.sleep(0.10)
+            alice.sock.sendall(second[3:])
+
+            got.clear()
+
+            def bob_got_split(p: Packet) -> bool:
+                if p.ptype == "b":
+                    f = p.fields()
+                    if len(f) >= 2 and f[0] == b"alice":
+                        got.append(f[1])
+                return len(got) == 2
+
+            bob.wait_for(bob_got_split, timeout_s=args.io_timeout_s)
+            if got != [b"split one", b"split two"]:
+                raise AssertionError(f"split packets mangled: {got!r}")
+        finally:
+            alice.close()
+            bob.close()
+    finally:
+        server.stop()
+
+
+def main() -> int:
+    enable_tls = "--tls" in __import__("sys").argv
+    run(enable_tls=enable_tls)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
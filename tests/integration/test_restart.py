@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+
+import argparse
+import os
+import signal
+import time
+from pathlib import Path
+
+from icb import ICBClient, Packet, login_and_sync, with_server
+
+
+def frame(payload: bytes) -> bytes:
+    return bytes([len(payload)]) + payload
+
+
+def is_back_up(p: Packet) -> bool:
+    return p.ptype == "f" and b"Server is back up." in p.payload
+
+
+def got_open(sender: bytes, text: bytes):
+    def pred(p: Packet) -> bool:
+        if p.ptype == "b":
+            f = p.fields()
+            return len(f) >= 2 and f[0] == sender and f[1] == text
+        return False
+
+    return pred
+
+
+def wl_host(nick: bytes):
+    def pred(p: Packet) -> bool:
+        if p.ptype == "i":
+            f = p.fields()
+            # iwl^AMod^ANick^AIdle^AResp^ALoginTime^AUserID^AHostID^ARegisterInfo
+            return len(f) >= 8 and f[0] == b"wl" and f[2] == nick
+        return False
+
+    return pred
+
+
+def run(enable_tls: bool) -> None:
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--icbd", required=True)
+    ap.add_argument("--fixtures", required=True)
+    ap.add_argument("--io-timeout-s", type=float, default=2.0)
+    ap.add_argument("--tls", action="store_true", help="Connect to the TLS listener (requires TLS-enabled build)")
+    args = ap.parse_args()
+
+    icbd_path = Path(args.icbd)
+    fixtures_dir = Path(args.fixtures)
+
+    server, clear_port, ssl_port = with_server(icbd_path, fixtures_dir, enable_tls=enable_tls)
+    new_pid = None
+    try:
+        old_pid = server.proc.pid
+
+        # The admin stays on the cleartext port either way, since TLS
+        # connections don't survive a restart.
+        admin = ICBClient.connect("127.0.0.1", clear_port, use_tls=False, timeout_s=args.io_timeout_s)
+        bob = ICBClient.connect("127.0.0.1", clear_port, use_tls=False, timeout_s=args.io_timeout_s)
+        erin = ICBClient.connect("127.0.0.1", clear_port, use_tls=False, timeout_s=args.io_timeout_s)
+        carol = None
+        if enable_tls:
+            assert ssl_port is not None
+            carol = ICBClient.connect("127.0.0.1", ssl_port, use_tls=True, timeout_s=args.io_timeout_s)
+        try:
+            admin.recv_packet(timeout_s=args.io_timeout_s)   # protocol banner
+            admin.send_login(loginid="testidA", nick="admin", group="rst", password="test")
+            admin.wait_for(lambda p: p.ptype == "a", timeout_s=args.io_timeout_s)
+            login_and_sync(bob, loginid="testidB", nick="bob", group="rst", io_timeout_s=args.io_timeout_s)
+            if carol is not None:
+                login_and_sync(carol, loginid="testidC", nick="carol", group="rst", io_timeout_s=args.io_timeout_s)
+            bob.drain_for(0.20)
+
+            # erin has connected but not logged in yet
+            pkt = erin.recv_packet(timeout_s=args.io_timeout_s)
+            if pkt.ptype != "j":
+                raise AssertionError(f"expected protocol banner 'j', got {pkt.ptype!r}")
+
+            # bob is halfway through sending something
+            split = frame(b"b" + b"across the restart" + b"\x00")
+            bob.sock.sendall(split[:6])
+            time.sleep(0.10)
+
+            # 1) Restart. The old server hands over and exits; everyone
+            #    on a plaintext connection hears that it's back.
+            admin.send_cmd("restart")
+            admin.wait_for(is_back_up, timeout_s=args.io_timeout_s * 5)
+            bob.wait_for(is_back_up, timeout_s=args.io_timeout_s * 5)
+            server.proc.wait(timeout=args.io_timeout_s * 5)
+
+            new_pid = int((server.run_dir / "icbd.pid").read_text().split()[0])
+            if new_pid == old_pid:
+                raise AssertionError("server didn't restart")
+
+            # 2) The connections and their state came across: bob is
+            #    still in the admin's group and hears him.
+            admin.send_open("still here")
+            bob.wait_for(got_open(b"admin", b"still here"), timeout_s=args.io_timeout_s)
+
+            #    and the half a packet bob had sent wasn't lost.
+            bob.sock.sendall(split[6:])
+            admin.wait_for(got_open(b"bob", b"across the restart"), timeout_s=args.io_timeout_s)
+
+            #    and erin can log in, coming from the same host as bob.
+            erin.send_login(loginid="testidE", nick="erin", group="rst", password="")
+            erin.wait_for(lambda p: p.ptype == "a", timeout_s=args.io_timeout_s)
+            admin.drain_for(0.20)
+            admin.send_cmd("w", "")
+            erin_host = admin.wait_for(wl_host(b"erin"), timeout_s=args.io_timeout_s)[-1].fields()[7]
+            admin.send_cmd("w", "")
+            bob_host = admin.wait_for(wl_host(b"bob"), timeout_s=args.io_timeout_s)[-1].fields()[7]
+            if erin_host == b"" or erin_host != bob_host:
+                raise AssertionError(f"erin came back from {erin_host!r}, bob is on {bob_host!r}")
+
+            # 3) TLS connections are closed, cleanly, rather than carried
+            #    over.
+            if carol is not None:
+                deadline = time.time() + args.io_timeout_s * 5
+                closed = False
+                while time.time() < deadline and not closed:
+                    try:
+                        carol.recv_packet(timeout_s=0.5)
+                    except RuntimeError:
+                        closed = True
+                    except TimeoutError:
+                        pass
+                if not closed:
+                    raise AssertionError("TLS connection wasn't closed on restart")
+
+            # 4) The listen ports came across too.
+            dave = ICBClient.connect("127.0.0.1", ssl_port if enable_tls else clear_port,
+                                     use_tls=enable_tls, timeout_s=args.io_timeout_s)
+            try:
+                login_and_sync(dave, loginid="testidD", nick="dave", group="rst", io_timeout_s=args.io_timeout_s)
+                dave.drain_for(0.20)
+                bob.send_open("hi dave")
+                dave.wait_for(got_open(b"bob", b"hi dave"), timeout_s=args.io_timeout_s)
+            finally:
+                dave.close()
+        finally:
+            admin.close()
+            bob.close()
+            erin.close()
+            if carol is not None:
+                carol.close()
+    finally:
+        if new_pid is not None:
+            try:
+                os.kill(new_pid, signal.SIGTERM)
+            except ProcessLookupError:
+                pass
+        server.stop()
+
+
+def main() -> int:
+    enable_tls = "--tls" in __import__("sys").argv
+    run(enable_tls=enable_tls)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
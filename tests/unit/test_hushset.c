@@ -0,0 +1,235 @@
+/*
+ * Unit tests for server/hushset.c
+ *
+ * Tests: bits against nlmatch() through logins, nick changes and hush
+ *        list changes; lists emptying; slots past the memory cap
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "server/server.h"
+#include "server/namelist.h"
+#include "server/hushset.h"
+#include "server/mdb.h"
+
+/* the table hushset.c works on, normally in globals.c */
+static USER_ITEM users[MAX_USERS];
+USER_ITEM *u_tab = users;
+int max_users = MAX_USERS;
+
+/*
+ * namelist.c and hushset.c log through server/mdb.c. Provide stubs.
+ */
+int icbd_log = -1;
+int log_level = 0;
+
+void mdb(int level, const char *message) {
+    (void)level;
+    (void)message;
+}
+
+void vmdb(int level, const char *fmt, ...) {
+    (void)level;
+    (void)fmt;
+}
+
+static NAMLIST lists[MAX_USERS][4];
+
+/* the index starts with nslots, though the table has them all */
+static void clear_table(int nslots, size_t maxbytes) {
+    int i, j;
+
+    assert(hushset_init(nslots, maxbytes) == 0);
+    for (i = 0; i < MAX_USERS; i++) {
+        for (j = 0; j < 4; j++) {
+            nlclear(&lists[i][j]);
+            nlinit(&lists[i][j], MAX_HUSHED);
+        }
+        memset(&u_tab[i], 0, sizeof(u_tab[i]));
+        u_tab[i].pri_n_hushed = &lists[i][0];
+        u_tab[i].pub_n_hushed = &lists[i][1];
+        u_tab[i].pri_s_hushed = &lists[i][2];
+        u_tab[i].pub_s_hushed = &lists[i][3];
+        strcpy(u_tab[i].uc_addr, "@");
+        hushset_update_names(i);
+    }
+}
+
+/* as update_match_names() does */
+static void set_names(int s, const char *nick, const char *addr) {
+    char *p;
+
+    snprintf(u_tab[s].uc_nick, sizeof(u_tab[s].uc_nick), "%s", nick);
+    snprintf(u_tab[s].uc_addr, sizeof(u_tab[s].uc_addr), "%s", addr);
+    for (p = u_tab[s].uc_nick; *p; p++)
+        *p = toupper((unsigned char)*p);
+    for (p = u_tab[s].uc_addr; *p; p++)
+        *p = toupper((unsigned char)*p);
+    hushset_update_names(s);
+}
+
+static void check_all(void) {
+    int r, s;
+    int open, personal;
+
+    for (r = 0; r < MAX_USERS; r++)
+        for (s = 0; s < MAX_USERS; s++) {
+            open = nlmatch(u_tab[s].uc_addr, u_tab[r].pub_s_hushed) ||
+                   nlmatch(u_tab[s].uc_nick, u_tab[r].pub_n_hushed);
+            personal = nlmatch(u_tab[s].uc_addr, u_tab[r].pri_s_hushed) ||
+                       nlmatch(u_tab[s].uc_nick, u_tab[r].pri_n_hushed);
+            assert(hushset_hushes(r, s, HUSH_OPEN) == open);
+            assert(hushset_hushes(r, s, HUSH_PERSONAL) == personal);
+        }
+}
+
+static void test_simple(void) {
+    clear_table(MAX_USERS, HUSH_INDEX_MAX);
+
+    set_names(1, "alice", "alice@example.org");
+    set_names(2, "bob", "bob@example.net");
+    set_names(3, "carol", "carol@example.org");
+    assert(!hushset_hushes(1, 2, HUSH_OPEN));
+
+    /* alice hushes bob in open messages only */
+    nlput(u_tab[1].pub_n_hushed, "BOB");
+    hushset_update_lists(1);
+    assert(hushset_hushes(1, 2, HUSH_OPEN));
+    assert(!hushset_hushes(1, 2, HUSH_PERSONAL));
+    assert(!hushset_hushes(1, 3, HUSH_OPEN));
+
+    /* bob changes nick and gets through; carol takes the name */
+    set_names(2, "robert", "bob@example.net");
+    assert(!hushset_hushes(1, 2, HUSH_OPEN));
+    set_names(3, "bob", "carol@example.org");
+    assert(hushset_hushes(1, 3, HUSH_OPEN));
+
+    /* a site hush covers whoever turns up from there */
+    nlput(u_tab[1].pri_s_hushed, "*@EXAMPLE.NET");
+    hushset_update_lists(1);
+    assert(hushset_hushes(1, 2, HUSH_PERSONAL));
+    set_names(4, "dave", "dave@example.net");
+    assert(hushset_hushes(1, 4, HUSH_PERSONAL));
+    check_all();
+
+    /* and when the lists are empty, nobody is */
+    nlclear(u_tab[1].pub_n_hushed);
+    nlclear(u_tab[1].pri_s_hushed);
+    hushset_update_lists(1);
+    assert(!hushset_hushes(1, 3, HUSH_OPEN));
+    assert(!hushset_hushes(1, 4, HUSH_PERSONAL));
+    check_all();
+}
+
+static const char *nicks[] = {
+    "alice", "bob", "carol", "dave", "erin", "frank", "bobby", "al", "x"
+};
+static const char *addrs[] = {
+    "alice@example.org", "bob@example.net", "root@localhost",
+    "guest@[192.0.2.1]", "bob@example.org", "x@y"
+};
+static const char *nick_pats[] = {
+    "BOB", "AL*", "*Y", "?", "CAROL", "*", "[A-C]*", "D?VE"
+};
+static const char *addr_pats[] = {
+    "*@EXAMPLE.ORG", "BOB@*", "ROOT@LOCALHOST", "*[192.0.2.*", "*@*.NET"
+};
+
+#define NELEM(a) (sizeof(a) / sizeof((a)[0]))
+
+/* a few thousand random logins, nick changes and hushes, checking
+ * every bit against the lists as it goes */
+static void test_random(size_t maxbytes) {
+    int step, s, r, which;
+    NAMLIST *nl;
+    char name[32];
+
+    clear_table(MAX_USERS, maxbytes);
+    srand(17);
+
+    for (step = 0; step < 3000; step++) {
+        s = rand() % MAX_USERS;
+        switch (rand() % 4) {
+        case 0:
+        case 1:
+            set_names(s, nicks[rand() % NELEM(nicks)],
+                      addrs[rand() % NELEM(addrs)]);
+            break;
+        case 2:
+            which = rand() % 4;
+            nl = &lists[s][which];
+            snprintf(name, sizeof(name), "%s",
+                     which < 2 ? nick_pats[rand() % NELEM(nick_pats)]
+                               : addr_pats[rand() % NELEM(addr_pats)]);
+            if (nlpresent(name, *nl))
+                nldelete(nl, name);
+            else
+                nlput(nl, name);
+            hushset_update_lists(s);
+            break;
+        case 3:
+            /* logging out clears the lot */
+            for (r = 0; r < 4; r++)
+                nlclear(&lists[s][r]);
+            hushset_update_lists(s);
+            set_names(s, "", "@");
+            break;
+        }
+        if (step % 100 == 0)
+            check_all();
+    }
+    check_all();
+}
+
+/* grown with rows in it, and names in the new slots already */
+static void test_grow(size_t maxbytes) {
+    int half = MAX_USERS / 2;
+
+    clear_table(half, maxbytes);
+
+    set_names(1, "alice", "alice@example.org");
+    set_names(2, "bob", "bob@example.net");
+    nlput(u_tab[1].pub_n_hushed, "BOB");
+    hushset_update_lists(1);
+    nlput(u_tab[2].pri_s_hushed, "*@EXAMPLE.NET");
+    hushset_update_lists(2);
+    nlput(u_tab[3].pub_n_hushed, "*");
+    hushset_update_lists(3);
+
+    /* past the end of the index, so it doesn't see them yet */
+    set_names(MAX_USERS - 1, "bob", "bob@example.org");
+    set_names(MAX_USERS - 2, "zed", "zed@example.net");
+
+    assert(hushset_grow(half) == 0);
+    assert(hushset_grow(MAX_USERS) == 0);
+    assert(hushset_hushes(1, MAX_USERS - 1, HUSH_OPEN));
+    assert(!hushset_hushes(1, MAX_USERS - 2, HUSH_OPEN));
+    assert(hushset_hushes(2, MAX_USERS - 2, HUSH_PERSONAL));
+    assert(hushset_hushes(3, MAX_USERS - 2, HUSH_OPEN));
+    check_all();
+
+    /* and it keeps up afterwards */
+    set_names(MAX_USERS - 2, "bob", "zed@example.org");
+    assert(hushset_hushes(1, MAX_USERS - 2, HUSH_OPEN));
+    assert(!hushset_hushes(2, MAX_USERS - 2, HUSH_PERSONAL));
+    check_all();
+}
+
+int main(void) {
+    test_simple();
+    test_grow(HUSH_INDEX_MAX);
+    /* two rows fit before, one after */
+    test_grow(2 * 2 * ((MAX_USERS / 2 + 63) / 64) * 8);
+    test_random(HUSH_INDEX_MAX);
+
+    /* room for only a couple of rows: the rest are matched the slow
+     * way, with the same answers */
+    test_random(2 * 2 * ((MAX_USERS + 63) / 64) * 8);
+    test_random(0);
+    return 0;
+}
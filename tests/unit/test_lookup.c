@@ -0,0 +1,161 @@
+/*
+ * Unit tests for server/lookup.c
+ *
+ * Tests: every name in commands.def found in any case, unknown names
+ *        and near misses turned away, random strings against a linear
+ *        strcasecmp() search, lookup() on a NULL terminated table
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "config.h"
+#include "server/lookup.h"
+#include "server/s_commands.h"
+#include "server/s_stats.h"
+
+/*
+ * lookup.c's tables point at the command handlers. Provide stubs.
+ */
+#define STUB(fn) \
+    int fn(int n, int argc, TOKEN *argv) { \
+        (void)n; (void)argc; (void)argv; return 0; \
+    }
+
+STUB(s_auto) STUB(s_drop) STUB(s_shutdown) STUB(s_restart) STUB(s_wall)
+STUB(s_beep) STUB(s_nobeep) STUB(s_away) STUB(s_noaway) STUB(s_brick)
+STUB(s_cancel) STUB(s_change) STUB(s_invite) STUB(s_pass) STUB(s_boot)
+STUB(s_status) STUB(s_topic) STUB(s_exclude) STUB(s_info) STUB(s_motd)
+STUB(s_news) STUB(s_personal) STUB(s_shuttime) STUB(s_help) STUB(s_hush)
+STUB(s_name) STUB(s_notify) STUB(s_echoback) STUB(s_version) STUB(s_who)
+STUB(s_ping) STUB(s_log) STUB(s_talk) STUB(s_server_stats)
+
+static const struct {
+    const char *name;
+    CMDFUNC fn;
+} commands[] = {
+#define COMMAND(name, handler)  { name, handler },
+#define AUTOCMD(name, which)
+#include "server/commands.def"
+#undef COMMAND
+#undef AUTOCMD
+};
+
+static const struct {
+    const char *name;
+    int which;
+} autocmds[] = {
+#define COMMAND(name, handler)
+#define AUTOCMD(name, which)    { name, which },
+#include "server/commands.def"
+#undef COMMAND
+#undef AUTOCMD
+};
+
+#define NELEM(a) (sizeof(a) / sizeof((a)[0]))
+
+/* the linear searches find_command() and find_autocmd() replaced */
+static CMDFUNC slow_command(const char *name) {
+    unsigned int i;
+
+    for (i = 0; i < NELEM(commands); i++)
+        if (strcasecmp(name, commands[i].name) == 0)
+            return commands[i].fn;
+    return NULL;
+}
+
+static int slow_autocmd(const char *name) {
+    unsigned int i;
+
+    for (i = 0; i < NELEM(autocmds); i++)
+        if (strcasecmp(name, autocmds[i].name) == 0)
+            return autocmds[i].which;
+    return -1;
+}
+
+static void test_all_names(void) {
+    char buf[64];
+    unsigned int i, j;
+
+    for (i = 0; i < NELEM(commands); i++) {
+        assert(find_command(commands[i].name) == commands[i].fn);
+        snprintf(buf, sizeof(buf), "%s", commands[i].name);
+        for (j = 0; buf[j]; j++)
+            buf[j] = toupper((unsigned char)buf[j]);
+        assert(find_command(buf) == commands[i].fn);
+        buf[0] = tolower((unsigned char)buf[0]);
+        assert(find_command(buf) == commands[i].fn);
+    }
+    for (i = 0; i < NELEM(autocmds); i++) {
+        assert(find_autocmd(autocmds[i].name) == autocmds[i].which);
+        snprintf(buf, sizeof(buf), "%s", autocmds[i].name);
+        for (j = 0; buf[j]; j++)
+            buf[j] = toupper((unsigned char)buf[j]);
+        assert(find_autocmd(buf) == autocmds[i].which);
+    }
+
+    assert(find_command("hush") == s_hush);
+    assert(find_command("SHUSH") == s_hush);
+    assert(find_command("whereis") == s_info);
+    assert(find_autocmd("whois") == AUTO_WHO);
+    assert(find_autocmd("?") == AUTO_QUESTION);
+}
+
+static void test_unknown(void) {
+    static const char *names[] = {
+        "", "x", "gg", "dro", "drops", "drop ", " drop", "s help",
+        "shut", "whois", "read", "?", "\001", "\377m",
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+    };
+    unsigned int i;
+
+    for (i = 0; i < NELEM(names); i++)
+        assert(find_command(names[i]) == NULL);
+
+#ifndef BRICK
+    assert(find_command("brick") == NULL);
+#endif
+    assert(find_autocmd("") == -1);
+    assert(find_autocmd("m") == -1);
+    assert(find_autocmd("drop") == -1);
+    assert(find_autocmd("wwww") == -1);
+}
+
+static void test_random(void) {
+    static const char chars[] = "abcdeghilmnoprstuvwy?_ ABGHMSW";
+    char buf[12];
+    int i, j, len;
+
+    srand(24);
+    for (i = 0; i < 200000; i++) {
+        len = rand() % 9;
+        for (j = 0; j < len; j++)
+            buf[j] = chars[rand() % (sizeof(chars) - 1)];
+        buf[len] = '\0';
+        assert(find_command(buf) == slow_command(buf));
+        assert(find_autocmd(buf) == slow_autocmd(buf));
+    }
+}
+
+static void test_lookup(void) {
+    static char *table[] = { "r", "m", "name", "idlebootmsg", (char *) 0 };
+
+    assert(lookup("r", table) == 0);
+    assert(lookup("NAME", table) == 2);
+    assert(lookup("IdleBootMsg", table) == 3);
+    assert(lookup("na", table) == -1);
+    assert(lookup("", table) == -1);
+}
+
+int main(void) {
+    test_all_names();
+    test_unknown();
+    test_random();
+    test_lookup();
+    return 0;
+}
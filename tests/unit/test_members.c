@@ -0,0 +1,150 @@
+/*
+ * Unit tests for server/members.c
+ *
+ * Tests: join/leave/move, slot order, counts, groups going away and
+ *        coming back, bad slots and groups, reinit
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "server/mdb.h"
+#include "server/members.h"
+
+/*
+ * members.c logs through server/mdb.c. Provide stubs.
+ */
+int icbd_log = -1;
+int log_level = 0;
+
+void mdb(int level, const char *message) {
+    (void)level;
+    (void)message;
+}
+
+void vmdb(int level, const char *fmt, ...) {
+    (void)level;
+    (void)fmt;
+}
+
+/* the members of group gid, in order, as "1,5,9" */
+static const char *list(int gid) {
+    static char buf[1024];
+    size_t len = 0;
+    int i;
+
+    buf[0] = '\0';
+    for (i = members_first(gid); i >= 0; i = members_next(i))
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%d", len ? "," : "", i);
+    return buf;
+}
+
+enum { LOBBY = 2, DEN = 7 };
+
+static void test_join_leave(void) {
+    assert(members_init(32, 10) == 0);
+
+    assert(members_count(LOBBY) == 0);
+    assert(members_first(LOBBY) == -1);
+
+    /* in slot order whatever order they come in */
+    members_set(9, LOBBY);
+    members_set(1, LOBBY);
+    members_set(5, LOBBY);
+    members_set(3, DEN);
+    assert(strcmp(list(LOBBY), "1,5,9") == 0);
+    assert(members_count(LOBBY) == 3);
+    assert(strcmp(list(DEN), "3") == 0);
+
+    /* moving */
+    members_set(5, DEN);
+    assert(strcmp(list(LOBBY), "1,9") == 0);
+    assert(strcmp(list(DEN), "3,5") == 0);
+
+    /* staying put changes nothing */
+    members_set(5, DEN);
+    assert(strcmp(list(DEN), "3,5") == 0);
+    assert(members_count(DEN) == 2);
+
+    /* leaving, from the front, middle and back */
+    members_set(12, LOBBY);
+    members_set(1, -1);
+    assert(strcmp(list(LOBBY), "9,12") == 0);
+    members_set(12, -1);
+    assert(strcmp(list(LOBBY), "9") == 0);
+    members_set(20, LOBBY);
+    members_set(15, LOBBY);
+    members_set(15, -1);
+    assert(strcmp(list(LOBBY), "9,20") == 0);
+
+    /* the last one out and back in again */
+    members_set(3, -1);
+    members_set(5, -1);
+    assert(members_count(DEN) == 0);
+    assert(members_first(DEN) == -1);
+    members_set(7, DEN);
+    assert(strcmp(list(DEN), "7") == 0);
+
+    /* nothing for groups or slots outside the tables */
+    assert(members_count(-1) == 0);
+    assert(members_first(10) == -1);
+    members_set(32, LOBBY);
+    members_set(-1, LOBBY);
+    assert(strcmp(list(LOBBY), "9,20") == 0);
+    members_set(9, 10);
+    assert(strcmp(list(LOBBY), "20") == 0);
+    assert(members_next(-1) == -1);
+}
+
+static void test_many(void) {
+    int i;
+
+    /* every slot in a group of its own, then everyone in one */
+    assert(members_init(2000, 2000) == 0);
+    for (i = 0; i < 2000; i++)
+        members_set(i, i);
+    for (i = 0; i < 2000; i++) {
+        assert(members_count(i) == 1);
+        assert(members_first(i) == i);
+    }
+    for (i = 1999; i >= 0; i--)
+        members_set(i, 0);
+    assert(members_count(0) == 2000);
+    assert(members_count(1) == 0);
+    for (i = 0; i < 2000; i++)
+        assert(members_next(i) == (i < 1999 ? i + 1 : -1));
+
+    /* starting over empties it */
+    assert(members_init(16, 4) == 0);
+    assert(members_count(0) == 0);
+}
+
+/* grown with members in, who stay where they were */
+static void test_grow(void) {
+    assert(members_init(16, 10) == 0);
+    members_set(9, LOBBY);
+    members_set(3, LOBBY);
+    members_set(40, LOBBY);
+    assert(strcmp(list(LOBBY), "3,9") == 0);
+
+    assert(members_grow(8) == 0);
+    assert(members_grow(64) == 0);
+    assert(strcmp(list(LOBBY), "3,9") == 0);
+    assert(members_count(LOBBY) == 2);
+    members_set(40, LOBBY);
+    members_set(12, LOBBY);
+    assert(strcmp(list(LOBBY), "3,9,12,40") == 0);
+    members_set(9, DEN);
+    assert(strcmp(list(LOBBY), "3,12,40") == 0);
+    assert(strcmp(list(DEN), "9") == 0);
+    assert(members_next(63) == -1);
+}
+
+int main(void) {
+    test_join_leave();
+    test_many();
+    test_grow();
+    return 0;
+}
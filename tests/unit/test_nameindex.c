@@ -0,0 +1,177 @@
+/*
+ * Unit tests for server/nameindex.c
+ *
+ * Tests: set/find, case folding, rename and clear, duplicate nicks,
+ *        overlong names, more than one index
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "server/mdb.h"
+#include "server/nameindex.h"
+
+/*
+ * nameindex.c logs through server/mdb.c. Provide stubs.
+ */
+int icbd_log = -1;
+int log_level = 0;
+
+void mdb(int level, const char *message) {
+    (void)level;
+    (void)message;
+}
+
+void vmdb(int level, const char *fmt, ...) {
+    (void)level;
+    (void)fmt;
+}
+
+static void test_set_find(void) {
+    nameindex_t *ix = nameindex_new(64, MAX_NICKLEN);
+
+    assert(ix != NULL);
+
+    assert(nameindex_find(ix, "alice") == -1);
+    nameindex_set(ix, 3, "Alice");
+    nameindex_set(ix, 9, "bob");
+
+    /* case doesn't matter, either way round */
+    assert(nameindex_find(ix, "alice") == 3);
+    assert(nameindex_find(ix, "ALICE") == 3);
+    assert(nameindex_find(ix, "Bob") == 9);
+    assert(nameindex_find(ix, "carol") == -1);
+    assert(nameindex_find(ix, "") == -1);
+    assert(nameindex_find(ix, "alic") == -1);
+    assert(nameindex_find(ix, "alicea") == -1);
+
+    /* a rename moves it */
+    nameindex_set(ix, 3, "Carol");
+    assert(nameindex_find(ix, "alice") == -1);
+    assert(nameindex_find(ix, "carol") == 3);
+
+    /* and clearing takes it out */
+    nameindex_set(ix, 3, NULL);
+    assert(nameindex_find(ix, "carol") == -1);
+    nameindex_set(ix, 9, "");
+    assert(nameindex_find(ix, "bob") == -1);
+
+    /* slots outside the table are ignored */
+    nameindex_set(ix, 64, "dave");
+    nameindex_set(ix, -1, "dave");
+    assert(nameindex_find(ix, "dave") == -1);
+    nameindex_free(ix);
+}
+
+static void test_duplicates(void) {
+    nameindex_t *ix = nameindex_new(64, MAX_NICKLEN);
+
+    assert(ix != NULL);
+
+    /* the lowest slot wins, as with a scan of the table */
+    nameindex_set(ix, 20, "same");
+    nameindex_set(ix, 5, "SAME");
+    nameindex_set(ix, 40, "Same");
+    assert(nameindex_find(ix, "same") == 5);
+    nameindex_set(ix, 5, NULL);
+    assert(nameindex_find(ix, "same") == 20);
+    nameindex_set(ix, 20, "other");
+    assert(nameindex_find(ix, "same") == 40);
+    nameindex_free(ix);
+}
+
+static void test_long_and_many(void) {
+    char nick[MAX_NICKLEN + 8];
+    nameindex_t *ix, *gx;
+    int i;
+
+    assert((ix = nameindex_new(5000, MAX_NICKLEN)) != NULL);
+
+    memset(nick, 'x', sizeof(nick));
+    nick[MAX_NICKLEN] = '\0';
+    nameindex_set(ix, 1, nick);
+    assert(nameindex_find(ix, nick) == 1);
+
+    /* no one can have a nick longer than that */
+    nick[MAX_NICKLEN] = 'x';
+    nick[MAX_NICKLEN + 1] = '\0';
+    assert(nameindex_find(ix, nick) == -1);
+
+    /* lots of them, so the chains get some use */
+    for (i = 0; i < 5000; i++) {
+        snprintf(nick, sizeof(nick), "u%d", i);
+        nameindex_set(ix, i, nick);
+    }
+    for (i = 0; i < 5000; i++) {
+        snprintf(nick, sizeof(nick), "U%d", i);
+        assert(nameindex_find(ix, nick) == i);
+    }
+    for (i = 0; i < 5000; i += 2)
+        nameindex_set(ix, i, NULL);
+    for (i = 0; i < 5000; i++) {
+        snprintf(nick, sizeof(nick), "u%d", i);
+        assert(nameindex_find(ix, nick) == ((i % 2) ? i : -1));
+    }
+
+    /* another index is another index, with its own length limit */
+    assert((gx = nameindex_new(16, MAX_GROUPLEN)) != NULL);
+    assert(nameindex_find(gx, "u1") == -1);
+    nameindex_set(gx, 1, "u1");
+    assert(nameindex_find(gx, "U1") == 1);
+    assert(nameindex_find(ix, "u1") == 1);
+    nameindex_set(ix, 1, NULL);
+    assert(nameindex_find(gx, "u1") == 1);
+    memset(nick, 'g', sizeof(nick));
+    nick[MAX_GROUPLEN + 1] = '\0';
+    nameindex_set(gx, 2, nick);
+    assert(nameindex_find(gx, nick) == -1);
+
+    nameindex_free(gx);
+    nameindex_free(ix);
+    nameindex_free(NULL);
+}
+
+/* grown with names in it, which it still finds */
+static void test_grow(void) {
+    nameindex_t *ix;
+    char nick[16];
+    int i;
+
+    assert((ix = nameindex_new(8, MAX_NICKLEN)) != NULL);
+    nameindex_set(ix, 1, "alice");
+    nameindex_set(ix, 5, "bob");
+    nameindex_set(ix, 9, "carol");
+    assert(nameindex_find(ix, "carol") == -1);
+
+    assert(nameindex_grow(ix, 4) == 0);
+    assert(nameindex_grow(ix, 3000) == 0);
+    assert(nameindex_find(ix, "ALICE") == 1);
+    assert(nameindex_find(ix, "Bob") == 5);
+    assert(nameindex_find(ix, "carol") == -1);
+
+    for (i = 8; i < 3000; i++) {
+        snprintf(nick, sizeof(nick), "u%d", i);
+        nameindex_set(ix, i, nick);
+    }
+    nameindex_set(ix, 2999, "alice");
+    assert(nameindex_find(ix, "alice") == 1);
+    nameindex_set(ix, 1, NULL);
+    assert(nameindex_find(ix, "alice") == 2999);
+    for (i = 8; i < 2999; i++) {
+        snprintf(nick, sizeof(nick), "U%d", i);
+        assert(nameindex_find(ix, nick) == i);
+    }
+
+    assert(nameindex_grow(NULL, 16) == 0);
+    nameindex_free(ix);
+}
+
+int main(void) {
+    test_set_find();
+    test_duplicates();
+    test_long_and_many();
+    test_grow();
+    return 0;
+}
@@ -1,7 +1,8 @@
 /*
  * Unit tests for server/namelist.c
  *
- * Tests: nlinit, nlput, nlget, nlcount, nlclear, nldelete, nlpresent, nlmatch
+ * Tests: nlinit, nlput, nlget, nlcount, nlclear, nldelete, nlpresent, nlmatch,
+ *        nlmatch's compiled lists against plain wildmat()
  */
 
 #include <assert.h>
@@ -10,6 +11,7 @@
 
 #include "server/mdb.h"
 #include "server/namelist.h"
+#include "server/wildmat.h"
 
 /*
  * namelist.c logs through server/mdb.c. Provide stubs.
@@ -247,8 +249,8 @@ static void test_nlmatch_wildcard(void) {
 
     nlput(&nl, "*.example.com");
 
-    assert(nlmatch("user@host.example.com", nl) == 1);
-    assert(nlmatch("user@other.net", nl) == 0);
+    assert(nlmatch("user@host.example.com", &nl) == 1);
+    assert(nlmatch("user@other.net", &nl) == 0);
 
     nlclear(&nl);
 }
@@ -256,7 +258,69 @@ static void test_nlmatch_wildcard(void) {
 static void test_nlmatch_empty(void) {
     NAMLIST nl;
     nlinit(&nl, 10);
-    assert(nlmatch("anything", nl) == 0);
+    assert(nlmatch("anything", &nl) == 0);
+}
+
+static void test_nlmatch_literals_and_globs(void) {
+    NAMLIST nl;
+    nlinit(&nl, 10);
+
+    nlput(&nl, "BOB");
+    nlput(&nl, "ALICE@HOST.EXAMPLE");
+    nlput(&nl, "CAR?L");
+    nlput(&nl, "*@EVIL.NET");
+    nlput(&nl, "[XYZ]ED*");
+
+    /* plain entries match exactly, and case counts, as with wildmat() */
+    assert(nlmatch("BOB", &nl) == 1);
+    assert(nlmatch("bob", &nl) == 0);
+    assert(nlmatch("BOBB", &nl) == 0);
+    assert(nlmatch("ALICE@HOST.EXAMPLE", &nl) == 1);
+
+    assert(nlmatch("CAROL", &nl) == 1);
+    assert(nlmatch("CARL", &nl) == 0);
+    assert(nlmatch("CAROLS", &nl) == 0);
+    assert(nlmatch("ANYONE@EVIL.NET", &nl) == 1);
+    assert(nlmatch("@EVIL.NET", &nl) == 1);
+    assert(nlmatch("ANYONE@EVIL.NETS", &nl) == 0);
+    assert(nlmatch("XEDNA", &nl) == 1);
+    assert(nlmatch("WEDNA", &nl) == 0);
+
+    /* a change is seen by the next match */
+    assert(nldelete(&nl, "BOB") == 0);
+    assert(nlmatch("BOB", &nl) == 0);
+    nlput(&nl, "B*");
+    assert(nlmatch("BOB", &nl) == 1);
+    nlclear(&nl);
+    assert(nlmatch("BOB", &nl) == 0);
+    nlput(&nl, "BOB");
+    assert(nlmatch("BOB", &nl) == 1);
+
+    nlclear(&nl);
+}
+
+/* the compiled form has to say exactly what wildmat() would */
+static void test_nlmatch_agrees_with_wildmat(void) {
+    static char *pats[] = {
+        "*", "A*", "*A", "*AB*CD*", "A?C", "??", "[AB]*", "[^AB]C",
+        "[]A]B", "[-A]B", "[A-C]D", "\\*X", "A\\?C", "AB*AB", "*.EXAMPLE.COM",
+        "X*Y*Z", "ABC",
+    };
+    static char *names[] = {
+        "", "A", "AB", "ABC", "ABD", "BC", "CC", "]B", "-B", "AB", "BD", "DD",
+        "*X", "AX", "A?C", "ABAB", "ABXAB", "USER@H.EXAMPLE.COM", "XYZ",
+        "XAYBZ", "ZYX", "ABCD", "AXBXCDX",
+    };
+    size_t i, j;
+    NAMLIST nl;
+
+    for (i = 0; i < sizeof(pats) / sizeof(pats[0]); i++) {
+        nlinit(&nl, 10);
+        nlput(&nl, pats[i]);
+        for (j = 0; j < sizeof(names) / sizeof(names[0]); j++)
+            assert(nlmatch(names[j], &nl) == wildmat(names[j], pats[i]));
+        nlclear(&nl);
+    }
 }
 
 /* ------------------------------------------------------------------ */
@@ -284,6 +348,8 @@ int main(void) {
 
     test_nlmatch_wildcard();
     test_nlmatch_empty();
+    test_nlmatch_literals_and_globs();
+    test_nlmatch_agrees_with_wildmat();
 
     return 0;
 }
@@ -0,0 +1,204 @@
+/*
+ * Unit tests for server/notifyindex.c
+ *
+ * Tests: plain and wildcard entries, nick and site lists kept apart,
+ *        each watcher once and in slot order, random list changes
+ *        against nlmatch(), reinit
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "server/server.h"
+#include "server/namelist.h"
+#include "server/notifyindex.h"
+#include "server/mdb.h"
+
+/* the table notifyindex.c works on, normally in globals.c */
+static USER_ITEM users[MAX_USERS];
+USER_ITEM *u_tab = users;
+int max_users = MAX_USERS;
+
+/*
+ * namelist.c and notifyindex.c log through server/mdb.c. Provide stubs.
+ */
+int icbd_log = -1;
+int log_level = 0;
+
+void mdb(int level, const char *message) {
+    (void)level;
+    (void)message;
+}
+
+void vmdb(int level, const char *fmt, ...) {
+    (void)level;
+    (void)fmt;
+}
+
+static NAMLIST lists[MAX_USERS][2];
+
+/* the index starts with nslots, though the table has them all */
+static void clear_table(int nslots) {
+    int i, j;
+
+    assert(notifyindex_init(nslots) == 0);
+    for (i = 0; i < MAX_USERS; i++) {
+        for (j = 0; j < 2; j++) {
+            nlclear(&lists[i][j]);
+            nlinit(&lists[i][j], MAX_NOTIFIES);
+        }
+        memset(&u_tab[i], 0, sizeof(u_tab[i]));
+        u_tab[i].n_notifies = &lists[i][0];
+        u_tab[i].s_notifies = &lists[i][1];
+    }
+}
+
+static void watch(int w, int site, const char *name) {
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), "%s", name);
+    nlput(site ? u_tab[w].s_notifies : u_tab[w].n_notifies, buf);
+    notifyindex_update(w);
+}
+
+/* the watchers, as "1,5,9" */
+static const char *watchers(const char *nick, const char *addr) {
+    static char buf[4096];
+    int to[MAX_USERS];
+    size_t len = 0;
+    int i, nto;
+
+    nto = notifyindex_watchers(nick, addr, to);
+    buf[0] = '\0';
+    for (i = 0; i < nto; i++)
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%d", len ? "," : "", to[i]);
+    return buf;
+}
+
+static void test_simple(void) {
+    clear_table(MAX_USERS);
+
+    assert(strcmp(watchers("BOB", "BOB@EXAMPLE.NET"), "") == 0);
+
+    watch(9, 0, "BOB");
+    watch(2, 0, "BOB");
+    watch(5, 1, "BOB@EXAMPLE.NET");
+    watch(7, 0, "BOB@EXAMPLE.NET");    /* on the wrong list */
+    watch(3, 1, "*@EXAMPLE.NET");
+    watch(4, 0, "CAROL");
+
+    /* in slot order, and a match on both lists counts once */
+    watch(2, 1, "*@*");
+    assert(strcmp(watchers("BOB", "BOB@EXAMPLE.NET"), "2,3,5,9") == 0);
+    assert(strcmp(watchers("CAROL", "CAROL@EXAMPLE.ORG"), "2,4") == 0);
+    assert(strcmp(watchers("DAVE", "DAVE@EXAMPLE.NET"), "2,3") == 0);
+
+    /* and off their lists, off the index */
+    nlclear(u_tab[2].n_notifies);
+    nlclear(u_tab[2].s_notifies);
+    notifyindex_update(2);
+    nldelete(u_tab[3].s_notifies, "*@EXAMPLE.NET");
+    notifyindex_update(3);
+    assert(strcmp(watchers("BOB", "BOB@EXAMPLE.NET"), "5,9") == 0);
+    assert(strcmp(watchers("DAVE", "DAVE@EXAMPLE.NET"), "") == 0);
+
+    /* starting again empties it */
+    assert(notifyindex_init(MAX_USERS) == 0);
+    assert(strcmp(watchers("BOB", "BOB@EXAMPLE.NET"), "") == 0);
+}
+
+static const char *nicks[] = {
+    "ALICE", "BOB", "CAROL", "DAVE", "BOBBY", "AL", "X"
+};
+static const char *addrs[] = {
+    "ALICE@EXAMPLE.ORG", "BOB@EXAMPLE.NET", "ROOT@LOCALHOST", "X@Y"
+};
+static const char *nick_pats[] = {
+    "BOB", "AL*", "*Y", "?", "CAROL", "ALICE", "[A-C]*", "DAVE"
+};
+static const char *addr_pats[] = {
+    "*@EXAMPLE.ORG", "BOB@EXAMPLE.NET", "ROOT@LOCALHOST", "X@Y", "*@*.NET"
+};
+
+#define NELEM(a) (sizeof(a) / sizeof((a)[0]))
+
+static void check_all(void) {
+    char want[4096];
+    size_t len;
+    unsigned int a, b;
+    int j;
+
+    for (a = 0; a < NELEM(nicks); a++)
+        for (b = 0; b < NELEM(addrs); b++) {
+            len = 0;
+            want[0] = '\0';
+            for (j = 0; j < MAX_USERS; j++)
+                if (nlmatch(nicks[a], u_tab[j].n_notifies) ||
+                    nlmatch(addrs[b], u_tab[j].s_notifies))
+                    len += snprintf(want + len, sizeof(want) - len, "%s%d",
+                                    len ? "," : "", j);
+            assert(strcmp(watchers(nicks[a], addrs[b]), want) == 0);
+        }
+}
+
+static void test_random(void) {
+    char name[64];
+    NAMLIST *nl;
+    int step, w, site;
+
+    clear_table(MAX_USERS);
+    srand(18);
+
+    for (step = 0; step < 3000; step++) {
+        w = rand() % MAX_USERS;
+        if (rand() % 8 == 0) {
+            nlclear(u_tab[w].n_notifies);
+            nlclear(u_tab[w].s_notifies);
+        } else {
+            site = rand() % 2;
+            nl = site ? u_tab[w].s_notifies : u_tab[w].n_notifies;
+            snprintf(name, sizeof(name), "%s",
+                     site ? addr_pats[rand() % NELEM(addr_pats)]
+                          : nick_pats[rand() % NELEM(nick_pats)]);
+            if (nlpresent(name, *nl))
+                nldelete(nl, name);
+            else
+                nlput(nl, name);
+        }
+        notifyindex_update(w);
+        if (step % 100 == 0)
+            check_all();
+    }
+    check_all();
+}
+
+/* grown with watches in it, which it still finds */
+static void test_grow(void) {
+    int half = MAX_USERS / 2;
+    char want[64];
+
+    clear_table(half);
+    watch(9, 0, "BOB");
+    watch(3, 1, "*@EXAMPLE.NET");
+    watch(5, 0, "BOB");
+
+    assert(notifyindex_grow(half) == 0);
+    assert(notifyindex_grow(MAX_USERS) == 0);
+    assert(strcmp(watchers("BOB", "BOB@EXAMPLE.NET"), "3,5,9") == 0);
+
+    watch(MAX_USERS - 1, 0, "BOB");
+    watch(half, 1, "*@*");
+    snprintf(want, sizeof(want), "3,5,9,%d,%d", half, MAX_USERS - 1);
+    assert(strcmp(watchers("BOB", "BOB@EXAMPLE.NET"), want) == 0);
+    check_all();
+}
+
+int main(void) {
+    test_simple();
+    test_grow();
+    test_random();
+    return 0;
+}
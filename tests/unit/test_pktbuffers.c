@@ -72,6 +72,98 @@ static void test_msgbuf_alloc_grows(void) {
     _msgbuf_free(b);
 }
 
+static void test_msgpool(void) {
+    static msgbuf_t *bufs[2000];
+    msgbuf_t *b, *big;
+    int inuse, nfree, peak;
+    int i;
+
+    b = _msgbuf_get(10);
+    assert(b != NULL);
+    assert(b->slab != NULL);
+    assert(b->sz == MSGPOOL_BUFSZ);
+    assert(b->len == 0);
+    assert(b->pos == b->data);
+    msgpool_stats(&inuse, &nfree, &peak);
+    assert(inuse == 1);
+    assert(nfree > 0);
+    assert(peak == 1);
+
+    /* a freed buffer is the next one handed out */
+    _msgbuf_free(b);
+    assert(_msgbuf_get(MSGPOOL_BUFSZ) == b);
+    _msgbuf_free(b);
+
+    /* too big for the pool */
+    big = _msgbuf_get(MSGPOOL_BUFSZ + 1);
+    assert(big != NULL);
+    assert(big->slab == NULL);
+    assert(big->sz == MSGPOOL_BUFSZ + 1);
+    _msgbuf_free(big);
+
+    /* regrowing a pool buffer swaps it for a malloc'd one */
+    b = _msgbuf_alloc(_msgbuf_get(8), MSGPOOL_BUFSZ * 2);
+    assert(b != NULL);
+    assert(b->slab == NULL);
+    assert(b->sz == MSGPOOL_BUFSZ * 2);
+    _msgbuf_free(b);
+
+    /* a burst grows the pool, and it shrinks back afterwards */
+    for (i = 0; i < 2000; i++) {
+        bufs[i] = _msgbuf_get(MSGPOOL_BUFSZ);
+        assert(bufs[i] != NULL);
+        bufs[i]->data[MSGPOOL_BUFSZ - 1] = 'x';
+    }
+    msgpool_stats(&inuse, NULL, &peak);
+    assert(inuse == 2000);
+    assert(peak == 2000);
+    for (i = 0; i < 2000; i++)
+        _msgbuf_free(bufs[i]);
+    msgpool_stats(&inuse, &nfree, &peak);
+    assert(inuse == 0);
+    assert(nfree > 0 && nfree < 2000);
+    assert(peak == 2000);
+
+    msgpool_reset_peak();
+    msgpool_stats(NULL, NULL, &peak);
+    assert(peak == 0);
+}
+
+static void test_msgbuf_share(void) {
+    msgpayload_t *p;
+    msgbuf_t *a, *b;
+
+    p = msgpayload_new("\005hello", 6);
+    assert(p != NULL);
+    assert(p->refs == 1);
+    assert(p->len == 6);
+
+    /* each entry points at the one copy, with its own position */
+    a = _msgbuf_share(p);
+    b = _msgbuf_share(p);
+    assert(a != NULL && b != NULL);
+    assert(p->refs == 3);
+    assert(a->data == p->data && b->data == p->data);
+    assert(a->len == 6);
+    a->pos += 2;
+    assert(b->pos == b->data);
+
+    /* the payload hangs around until the last entry lets go */
+    msgpayload_unref(p);
+    _msgbuf_free(a);
+    assert(p->refs == 1);
+    assert(memcmp(b->data, "\005hello", 6) == 0);
+    _msgbuf_free(b);
+
+    /* a recycled entry header picks up the new payload */
+    p = msgpayload_new("x", 1);
+    a = _msgbuf_share(p);
+    assert(a->shared == p);
+    assert(a->slab == NULL);
+    msgpayload_unref(p);
+    _msgbuf_free(a);
+}
+
 static void test_socket_state_str(void) {
     assert(strcmp(socketStateStr(DISCONNECTED), "DISCONNECTED") == 0);
     assert(strcmp(socketStateStr(WANT_HEADER), "WANT_HEADER") == 0);
@@ -79,10 +171,87 @@ static void test_socket_state_str(void) {
     assert(strcmp(socketStateStr((SocketState)9999), "UNKNOWN") == 0);
 }
 
+static void test_cbuf_slots(void) {
+    cbuf_t *a, *b, *c;
+    u_int gen;
+    int i;
+
+    assert(cbufs_init() == 0);
+
+    /* slot ids aren't tied to fd numbers, and slot 0 is never used */
+    a = cbuf_alloc(40000);
+    assert(a != NULL);
+    assert(a->slot == 1);
+    assert(a->fd == 40000);
+    assert(a->state == DISCONNECTED);
+    assert(TAILQ_EMPTY(&(a->wlist)));
+    assert(cbuf_from_fd(40000) == a);
+    assert(cbuf_from_slot(a->slot) == a);
+    assert(cbuf_from_fd(3) == NULL);
+    assert(cbuf_from_slot(-1) == NULL);
+
+    b = cbuf_alloc(3);
+    assert(b != NULL);
+    assert(b->slot == 2);
+    assert(cbuf_from_fd(3) == b);
+
+    /* released slots get reused with a new generation */
+    gen = a->gen;
+    cbuf_release(a);
+    assert(a->fd == -1);
+    assert(cbuf_from_fd(40000) == NULL);
+    cbuf_release(a); /* harmless */
+    c = cbuf_alloc(7);
+    assert(c == a);
+    assert(c->slot == 1);
+    assert(c->gen == gen + 1);
+    assert(cbuf_from_fd(7) == c);
+
+    /* the table grows on demand, and existing entries don't move */
+    for (i = 0; i < 100; i++) {
+        cbuf_t *x = cbuf_alloc(100 + i);
+        assert(x != NULL);
+        assert(x->slot > 0 && x->slot < cbufs_size);
+    }
+    assert(cbufs_size > 100);
+    assert(cbuf_from_fd(3) == b);
+    assert(cbuf_from_slot(1) == c);
+
+    /* a specific slot can be claimed if it's free */
+    assert(cbuf_claim(2, 9) == NULL);
+    a = cbuf_claim(300, 9);
+    assert(a != NULL);
+    assert(a->slot == 300);
+    assert(cbuf_from_fd(9) == a);
+}
+
+static void test_cbuf_slots_max(void) {
+    int i;
+
+    /* with a cap, we stop handing out slots once we hit it */
+    cbufs_set_max(cbufs_size + 4);
+    for (i = 0; i < 1000; i++) {
+        if (cbuf_alloc(1000 + i) == NULL)
+            break;
+    }
+    assert(i < 1000);
+    assert(cbuf_from_fd(1000 + i) == NULL);
+    assert(cbuf_from_fd(1000 + i - 1)->slot < cbufs_size);
+
+    /* ...but freed slots can still be reused */
+    cbuf_release(cbuf_from_fd(1000));
+    assert(cbuf_alloc(5000) != NULL);
+    cbufs_set_max(0);
+}
+
 int main(void) {
     test_msgbuf_alloc_reuse_clears();
     test_msgbuf_alloc_grows();
+    test_msgpool();
+    test_msgbuf_share();
     test_socket_state_str();
+    test_cbuf_slots();
+    test_cbuf_slots_max();
     return 0;
 }
 
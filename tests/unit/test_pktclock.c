@@ -0,0 +1,62 @@
+#include <assert.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "pktserv/pktclock.h"
+#include "pktserv/pkttimer.h"
+
+/* the coarse clocks may trail the fine ones by a tick or so */
+#define SLACK_MS    100
+
+static void test_update(void) {
+    struct timeval tv;
+    time_t before, after;
+    uint64_t ms;
+
+    before = time(NULL);
+    pktclock_update();
+    after = time(NULL);
+
+    assert(pktclock_time() >= before - 1 && pktclock_time() <= after);
+    pktclock_timeval(&tv);
+    assert(tv.tv_sec == pktclock_time());
+    assert(tv.tv_usec >= 0 && tv.tv_usec < 1000000);
+
+    /* the timer wheel runs on it */
+    ms = pktclock_ms();
+    assert(pkttimer_now() == ms);
+
+    /* and a fresh read counts from the same point */
+    assert(pktclock_read_ms() + SLACK_MS >= ms);
+    assert(pktclock_read_ms() <= ms + SLACK_MS);
+}
+
+static void test_held(void) {
+    struct timespec ts = { 0, 30 * 1000000 };
+    struct timeval tv1, tv2;
+    time_t t;
+    uint64_t ms;
+
+    /* it stands still between updates */
+    pktclock_update();
+    t = pktclock_time();
+    ms = pktclock_ms();
+    pktclock_timeval(&tv1);
+    nanosleep(&ts, NULL);
+    assert(pktclock_time() == t);
+    assert(pktclock_ms() == ms);
+    pktclock_timeval(&tv2);
+    assert(tv1.tv_sec == tv2.tv_sec && tv1.tv_usec == tv2.tv_usec);
+
+    /* and moves on, never back, when there is one */
+    pktclock_update();
+    assert(pktclock_ms() > ms);
+    assert(pktclock_time() >= t);
+}
+
+int main(void) {
+    test_update();
+    test_held();
+    return 0;
+}
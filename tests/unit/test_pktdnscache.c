@@ -0,0 +1,187 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "config.h"
+#include "server/mdb.h"
+#include "pktserv/pkttimer.h"
+#include "pktserv/pktresolve.h"
+#include "pktserv/pktdnscache.h"
+
+/* logging stubs, as in test_pktbuffers.c */
+int icbd_log = -1;
+int log_level = 0;
+
+void mdb(int level, const char *message) {
+    (void)level;
+    (void)message;
+}
+
+void vmdb(int level, const char *fmt, ...) {
+    (void)level;
+    (void)fmt;
+}
+
+int sslmdb(const char *str, size_t len, void *u) {
+    (void)str;
+    (void)len;
+    (void)u;
+    return 0;
+}
+
+static uint64_t fake_now = 1000;
+
+static uint64_t fake_clock(void) {
+    return fake_now;
+}
+
+static struct sockaddr *v4(struct sockaddr_in *sin, const char *addr) {
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    assert(inet_pton(AF_INET, addr, &sin->sin_addr) == 1);
+    return (struct sockaddr *)sin;
+}
+
+static struct sockaddr *v6(struct sockaddr_in6 *sin6, const char *addr) {
+    memset(sin6, 0, sizeof(*sin6));
+    sin6->sin6_family = AF_INET6;
+    assert(inet_pton(AF_INET6, addr, &sin6->sin6_addr) == 1);
+    return (struct sockaddr *)sin6;
+}
+
+static void test_hit_and_negative(void) {
+    struct sockaddr_in a, b;
+    struct sockaddr_in6 c;
+    char name[PKTRESOLVE_NAMELEN];
+    unsigned long hits, misses;
+    int entries;
+
+    pktdnscache_config(8, 1000, 100);
+    pktdnscache_flush();
+    pktdnscache_reset_stats();
+
+    assert(pktdnscache_get(v4(&a, "192.0.2.1"), sizeof(a), name, sizeof(name)) == PKTDNSCACHE_MISS);
+
+    pktdnscache_put(v4(&a, "192.0.2.1"), sizeof(a), "one.example");
+    pktdnscache_put(v4(&b, "192.0.2.2"), sizeof(b), NULL);
+
+    assert(pktdnscache_get(v4(&a, "192.0.2.1"), sizeof(a), name, sizeof(name)) == PKTDNSCACHE_HIT);
+    assert(strcmp(name, "one.example") == 0);
+    assert(pktdnscache_get(v4(&b, "192.0.2.2"), sizeof(b), name, sizeof(name)) == PKTDNSCACHE_NEGATIVE);
+
+    /* the same bytes in another family are another address, but a
+     * v4-mapped address is the v4 one */
+    assert(pktdnscache_get(v6(&c, "c000:201::"), sizeof(c), name, sizeof(name)) == PKTDNSCACHE_MISS);
+    assert(pktdnscache_get(v6(&c, "::ffff:192.0.2.1"), sizeof(c), name, sizeof(name)) == PKTDNSCACHE_HIT);
+    assert(strcmp(name, "one.example") == 0);
+
+    pktdnscache_stats(&entries, &hits, &misses);
+    assert(entries == 2);
+    assert(hits == 3);
+    assert(misses == 2);
+
+    /* a short buffer gets a truncated name, not an overrun */
+    assert(pktdnscache_get(v4(&a, "192.0.2.1"), sizeof(a), name, 4) == PKTDNSCACHE_HIT);
+    assert(strcmp(name, "one") == 0);
+}
+
+static void test_ttl(void) {
+    struct sockaddr_in a, b;
+    char name[PKTRESOLVE_NAMELEN];
+    int entries;
+
+    pktdnscache_config(8, 1000, 100);
+    pktdnscache_flush();
+
+    pktdnscache_put(v4(&a, "192.0.2.1"), sizeof(a), "one.example");
+    pktdnscache_put(v4(&b, "192.0.2.2"), sizeof(b), NULL);
+
+    /* the negative answer goes stale first */
+    fake_now += 100;
+    assert(pktdnscache_get(v4(&b, "192.0.2.2"), sizeof(b), name, sizeof(name)) == PKTDNSCACHE_MISS);
+    assert(pktdnscache_get(v4(&a, "192.0.2.1"), sizeof(a), name, sizeof(name)) == PKTDNSCACHE_HIT);
+
+    fake_now += 900;
+    assert(pktdnscache_get(v4(&a, "192.0.2.1"), sizeof(a), name, sizeof(name)) == PKTDNSCACHE_MISS);
+
+    pktdnscache_stats(&entries, NULL, NULL);
+    assert(entries == 0);
+
+    /* a TTL of 0 means not to keep those at all */
+    pktdnscache_config(8, 1000, 0);
+    pktdnscache_put(v4(&b, "192.0.2.2"), sizeof(b), NULL);
+    assert(pktdnscache_get(v4(&b, "192.0.2.2"), sizeof(b), name, sizeof(name)) == PKTDNSCACHE_MISS);
+}
+
+static void test_lru(void) {
+    struct sockaddr_in a;
+    char addr[32];
+    char name[PKTRESOLVE_NAMELEN];
+    int entries;
+    int i;
+
+    pktdnscache_config(4, 1000, 1000);
+
+    for (i = 1; i <= 4; i++) {
+        snprintf(addr, sizeof(addr), "198.51.100.%d", i);
+        snprintf(name, sizeof(name), "host%d.example", i);
+        pktdnscache_put(v4(&a, addr), sizeof(a), name);
+    }
+
+    /* touch the oldest, so the second oldest is the one to go */
+    assert(pktdnscache_get(v4(&a, "198.51.100.1"), sizeof(a), name, sizeof(name)) == PKTDNSCACHE_HIT);
+    pktdnscache_put(v4(&a, "198.51.100.5"), sizeof(a), "host5.example");
+
+    pktdnscache_stats(&entries, NULL, NULL);
+    assert(entries == 4);
+    assert(pktdnscache_get(v4(&a, "198.51.100.2"), sizeof(a), name, sizeof(name)) == PKTDNSCACHE_MISS);
+    assert(pktdnscache_get(v4(&a, "198.51.100.1"), sizeof(a), name, sizeof(name)) == PKTDNSCACHE_HIT);
+    assert(pktdnscache_get(v4(&a, "198.51.100.5"), sizeof(a), name, sizeof(name)) == PKTDNSCACHE_HIT);
+    assert(strcmp(name, "host5.example") == 0);
+
+    /* storing an address again replaces it rather than adding one */
+    pktdnscache_put(v4(&a, "198.51.100.5"), sizeof(a), "renamed.example");
+    pktdnscache_stats(&entries, NULL, NULL);
+    assert(entries == 4);
+    assert(pktdnscache_get(v4(&a, "198.51.100.5"), sizeof(a), name, sizeof(name)) == PKTDNSCACHE_HIT);
+    assert(strcmp(name, "renamed.example") == 0);
+
+    /* size 0 turns it off */
+    pktdnscache_config(0, 1000, 1000);
+    pktdnscache_put(v4(&a, "198.51.100.5"), sizeof(a), "host5.example");
+    assert(pktdnscache_get(v4(&a, "198.51.100.5"), sizeof(a), name, sizeof(name)) == PKTDNSCACHE_MISS);
+    pktdnscache_stats(&entries, NULL, NULL);
+    assert(entries == 0);
+}
+
+static void test_getsockaddrname(void) {
+    struct sockaddr_in a;
+    char name[PKTRESOLVE_NAMELEN];
+
+    pktdnscache_config(8, 1000, 1000);
+    pktdnscache_flush();
+
+    /* cached answers come back without a lookup */
+    assert(getsockaddrcached(v4(&a, "192.0.2.7"), sizeof(a), name, sizeof(name)) < 0);
+    pktdnscache_put(v4(&a, "192.0.2.7"), sizeof(a), "seven.example");
+    getsockaddrname(v4(&a, "192.0.2.7"), sizeof(a), name, sizeof(name));
+    assert(strcmp(name, "seven.example") == 0);
+
+    pktdnscache_put(v4(&a, "192.0.2.8"), sizeof(a), NULL);
+    assert(getsockaddrcached(v4(&a, "192.0.2.8"), sizeof(a), name, sizeof(name)) == 0);
+    assert(strcmp(name, "[192.0.2.8]") == 0);
+}
+
+int main(void) {
+    pkttimer_set_clock(fake_clock);
+
+    test_hit_and_negative();
+    test_ttl();
+    test_lru();
+    test_getsockaddrname();
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdarg.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "config.h"
+#include "server/mdb.h"
+#include "pktserv/pktresolve.h"
+
+/* logging stubs, as in test_pktbuffers.c */
+int icbd_log = -1;
+int log_level = 0;
+
+void mdb(int level, const char *message) {
+    (void)level;
+    (void)message;
+}
+
+void vmdb(int level, const char *fmt, ...) {
+    (void)level;
+    (void)fmt;
+}
+
+int sslmdb(const char *str, size_t len, void *u) {
+    (void)str;
+    (void)len;
+    (void)u;
+    return 0;
+}
+
+static int ndone;
+static int done_slot[4];
+static u_int done_gen[4];
+static char done_name[4][PKTRESOLVE_NAMELEN];
+
+static void done_cb(int slot, u_int gen, const char *name) {
+    assert(ndone < 4);
+    done_slot[ndone] = slot;
+    done_gen[ndone] = gen;
+    strncpy(done_name[ndone], name, PKTRESOLVE_NAMELEN - 1);
+    ndone++;
+}
+
+/* an address that should never resolve to anything */
+static void test_addr(struct sockaddr_in *sin) {
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = inet_addr("192.0.2.1");   /* TEST-NET-1 */
+}
+
+static void test_inline_fallback(void) {
+    struct sockaddr_in sin;
+    char name[PKTRESOLVE_NAMELEN];
+
+    test_addr(&sin);
+    getsockaddrname((struct sockaddr *)&sin, sizeof(sin), name, sizeof(name));
+    assert(name[0] != '\0');
+}
+
+static void test_worker_pool(void) {
+#ifdef HAVE_PTHREAD
+    struct sockaddr_in sin;
+    struct pollfd pfd;
+    int fd;
+#endif
+
+#ifndef HAVE_PTHREAD
+    /* no threads, so everything has to be looked up inline */
+    assert(pktresolve_init(2, done_cb) < 0);
+#else
+    /* nothing to start, nothing started */
+    assert(pktresolve_init(0, done_cb) < 0);
+
+    fd = pktresolve_init(2, done_cb);
+    assert(fd >= 0);
+    assert(pktresolve_init(2, done_cb) == fd);   /* only once */
+
+    test_addr(&sin);
+    assert(pktresolve_request(3, 7, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+    assert(pktresolve_request(5, 9, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+
+    /* answers come back through the pipe, in the event loop's time */
+    while (ndone < 2) {
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        assert(poll(&pfd, 1, 30000) == 1);
+        pktresolve_complete();
+    }
+
+    assert(ndone == 2);
+    assert((done_slot[0] == 3 && done_gen[0] == 7) ||
+           (done_slot[1] == 3 && done_gen[1] == 7));
+    assert((done_slot[0] == 5 && done_gen[0] == 9) ||
+           (done_slot[1] == 5 && done_gen[1] == 9));
+    assert(done_name[0][0] != '\0');
+    assert(done_name[1][0] != '\0');
+
+    /* nothing left over */
+    pktresolve_complete();
+    assert(ndone == 2);
+#endif
+}
+
+int main(void) {
+    test_inline_fallback();
+    test_worker_pool();
+    return 0;
+}
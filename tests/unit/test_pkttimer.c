@@ -0,0 +1,207 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pktserv/pkttimer.h"
+
+/*
+ * Drive the wheel off a fake clock so the tests are deterministic.
+ */
+static uint64_t fake_now = 1000000;
+
+static uint64_t fake_clock(void) {
+    return fake_now;
+}
+
+static int fired[8];
+static uint64_t fired_at[8];
+
+static void count_cb(pkttimer_t *t, void *arg) {
+    int i = (int)(intptr_t)arg;
+    (void)t;
+    fired[i]++;
+    fired_at[i] = fake_now;
+}
+
+static void reset(void) {
+    int i;
+    for (i = 0; i < 8; i++) {
+        fired[i] = 0;
+        fired_at[i] = 0;
+    }
+}
+
+/* advance the clock one millisecond at a time, running the wheel */
+static void advance(uint64_t ms) {
+    while (ms-- > 0) {
+        fake_now++;
+        pkttimer_run();
+    }
+}
+
+/* advance the way the server does: sleep until the next deadline */
+static void advance_by_timeout(uint64_t ms) {
+    uint64_t end = fake_now + ms;
+    int timeout;
+
+    while (fake_now < end) {
+        timeout = pkttimer_next_timeout();
+        if (timeout < 0 || fake_now + (uint64_t)timeout > end)
+            fake_now = end;
+        else
+            fake_now += (uint64_t)timeout;
+        pkttimer_run();
+    }
+}
+
+static void test_fires_once_on_time(void) {
+    pkttimer_t t = {0};
+
+    reset();
+    pkttimer_init(&t, count_cb, (void *)0);
+    assert(pkttimer_next_timeout() == -1);
+
+    pkttimer_schedule(&t, 10);
+    assert(pkttimer_pending(&t));
+    assert(pkttimer_next_timeout() == 10);
+
+    advance(9);
+    assert(fired[0] == 0);
+    advance(1);
+    assert(fired[0] == 1);
+    assert(!pkttimer_pending(&t));
+    assert(pkttimer_next_timeout() == -1);
+
+    advance(100);
+    assert(fired[0] == 1);
+}
+
+static void test_zero_delay(void) {
+    pkttimer_t t = {0};
+
+    reset();
+    pkttimer_init(&t, count_cb, (void *)0);
+    pkttimer_schedule(&t, 0);
+    assert(pkttimer_next_timeout() == 0);
+    pkttimer_run();
+    assert(fired[0] == 1);
+}
+
+static void test_cancel_and_reschedule(void) {
+    pkttimer_t a = {0}, b = {0};
+
+    reset();
+    pkttimer_init(&a, count_cb, (void *)0);
+    pkttimer_init(&b, count_cb, (void *)1);
+
+    pkttimer_schedule(&a, 5);
+    pkttimer_schedule(&b, 5);
+    pkttimer_cancel(&a);
+    pkttimer_cancel(&a);    /* harmless */
+    assert(!pkttimer_pending(&a));
+
+    /* moving a pending timer replaces the old deadline */
+    pkttimer_schedule(&b, 20);
+    advance(10);
+    assert(fired[0] == 0);
+    assert(fired[1] == 0);
+    advance(10);
+    assert(fired[1] == 1);
+    assert(fired_at[1] == fake_now);
+}
+
+static void test_long_delays_cascade(void) {
+    static const long delays[] = { 63, 64, 4095, 4096, 300000, 3600000 };
+    pkttimer_t t[6];
+    uint64_t start = fake_now;
+    int i;
+
+    reset();
+    for (i = 0; i < 6; i++) {
+        pkttimer_init(&t[i], count_cb, (void *)(intptr_t)i);
+        pkttimer_schedule(&t[i], delays[i]);
+    }
+
+    advance_by_timeout(3600000);
+    for (i = 0; i < 6; i++) {
+        assert(fired[i] == 1);
+        assert(fired_at[i] == start + (uint64_t)delays[i]);
+    }
+}
+
+static void test_clamped(void) {
+    pkttimer_t t = {0};
+
+    reset();
+    pkttimer_init(&t, count_cb, (void *)0);
+    pkttimer_schedule(&t, 0x7fffffffL);
+    assert(pkttimer_next_timeout() > 0);
+    assert(pkttimer_next_timeout() < 0x7fffffff);
+    pkttimer_cancel(&t);
+}
+
+/* a callback that reschedules itself, and one that cancels its peer */
+static pkttimer_t peer;
+static int ticks;
+
+static void periodic_cb(pkttimer_t *t, void *arg) {
+    (void)arg;
+    if (++ticks < 5)
+        pkttimer_schedule(t, 63);
+}
+
+static void cancel_peer_cb(pkttimer_t *t, void *arg) {
+    (void)t;
+    (void)arg;
+    pkttimer_cancel(&peer);
+}
+
+static void test_callbacks_modify_wheel(void) {
+    pkttimer_t p = {0}, c = {0};
+
+    reset();
+    ticks = 0;
+    pkttimer_init(&p, periodic_cb, NULL);
+    pkttimer_schedule(&p, 63);
+    advance(63);
+    assert(ticks == 1);     /* didn't re-fire within the same run */
+    advance(63 * 4);
+    assert(ticks == 5);
+    assert(!pkttimer_pending(&p));
+
+    /* both due on the same tick; the first one cancels the second */
+    pkttimer_init(&c, cancel_peer_cb, NULL);
+    pkttimer_init(&peer, count_cb, (void *)0);
+    pkttimer_schedule(&c, 7);
+    pkttimer_schedule(&peer, 7);
+    advance(7);
+    assert(fired[0] == 0);
+    assert(pkttimer_next_timeout() == -1);
+}
+
+static void test_idle_gap(void) {
+    pkttimer_t t = {0};
+
+    /* nothing scheduled for a long stretch, then a short timer */
+    reset();
+    fake_now += 86400000;
+    pkttimer_run();
+    pkttimer_init(&t, count_cb, (void *)0);
+    pkttimer_schedule(&t, 3);
+    assert(pkttimer_next_timeout() == 3);
+    advance(3);
+    assert(fired[0] == 1);
+}
+
+int main(void) {
+    pkttimer_set_clock(fake_clock);
+
+    test_fires_once_on_time();
+    test_zero_delay();
+    test_cancel_and_reschedule();
+    test_long_delays_cascade();
+    test_clamped();
+    test_callbacks_modify_wheel();
+    test_idle_gap();
+    return 0;
+}
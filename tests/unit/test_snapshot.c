@@ -0,0 +1,370 @@
+/*
+ * Unit tests for server/snapshot.c
+ *
+ * Tests: encode/load round trip, damaged and truncated images,
+ *        snapshot_save_file/snapshot_load_file, the old text format,
+ *        version 1 images with NICKSERV in the last slot
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "server/server.h"
+#include "server/namelist.h"
+#include "server/mdb.h"
+#include "server/snapshot.h"
+
+/* the tables snapshot.c works on, normally in globals.c */
+static USER_ITEM users[MAX_USERS];
+static short kills[MAX_USERS];
+USER_ITEM *u_tab = users;
+int max_users = MAX_USERS;
+GROUP_ITEM g_tab[MAX_GROUPS];
+short *S_kill = kills;
+
+/*
+ * namelist.c and snapshot.c log through server/mdb.c. Provide stubs.
+ */
+int icbd_log = -1;
+int log_level = 0;
+
+void mdb(int level, const char *message) {
+    (void)level;
+    (void)message;
+}
+
+void vmdb(int level, const char *fmt, ...) {
+    (void)level;
+    (void)fmt;
+}
+
+/* stand-ins for the ones in users.c and groups.c */
+static NAMLIST ulists[MAX_USERS][6];
+static NAMLIST glists[MAX_GROUPS][10];
+
+void clear_users(void) {
+    int i, j;
+
+    for (i = 0; i < MAX_USERS; i++) {
+        for (j = 0; j < 6; j++) {
+            nlclear(&ulists[i][j]);
+            nlinit(&ulists[i][j], 50);
+        }
+        memset(&u_tab[i], 0, sizeof(u_tab[i]));
+        u_tab[i].gid = -1;
+        u_tab[i].pri_n_hushed = &ulists[i][0];
+        u_tab[i].pub_n_hushed = &ulists[i][1];
+        u_tab[i].pri_s_hushed = &ulists[i][2];
+        u_tab[i].pub_s_hushed = &ulists[i][3];
+        u_tab[i].n_notifies = &ulists[i][4];
+        u_tab[i].s_notifies = &ulists[i][5];
+        S_kill[i] = 0;
+    }
+}
+
+/* these tables don't grow */
+int users_grow(int want) {
+    return want <= max_users ? 0 : -1;
+}
+
+void init_groups(void) {
+    int i, j;
+
+    for (i = 0; i < MAX_GROUPS; i++) {
+        for (j = 0; j < 10; j++) {
+            nlclear(&glists[i][j]);
+            nlinit(&glists[i][j], 50);
+        }
+        memset(&g_tab[i], 0, sizeof(g_tab[i]));
+        g_tab[i].n_invites = &glists[i][0];
+        g_tab[i].nr_invites = &glists[i][1];
+        g_tab[i].s_invites = &glists[i][2];
+        g_tab[i].sr_invites = &glists[i][3];
+        g_tab[i].n_bars = &glists[i][4];
+        g_tab[i].n_nr_bars = &glists[i][5];
+        g_tab[i].s_bars = &glists[i][6];
+        g_tab[i].s_nr_bars = &glists[i][7];
+        g_tab[i].n_talk = &glists[i][8];
+        g_tab[i].nr_talk = &glists[i][9];
+        g_tab[i].mod = -1;
+    }
+}
+
+static void fill_tables(void) {
+    init_groups();
+    clear_users();
+
+    strcpy(u_tab[3].loginid, "alice");
+    strcpy(u_tab[3].nodeid, "example.org");
+    strcpy(u_tab[3].nickname, "Alice");
+    u_tab[3].gid = 5;
+    strcpy(u_tab[3].awaymsg, "out to lunch");
+    u_tab[3].login = LOGIN_COMPLETE;
+    u_tab[3].lastawaytime = 1700000123;
+    u_tab[3].perms = 12345678901L;
+    u_tab[3].t_on = 1700000000;
+    nlput(u_tab[3].pri_n_hushed, "bob");
+    nlput(u_tab[3].pri_n_hushed, "carol");
+    nlput(u_tab[3].s_notifies, "dave@example.org");
+
+    /* not logged in, but about to be killed */
+    S_kill[7] = 2;
+
+    /* connected, not logged in yet, and still being looked up */
+    strcpy(u_tab[9].nodeid, "[192.0.2.1]");
+    u_tab[9].resolving = 1;
+
+    strcpy(g_tab[5].name, "lobby");
+    strcpy(g_tab[5].topic, "say hi");
+    g_tab[5].mod = 3;
+    g_tab[5].modtimeout = 60;
+    g_tab[5].idleboot = 1800;
+    strcpy(g_tab[5].idleboot_msg, "wake up");
+    nlput(g_tab[5].n_invites, "erin");
+    nlput(g_tab[5].nr_invites, "frank");
+}
+
+static void check_tables(void) {
+    int i;
+
+    assert(strcmp(u_tab[3].loginid, "alice") == 0);
+    assert(strcmp(u_tab[3].nodeid, "example.org") == 0);
+    assert(strcmp(u_tab[3].nickname, "Alice") == 0);
+    assert(u_tab[3].gid == 5);
+    assert(strcmp(u_tab[3].awaymsg, "out to lunch") == 0);
+    assert(u_tab[3].password[0] == '\0');
+    assert(u_tab[3].login == LOGIN_COMPLETE);
+    assert(u_tab[3].lastawaytime == 1700000123);
+    assert(u_tab[3].perms == 12345678901L);
+    assert(u_tab[3].t_on == 1700000000);
+
+    /* same names, same order */
+    assert(nlcount(*u_tab[3].pri_n_hushed) == 2);
+    assert(strcmp(u_tab[3].pri_n_hushed->head->str, "carol") == 0);
+    assert(strcmp(u_tab[3].pri_n_hushed->tail->str, "bob") == 0);
+    assert(nlcount(*u_tab[3].s_notifies) == 1);
+    assert(nlpresent("dave@example.org", *u_tab[3].s_notifies));
+    assert(nlcount(*u_tab[3].pub_n_hushed) == 0);
+
+    assert(S_kill[7] == 2);
+    assert(u_tab[7].login == LOGIN_FALSE);
+
+    assert(strcmp(u_tab[9].nodeid, "[192.0.2.1]") == 0);
+    assert(u_tab[9].login == LOGIN_FALSE);
+
+    assert(strcmp(g_tab[5].name, "lobby") == 0);
+    assert(strcmp(g_tab[5].topic, "say hi") == 0);
+    assert(g_tab[5].mod == 3);
+    assert(g_tab[5].modtimeout == 60);
+    assert(g_tab[5].idleboot == 1800);
+    assert(strcmp(g_tab[5].idleboot_msg, "wake up") == 0);
+    assert(nlpresent("erin", *g_tab[5].n_invites));
+    assert(nlpresent("frank", *g_tab[5].nr_invites));
+
+    /* nothing turned up anywhere else */
+    for (i = 0; i < MAX_USERS; i++)
+        if (i != 3)
+            assert(u_tab[i].login == LOGIN_FALSE && u_tab[i].nickname[0] == '\0' &&
+                   u_tab[i].gid == -1);
+    for (i = 0; i < MAX_GROUPS; i++)
+        if (i != 5)
+            assert(g_tab[i].name[0] == '\0');
+}
+
+static void test_round_trip(void) {
+    char *image;
+    size_t len;
+
+    fill_tables();
+    assert(snapshot_encode(&image, &len) == 0);
+
+    /* only the slots in use are written */
+    assert(len < 1024);
+
+    init_groups();
+    clear_users();
+    assert(snapshot_load(image, len) == 0);
+    check_tables();
+
+    /* the old text dumps didn't have this */
+    assert(u_tab[9].resolving == 1);
+
+    free(image);
+}
+
+static void test_damaged(void) {
+    char *image;
+    size_t len;
+
+    fill_tables();
+    assert(snapshot_encode(&image, &len) == 0);
+
+    /* a flipped bit is caught, and the tables are left alone */
+    image[len - 3] ^= 0x10;
+    assert(snapshot_load(image, len) == SNAPSHOT_ERR);
+    check_tables();
+    image[len - 3] ^= 0x10;
+
+    assert(snapshot_load(image, len - 1) == SNAPSHOT_ERR);
+    assert(snapshot_load(image, 16) == SNAPSHOT_ERR);
+    assert(snapshot_load("0\n0\n", 4) == SNAPSHOT_NOTSNAP);
+
+    /* a newer version than we know */
+    image[4] = 99;
+    assert(snapshot_load(image, len) == SNAPSHOT_ERR);
+    check_tables();
+    image[4] = 2;
+
+    /* more user slots than there's room for */
+    image[9] = 0x10;
+    assert(snapshot_load(image, len) == SNAPSHOT_ERR);
+    check_tables();
+
+    free(image);
+}
+
+/* a version 1 image has NICKSERV in its last slot */
+static void test_version1(void) {
+    char *image;
+    size_t len;
+    int i;
+
+    fill_tables();
+    strcpy(u_tab[MAX_USERS - 1].nickname, "server");
+    u_tab[MAX_USERS - 1].login = LOGIN_COMPLETE;
+    strcpy(g_tab[0].name, "ICB");
+    g_tab[0].mod = MAX_USERS - 1;
+    assert(snapshot_encode(&image, &len) == 0);
+
+    image[4] = 1;
+    init_groups();
+    clear_users();
+    assert(snapshot_load(image, len) == 0);
+
+    assert(strcmp(u_tab[NICKSERV].nickname, "server") == 0);
+    assert(u_tab[NICKSERV].login == LOGIN_COMPLETE);
+    assert(u_tab[MAX_USERS - 1].nickname[0] == '\0');
+    assert(g_tab[0].mod == NICKSERV);
+    assert(g_tab[5].mod == 3);
+    for (i = 1; i < MAX_USERS; i++)
+        if (i != 3 && i != 7 && i != 9)
+            assert(u_tab[i].login == LOGIN_FALSE && S_kill[i] == 0 &&
+                   u_tab[i].nodeid[0] == '\0');
+    assert(strcmp(u_tab[3].nickname, "Alice") == 0);
+    assert(S_kill[7] == 2);
+
+    free(image);
+}
+
+static void test_files(void) {
+    char path[] = "/tmp/icbd_snapshot_XXXXXX";
+    int fd;
+
+    assert((fd = mkstemp(path)) >= 0);
+    close(fd);
+
+    fill_tables();
+    assert(snapshot_save_file(path) == 0);
+    init_groups();
+    clear_users();
+    assert(snapshot_load_file(path) == 0);
+    check_tables();
+
+    unlink(path);
+}
+
+/* what icbdump() used to write: sockets, S_kill[], then every field
+ * of every slot */
+static void write_text_list(FILE *fp, NAMLIST *nl) {
+    STRLIST *sp;
+
+    fprintf(fp, "%d\n", nlcount(*nl));
+    for (sp = nl->head; sp; sp = sp->next)
+        fprintf(fp, "%sX\n", sp->str);
+}
+
+static void write_text_dump(FILE *fp) {
+    int i;
+
+    fprintf(fp, "2\n4\n5\n4\n-1\n");
+    for (i = 0; i < MAX_USERS; i++)
+        fprintf(fp, "%d\n", S_kill[i]);
+    for (i = 0; i < MAX_USERS; i++) {
+        fprintf(fp, "%sX\n%sX\n%sX\n%sX\n%sX\n%sX\n%sX\n",
+                u_tab[i].loginid, u_tab[i].nodeid, u_tab[i].nickname,
+                u_tab[i].password, u_tab[i].realname,
+                u_tab[i].gid >= 0 ? g_tab[u_tab[i].gid].name : "",
+                u_tab[i].awaymsg);
+        fprintf(fp, "%d\n%ld\n%d\n%d\n%d\n%ld\n%d\n%ld\n%ld\n%ld\n%ld\n",
+                u_tab[i].lastaway, (long)u_tab[i].lastawaytime,
+                u_tab[i].login, u_tab[i].echoback, u_tab[i].nobeep,
+                u_tab[i].perms, u_tab[i].t_notify, (long)u_tab[i].t_on,
+                (long)u_tab[i].t_sent, (long)u_tab[i].t_recv,
+                (long)u_tab[i].t_group);
+        write_text_list(fp, u_tab[i].pri_n_hushed);
+        write_text_list(fp, u_tab[i].pub_n_hushed);
+        write_text_list(fp, u_tab[i].pri_s_hushed);
+        write_text_list(fp, u_tab[i].pub_s_hushed);
+        write_text_list(fp, u_tab[i].n_notifies);
+        write_text_list(fp, u_tab[i].s_notifies);
+    }
+    for (i = 0; i < MAX_GROUPS; i++) {
+        fprintf(fp, "%sX\n%sX\n%d\n%d\n%d\n%ld\n%sX\n%d\n",
+                g_tab[i].name, g_tab[i].topic, g_tab[i].visibility,
+                g_tab[i].control, g_tab[i].mod, g_tab[i].modtimeout,
+                g_tab[i].missingmod, g_tab[i].volume);
+        write_text_list(fp, g_tab[i].n_invites);
+        write_text_list(fp, g_tab[i].nr_invites);
+        write_text_list(fp, g_tab[i].s_invites);
+        write_text_list(fp, g_tab[i].sr_invites);
+        write_text_list(fp, g_tab[i].n_bars);
+        write_text_list(fp, g_tab[i].n_nr_bars);
+        write_text_list(fp, g_tab[i].s_bars);
+        write_text_list(fp, g_tab[i].s_nr_bars);
+        write_text_list(fp, g_tab[i].n_talk);
+        write_text_list(fp, g_tab[i].nr_talk);
+        fprintf(fp, "%d\n%d\n%sX\n%d\n", g_tab[i].size, g_tab[i].idleboot,
+                g_tab[i].idleboot_msg, g_tab[i].idlemod);
+    }
+}
+
+static void test_text(void) {
+    FILE *fp;
+    char *image;
+    size_t len;
+
+    fill_tables();
+    assert((fp = tmpfile()) != NULL);
+    write_text_dump(fp);
+    rewind(fp);
+
+    init_groups();
+    clear_users();
+    assert(snapshot_load_text(fp) == 0);
+    check_tables();
+
+    /* and it converts */
+    assert(snapshot_encode(&image, &len) == 0);
+    assert(snapshot_load(image, len) == 0);
+    check_tables();
+    free(image);
+
+    /* a short one is refused */
+    rewind(fp);
+    assert(ftruncate(fileno(fp), 2000) == 0);
+    assert(snapshot_load_text(fp) == SNAPSHOT_ERR);
+    fclose(fp);
+}
+
+int main(void) {
+    test_round_trip();
+    test_damaged();
+    test_version1();
+    test_files();
+    test_text();
+    return 0;
+}
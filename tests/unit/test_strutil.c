@@ -2,7 +2,8 @@
  * Unit tests for server/strutil.c
  *
  * Tests: filternickname, filtertext, filtergroupname, filterfmt,
- *        lcaseit, ucaseit, getword, get_tail, split
+ *        lcaseit, ucaseit, tok_word, tokenize; filtertext against
+ *        the byte-at-a-time version it replaced
  */
 
 #include <assert.h>
@@ -13,9 +14,7 @@
 #include "config.h"
 #include "server/mdb.h"
 #include "server/strutil.h"
-
-/* strutil.c uses the fields[] global from externs, we must provide it. */
-extern char *fields[];
+#include "server/utf8.h"
 
 /*
  * utf8.c and strutil.c log through server/mdb.c. Provide stubs.
@@ -128,6 +127,92 @@ static void test_filtertext_utf8_invalid_byte(void) {
     assert(dest[1] == '?');
     assert(dest[2] == 'b');
 }
+
+/* filtertext() as it was before it learned to copy ascii in bulk */
+static size_t ref_filtertext(const char *src, char *dest, size_t len) {
+    uint32_t codepoint;
+    uint32_t prevState = UTF8_ACCEPT;
+    uint32_t curState = UTF8_ACCEPT;
+    size_t offset = 0;
+    const char *s = src;
+
+    memset(dest, 0, len);
+
+    for (; *s; prevState = curState, ++s) {
+        if ((size_t)(s - src) >= len)
+            break;
+        switch (decode(&curState, &codepoint, *s)) {
+            case UTF8_ACCEPT:
+                if (codepoint >= 0x20 && codepoint <= 0x7F) {
+                    dest[offset++] = *s;
+                } else if (codepoint >= 0x80 && codepoint <= 0x7FF) {
+                    dest[offset++] = *(s-1);
+                    dest[offset++] = *s;
+                } else if (codepoint >= 0x800 && codepoint <= 0xFFFF) {
+                    dest[offset++] = *(s-2);
+                    dest[offset++] = *(s-1);
+                    dest[offset++] = *s;
+                } else if (codepoint >= 0x10000 && codepoint <= 0x10FFFF) {
+                    dest[offset++] = *(s-3);
+                    dest[offset++] = *(s-2);
+                    dest[offset++] = *(s-1);
+                    dest[offset++] = *s;
+                }
+                break;
+            case UTF8_REJECT:
+                dest[offset++] = '?';
+                curState = UTF8_ACCEPT;
+                if (prevState != UTF8_ACCEPT)
+                    s--;
+                break;
+            default:
+                ;
+        }
+    }
+    return offset;
+}
+
+/* random runs of ascii with control characters, valid and broken
+ * multibyte sequences and stray bytes scattered through them, cut off
+ * at every sort of length */
+static void test_filtertext_matches_reference(void) {
+    static const char *pieces[] = {
+        "a", "Hello, world! ", "0123456789abcdef0123456789abcdef", "~\x7f",
+        "\x01", "\t", "\x1f", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80",
+        "\xc3", "\xe2\x82", "\xf0\x9f\x98", "\x80", "\xbf", "\xff", "\xc0\xaf",
+        "\xed\xa0\x80", "\xf4\x90\x80\x80"
+    };
+    char src[600], got[600], want[600];
+    size_t srclen, len, ngot, nwant;
+    const char *piece;
+    int iter;
+
+    srand(22);
+    for (iter = 0; iter < 20000; iter++) {
+        srclen = 0;
+        while (srclen < 500 && rand() % 40) {
+            piece = pieces[rand() % (sizeof(pieces) / sizeof(pieces[0]))];
+            if (srclen + strlen(piece) >= sizeof(src))
+                break;
+            memcpy(src + srclen, piece, strlen(piece));
+            srclen += strlen(piece);
+        }
+        src[srclen] = '\0';
+        len = 1 + rand() % 520;
+
+        memset(got, 'X', sizeof(got));
+        ngot = filtertext(src, got, len);
+        nwant = ref_filtertext(src, want, len);
+        assert(ngot == nwant);
+        assert(ngot <= len);
+        assert(memcmp(got, want, ngot) == 0);
+        if (ngot < len)
+            assert(got[ngot] == '\0');
+        /* nothing written past the text and its NUL */
+        if (ngot + 1 < len)
+            assert(got[ngot + 1] == 'X');
+    }
+}
 #endif
 
 /* ------------------------------------------------------------------ */
@@ -214,64 +299,102 @@ static void test_lcaseit_empty(void) {
 }
 
 /* ------------------------------------------------------------------ */
-/* getword                                                             */
+/* tok_word                                                            */
 /* ------------------------------------------------------------------ */
-static void test_getword_single(void) {
-    char *w = getword("hello");
-    assert(strcmp(w, "hello") == 0);
-}
-
-static void test_getword_first_of_many(void) {
-    char *w = getword("first second third");
-    assert(strcmp(w, "first") == 0);
-}
-
-static void test_getword_empty(void) {
-    char *w = getword("");
-    assert(strcmp(w, "") == 0);
+static void test_tok_word_single(void) {
+    char buf[] = "hello";
+    TOKEN t = tok_str(buf);
+    TOKEN w = tok_word(&t);
+    assert(strcmp(w.s, "hello") == 0);
+    assert(w.len == 5);
+    assert(t.len == 0);
+    assert(strcmp(t.s, "") == 0);
 }
 
-/* ------------------------------------------------------------------ */
-/* get_tail                                                            */
-/* ------------------------------------------------------------------ */
-static void test_get_tail_normal(void) {
+static void test_tok_word_first_of_many(void) {
     char buf[] = "first second third";
-    char *t = get_tail(buf);
-    assert(strcmp(t, "second third") == 0);
+    TOKEN t = tok_str(buf);
+    TOKEN w = tok_word(&t);
+    assert(strcmp(w.s, "first") == 0);
+    assert(w.len == 5);
+    /* what's left is the tail, and the word was cut off in place */
+    assert(strcmp(t.s, "second third") == 0);
+    assert(t.len == strlen("second third"));
+    assert(w.s == buf);
 }
 
-static void test_get_tail_single(void) {
-    char buf[] = "only";
-    char *t = get_tail(buf);
-    assert(strcmp(t, "") == 0);
+static void test_tok_word_empty(void) {
+    char buf[] = "";
+    TOKEN t = tok_str(buf);
+    TOKEN w = tok_word(&t);
+    assert(strcmp(w.s, "") == 0);
+    assert(w.len == 0);
+    w = tok_word(&t);
+    assert(w.len == 0);
+}
+
+static void test_tok_word_blanks(void) {
+    char buf[] = "a \t  b\tc ";
+    TOKEN t = tok_str(buf);
+    assert(strcmp(tok_word(&t).s, "a") == 0);
+    assert(strcmp(t.s, "b\tc ") == 0);
+    assert(strcmp(tok_word(&t).s, "b") == 0);
+    assert(strcmp(tok_word(&t).s, "c") == 0);
+    assert(t.len == 0);
+    assert(tok_word(&t).len == 0);
+
+    /* a leading blank makes for an empty first word */
+    strcpy(buf, " x");
+    t = tok_str(buf);
+    assert(tok_word(&t).len == 0);
+    assert(strcmp(t.s, "x") == 0);
 }
 
 /* ------------------------------------------------------------------ */
-/* split                                                               */
+/* tokenize                                                            */
 /* ------------------------------------------------------------------ */
-static void test_split_one_field(void) {
+static void test_tokenize_one_field(void) {
     char buf[] = "hello";
-    int n = split(buf);
+    TOKEN f[MAX_FIELDS];
+    int n = tokenize(buf, f, MAX_FIELDS);
     assert(n == 1);
-    assert(strcmp(fields[0], "hello") == 0);
+    assert(strcmp(f[0].s, "hello") == 0);
+    assert(f[0].len == 5);
 }
 
-static void test_split_three_fields(void) {
-    char buf[] = "a\001b\001c";
-    int n = split(buf);
+static void test_tokenize_three_fields(void) {
+    char buf[] = "a\001bb\001c";
+    TOKEN f[MAX_FIELDS];
+    int n = tokenize(buf, f, MAX_FIELDS);
     assert(n == 3);
-    assert(strcmp(fields[0], "a") == 0);
-    assert(strcmp(fields[1], "b") == 0);
-    assert(strcmp(fields[2], "c") == 0);
+    assert(strcmp(f[0].s, "a") == 0);
+    assert(strcmp(f[1].s, "bb") == 0);
+    assert(f[1].len == 2);
+    assert(strcmp(f[2].s, "c") == 0);
+    /* pointing into the packet, not copied out of it */
+    assert(f[1].s == buf + 2);
 }
 
-static void test_split_empty_fields(void) {
+static void test_tokenize_empty_fields(void) {
     char buf[] = "\001\001";
-    int n = split(buf);
+    TOKEN f[MAX_FIELDS];
+    int n = tokenize(buf, f, MAX_FIELDS);
     assert(n == 3);
-    assert(strcmp(fields[0], "") == 0);
-    assert(strcmp(fields[1], "") == 0);
-    assert(strcmp(fields[2], "") == 0);
+    assert(strcmp(f[0].s, "") == 0);
+    assert(strcmp(f[1].s, "") == 0);
+    assert(strcmp(f[2].s, "") == 0);
+    assert(f[2].len == 0);
+}
+
+static void test_tokenize_too_many(void) {
+    char buf[] = "a\001b\001c\001d";
+    TOKEN f[2];
+    int n = tokenize(buf, f, 2);
+    assert(n == 2);
+    assert(strcmp(f[0].s, "a") == 0);
+    /* the last one gets the rest */
+    assert(strcmp(f[1].s, "b\001c\001d") == 0);
+    assert(f[1].len == 5);
 }
 
 /* ------------------------------------------------------------------ */
@@ -290,6 +413,7 @@ int main(void) {
 #if ALLOW_UTF8_MESSAGES
     test_filtertext_utf8_2byte();
     test_filtertext_utf8_invalid_byte();
+    test_filtertext_matches_reference();
 #endif
 
     test_filtergroupname_passthrough();
@@ -306,16 +430,15 @@ int main(void) {
     test_ucaseit();
     test_lcaseit_empty();
 
-    test_getword_single();
-    test_getword_first_of_many();
-    test_getword_empty();
-
-    test_get_tail_normal();
-    test_get_tail_single();
+    test_tok_word_single();
+    test_tok_word_first_of_many();
+    test_tok_word_empty();
+    test_tok_word_blanks();
 
-    test_split_one_field();
-    test_split_three_fields();
-    test_split_empty_fields();
+    test_tokenize_one_field();
+    test_tokenize_three_fields();
+    test_tokenize_empty_fields();
+    test_tokenize_too_many();
 
     return 0;
 }